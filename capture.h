@@ -0,0 +1,145 @@
+/****************************************************************************
+ *                                                                          *
+ *  Example of a simple 3D application using Vulkan API                     *
+ *  Copyright (C) 2020 Artem Hlumov <artyom.altair@gmail.com>               *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************
+ *                                                                          *
+ *      Format of the command stream capture file written by the main       *
+ *         application in capture mode and read by the replay tool.         *
+ *                                                                          *
+ *     The file starts with CaptureFileHeader followed by a sequence of     *
+ *    records. Each record is CaptureRecordHeader followed by "size" bytes  *
+ *    of payload. Resource records go first, then each frame is written     *
+ *       as a uniform buffer update followed by a draw submission.          *
+ *                                                                          *
+ ****************************************************************************/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <cstdint>
+
+/**
+ * Default name of the capture file.
+ */
+constexpr const char* CAPTURE_FILE_NAME = "capture.bin";
+/**
+ * Signature of the capture file ("VKCS").
+ */
+constexpr uint32_t CAPTURE_MAGIC = 0x53434B56;
+/**
+ * Version of the capture file format.
+ * Should be incremented each time any structure below changes.
+ */
+constexpr uint32_t CAPTURE_VERSION = 1;
+
+/**
+ * Types of records.
+ */
+enum CaptureRecordType : uint32_t
+{
+    // Render targets: CaptureTargets.
+    CAPTURE_RECORD_TARGETS = 1,
+    // SPIR-V code of a shader: CaptureShader followed by the code.
+    CAPTURE_RECORD_SHADER = 2,
+    // Vertex buffer: CaptureVertexLayout, attributes and vertex data.
+    CAPTURE_RECORD_VERTEX_BUFFER = 3,
+    // New content of the uniform buffer used by the next draw.
+    CAPTURE_RECORD_UNIFORM_UPDATE = 4,
+    // Draw submission of one frame: CaptureDraw.
+    CAPTURE_RECORD_DRAW = 5
+};
+
+/**
+ * Header of the file.
+ */
+struct CaptureFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+/**
+ * Header of each record.
+ */
+struct CaptureRecordHeader
+{
+    // One of CaptureRecordType values.
+    uint32_t type;
+    // Size of the payload following the header.
+    uint32_t size;
+};
+
+/**
+ * Description of render targets and fixed function states.
+ */
+struct CaptureTargets
+{
+    uint32_t width;
+    uint32_t height;
+    // VkFormat of color attachments.
+    uint32_t colorFormat;
+    // VkFormat of the depth attachment.
+    uint32_t depthFormat;
+    // VkSampleCountFlagBits of multi-sampled attachments.
+    uint32_t samples;
+    // VkCompareOp of the depth test.
+    uint32_t depthCompareOp;
+    // Value the depth buffer is cleared with.
+    float clearDepth;
+};
+
+/**
+ * Shader record payload header.
+ */
+struct CaptureShader
+{
+    // VkShaderStageFlagBits of the shader.
+    uint32_t stage;
+};
+
+/**
+ * Vertex buffer record payload header.
+ * It is followed by attributeCount CaptureVertexAttribute structures
+ * and vertex data up to the end of the record.
+ */
+struct CaptureVertexLayout
+{
+    uint32_t stride;
+    uint32_t attributeCount;
+};
+
+/**
+ * Vertex attribute description.
+ */
+struct CaptureVertexAttribute
+{
+    uint32_t location;
+    // VkFormat of the attribute.
+    uint32_t format;
+    uint32_t offset;
+};
+
+/**
+ * Draw record payload.
+ */
+struct CaptureDraw
+{
+    uint32_t vertexCount;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+
+// Number of samples in the G-buffer.
+layout(constant_id = 0) const int sampleCount = 1;
+
+#ifdef TAA
+// TAA renders with a single sample.
+layout(input_attachment_index = 0, binding = 0) uniform subpassInput albedoInput;
+layout(input_attachment_index = 1, binding = 1) uniform subpassInput normalInput;
+#else
+layout(input_attachment_index = 0, binding = 0) uniform subpassInputMS albedoInput;
+layout(input_attachment_index = 1, binding = 1) uniform subpassInputMS normalInput;
+#endif
+
+layout(location = 0) out vec4 outColor;
+
+// Directional light in world space.
+const vec3 lightDirection = normalize(vec3(0.5, 1.0, 0.75));
+const float ambient = 0.3;
+
+vec3 shade(vec4 albedo, vec4 encodedNormal) {
+    vec3 normal = normalize(encodedNormal.xyz * 2.0 - 1.0);
+    // Both sides of a face are lit. The background has zero albedo and stays black.
+    float diffuse = abs(dot(normal, lightDirection));
+    return albedo.rgb * (ambient + (1.0 - ambient) * diffuse);
+}
+
+void main() {
+#ifdef TAA
+    vec3 color = shade(subpassLoad(albedoInput), subpassLoad(normalInput));
+#else
+    // Each sample is lit separately and the result is averaged,
+    // so edges look the same as with forward shading.
+    vec3 color = vec3(0.0);
+    for (int i = 0; i < sampleCount; i++) {
+        color += shade(subpassLoad(albedoInput, i), subpassLoad(normalInput, i));
+    }
+    color /= float(sampleCount);
+#endif
+    outColor = vec4(color, 1.0);
+}
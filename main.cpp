@@ -47,16 +47,50 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <set>
 #include <array>
+#include <cmath>
+#include <mutex>
+#include <atomic>
 #include <chrono>
+#include <future>
 #include <string>
+#include <thread>
 #include <vector>
+#include <cstddef>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <sstream>
 #include <iostream>
 #include <optional>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>
+
+#ifdef CAPTURE_MODE
+// Format of the command stream capture file.
+#include "capture.h"
+#endif
+
+#ifdef TARGET_FPS
+// High-resolution timers of the system for the frame rate limiter.
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <mmsystem.h>
+// Available since Windows 10 1803, older SDKs do not define it.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <time.h>
+#include <cerrno>
+#endif
+#endif
 
 /**
  * Window width.
@@ -74,1871 +108,6875 @@ constexpr const char* APPLICATION_NAME = "VKExample";
  * Maximal amount of frames processed at the same time.
  */
 constexpr int MAX_FRAMES_IN_FLIGHT = 5;
-
 /**
- * Callback function that will be called each time a validation level produces a message.
- * @param messageSeverity Bitmask specifying which severities of events cause a debug messenger callback.
- * @param messageType Bitmask specifying which types of events cause a debug messenger callback.
- * @param pCallbackData Structure specifying parameters returned to the callback.
- * @param pUserData Arbitrary user data provided when the callback is created.
- * @return True in case the Vulkan call should be aborted, false - otherwise.
+ * Maximal amount of input events waiting for the next frame.
  */
-VKAPI_ATTR VkBool32 VKAPI_CALL messageCallback
-    (
-        VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-        VkDebugUtilsMessageTypeFlagsEXT messageType,
-        const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
-        void* pUserData
-    )
-{
-    // Mark variables as not used to suppress warnings.
-    (void) messageSeverity;
-    (void) messageType;
-    (void) pUserData;
-    // Print the message.
-    std::cerr << "[MSG]:" << pCallbackData->pMessage << std::endl;
-    // Do only logging, do not abort the call.
-    return VK_FALSE;
-}
+constexpr size_t INPUT_QUEUE_SIZE = 64;
+
+#ifdef SIMULATION_THREAD
 
 /**
- * Main function.
- * @return Return code of the application.
+ * Amount of simulation steps per second.
  */
-int main()
-{
-    // ==========================================================================
-    //                 STEP 1: Create a Window using GLFW
-    // ==========================================================================
-    // GLFW abstracts native calls to create the window and allows us to write
-    // a cross-platform application.
-    // ==========================================================================
+constexpr int SIMULATION_TICK_RATE = 120;
 
-    // Initialize GLFW context.
-    glfwInit();
-    // Do not create an OpenGL context - we use Vulkan.
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    // Make the window not resizable.
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-    // Create a window instance.
-    GLFWwindow* glfwWindow = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, APPLICATION_NAME, nullptr, nullptr);
+#endif
 
-    // ==========================================================================
-    //                   STEP 2: Select Vulkan extensions
-    // ==========================================================================
-    // Vulkan has a list of extensions providing some functionality.
-    // We should explicitly select extensions we need.
-    // At least GLFW requires some graphical capabilities
-    // in order to draw an image.
-    // ==========================================================================
+#ifdef TARGET_FPS
 
-    // Take a minimal set of Vulkan extensions required by GLWF.
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+/**
+ * Time between frames with the frame rate limited to TARGET_FPS.
+ */
+constexpr std::chrono::nanoseconds TARGET_FRAME_TIME(1000000000 / TARGET_FPS);
+/**
+ * Time before the deadline the frame rate limiter spins through instead of sleeping.
+ */
+constexpr std::chrono::microseconds FRAME_LIMITER_SPIN_TIME(500);
 
-    // Fetch list of available Vulkan extensions.
-    uint32_t vkNumAvailableExtensions = 0;
-    vkEnumerateInstanceExtensionProperties(nullptr, &vkNumAvailableExtensions, nullptr);
-    std::vector< VkExtensionProperties > vkAvailableExtensions(vkNumAvailableExtensions);
-    vkEnumerateInstanceExtensionProperties(nullptr, &vkNumAvailableExtensions, vkAvailableExtensions.data());
+#endif
 
-    // Construct a list of extensions we should request.
-    std::vector< const char* > extensionsList(glfwExtensions, glfwExtensions + glfwExtensionCount);
+#ifdef SWAPCHAIN_IMAGES_AUTO
 
-#ifdef DEBUG_MODE
+/**
+ * Frames rendered with each swap chain image count before acquisition is measured.
+ * They let the presentation engine fill its queue after the swap chain is created.
+ */
+constexpr uint32_t SWAPCHAIN_WARMUP_SKIP_FRAMES = 30;
+/**
+ * Frames measured with each swap chain image count.
+ */
+constexpr uint32_t SWAPCHAIN_WARMUP_FRAMES = 120;
+/**
+ * Average time spent waiting in vkAcquireNextImageKHR which counts as no waiting.
+ */
+constexpr std::chrono::microseconds SWAPCHAIN_ACQUIRE_WAIT_THRESHOLD(200);
+/**
+ * Largest amount of swap chain images tried above the minimal one.
+ */
+constexpr uint32_t SWAPCHAIN_MAX_EXTRA_IMAGES = 2;
 
-    // Add an extension to print debug messages.
-    extensionsList.push_back("VK_EXT_debug_utils");
+#endif
 
-    // ==========================================================================
-    //              STEP 3: Select validation layers for debug
-    // ==========================================================================
-    // Validation layers is a mechanism to hook Vulkan API calls, validate
-    // them and notify the user if something goes wrong.
-    // Here we need to make sure that requested validation layers are available.
-    // ==========================================================================
+#ifdef ON_DEMAND_RENDERING
 
-    // Specify desired validation layers.
-    const std::vector< const char* > desiredValidationLayers = {
-        "VK_LAYER_KHRONOS_validation"
-    };
+/**
+ * Longest time the loop waits for a reason to render a frame.
+ * Changes that do not come from the window are noticed after this time.
+ */
+constexpr std::chrono::milliseconds ON_DEMAND_IDLE_TIMEOUT(250);
 
-    // Fetch available validation layers.
-    uint32_t vkLayerCount;
-    vkEnumerateInstanceLayerProperties(&vkLayerCount, nullptr);
-    std::vector< VkLayerProperties > vkAvailableLayers(vkLayerCount);
-    vkEnumerateInstanceLayerProperties(&vkLayerCount, vkAvailableLayers.data());
+#endif
 
-    // Check if desired validation layers are in the list.
-    bool validationLayersAvailable = true;
-    for (auto requestedLayer : desiredValidationLayers) {
-        bool isLayerAvailable = false;
-        for (auto availableLayer : vkAvailableLayers) {
-            if (std::strcmp(requestedLayer, availableLayer.layerName) == 0) {
-                isLayerAvailable = true;
-                break;
-            }
-        }
-        if (!isLayerAvailable) {
-            validationLayersAvailable = false;
-            break;
-        }
-    }
-    if (!validationLayersAvailable) {
-        std::cerr << "Desired validation levels are not available!";
-        abort();
-    }
+#ifdef LATE_LATCH
 
-    // ==========================================================================
-    //                STEP 4: Create a debug message callback
-    // ==========================================================================
-    // Debug message callback allows us to display errors and warnings if
-    // we do some mistake using Vulkan API.
-    // ==========================================================================
+/**
+ * Rotation of the camera around the cube per pixel of cursor movement in radians.
+ */
+constexpr float CAMERA_ROTATION_SPEED = 0.005f;
 
-    // Set up message logging.
-    // See %VK_SDK_PATH%/Config/vk_layer_settings.txt for detailed information.
-    VkDebugUtilsMessengerCreateInfoEXT vkMessangerCreateInfo {};
-    vkMessangerCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-    // Which severities of events cause a debug messenger callback.
-    vkMessangerCreateInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                                            VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                                            VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-    // Which types of events cause a debug messenger callback.
-    vkMessangerCreateInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                                        VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                                        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-    // Pointer to a callback function.
-    vkMessangerCreateInfo.pfnUserCallback = messageCallback;
-    // Here we can pass some arbitrary date to the callback function.
-    vkMessangerCreateInfo.pUserData = nullptr;
+#ifdef LATE_LATCH_PREDICTION
+/**
+ * Interval between presentations assumed until it is measured.
+ */
+constexpr std::chrono::microseconds LATE_LATCH_DEFAULT_PRESENT_INTERVAL(16667);
+/**
+ * Intervals between presentations longer than this are pauses of rendering
+ * and are not taken into account.
+ */
+constexpr std::chrono::milliseconds LATE_LATCH_MAX_PRESENT_INTERVAL(100);
+/**
+ * A cursor without new positions for this time is considered stopped
+ * and is not extrapolated.
+ */
+constexpr std::chrono::milliseconds LATE_LATCH_STOPPED_CURSOR_TIME(20);
+#endif
 
 #endif
 
-    // ==========================================================================
-    //                    STEP 5: Create a Vulkan instance
-    // ==========================================================================
-    // Vulkan instance is a starting point of using Vulkan API.
-    // Here we specify API version and which extensions to use.
-    // ==========================================================================
+#ifdef DEVICE_CACHE
 
-    // Specify application info and required Vulkan version.
-    VkApplicationInfo vkAppInfo {};
-    // Information about your application.
-    vkAppInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    vkAppInfo.pApplicationName = APPLICATION_NAME;
-    vkAppInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-    // Information about your 3D engine (if applicable).
-    vkAppInfo.pEngineName = APPLICATION_NAME;
-    vkAppInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    // Use v1.0 that is likely supported by the most of drivers.
-    vkAppInfo.apiVersion = VK_API_VERSION_1_0;
+/**
+ * Name of the file that keeps capabilities of physical devices between launches.
+ */
+constexpr const char* DEVICE_CACHE_FILE_NAME = "device.cache";
+/**
+ * Signature of the device capability cache file ("VKDC").
+ */
+constexpr uint32_t DEVICE_CACHE_MAGIC = 0x43444B56;
+/**
+ * Version of the device capability cache file format.
+ * Should be incremented each time the record structure changes.
+ */
+constexpr uint32_t DEVICE_CACHE_VERSION = 4;
+/**
+ * Largest amount of records in the device capability cache file.
+ * Builds with different options keep separate records of the same device.
+ */
+constexpr uint32_t DEVICE_CACHE_MAX_RECORDS = 32;
 
-    // Fill in an instance create structure.
-    VkInstanceCreateInfo vkCreateInfo {};
-    vkCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    vkCreateInfo.pApplicationInfo = &vkAppInfo;
-    // Specify which extensions we need.
-    vkCreateInfo.enabledExtensionCount = extensionsList.size();
-    vkCreateInfo.ppEnabledExtensionNames = extensionsList.data();
+#endif
 
-#ifdef DEBUG_MODE
+#ifdef CAPTURE_MODE
 
-    // Switch on all requested layers for debug mode.
-    vkCreateInfo.enabledLayerCount = static_cast< uint32_t >(desiredValidationLayers.size());
-    vkCreateInfo.ppEnabledLayerNames = desiredValidationLayers.data();
-    // Debug message callbacks are attached after instance creation and should be destroyed
-    // before instance destruction. Therefore they do not catch errors in these two calls.
-    // To avoid this we can pass our debug messager duing instance creation.
-    // This will apply it for vkCreateInstance() and vkDestroyInstance() calls only,
-    // so in any case debug messages should be switched on after the instance is created.
-    vkCreateInfo.pNext = reinterpret_cast< VkDebugUtilsMessengerCreateInfoEXT* >(&vkMessangerCreateInfo);
+/**
+ * Maximal amount of frames written to the capture file.
+ */
+constexpr uint32_t CAPTURE_MAX_FRAMES = 3600;
 
-#else
+#endif
 
-    // Do not use layers in release mode.
-    vkCreateInfo.enabledLayerCount = 0;
+#ifdef POST_PROCESSING
 
+#ifndef RENDER_SCALE
+/**
+ * Size of rendered images relative to the window, set by the RENDER_SCALE option.
+ * Post-processing upscales the image to the window size.
+ */
+#define RENDER_SCALE 1.0
 #endif
+static_assert(RENDER_SCALE > 0.0, "RENDER_SCALE must be positive");
+/**
+ * Width and height of a workgroup of post-processing shaders.
+ * Should match local_size_x and local_size_y in their code.
+ */
+constexpr uint32_t POST_PROCESSING_WORKGROUP_SIZE = 8;
 
-    // Create a Vulkan instance and check its validity.
-    VkInstance vkInstance;
-    if (vkCreateInstance(&vkCreateInfo, nullptr, &vkInstance) != VK_SUCCESS) {
-        std::cerr << "Failed to creae a Vulkan instance!";
-        abort();
-    }
-
-    // ==========================================================================
-    //                    STEP 6: Create a window surface
-    // ==========================================================================
-    // Surface is an abstraction that works with the window system of your OS.
-    // Athough it is possible to use platform-dependent calls to create
-    // a surface, GLFW provides us a way to do this platform-agnostic.
-    // ==========================================================================
+#endif
 
-    VkSurfaceKHR vkSurface;
-    if (glfwCreateWindowSurface(vkInstance, glfwWindow, nullptr, &vkSurface) != VK_SUCCESS) {
-        std::cerr << "Failed to create a surface!" << std::endl;
-        abort();
-    }
+#ifdef TAA
 
-#ifdef DEBUG_MODE
+/**
+ * Amount of sub-pixel positions the projection cycles through.
+ */
+constexpr uint32_t TAA_JITTER_SAMPLE_COUNT = 8;
+/**
+ * Width and height of a workgroup of the TAA resolve shader.
+ * Should match local_size_x and local_size_y in taa.comp.
+ */
+constexpr uint32_t TAA_WORKGROUP_SIZE = 8;
 
-    // ==========================================================================
-    //                    STEP 7: Attach a message handler
-    // ==========================================================================
-    // Attach a message handler to the Vulkan context in order to see
-    // debug messages and warnings.
-    // ==========================================================================
+#endif
 
-    // Since vkCreateDebugUtilsMessengerEXT is a function of an extension,
-    // it is not explicitly declared in Vulkan header, because if we do not load
-    // validation layers, it does not exist.
-    // First of all we have to obtain a pointer to the function.
-    auto vkCreateDebugUtilsMessengerEXT = reinterpret_cast< PFN_vkCreateDebugUtilsMessengerEXT >(vkGetInstanceProcAddr(vkInstance, "vkCreateDebugUtilsMessengerEXT"));
-    if (vkCreateDebugUtilsMessengerEXT == nullptr) {
-        std::cerr << "Function vkCreateDebugUtilsMessengerEXT not found!";
-        abort();
-    }
+#ifdef ASYNC_LOG
 
-    // Create a messenger.
-    VkDebugUtilsMessengerEXT vkDebugMessenger;
-    vkCreateDebugUtilsMessengerEXT(vkInstance, &vkMessangerCreateInfo, nullptr, &vkDebugMessenger);
+/**
+ * Amount of messages the log queue keeps. Should be a power of two.
+ */
+constexpr size_t LOG_QUEUE_SIZE = 256;
+/**
+ * Maximal length of a log message including the terminating zero.
+ */
+constexpr size_t LOG_MESSAGE_SIZE = 1024;
+/**
+ * Amount of messages with the same ID written per LOG_REPEAT_PERIOD.
+ */
+constexpr uint32_t LOG_REPEAT_LIMIT = 5;
+/**
+ * Period repeats of a message are counted over.
+ */
+constexpr std::chrono::seconds LOG_REPEAT_PERIOD(1);
+/**
+ * Delay of the log writer thread when the queue is empty.
+ */
+constexpr std::chrono::milliseconds LOG_WRITER_INTERVAL(2);
 
 #endif
 
-    // ==========================================================================
-    //                      STEP 8: Pick a physical device
-    // ==========================================================================
-    // Physical devices correspond to graphical cards available in the system.
-    // Before we continue, we should make sure the graphical card is suitable
-    // for our needs and in case there is more than one card
-    // in the system - select one of them.
-    // We are going to perform some tests and fetch device information that
-    // we will need after. So, to not request this information twice,
-    // we will fill some structures declared below for the selected
-    // physical device and use them in the rest of code.
-    // ==========================================================================
-
-    // --------------------------------------------------------------------------
-    //                    Information about selected device
-    // --------------------------------------------------------------------------
-    // Here we will store a selected physical device.
-    VkPhysicalDevice vkPhysicalDevice = VK_NULL_HANDLE;
-    // Here we store information about queues supported by the selected physical device.
-    // For our simple application device should support two queues:
-    struct QueueFamilyIndices
-    {
-        // Graphics queue processes rendering requests and stores result into Vulkan images.
-        std::optional< uint32_t > graphicsFamily;
-        // Present queue tranfers images to the surface.
-        std::optional< uint32_t > presentFamily;
-    };
-    QueueFamilyIndices queueFamilyIndices;
-    // Here we take information about a swap chain.
-    struct SwapChainSupportDetails {
-        VkSurfaceCapabilitiesKHR capabilities;
-        std::vector< VkSurfaceFormatKHR > formats;
-        std::vector< VkPresentModeKHR > presentModes;
-    };
-    SwapChainSupportDetails swapChainSupportDetails;
-    // Here we keep a selected format for z-buffer.
-    VkFormat vkDepthFormat = VK_FORMAT_UNDEFINED;
-    // --------------------------------------------------------------------------
-
-    // Desired extensions that should be supported by the graphical card.
-    const std::vector< const char* > desiredDeviceExtensions = {
-        // Swap chain extension is needed for drawing.
-        // Any graphical card that aims to draw into a framebuffer
-        // should support this extension.
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
-    };
-
-    // Get a list of available physical devices.
-    uint32_t vkDeviceCount = 0;
-    vkEnumeratePhysicalDevices(vkInstance, &vkDeviceCount, nullptr);
-    if (vkDeviceCount == 0) {
-        std::cerr << "No physical devices!" << std::endl;
-        abort();
-    }
-    std::vector< VkPhysicalDevice > vkDevices(vkDeviceCount);
-    vkEnumeratePhysicalDevices(vkInstance, &vkDeviceCount, vkDevices.data());
-
-    // Go through the list of physical device and select the first suitable one.
-    // In advanced applications you may introduce a rating to choose
-    // the best video card or let the user select one manually.
-    for (auto device : vkDevices) {
-        // Get properties of the physical device.
-        VkPhysicalDeviceProperties vkDeviceProperties;
-        vkGetPhysicalDeviceProperties(device, &vkDeviceProperties);
-
-        // Get features of the physical device.
-        VkPhysicalDeviceFeatures vkDeviceFeatures;
-        vkGetPhysicalDeviceFeatures(device, &vkDeviceFeatures);
+#ifdef HOST_ALLOCATOR
 
-        // Get extensions available for the physical device.
-        uint32_t vkExtensionCount;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &vkExtensionCount, nullptr);
-        std::vector< VkExtensionProperties > vkAvailableExtensions(vkExtensionCount);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &vkExtensionCount, vkAvailableExtensions.data());
+/**
+ * Amount of allocation scopes defined by VkSystemAllocationScope.
+ */
+constexpr size_t HOST_ALLOCATION_SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+/**
+ * Size of a header stored in front of each host allocation.
+ */
+constexpr size_t HOST_ALLOCATION_HEADER_SIZE = 32;
+/**
+ * Size of the smallest pooled block. Each next size class is twice bigger.
+ */
+constexpr size_t HOST_POOL_MIN_BLOCK_SIZE = 64;
+/**
+ * Amount of pooled size classes (64 to 4096 bytes).
+ */
+constexpr size_t HOST_POOL_CLASS_COUNT = 7;
+/**
+ * Size of an arena chunk pooled blocks are cut from.
+ */
+constexpr size_t HOST_POOL_ARENA_SIZE = 64 * 1024;
 
-        // ---------------------------------------------------
-        // TEST 1: Check if all desired extensions are present
-        // ---------------------------------------------------
+#endif
 
-        // Get list of extensions and compare it to desired one.
-        std::set< std::string > requiredExtensions(desiredDeviceExtensions.begin(), desiredDeviceExtensions.end());
-        for (const auto& extension : vkAvailableExtensions) {
-            requiredExtensions.erase(extension.extensionName);
-        }
-        bool allExtensionsAvailable = requiredExtensions.empty();
+/**
+ * Severity of log messages.
+ */
+enum LogSeverity : uint32_t
+{
+    LOG_SEVERITY_VERBOSE = 0,
+    LOG_SEVERITY_INFO = 1,
+    LOG_SEVERITY_WARNING = 2,
+    LOG_SEVERITY_ERROR = 3
+};
+/**
+ * Messages of a lower severity are dropped right away.
+ * Warnings and errors go to stderr, the rest goes to stdout.
+ */
+constexpr LogSeverity LOG_MIN_SEVERITY = LOG_SEVERITY_VERBOSE;
 
-        // ----------------------------------------------------------
-        // TEST 2: Check if all required queue families are supported
-        // ----------------------------------------------------------
+#ifdef ASYNC_LOG
 
-        // Get list of available queue families.
-        uint32_t vkQueueFamilyCount = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &vkQueueFamilyCount, nullptr);
-        std::vector< VkQueueFamilyProperties > vkQueueFamilies(vkQueueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &vkQueueFamilyCount, vkQueueFamilies.data());
+/**
+ * Slot of the log queue.
+ */
+struct LogSlot
+{
+    // Position in the queue the slot is ready for: equal to the position
+    // while the slot is free and the position + 1 once the message is written.
+    std::atomic< size_t > sequence;
+    // Severity of the message.
+    LogSeverity severity;
+    // Identifier of repeated messages or 0.
+    int32_t messageId;
+    // Text of the message. Longer messages are truncated.
+    char text[LOG_MESSAGE_SIZE];
+};
 
-        // Fill in QueueFamilyIndices structure to check that all required queue families are present.
-        QueueFamilyIndices currentDeviceQueueFamilyIndices;
-        for (uint32_t i = 0; i < vkQueueFamilyCount; i++) {
-            // Take a queue family.
-            const auto& queueFamily = vkQueueFamilies[i];
+/**
+ * Bounded queue of log messages.
+ * Any thread may push a message without locking,
+ * the only consumer is the log writer thread.
+ */
+struct LogQueue
+{
+    // Ring of messages.
+    std::array< LogSlot, LOG_QUEUE_SIZE > slots;
+    // Position of the next message to push. Producers compete for it.
+    alignas(64) std::atomic< size_t > pushPosition;
+    // Position of the next message to write. Used by the writer thread only.
+    alignas(64) size_t writePosition;
+    // Amount of messages lost because the queue was full.
+    std::atomic< uint64_t > droppedCount;
+    // Set to finish the writer thread once the queue is empty.
+    std::atomic< bool > stopRequested;
+} logQueue;
 
-            // Check if this is a graphics family.
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-                currentDeviceQueueFamilyIndices.graphicsFamily = i;
-            }
+/**
+ * Thread that writes log messages to the console.
+ */
+std::thread logWriterThread;
 
-            // Check if it supports presentation.
-            // Note that graphicsFamily and presentFamily may refer to the same queue family
-            // for some video cards and we should be ready to this.
-            VkBool32 vkPresentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, vkSurface, &vkPresentSupport);
-            if (vkPresentSupport) {
-                currentDeviceQueueFamilyIndices.presentFamily = i;
+/**
+ * Put a message into the log queue.
+ * The message is dropped if the writer thread does not keep up.
+ * @param severity Severity of the message.
+ * @param messageId Identifier of repeated messages or 0.
+ * @param text Text of the message.
+ * @return True if the message has been queued, false - if dropped.
+ */
+bool pushLogMessage(LogSeverity severity, int32_t messageId, const char* text)
+{
+    size_t position = logQueue.pushPosition.load(std::memory_order_relaxed);
+    for (;;) {
+        LogSlot& slot = logQueue.slots[position % LOG_QUEUE_SIZE];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast< intptr_t >(sequence) - static_cast< intptr_t >(position);
+        if (difference == 0) {
+            // The slot is free. Take it unless another thread is faster,
+            // a failed exchange reloads the position.
+            if (logQueue.pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.severity = severity;
+                slot.messageId = messageId;
+                size_t length = std::min(std::strlen(text), LOG_MESSAGE_SIZE - 1);
+                std::memcpy(slot.text, text, length);
+                slot.text[length] = '\0';
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return true;
             }
+        } else if (difference < 0) {
+            // The slot still keeps a message of the previous lap.
+            logQueue.droppedCount++;
+            return false;
+        } else {
+            // Another thread has taken the slot.
+            position = logQueue.pushPosition.load(std::memory_order_relaxed);
         }
-        bool queuesOk = currentDeviceQueueFamilyIndices.graphicsFamily.has_value() &&
-                        currentDeviceQueueFamilyIndices.presentFamily.has_value();
+    }
+}
 
-        // ---------------------------------------------------------
-        // TEST 3: Check if the swap chain supports required formats
-        // ---------------------------------------------------------
+/**
+ * Body of the log writer thread.
+ * Messages are collected in batches and each stream is written and flushed once per batch.
+ * A message ID is not written more than LOG_REPEAT_LIMIT times per LOG_REPEAT_PERIOD,
+ * the amount of suppressed repeats is reported when the period is over.
+ */
+void writeLogMessages()
+{
+    struct LogRepeat
+    {
+        std::chrono::steady_clock::time_point periodStart;
+        uint32_t count;
+        uint64_t suppressedCount;
+    };
+    std::unordered_map< int32_t, LogRepeat > repeats;
+    uint64_t reportedDroppedCount = 0;
+    std::string outputBatch;
+    std::string errorBatch;
+    auto reportSuppressed = [&](int32_t messageId, const LogRepeat& repeat) {
+        if (repeat.suppressedCount > 0) {
+            errorBatch += "[LOG]: " + std::to_string(repeat.suppressedCount) +
+                          " repeats of message " + std::to_string(messageId) + " suppressed\n";
+        }
+    };
 
-        // Fill swap chain information into a SwapChainSupportDetails structure.
-        SwapChainSupportDetails currenDeviceSwapChainDetails;
-        // We should do this only in case the device supports swap buffer.
-        // To avoid extra flags and more complex logic, just make sure that all
-        // desired extensions have been found.
-        if (allExtensionsAvailable) {
-            // Get surface capabilities.
-            vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, vkSurface, &currenDeviceSwapChainDetails.capabilities);
-            // Get supported formats.
-            uint32_t vkPhysicalDeviceFormatCount;
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, vkSurface, &vkPhysicalDeviceFormatCount, nullptr);
-            if (vkPhysicalDeviceFormatCount != 0) {
-                currenDeviceSwapChainDetails.formats.resize(vkPhysicalDeviceFormatCount);
-                vkGetPhysicalDeviceSurfaceFormatsKHR(device, vkSurface, &vkPhysicalDeviceFormatCount, currenDeviceSwapChainDetails.formats.data());
+    for (;;) {
+        // Check the flag before the queue is drained, so messages
+        // pushed before the stop request are never lost.
+        bool stop = logQueue.stopRequested.load(std::memory_order_acquire);
+        auto now = std::chrono::steady_clock::now();
+        for (;;) {
+            LogSlot& slot = logQueue.slots[logQueue.writePosition % LOG_QUEUE_SIZE];
+            if (slot.sequence.load(std::memory_order_acquire) != logQueue.writePosition + 1) {
+                break;
             }
-            // Get supported present modes.
-            uint32_t vkPhysicalDevicePresentModeCount;
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, vkSurface, &vkPhysicalDevicePresentModeCount, nullptr);
-            if (vkPhysicalDevicePresentModeCount != 0) {
-                currenDeviceSwapChainDetails.presentModes.resize(vkPhysicalDevicePresentModeCount);
-                vkGetPhysicalDeviceSurfacePresentModesKHR(device, vkSurface, &vkPhysicalDevicePresentModeCount, currenDeviceSwapChainDetails.presentModes.data());
+            bool suppressed = false;
+            if (slot.messageId != 0) {
+                LogRepeat& repeat = repeats[slot.messageId];
+                if (now - repeat.periodStart >= LOG_REPEAT_PERIOD) {
+                    reportSuppressed(slot.messageId, repeat);
+                    repeat = { now, 0, 0 };
+                }
+                suppressed = (++repeat.count > LOG_REPEAT_LIMIT);
+                repeat.suppressedCount += suppressed ? 1 : 0;
             }
+            if (!suppressed) {
+                std::string& batch = (slot.severity >= LOG_SEVERITY_WARNING) ? errorBatch : outputBatch;
+                batch += slot.text;
+                batch += '\n';
+            }
+            // Give the slot back to producers for the next lap.
+            slot.sequence.store(logQueue.writePosition + LOG_QUEUE_SIZE, std::memory_order_release);
+            logQueue.writePosition++;
         }
-        bool swapChainOk = !currenDeviceSwapChainDetails.formats.empty() &&
-                           !currenDeviceSwapChainDetails.presentModes.empty();
-
-        // ----------------------------------------------
-        // TEST 4: Check if the depth buffer is avaialble
-        // ----------------------------------------------
 
-        // Select a format of depth buffer.
-        // We have a list of formats we need to test and pick one.
-        std::vector< VkFormat > depthFormatCandidates = {
-            VK_FORMAT_D32_SFLOAT,
-            VK_FORMAT_D32_SFLOAT_S8_UINT,
-            VK_FORMAT_D24_UNORM_S8_UINT
-        };
-        VkFormat currentDepthFormat = VK_FORMAT_UNDEFINED;
-        for (VkFormat format : depthFormatCandidates) {
-            VkFormatProperties vkProps;
-            vkGetPhysicalDeviceFormatProperties(device, format, &vkProps);
-            if (vkProps.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
-                currentDepthFormat = format;
-                break;
+        uint64_t droppedCount = logQueue.droppedCount.load();
+        if (droppedCount != reportedDroppedCount) {
+            errorBatch += "[LOG]: " + std::to_string(droppedCount - reportedDroppedCount) + " messages dropped, the queue is full\n";
+            reportedDroppedCount = droppedCount;
+        }
+        if (stop) {
+            for (const auto& repeat : repeats) {
+                reportSuppressed(repeat.first, repeat.second);
             }
         }
-        bool depthFormatOk = (currentDepthFormat != VK_FORMAT_UNDEFINED);
-
-        // Select the first suitable device.
-        if (allExtensionsAvailable && queuesOk && swapChainOk && depthFormatOk) {
-            vkPhysicalDevice = device;
-            queueFamilyIndices = currentDeviceQueueFamilyIndices;
-            swapChainSupportDetails = currenDeviceSwapChainDetails;
-            vkDepthFormat = currentDepthFormat;
+        if (!outputBatch.empty()) {
+            std::cout.write(outputBatch.data(), outputBatch.size());
+            std::cout.flush();
+            outputBatch.clear();
+        }
+        if (!errorBatch.empty()) {
+            std::cerr.write(errorBatch.data(), errorBatch.size());
+            errorBatch.clear();
+        }
+        if (stop) {
             break;
         }
+        std::this_thread::sleep_for(LOG_WRITER_INTERVAL);
     }
+}
 
-    // Check if we have found any suitable device.
-    if (vkPhysicalDevice == VK_NULL_HANDLE) {
-        std::cerr << "No suitable physical devices available!" << std::endl;
-        abort();
+/**
+ * Start the log writer thread. Should be called before any message is logged.
+ */
+void startLogWriter()
+{
+    for (size_t i = 0; i < LOG_QUEUE_SIZE; i++) {
+        logQueue.slots[i].sequence.store(i, std::memory_order_relaxed);
     }
+    logQueue.pushPosition = 0;
+    logQueue.writePosition = 0;
+    logQueue.stopRequested = false;
+    logWriterThread = std::thread(writeLogMessages);
+}
 
-    // ==========================================================================
-    //                   STEP 9: Create a logical device
-    // ==========================================================================
-    // Logical devices are instances of the physical device created for
-    // the particular application. We should create one in order to use it.
-    // ==========================================================================
-
-    // Logical device of a video card.
-    VkDevice vkDevice;
+/**
+ * Write all queued messages and finish the log writer thread.
+ */
+void stopLogWriter()
+{
+    logQueue.stopRequested = true;
+    logWriterThread.join();
+}
 
-    // As it was mentioned above, we might have two queue families referring
-    // to the same index which means there is only one family that is suitable
-    // for both needs.
-    // Use std::set to filter out duplicates as we should mention each queue
-    // only once during logical device creation.
-    std::set< uint32_t > uniqueQueueFamilies = {
-        queueFamilyIndices.graphicsFamily.value(),
-        queueFamilyIndices.presentFamily.value()
-    };
+#endif
 
-    // Go through all remaining queues and make a creation info structure.
-    std::vector< VkDeviceQueueCreateInfo > queueCreateInfos;
-    float queuePriority = 1.0f;
-    for (uint32_t queueFamily : uniqueQueueFamilies) {
-        VkDeviceQueueCreateInfo queueCreateInfo{};
-        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCreateInfo.queueFamilyIndex = queueFamily;
-        queueCreateInfo.queueCount = 1;
-        queueCreateInfo.pQueuePriorities = &queuePriority;
-        queueCreateInfos.push_back(queueCreateInfo);
+/**
+ * Log a message.
+ * In ASYNC_LOG mode the message is only queued and written by another thread,
+ * so this call never waits for the console.
+ * @param severity Severity of the message.
+ * @param messageId Identifier of repeated messages or 0 if the message should never be suppressed.
+ * @param text Text of the message.
+ */
+void logMessage(LogSeverity severity, int32_t messageId, const char* text)
+{
+    if (severity < LOG_MIN_SEVERITY) {
+        return;
     }
+#ifdef ASYNC_LOG
+    pushLogMessage(severity, messageId, text);
+#else
+    (void) messageId;
+    ((severity >= LOG_SEVERITY_WARNING) ? std::cerr : std::cout) << text << std::endl;
+#endif
+}
 
-    // Select physical device features we want to use.
-    // As this is a quite simple application we need nothing special.
-    // However, for more compex applications you might need to first
-    // check if device supports features you need via
-    // vkGetPhysicalDeviceFeatures() call in physical device suitability check.
-    // If you specify something that is not supported - device
-    // creation will fail, so you should check beforehand.
-    VkPhysicalDeviceFeatures vkDeviceFeatures {};
+/**
+ * Bounded queue passing values from one thread to another without locking.
+ * Only one thread may push values and only one thread may pop them,
+ * it may be the same thread.
+ * @tparam T Type of values.
+ * @tparam N Maximal amount of values in the queue.
+ */
+template< typename T, size_t N >
+struct SpscQueue
+{
+    // Ring of values.
+    std::array< T, N > items;
+    // Amount of values ever popped. Written by the consumer only.
+    alignas(64) std::atomic< size_t > readPosition{ 0 };
+    // Amount of values ever pushed. Written by the producer only.
+    alignas(64) std::atomic< size_t > writePosition{ 0 };
+
+    /**
+     * Add a value to the queue. Called by the producer.
+     * @param value Value to add.
+     * @return True if the value has been added, false - if the queue is full.
+     */
+    bool push(const T& value)
+    {
+        size_t position = writePosition.load(std::memory_order_relaxed);
+        if (position - readPosition.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        items[position % N] = value;
+        writePosition.store(position + 1, std::memory_order_release);
+        return true;
+    }
 
-    // Logical device creation info.
-    VkDeviceCreateInfo vkDeviceCreateInfo {};
-    vkDeviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    vkDeviceCreateInfo.queueCreateInfoCount = queueCreateInfos.size();
-    vkDeviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
-    vkDeviceCreateInfo.pEnabledFeatures = &vkDeviceFeatures;
-    // Specify which extensions we want to enable.
-    vkDeviceCreateInfo.enabledExtensionCount = static_cast< uint32_t >(desiredDeviceExtensions.size());
-    vkDeviceCreateInfo.ppEnabledExtensionNames = desiredDeviceExtensions.data();
+    /**
+     * Take the oldest value from the queue. Called by the consumer.
+     * @param value Variable the value is written to.
+     * @return True if a value has been taken, false - if the queue is empty.
+     */
+    bool pop(T& value)
+    {
+        size_t position = readPosition.load(std::memory_order_relaxed);
+        if (position == writePosition.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = items[position % N];
+        readPosition.store(position + 1, std::memory_order_release);
+        return true;
+    }
+};
 
-#ifdef DEBUG_MODE
+/**
+ * Three copies of a value shared by a writer and a reader thread without locking.
+ * The writer fills its own copy and publishes it, the reader always takes
+ * the latest published copy. Neither of them ever waits for the other one
+ * and values are not copied between the copies.
+ * @tparam T Type of the value.
+ */
+template< typename T >
+struct TripleBuffer
+{
+    // Bit of the shared index set when its copy has not been taken by the reader yet.
+    static constexpr uint32_t FRESH_BIT = 4;
+
+    // Copies of the value.
+    std::array< T, 3 > items{};
+    // Index of the copy owned by the writer.
+    uint32_t writeIndex = 0;
+    // Index of the copy passed between the threads.
+    alignas(64) std::atomic< uint32_t > sharedIndex{ 1 };
+    // Index of the copy owned by the reader.
+    alignas(64) uint32_t readIndex = 2;
+
+    /**
+     * Get the copy to fill. Called by the writer.
+     * It keeps an old value, so it should be filled completely.
+     * @return Copy owned by the writer.
+     */
+    T& writeItem()
+    {
+        return items[writeIndex];
+    }
 
-    // Switch on all requested layers for debug mode.
-    vkDeviceCreateInfo.enabledLayerCount = static_cast< uint32_t >(desiredValidationLayers.size());
-    vkDeviceCreateInfo.ppEnabledLayerNames = desiredValidationLayers.data();
+    /**
+     * Give the filled copy to the reader. Called by the writer.
+     */
+    void publish()
+    {
+        writeIndex = sharedIndex.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel) & ~FRESH_BIT;
+    }
 
-#else
+    /**
+     * Take the latest published copy. Called by the reader.
+     * @return Copy owned by the reader until the next call.
+     */
+    const T& read()
+    {
+        if (sharedIndex.load(std::memory_order_relaxed) & FRESH_BIT) {
+            readIndex = sharedIndex.exchange(readIndex, std::memory_order_acq_rel) & ~FRESH_BIT;
+        }
+        return items[readIndex];
+    }
+};
 
-    vkDeviceCreateInfo.enabledLayerCount = 0;
+/**
+ * Key event passed from the window to the simulation.
+ */
+struct InputEvent
+{
+    // GLFW key code.
+    int key;
+    // GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT.
+    int action;
+};
+
+#ifdef LATE_LATCH
+
+/**
+ * Position of the mouse cursor passed from the window to the camera.
+ */
+struct CursorSample
+{
+    // Position in screen coordinates.
+    double x;
+    double y;
+    // Speed in screen coordinates per second.
+    double speedX;
+    double speedY;
+    // When the position has been received.
+    std::chrono::steady_clock::time_point time;
+};
 
 #endif
 
-    // Create a logical device.
-    if (vkCreateDevice(vkPhysicalDevice, &vkDeviceCreateInfo, nullptr, &vkDevice) != VK_SUCCESS) {
-        std::cerr << "Failed to create a logical device!" << std::endl;
-        abort();
+/**
+ * Callback function that will be called each time a validation level produces a message.
+ * @param messageSeverity Bitmask specifying which severities of events cause a debug messenger callback.
+ * @param messageType Bitmask specifying which types of events cause a debug messenger callback.
+ * @param pCallbackData Structure specifying parameters returned to the callback.
+ * @param pUserData Arbitrary user data provided when the callback is created.
+ * @return True in case the Vulkan call should be aborted, false - otherwise.
+ */
+VKAPI_ATTR VkBool32 VKAPI_CALL messageCallback
+    (
+        VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+        VkDebugUtilsMessageTypeFlagsEXT messageType,
+        const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
+        void* pUserData
+    )
+{
+    // Mark variables as not used to suppress warnings.
+    (void) messageType;
+    (void) pUserData;
+    LogSeverity severity = LOG_SEVERITY_VERBOSE;
+    if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        severity = LOG_SEVERITY_ERROR;
+    } else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        severity = LOG_SEVERITY_WARNING;
+    } else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+        severity = LOG_SEVERITY_INFO;
     }
+    // Do not spend time on formatting messages that are filtered out anyway.
+    if (severity < LOG_MIN_SEVERITY) {
+        return VK_FALSE;
+    }
+    // Print the message. Repeats are recognized by the message ID.
+    std::string message = std::string("[MSG]:") + pCallbackData->pMessage;
+    logMessage(severity, pCallbackData->messageIdNumber, message.c_str());
+    // Do only logging, do not abort the call.
+    return VK_FALSE;
+}
 
-    // ==========================================================================
-    //                   STEP 10: Select surface configuration
-    // ==========================================================================
-    // We should select surface format, present mode and extent (size) from
-    // the proposed values. They will be used in furhter calls.
-    // ==========================================================================
+#ifdef HOST_ALLOCATOR
 
-    // Select a color format.
-    VkSurfaceFormatKHR vkSelectedFormat = swapChainSupportDetails.formats[0];
-    for (const auto& availableFormat : swapChainSupportDetails.formats) {
-        if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-            vkSelectedFormat = availableFormat;
-            break;
-        }
+/**
+ * Header stored right before each block returned to Vulkan.
+ */
+struct HostAllocationHeader
+{
+    // Pointer returned by malloc() or taken from a pool.
+    void* base;
+    // Size requested by Vulkan.
+    size_t size;
+    // Allocation scope the block has been requested for.
+    uint32_t scope;
+    // Pool size class or UINT32_MAX if the block is not pooled.
+    uint32_t sizeClass;
+};
+static_assert(sizeof(HostAllocationHeader) <= HOST_ALLOCATION_HEADER_SIZE, "Host allocation header is too big");
+
+/**
+ * Statistics of host allocations made by Vulkan.
+ * Callbacks may be called from any thread, so all counters are atomic.
+ */
+struct HostAllocationStatistics
+{
+    // Amount of allocations per scope.
+    std::array< std::atomic< uint64_t >, HOST_ALLOCATION_SCOPE_COUNT > count;
+    // Bytes currently allocated per scope.
+    std::array< std::atomic< uint64_t >, HOST_ALLOCATION_SCOPE_COUNT > bytes;
+    // Maximal amount of bytes allocated per scope at the same time.
+    std::array< std::atomic< uint64_t >, HOST_ALLOCATION_SCOPE_COUNT > peakBytes;
+    // Bytes currently allocated in all scopes.
+    std::atomic< uint64_t > totalBytes;
+    // Maximal amount of bytes allocated in all scopes at the same time.
+    std::atomic< uint64_t > peakTotalBytes;
+    // Amount of allocations served from thread-local pools.
+    std::atomic< uint64_t > pooledCount;
+    // Bytes the driver reported to allocate on its own (internal allocations).
+    std::atomic< uint64_t > internalBytes;
+} hostAllocationStatistics{};
+
+/**
+ * Lists of free pooled blocks owned by the current thread, one per size class.
+ * Blocks freed by another thread simply move to the pool of that thread.
+ */
+thread_local std::array< void*, HOST_POOL_CLASS_COUNT > hostPoolFreeLists{};
+
+/**
+ * All arena chunks allocated for pools. They are released at exit only.
+ */
+std::vector< void* > hostPoolArenas;
+/**
+ * Mutex protecting the list of arena chunks.
+ */
+std::mutex hostPoolArenasMutex;
+
+/**
+ * Update statistics of a scope after a block has been allocated or freed.
+ * @param scope Allocation scope.
+ * @param size Size of the block.
+ * @param allocated True if the block has been allocated, false - if freed.
+ */
+void trackHostAllocation(uint32_t scope, size_t size, bool allocated)
+{
+    if (!allocated) {
+        hostAllocationStatistics.bytes[scope] -= size;
+        hostAllocationStatistics.totalBytes -= size;
+        return;
     }
 
-    // Select a present mode.
-    VkPresentModeKHR vkSelectedPresendMode = swapChainSupportDetails.presentModes[0];
-    for (const auto& availablePresentMode : swapChainSupportDetails.presentModes) {
-        // Preferrable mode. If we find it, break the cycle immediately.
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            vkSelectedPresendMode = availablePresentMode;
-            break;
+    hostAllocationStatistics.count[scope]++;
+    uint64_t scopeBytes = hostAllocationStatistics.bytes[scope] += size;
+    uint64_t totalBytes = hostAllocationStatistics.totalBytes += size;
+
+    // Raise peaks if they have been exceeded.
+    uint64_t peak = hostAllocationStatistics.peakBytes[scope];
+    while (scopeBytes > peak && !hostAllocationStatistics.peakBytes[scope].compare_exchange_weak(peak, scopeBytes));
+    peak = hostAllocationStatistics.peakTotalBytes;
+    while (totalBytes > peak && !hostAllocationStatistics.peakTotalBytes.compare_exchange_weak(peak, totalBytes));
+}
+
+/**
+ * Callback function that allocates host memory for Vulkan.
+ * Small COMMAND and OBJECT scope allocations are frequent and short-lived,
+ * so they are served from thread-local pools without locking.
+ * @param pUserData Arbitrary user data provided in VkAllocationCallbacks.
+ * @param size Size of the allocation in bytes.
+ * @param alignment Required alignment of the allocation in bytes.
+ * @param allocationScope Scope of the allocation lifetime.
+ * @return Pointer to the allocated memory or nullptr on failure.
+ */
+VKAPI_ATTR void* VKAPI_CALL hostAllocate
+    (
+        void* pUserData,
+        size_t size,
+        size_t alignment,
+        VkSystemAllocationScope allocationScope
+    )
+{
+    (void) pUserData;
+
+    // Try to serve the allocation from a pool.
+    // Arena chunks come from malloc(), so only alignments it guarantees are pooled.
+    bool poolable = (allocationScope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND || allocationScope == VK_SYSTEM_ALLOCATION_SCOPE_OBJECT) &&
+            alignment <= alignof(std::max_align_t) &&
+            size + HOST_ALLOCATION_HEADER_SIZE <= (HOST_POOL_MIN_BLOCK_SIZE << (HOST_POOL_CLASS_COUNT - 1));
+    if (poolable) {
+        // Find the smallest size class the block fits.
+        uint32_t sizeClass = 0;
+        while ((HOST_POOL_MIN_BLOCK_SIZE << sizeClass) < size + HOST_ALLOCATION_HEADER_SIZE) {
+            sizeClass++;
         }
-        // Fallback mode. If we find it, store to vkSelectedPresendMode,
-        // but try to find something better.
-        if (availablePresentMode == VK_PRESENT_MODE_FIFO_KHR) {
-            vkSelectedPresendMode = availablePresentMode;
+        size_t blockSize = HOST_POOL_MIN_BLOCK_SIZE << sizeClass;
+
+        // Cut a new arena chunk into blocks if the pool is empty.
+        void*& freeList = hostPoolFreeLists[sizeClass];
+        if (freeList == nullptr) {
+            char* arena = static_cast< char* >(std::malloc(HOST_POOL_ARENA_SIZE));
+            if (arena == nullptr) {
+                return nullptr;
+            }
+            {
+                std::lock_guard< std::mutex > lock(hostPoolArenasMutex);
+                hostPoolArenas.push_back(arena);
+            }
+            for (size_t offset = 0; offset + blockSize <= HOST_POOL_ARENA_SIZE; offset += blockSize) {
+                *reinterpret_cast< void** >(arena + offset) = freeList;
+                freeList = arena + offset;
+            }
         }
+
+        // Take the first free block.
+        char* block = static_cast< char* >(freeList);
+        freeList = *reinterpret_cast< void** >(block);
+
+        HostAllocationHeader* header = reinterpret_cast< HostAllocationHeader* >(block);
+        header->base = block;
+        header->size = size;
+        header->scope = allocationScope;
+        header->sizeClass = sizeClass;
+        hostAllocationStatistics.pooledCount++;
+        trackHostAllocation(allocationScope, size, true);
+        return block + HOST_ALLOCATION_HEADER_SIZE;
     }
 
-    // Select a swap chain images resolution.
-    VkExtent2D vkSelectedExtent;
-    if (swapChainSupportDetails.capabilities.currentExtent.width != UINT32_MAX) {
-        vkSelectedExtent = swapChainSupportDetails.capabilities.currentExtent;
-    } else {
-        // Some window managers do not allow to use resolution different from
-        // the resolution of the window. In such cases Vulkan will report
-        // UINT32_MAX as currentExtent.width and currentExtent.height.
-        vkSelectedExtent = { WINDOW_WIDTH, WINDOW_HEIGHT };
-        // Make sure the value is between minImageExtent.width and maxImageExtent.width.
-        vkSelectedExtent.width = std::max(
-                    swapChainSupportDetails.capabilities.minImageExtent.width,
-                    std::min(
-                        swapChainSupportDetails.capabilities.maxImageExtent.width,
-                        vkSelectedExtent.width
-                        )
-                    );
-        // Make sure the value is between minImageExtent.height and maxImageExtent.height.
-        vkSelectedExtent.height = std::max(
-                    swapChainSupportDetails.capabilities.minImageExtent.height,
-                    std::min(
-                        swapChainSupportDetails.capabilities.maxImageExtent.height,
-                        vkSelectedExtent.height
-                        )
-                    );
+    // Allocate enough space to align the block and put the header in front of it.
+    char* base = static_cast< char* >(std::malloc(size + alignment + HOST_ALLOCATION_HEADER_SIZE));
+    if (base == nullptr) {
+        return nullptr;
     }
+    uintptr_t address = reinterpret_cast< uintptr_t >(base) + HOST_ALLOCATION_HEADER_SIZE;
+    address = (address + alignment - 1) & ~(static_cast< uintptr_t >(alignment) - 1);
+    char* memory = reinterpret_cast< char* >(address);
+
+    HostAllocationHeader* header = reinterpret_cast< HostAllocationHeader* >(memory - HOST_ALLOCATION_HEADER_SIZE);
+    header->base = base;
+    header->size = size;
+    header->scope = allocationScope;
+    header->sizeClass = UINT32_MAX;
+    trackHostAllocation(allocationScope, size, true);
+    return memory;
+}
 
-    // ==========================================================================
-    //                     STEP 11: Create a swap chain
-    // ==========================================================================
-    // Swap chain is a chain of rendered images that are going to be displayed
-    // on the screen. It is used to synchronize image rendering with refresh
-    // rate of the screen (VSync). If the application generates frames faster
-    // than they are displayed, it should wait.
-    // ==========================================================================
+/**
+ * Callback function that frees host memory allocated by hostAllocate().
+ * @param pUserData Arbitrary user data provided in VkAllocationCallbacks.
+ * @param pMemory Memory to free, may be nullptr.
+ */
+VKAPI_ATTR void VKAPI_CALL hostFree
+    (
+        void* pUserData,
+        void* pMemory
+    )
+{
+    (void) pUserData;
 
-    // First of all we should select a size of the swap chain.
-    // It is recommended to use minValue + 1 but we also have to make sure
-    // it does not exceed maxValue.
-    // If maxValue is zero, it means there is no upper bound.
-    uint32_t imageCount = swapChainSupportDetails.capabilities.minImageCount + 1;
-    if (swapChainSupportDetails.capabilities.maxImageCount > 0 && imageCount > swapChainSupportDetails.capabilities.maxImageCount) {
-        imageCount = swapChainSupportDetails.capabilities.maxImageCount;
+    if (pMemory == nullptr) {
+        return;
     }
 
-    // Fill in swap chain create info using selected surface configuration.
-    VkSwapchainCreateInfoKHR vkSwapChainCreateInfo{};
-    vkSwapChainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    vkSwapChainCreateInfo.surface = vkSurface;
-    vkSwapChainCreateInfo.minImageCount = imageCount;
-    vkSwapChainCreateInfo.imageFormat = vkSelectedFormat.format;
-    vkSwapChainCreateInfo.imageColorSpace = vkSelectedFormat.colorSpace;
-    vkSwapChainCreateInfo.imageExtent = vkSelectedExtent;
-    vkSwapChainCreateInfo.imageArrayLayers = 1;
-    vkSwapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    // We have two options for queue synchronization:
-    // - VK_SHARING_MODE_EXCLUSIVE - An image ownership should be explicitly transferred
-    //                               before using it in a differen queue. Best performance option.
-    // - VK_SHARING_MODE_CONCURRENT - Images can be used in different queues without
-    //                                explicit ownership transfer. Less performant, but simpler in implementation.
-    // If we have only one queue family - we should use VK_SHARING_MODE_EXCLUSIVE as we do not need
-    // to do any synchrnoization and can use the faster option for free.
-    // If we have two queue families - we will use VK_SHARING_MODE_CONCURRENT mode to avoid
-    // additional complexity of ownership transferring.
-    uint32_t familyIndices[] = {
-        queueFamilyIndices.graphicsFamily.value(),
-        queueFamilyIndices.presentFamily.value()
-    };
-    if (familyIndices[0] != familyIndices[1]) {
-        vkSwapChainCreateInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-        vkSwapChainCreateInfo.queueFamilyIndexCount = 2;
-        vkSwapChainCreateInfo.pQueueFamilyIndices = familyIndices;
-    } else {
-        vkSwapChainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        vkSwapChainCreateInfo.queueFamilyIndexCount = 0;
-        vkSwapChainCreateInfo.pQueueFamilyIndices = nullptr;
-    }
-    vkSwapChainCreateInfo.preTransform = swapChainSupportDetails.capabilities.currentTransform;
-    vkSwapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    vkSwapChainCreateInfo.presentMode = vkSelectedPresendMode;
-    vkSwapChainCreateInfo.clipped = VK_TRUE;
-    // This option is only required if we recreate a swap chain.
-    vkSwapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+    HostAllocationHeader* header = reinterpret_cast< HostAllocationHeader* >(static_cast< char* >(pMemory) - HOST_ALLOCATION_HEADER_SIZE);
+    trackHostAllocation(header->scope, header->size, false);
 
-    // Create a swap chain.
-    VkSwapchainKHR vkSwapChain;
-    if (vkCreateSwapchainKHR(vkDevice, &vkSwapChainCreateInfo, nullptr, &vkSwapChain) != VK_SUCCESS) {
-        std::cerr << "Failed to create a swap chain!" << std::endl;
-        abort();
+    if (header->sizeClass == UINT32_MAX) {
+        std::free(header->base);
+        return;
     }
 
-    // ==========================================================================
-    //                 STEP 12: Create swap chain image views
-    // ==========================================================================
-    // After the swap chain is created, it contains Vulkan images that are
-    // used to transfer rendered picture. In order to work with images
-    // we should create image views.
-    // ==========================================================================
-
-    // Fetch Vulkan images associated to the swap chain.
-    std::vector< VkImage > vkSwapChainImages;
-    uint32_t vkSwapChainImageCount;
-    vkGetSwapchainImagesKHR(vkDevice, vkSwapChain, &vkSwapChainImageCount, nullptr);
-    vkSwapChainImages.resize(vkSwapChainImageCount);
-    vkGetSwapchainImagesKHR(vkDevice, vkSwapChain, &vkSwapChainImageCount, vkSwapChainImages.data());
+    // Return the block to the pool of the current thread.
+    void*& freeList = hostPoolFreeLists[header->sizeClass];
+    void* block = header->base;
+    *reinterpret_cast< void** >(block) = freeList;
+    freeList = block;
+}
 
-    // Create image views for each image.
-    std::vector< VkImageView > vkSwapChainImageViews;
-    vkSwapChainImageViews.resize(vkSwapChainImageCount);
-    for (size_t i = 0; i < vkSwapChainImageCount; i++) {
-        // Image view create info.
-        VkImageViewCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        createInfo.image = vkSwapChainImages[i];
-        createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        createInfo.format = vkSelectedFormat.format;
-        createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        createInfo.subresourceRange.baseMipLevel = 0;
-        createInfo.subresourceRange.levelCount = 1;
-        createInfo.subresourceRange.baseArrayLayer = 0;
-        createInfo.subresourceRange.layerCount = 1;
-        // Create an image view.
-        if (vkCreateImageView(vkDevice, &createInfo, nullptr, &vkSwapChainImageViews[i]) != VK_SUCCESS) {
-            std::cerr << "Failed to create an image view #" << i << "!" << std::endl;
-            abort();
-        }
+/**
+ * Callback function that reallocates host memory allocated by hostAllocate().
+ * @param pUserData Arbitrary user data provided in VkAllocationCallbacks.
+ * @param pOriginal Memory to reallocate, may be nullptr.
+ * @param size New size of the allocation in bytes.
+ * @param alignment Required alignment of the allocation in bytes.
+ * @param allocationScope Scope of the allocation lifetime.
+ * @return Pointer to the reallocated memory or nullptr on failure.
+ */
+VKAPI_ATTR void* VKAPI_CALL hostReallocate
+    (
+        void* pUserData,
+        void* pOriginal,
+        size_t size,
+        size_t alignment,
+        VkSystemAllocationScope allocationScope
+    )
+{
+    if (pOriginal == nullptr) {
+        return hostAllocate(pUserData, size, alignment, allocationScope);
+    }
+    if (size == 0) {
+        hostFree(pUserData, pOriginal);
+        return nullptr;
     }
 
-    // ==========================================================================
-    //               STEP 13: Create a descriptor set layout
-    // ==========================================================================
-    // Descriptor set layout describes a layout for uniform variables.
-    // The pipeline is create taking into account the layout and after it is
-    // possible to attach particular values of the unifrom variables that
-    // correspond to the layout. In short, the layout descibe which uniforms
-    // are expected by the shaders.
-    // We bind a single uniform buffer object to the vertex shader, so
-    // we have only one binding.
-    // ==========================================================================
+    // A pooled block may be big enough to keep the new size in place.
+    HostAllocationHeader* header = reinterpret_cast< HostAllocationHeader* >(static_cast< char* >(pOriginal) - HOST_ALLOCATION_HEADER_SIZE);
+    if (header->sizeClass != UINT32_MAX &&
+            header->scope == static_cast< uint32_t >(allocationScope) &&
+            size + HOST_ALLOCATION_HEADER_SIZE <= (HOST_POOL_MIN_BLOCK_SIZE << header->sizeClass)) {
+        trackHostAllocation(header->scope, header->size, false);
+        trackHostAllocation(header->scope, size, true);
+        header->size = size;
+        return pOriginal;
+    }
 
-    VkDescriptorSetLayoutBinding vkUboLayoutBinding{};
-    vkUboLayoutBinding.binding = 0;
-    vkUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    vkUboLayoutBinding.descriptorCount = 1;
-    vkUboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    vkUboLayoutBinding.pImmutableSamplers = nullptr;
+    // Otherwise move the data to a new block.
+    void* memory = hostAllocate(pUserData, size, alignment, allocationScope);
+    if (memory == nullptr) {
+        // The original block must stay valid on failure.
+        return nullptr;
+    }
+    std::memcpy(memory, pOriginal, std::min(size, header->size));
+    hostFree(pUserData, pOriginal);
+    return memory;
+}
 
-    VkDescriptorSetLayout vkDescriptorSetLayout;
+/**
+ * Callback function called when the driver allocates host memory on its own.
+ * @param pUserData Arbitrary user data provided in VkAllocationCallbacks.
+ * @param size Size of the allocation in bytes.
+ * @param allocationType Type of the allocation.
+ * @param allocationScope Scope of the allocation lifetime.
+ */
+VKAPI_ATTR void VKAPI_CALL hostInternalAllocation
+    (
+        void* pUserData,
+        size_t size,
+        VkInternalAllocationType allocationType,
+        VkSystemAllocationScope allocationScope
+    )
+{
+    (void) pUserData;
+    (void) allocationType;
+    (void) allocationScope;
+    hostAllocationStatistics.internalBytes += size;
+}
 
-    VkDescriptorSetLayoutCreateInfo vkLayoutInfo{};
-    vkLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    vkLayoutInfo.bindingCount = 1;
-    vkLayoutInfo.pBindings = &vkUboLayoutBinding;
+/**
+ * Callback function called when the driver frees host memory allocated on its own.
+ * @param pUserData Arbitrary user data provided in VkAllocationCallbacks.
+ * @param size Size of the allocation in bytes.
+ * @param allocationType Type of the allocation.
+ * @param allocationScope Scope of the allocation lifetime.
+ */
+VKAPI_ATTR void VKAPI_CALL hostInternalFree
+    (
+        void* pUserData,
+        size_t size,
+        VkInternalAllocationType allocationType,
+        VkSystemAllocationScope allocationScope
+    )
+{
+    (void) pUserData;
+    (void) allocationType;
+    (void) allocationScope;
+    hostAllocationStatistics.internalBytes -= size;
+}
 
-    if (vkCreateDescriptorSetLayout(vkDevice, &vkLayoutInfo, nullptr, &vkDescriptorSetLayout) != VK_SUCCESS) {
-        std::cerr << "Failed to create a descriptor set layout" << std::endl;
-        abort();
-    }
+#endif
 
+/**
+ * Main function.
+ * @return Return code of the application.
+ */
+int main()
+{
     // ==========================================================================
-    //                      STEP 14: Create uniform buffers
+    //                 STEP 1: Create a Window using GLFW
     // ==========================================================================
-    // Uniform buffer contains a structure that is provided to shaders
-    // as a uniform variable. In our case this is a couple of matrices.
-    // As we expect to have more than one frame rendered at the same time
-    // and we are going to update this buffer every frame, we should avoid
-    // situation when one frame reads the uniform buffer while it is
-    // being updated. So we should create one buffer per swap chain image.
+    // GLFW abstracts native calls to create the window and allows us to write
+    // a cross-platform application.
     // ==========================================================================
 
-    // Structure that we want to provide to the vertext shader.
-    struct UniformBufferObject {
-        glm::mat4 model;
-        glm::mat4 view;
-        glm::mat4 proj;
-    };
-
-    // Get size of the uniform buffer.
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    // Remember when the application started to measure time to the first frame.
+    auto launchTime = std::chrono::high_resolution_clock::now();
 
-    // Uniform buffers.
-    std::vector< VkBuffer > vkUniformBuffers;
-    vkUniformBuffers.resize(vkSwapChainImages.size());
-
-    // Memory of uniform buffers.
-    std::vector< VkDeviceMemory > vkUniformBuffersMemory;
-    vkUniformBuffersMemory.resize(vkSwapChainImages.size());
-
-    // Create one uniform buffer per swap chain image.
-    for (size_t i = 0; i < vkSwapChainImages.size(); i++) {
-        // Describe a buffer.
-        VkBufferCreateInfo vkBufferInfo{};
-        vkBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        vkBufferInfo.size = bufferSize;
-        vkBufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-        vkBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+#ifdef ASYNC_LOG
+    // Messages may come from Vulkan as soon as the instance is being created.
+    startLogWriter();
+#endif
 
-        // Create a buffer.
-        if (vkCreateBuffer(vkDevice, &vkBufferInfo, nullptr, &vkUniformBuffers[i]) != VK_SUCCESS) {
-            std::cerr << "Failed to create a buffer!" << std::endl;
+    // Read SPIR-V code of a shader.
+    auto readShaderFile = [](const char* fileName) {
+        // Open file.
+        std::ifstream file(fileName, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Shader file " << fileName << " not found!" << std::endl;
+            abort();
+        }
+        // The position at the end is the file size, or -1 if it is unknown.
+        std::streamoff fileSize = file.tellg();
+        if (fileSize < 0) {
+            std::cerr << "Failed to read " << fileName << "!" << std::endl;
             abort();
         }
+        // Jump to the beginning of the file.
+        file.seekg(0);
+        // Read shader code.
+        std::vector< char > buffer(static_cast< size_t >(fileSize));
+        file.read(buffer.data(), buffer.size());
+        // Close the file.
+        file.close();
+        return buffer;
+    };
 
-        // Retrieve memory requirements for the vertex buffer.
-        VkMemoryRequirements vkMemRequirements;
-        vkGetBufferMemoryRequirements(vkDevice, vkUniformBuffers[i], &vkMemRequirements);
+#ifdef PARALLEL_STARTUP
 
-        // Define memory allocate info.
-        VkMemoryAllocateInfo vkAllocInfo{};
-        vkAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        vkAllocInfo.allocationSize = vkMemRequirements.size;
-        // Select suitable memory type.
-        uint32_t memTypeIndex = UINT32_MAX;
-        VkMemoryPropertyFlags vkMemFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-        VkPhysicalDeviceMemoryProperties vkMemProperties;
-        vkGetPhysicalDeviceMemoryProperties(vkPhysicalDevice, &vkMemProperties);
-        for (uint32_t i = 0; i < vkMemProperties.memoryTypeCount; i++) {
-            if ((vkMemRequirements.memoryTypeBits & (1 << i)) && (vkMemProperties.memoryTypes[i].propertyFlags & vkMemFlags) == vkMemFlags) {
-                memTypeIndex = i;
-                break;
-            }
-        }
-        vkAllocInfo.memoryTypeIndex = memTypeIndex;
+    // Shader files do not depend on Vulkan at all,
+    // so start reading them right now on worker threads.
+    // The code is taken in STEP 16 when shader modules are created.
+    auto vertexShaderTask = std::async(std::launch::async, readShaderFile, "main.vert.spv");
+    auto fragmentShaderTask = std::async(std::launch::async, readShaderFile, "main.frag.spv");
 
-        // Allocate memory for the vertex buffer.
-        if (vkAllocateMemory(vkDevice, &vkAllocInfo, nullptr, &vkUniformBuffersMemory[i]) != VK_SUCCESS) {
-            std::cerr << "Failed to allocate buffer memory!" << std::endl;
-            abort();
-        }
+#endif
 
-        // Bind the buffer to the allocated memory.
-        vkBindBufferMemory(vkDevice, vkUniformBuffers[i], vkUniformBuffersMemory[i], 0);
-    }
+    // Initialize GLFW context.
+    glfwInit();
+    // Do not create an OpenGL context - we use Vulkan.
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    // Make the window not resizable.
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+#ifdef PARALLEL_STARTUP
+    // The window is created in STEP 5 while the Vulkan instance is being created.
+    GLFWwindow* glfwWindow = nullptr;
+#else
+    // Create a window instance.
+    GLFWwindow* glfwWindow = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, APPLICATION_NAME, nullptr, nullptr);
+#endif
 
     // ==========================================================================
-    //                  STEP 15: Write descriptopr sets
+    //                   STEP 2: Select Vulkan extensions
     // ==========================================================================
-    // For each unifrom buffer we have to create a descriptor set and submit
-    // the buffer data to it. Descriptor sets are created by the descriptor pool.
+    // Vulkan has a list of extensions providing some functionality.
+    // We should explicitly select extensions we need.
+    // At least GLFW requires some graphical capabilities
+    // in order to draw an image.
     // ==========================================================================
 
-    // Define a descriptor pool size. We need one descriptor set per swap chain image.
-    VkDescriptorPoolSize vkPoolSize{};
-    vkPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    vkPoolSize.descriptorCount = static_cast< uint32_t >(vkSwapChainImages.size());
+    // Take a minimal set of Vulkan extensions required by GLWF.
+    uint32_t glfwExtensionCount = 0;
+    const char** glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-    // Define descriptor pool.
-    VkDescriptorPoolCreateInfo vkDescriptorPoolInfo{};
-    vkDescriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    vkDescriptorPoolInfo.poolSizeCount = 1;
-    vkDescriptorPoolInfo.pPoolSizes = &vkPoolSize;
-    vkDescriptorPoolInfo.maxSets = static_cast< uint32_t >(vkSwapChainImages.size());
+    // Fetch list of available Vulkan extensions.
+    uint32_t vkNumAvailableExtensions = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &vkNumAvailableExtensions, nullptr);
+    std::vector< VkExtensionProperties > vkAvailableExtensions(vkNumAvailableExtensions);
+    vkEnumerateInstanceExtensionProperties(nullptr, &vkNumAvailableExtensions, vkAvailableExtensions.data());
 
-    // Create descriptor pool.
-    VkDescriptorPool vkDescriptorPool;
-    if (vkCreateDescriptorPool(vkDevice, &vkDescriptorPoolInfo, nullptr, &vkDescriptorPool) != VK_SUCCESS) {
-        std::cerr << "Failed to create a descriptor pool!" << std::endl;
-        abort();
-    }
+    // Construct a list of extensions we should request.
+    std::vector< const char* > extensionsList(glfwExtensions, glfwExtensions + glfwExtensionCount);
 
-    // Take a descriptor set layout created above and use it for all descriptor sets.
-    std::vector< VkDescriptorSetLayout > layouts(vkSwapChainImages.size(), vkDescriptorSetLayout);
+#ifdef DEBUG_MODE
 
-    // Describe allocate infor for descriptor set.
-    VkDescriptorSetAllocateInfo vkDescriptSetAllocInfo{};
-    vkDescriptSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    vkDescriptSetAllocInfo.descriptorPool = vkDescriptorPool;
-    vkDescriptSetAllocInfo.descriptorSetCount = static_cast< uint32_t >(vkSwapChainImages.size());
-    vkDescriptSetAllocInfo.pSetLayouts = layouts.data();
+    // Add an extension to print debug messages.
+    extensionsList.push_back("VK_EXT_debug_utils");
 
-    // Create a descriptor set.
-    std::vector< VkDescriptorSet > vkDescriptorSets;
-    vkDescriptorSets.resize(vkSwapChainImages.size());
-    if (vkAllocateDescriptorSets(vkDevice, &vkDescriptSetAllocInfo, vkDescriptorSets.data()) != VK_SUCCESS) {
-        std::cerr << "Failed to allocate descriptor set!" << std::endl;
+    // ==========================================================================
+    //              STEP 3: Select validation layers for debug
+    // ==========================================================================
+    // Validation layers is a mechanism to hook Vulkan API calls, validate
+    // them and notify the user if something goes wrong.
+    // Here we need to make sure that requested validation layers are available.
+    // ==========================================================================
+
+    // Specify desired validation layers.
+    const std::vector< const char* > desiredValidationLayers = {
+        "VK_LAYER_KHRONOS_validation"
+    };
+
+    // Fetch available validation layers.
+    uint32_t vkLayerCount;
+    vkEnumerateInstanceLayerProperties(&vkLayerCount, nullptr);
+    std::vector< VkLayerProperties > vkAvailableLayers(vkLayerCount);
+    vkEnumerateInstanceLayerProperties(&vkLayerCount, vkAvailableLayers.data());
+
+    // Check if desired validation layers are in the list.
+    bool validationLayersAvailable = true;
+    for (auto requestedLayer : desiredValidationLayers) {
+        bool isLayerAvailable = false;
+        for (auto availableLayer : vkAvailableLayers) {
+            if (std::strcmp(requestedLayer, availableLayer.layerName) == 0) {
+                isLayerAvailable = true;
+                break;
+            }
+        }
+        if (!isLayerAvailable) {
+            validationLayersAvailable = false;
+            break;
+        }
+    }
+    if (!validationLayersAvailable) {
+        std::cerr << "Desired validation levels are not available!";
         abort();
     }
 
-    // Write descriptors for each uniform buffer.
-    for (size_t i = 0; i < vkSwapChainImages.size(); i++) {
-        // Describe a uniform buffer info.
-        VkDescriptorBufferInfo vkBufferInfo{};
-        vkBufferInfo.buffer = vkUniformBuffers[i];
-        vkBufferInfo.offset = 0;
-        vkBufferInfo.range = sizeof(UniformBufferObject);
+    // ==========================================================================
+    //                STEP 4: Create a debug message callback
+    // ==========================================================================
+    // Debug message callback allows us to display errors and warnings if
+    // we do some mistake using Vulkan API.
+    // ==========================================================================
 
-        // Describe a descriptor set to write.
-        VkWriteDescriptorSet vkDescriptorWrite{};
-        vkDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        vkDescriptorWrite.dstSet = vkDescriptorSets[i];
-        vkDescriptorWrite.dstBinding = 0;
-        vkDescriptorWrite.dstArrayElement = 0;
-        vkDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        vkDescriptorWrite.descriptorCount = 1;
-        vkDescriptorWrite.pBufferInfo = &vkBufferInfo;
-        vkDescriptorWrite.pImageInfo = nullptr;
-        vkDescriptorWrite.pTexelBufferView = nullptr;
+    // Set up message logging.
+    // See %VK_SDK_PATH%/Config/vk_layer_settings.txt for detailed information.
+    VkDebugUtilsMessengerCreateInfoEXT vkMessangerCreateInfo {};
+    vkMessangerCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    // Which severities of events cause a debug messenger callback.
+    vkMessangerCreateInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                                            VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                                            VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    // Which types of events cause a debug messenger callback.
+    vkMessangerCreateInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                                        VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                                        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    // Pointer to a callback function.
+    vkMessangerCreateInfo.pfnUserCallback = messageCallback;
+    // Here we can pass some arbitrary date to the callback function.
+    vkMessangerCreateInfo.pUserData = nullptr;
 
-        // Write the descriptor set.
-        vkUpdateDescriptorSets(vkDevice, 1, &vkDescriptorWrite, 0, nullptr);
-    }
+#endif
 
     // ==========================================================================
-    //                        STEP 16: Load shaders
+    //                    STEP 5: Create a Vulkan instance
     // ==========================================================================
-    // Shaders are special code that is executed directly on GPU.
-    // For our simple example we use vertex and fragment shaders.
-    // Unlike OpenGL, Vulcan uses a binary format which is called SPIR-V and
-    // each shader should be compiled to this format using glslc compiler that
-    // could be found in Vulkan SDK.
+    // Vulkan instance is a starting point of using Vulkan API.
+    // Here we specify API version and which extensions to use.
     // ==========================================================================
 
-    // --------------------------------------------------------------------------
-    // Create a vertex shader module.
-    // --------------------------------------------------------------------------
+    // Specify application info and required Vulkan version.
+    VkApplicationInfo vkAppInfo {};
+    // Information about your application.
+    vkAppInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    vkAppInfo.pApplicationName = APPLICATION_NAME;
+    vkAppInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    // Information about your 3D engine (if applicable).
+    vkAppInfo.pEngineName = APPLICATION_NAME;
+    vkAppInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    // Request the highest version supported by the loader, but not newer
+    // than v1.3 which is the last one this application knows about.
+    // Loaders of v1.0 do not have vkEnumerateInstanceVersion() at all.
+    // The version actually used with a device is negotiated in STEP 8.
+    uint32_t vkInstanceVersion = VK_API_VERSION_1_0;
+    auto vkEnumerateInstanceVersion = reinterpret_cast< PFN_vkEnumerateInstanceVersion >(vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion"));
+    if (vkEnumerateInstanceVersion != nullptr && vkEnumerateInstanceVersion(&vkInstanceVersion) != VK_SUCCESS) {
+        vkInstanceVersion = VK_API_VERSION_1_0;
+    }
+    vkAppInfo.apiVersion = std::min< uint32_t >(vkInstanceVersion, VK_API_VERSION_1_3);
+
+    // Fill in an instance create structure.
+    VkInstanceCreateInfo vkCreateInfo {};
+    vkCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    vkCreateInfo.pApplicationInfo = &vkAppInfo;
+    // Specify which extensions we need.
+    vkCreateInfo.enabledExtensionCount = extensionsList.size();
+    vkCreateInfo.ppEnabledExtensionNames = extensionsList.data();
+
+#ifdef DEBUG_MODE
+
+    // Switch on all requested layers for debug mode.
+    vkCreateInfo.enabledLayerCount = static_cast< uint32_t >(desiredValidationLayers.size());
+    vkCreateInfo.ppEnabledLayerNames = desiredValidationLayers.data();
+    // Debug message callbacks are attached after instance creation and should be destroyed
+    // before instance destruction. Therefore they do not catch errors in these two calls.
+    // To avoid this we can pass our debug messager duing instance creation.
+    // This will apply it for vkCreateInstance() and vkDestroyInstance() calls only,
+    // so in any case debug messages should be switched on after the instance is created.
+    vkCreateInfo.pNext = reinterpret_cast< VkDebugUtilsMessengerCreateInfoEXT* >(&vkMessangerCreateInfo);
+
+#else
+
+    // Do not use layers in release mode.
+    vkCreateInfo.enabledLayerCount = 0;
+
+#endif
 
-    // Open file.
-    std::ifstream vertexShaderFile("main.vert.spv", std::ios::ate | std::ios::binary);
-    if (!vertexShaderFile.is_open()) {
-        std::cerr << "Vertex shader file not found!" << std::endl;
+    // Host memory allocator passed to each Vulkan call.
+    // Null pointer means that the driver uses its own allocator.
+#ifdef HOST_ALLOCATOR
+    VkAllocationCallbacks vkAllocationCallbacks{};
+    vkAllocationCallbacks.pUserData = nullptr;
+    vkAllocationCallbacks.pfnAllocation = hostAllocate;
+    vkAllocationCallbacks.pfnReallocation = hostReallocate;
+    vkAllocationCallbacks.pfnFree = hostFree;
+    vkAllocationCallbacks.pfnInternalAllocation = hostInternalAllocation;
+    vkAllocationCallbacks.pfnInternalFree = hostInternalFree;
+    const VkAllocationCallbacks* vkAllocator = &vkAllocationCallbacks;
+#else
+    const VkAllocationCallbacks* vkAllocator = nullptr;
+#endif
+
+    // Create a Vulkan instance and check its validity.
+    VkInstance vkInstance;
+#ifdef PARALLEL_STARTUP
+    // Most of the instance creation time is spent on loading drivers.
+    // GLFW requires windows to be created on the main thread, so create
+    // the instance on a worker thread and the window here at the same time.
+    auto instanceTask = std::async(std::launch::async, [&]() {
+        return vkCreateInstance(&vkCreateInfo, vkAllocator, &vkInstance);
+    });
+    glfwWindow = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, APPLICATION_NAME, nullptr, nullptr);
+    if (instanceTask.get() != VK_SUCCESS) {
+        std::cerr << "Failed to creae a Vulkan instance!";
         abort();
     }
-    // Calculate file size.
-    size_t vertexFileSize = static_cast< size_t >(vertexShaderFile.tellg());
-    // Jump to the beginning of the file.
-    vertexShaderFile.seekg(0);
-    // Read shader code.
-    std::vector< char > vertexShaderBuffer(vertexFileSize);
-    vertexShaderFile.read(vertexShaderBuffer.data(), vertexFileSize);
-    // Close the file.
-    vertexShaderFile.close();
-    // Shader module creation info.
-    VkShaderModuleCreateInfo vkVertexShaderCreateInfo{};
-    vkVertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    vkVertexShaderCreateInfo.codeSize = vertexShaderBuffer.size();
-    vkVertexShaderCreateInfo.pCode = reinterpret_cast< const uint32_t* >(vertexShaderBuffer.data());
-    // Create a vertex shader module.
-    VkShaderModule vkVertexShaderModule;
-    if (vkCreateShaderModule(vkDevice, &vkVertexShaderCreateInfo, nullptr, &vkVertexShaderModule) != VK_SUCCESS) {
-        std::cerr << "Failed to create a shader!" << std::endl;
+#else
+    if (vkCreateInstance(&vkCreateInfo, vkAllocator, &vkInstance) != VK_SUCCESS) {
+        std::cerr << "Failed to creae a Vulkan instance!";
         abort();
     }
+#endif
 
-    // --------------------------------------------------------------------------
-    // Create a fragment shader module.
-    // --------------------------------------------------------------------------
+    // ==========================================================================
+    //                    STEP 6: Create a window surface
+    // ==========================================================================
+    // Surface is an abstraction that works with the window system of your OS.
+    // Athough it is possible to use platform-dependent calls to create
+    // a surface, GLFW provides us a way to do this platform-agnostic.
+    // ==========================================================================
 
-    // Open file.
-    std::ifstream fragmentShaderFile("main.frag.spv", std::ios::ate | std::ios::binary);
-    if (!fragmentShaderFile.is_open()) {
-        std::cerr << "Fragment shader file not found!" << std::endl;
-        abort();
-    }
-    // Calculate file size.
-    size_t fragmentFileSize = static_cast< size_t >(fragmentShaderFile.tellg());
-    // Jump to the beginning of the file.
-    fragmentShaderFile.seekg(0);
-    // Read shader code.
-    std::vector< char > fragmentShaderBuffer(fragmentFileSize);
-    fragmentShaderFile.read(fragmentShaderBuffer.data(), fragmentFileSize);
-    // Close the file.
-    fragmentShaderFile.close();
-    // Shader module creation info.
-    VkShaderModuleCreateInfo vkFragmentShaderCreateInfo{};
-    vkFragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    vkFragmentShaderCreateInfo.codeSize = fragmentShaderBuffer.size();
-    vkFragmentShaderCreateInfo.pCode = reinterpret_cast< const uint32_t* >(fragmentShaderBuffer.data());
-    // Create a fragment shader module.
-    VkShaderModule vkFragmentShaderModule;
-    if (vkCreateShaderModule(vkDevice, &vkFragmentShaderCreateInfo, nullptr, &vkFragmentShaderModule) != VK_SUCCESS) {
-        std::cerr << "Failed to create a shader!" << std::endl;
+    VkSurfaceKHR vkSurface;
+    if (glfwCreateWindowSurface(vkInstance, glfwWindow, vkAllocator, &vkSurface) != VK_SUCCESS) {
+        std::cerr << "Failed to create a surface!" << std::endl;
         abort();
     }
 
-    // --------------------------------------------------------------------------
-
-    // Create a pipeline stage for a vertex shader.
-    VkPipelineShaderStageCreateInfo vkVertShaderStageInfo{};
-    vkVertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vkVertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vkVertShaderStageInfo.module = vkVertexShaderModule;
-    // main function name
-    vkVertShaderStageInfo.pName = "main";
-
-    // Create a pipeline stage for a fragment shader.
-    VkPipelineShaderStageCreateInfo vkFragShaderStageInfo{};
-    vkFragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vkFragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    vkFragShaderStageInfo.module = vkFragmentShaderModule;
-    // main function name
-    vkFragShaderStageInfo.pName = "main";
-
-    // Put both shader modules into an array.
-    std::array< VkPipelineShaderStageCreateInfo, 2 > shaderStages {
-        vkVertShaderStageInfo,
-        vkFragShaderStageInfo
-    };
+#ifdef DEBUG_MODE
 
     // ==========================================================================
-    //                    STEP 17: Describe a vertex buffer
+    //                    STEP 7: Attach a message handler
     // ==========================================================================
-    // Vertex buffers provide vertices to shaders. In our case this is a geometry
-    // of a cube. First of all we have to describe the buffer pointint out to
-    // how struct data is bound into shader variables.
+    // Attach a message handler to the Vulkan context in order to see
+    // debug messages and warnings.
     // ==========================================================================
 
-    // Structure that represents a vertex of a cube.
-    struct Vertex
-    {
-        // 3D coordinates of the vertex.
-        glm::vec3 pos;
-        // Color of the vertex.
-        glm::vec3 color;
-    };
-
-    // Binding descriptor specifies how our array is splited into vertices.
-    // In particular, we say that each sizeof(Vertex) bytes correspond to one vertex.
-    VkVertexInputBindingDescription vkBindingDescription{};
-    vkBindingDescription.binding = 0;
-    vkBindingDescription.stride = sizeof(Vertex);
-    vkBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    // Since vkCreateDebugUtilsMessengerEXT is a function of an extension,
+    // it is not explicitly declared in Vulkan header, because if we do not load
+    // validation layers, it does not exist.
+    // First of all we have to obtain a pointer to the function.
+    auto vkCreateDebugUtilsMessengerEXT = reinterpret_cast< PFN_vkCreateDebugUtilsMessengerEXT >(vkGetInstanceProcAddr(vkInstance, "vkCreateDebugUtilsMessengerEXT"));
+    if (vkCreateDebugUtilsMessengerEXT == nullptr) {
+        std::cerr << "Function vkCreateDebugUtilsMessengerEXT not found!";
+        abort();
+    }
 
-    // Attribute description specifies how one vertext is split into separate variables.
-    // In our case a vertext is a composition of two vec3 values: coordinates and color.
-    // Property location corresponds to a location value in shader code.
-    std::array< VkVertexInputAttributeDescription, 2 > vkAttributeDescriptions{};
-    // Description of the first attribute (coordinates).
-    vkAttributeDescriptions[0].binding = 0;
-    vkAttributeDescriptions[0].location = 0;
-    vkAttributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    vkAttributeDescriptions[0].offset = offsetof(Vertex, pos);
-    // Description of the second attribute (color).
-    vkAttributeDescriptions[1].binding = 0;
-    vkAttributeDescriptions[1].location = 1;
-    vkAttributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    vkAttributeDescriptions[1].offset = offsetof(Vertex, color);
+    // Create a messenger.
+    VkDebugUtilsMessengerEXT vkDebugMessenger;
+    vkCreateDebugUtilsMessengerEXT(vkInstance, &vkMessangerCreateInfo, vkAllocator, &vkDebugMessenger);
 
-    // Create a vertex input state for pipeline creation.
-    VkPipelineVertexInputStateCreateInfo vkVertexInputInfo{};
-    vkVertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vkVertexInputInfo.vertexBindingDescriptionCount = 1;
-    vkVertexInputInfo.pVertexBindingDescriptions = &vkBindingDescription;
-    vkVertexInputInfo.vertexAttributeDescriptionCount = static_cast< uint32_t >(vkAttributeDescriptions.size());
-    vkVertexInputInfo.pVertexAttributeDescriptions = vkAttributeDescriptions.data();
+#endif
 
     // ==========================================================================
-    //                    STEP 18: Create a vertex buffer
+    //                      STEP 8: Pick a physical device
     // ==========================================================================
-    // Vertex buffer contains vertices of our model we want to pass
-    // to the vertex shader.
+    // Physical devices correspond to graphical cards available in the system.
+    // Before we continue, we should make sure the graphical card is suitable
+    // for our needs and in case there is more than one card
+    // in the system - select one of them.
+    // We are going to perform some tests and fetch device information that
+    // we will need after. So, to not request this information twice,
+    // we will fill some structures declared below for the selected
+    // physical device and use them in the rest of code.
     // ==========================================================================
 
-    // Create a cube specifying its vertices.
-    // Each triplet of vertices represent one triangle.
-    // We do not use index buffer, so some vertices are duplicated.
-    // Each plane has its own color.
-    std::vector< Vertex > vertices
+    // --------------------------------------------------------------------------
+    //                    Information about selected device
+    // --------------------------------------------------------------------------
+    // Here we will store a selected physical device.
+    VkPhysicalDevice vkPhysicalDevice = VK_NULL_HANDLE;
+    // Here we store information about queues supported by the selected physical device.
+    // For our simple application device should support two queues:
+    struct QueueFamilyIndices
     {
-        { { -0.5f, -0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
-        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
-        { {  0.5f, -0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
-        { {  0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
-        { {  0.5f, -0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
-        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+        // Graphics queue processes rendering requests and stores result into Vulkan images.
+        std::optional< uint32_t > graphicsFamily;
+        // Present queue tranfers images to the surface.
+        std::optional< uint32_t > presentFamily;
+    };
+    QueueFamilyIndices queueFamilyIndices;
+    // Here we take information about a swap chain.
+    struct SwapChainSupportDetails {
+        VkSurfaceCapabilitiesKHR capabilities;
+        std::vector< VkSurfaceFormatKHR > formats;
+        std::vector< VkPresentModeKHR > presentModes;
+    };
+    SwapChainSupportDetails swapChainSupportDetails;
+    // Here we keep a selected format for z-buffer.
+    VkFormat vkDepthFormat = VK_FORMAT_UNDEFINED;
+    // Here we keep properties of the selected device to not request them again.
+    VkPhysicalDeviceProperties vkPhysicalDeviceProperties;
+    // Here we keep what the selected device can do beyond v1.0.
+    // Everything that depends on the API version or optional features
+    // should branch on this structure instead of asking the driver again.
+    struct DeviceCapabilities {
+        // Version used with the device: the lowest of instance and device versions.
+        uint32_t apiVersion = VK_API_VERSION_1_0;
+        // Optional features of v1.0.
+        bool multiDrawIndirect = false;
+        bool pipelineStatisticsQuery = false;
+        // Features of v1.2.
+        bool timelineSemaphore = false;
+        bool descriptorIndexing = false;
+        bool bufferDeviceAddress = false;
+        // Features of v1.3.
+        bool synchronization2 = false;
+        bool dynamicRendering = false;
+        // Features of extensions that are checked only if the device lists them.
+        bool graphicsPipelineLibrary = false;
+        bool extendedDynamicState = false;
+        // Valid bits of timestamps written by the graphics queue, 0 if there are none.
+        uint32_t timestampValidBits = 0;
+        // Memory types and heaps, asked for once the device is selected.
+        VkPhysicalDeviceMemoryProperties memoryProperties{};
+        // Transient attachments may be backed by memory allocated on first use.
+        bool lazilyAllocatedMemory = false;
+    };
+    DeviceCapabilities deviceCapabilities;
+    // --------------------------------------------------------------------------
 
-        { { -0.5f, -0.5f, -0.5f }, { 1.0f, 1.0f, 0.0f } },
-        { { -0.5f, -0.5f,  0.5f }, { 1.0f, 1.0f, 0.0f } },
-        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 1.0f, 0.0f } },
-        { { -0.5f,  0.5f,  0.5f }, { 1.0f, 1.0f, 0.0f } },
-        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 1.0f, 0.0f } },
-        { { -0.5f, -0.5f,  0.5f }, { 1.0f, 1.0f, 0.0f } },
+    // Desired extensions that should be supported by the graphical card.
+    const std::vector< const char* > desiredDeviceExtensions = {
+        // Swap chain extension is needed for drawing.
+        // Any graphical card that aims to draw into a framebuffer
+        // should support this extension.
+        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+#ifdef GRAPHICS_PIPELINE_LIBRARY
+        // Pipelines are linked from separately compiled parts.
+        VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+        VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+#endif
+#ifdef EXTENDED_DYNAMIC_STATE
+        // Render states are set in command buffers.
+        VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME,
+#endif
+    };
 
-        { {  0.5f, -0.5f,  0.5f }, { 1.0f, 1.0f, 1.0f } },
-        { {  0.5f, -0.5f, -0.5f }, { 1.0f, 1.0f, 1.0f } },
-        { {  0.5f,  0.5f,  0.5f }, { 1.0f, 1.0f, 1.0f } },
-        { {  0.5f,  0.5f, -0.5f }, { 1.0f, 1.0f, 1.0f } },
-        { {  0.5f,  0.5f,  0.5f }, { 1.0f, 1.0f, 1.0f } },
-        { {  0.5f, -0.5f, -0.5f }, { 1.0f, 1.0f, 1.0f } },
+    // Formats of the depth buffer tested by TEST 4 in the order of preference.
+    // Floating point formats go first: reversed depth (see STEP 29)
+    // keeps precision uniform only if depth is stored as a float.
+    const std::vector< VkFormat > depthFormatCandidates = {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_D32_SFLOAT_S8_UINT,
+        VK_FORMAT_D24_UNORM_S8_UINT
+    };
 
-        { { -0.5f,  0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
-        { { -0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
-        { {  0.5f,  0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
-        { {  0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
-        { {  0.5f,  0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
-        { { -0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
+    // Get a list of available physical devices.
+    uint32_t vkDeviceCount = 0;
+    vkEnumeratePhysicalDevices(vkInstance, &vkDeviceCount, nullptr);
+    if (vkDeviceCount == 0) {
+        std::cerr << "No physical devices!" << std::endl;
+        abort();
+    }
+    std::vector< VkPhysicalDevice > vkDevices(vkDeviceCount);
+    vkEnumeratePhysicalDevices(vkInstance, &vkDeviceCount, vkDevices.data());
 
-        { {  0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 1.0f } },
-        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 1.0f } },
-        { {  0.5f,  0.5f,  0.5f }, { 1.0f, 0.0f, 1.0f } },
-        { { -0.5f,  0.5f,  0.5f }, { 1.0f, 0.0f, 1.0f } },
-        { {  0.5f,  0.5f,  0.5f }, { 1.0f, 0.0f, 1.0f } },
-        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 1.0f } },
+#ifdef DEVICE_CACHE
 
-        { { -0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 1.0f } },
-        { { -0.5f, -0.5f, -0.5f }, { 0.0f, 1.0f, 1.0f } },
-        { {  0.5f, -0.5f, -0.5f }, { 0.0f, 1.0f, 1.0f } },
-        { { -0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 1.0f } },
-        { {  0.5f, -0.5f, -0.5f }, { 0.0f, 1.0f, 1.0f } },
-        { {  0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 1.0f } },
+    // --------------------------------------------------------------------------
+    //                      Load cached device capabilities
+    // --------------------------------------------------------------------------
+    // Capabilities of a physical device do not change until the driver is
+    // updated, so the results of the tests below are stored in a file and
+    // reused on the next start instead of asking the driver again.
+    // Everything that depends on the surface is still queried each time.
+    // --------------------------------------------------------------------------
+
+    // A record of the cache file that describes one physical device.
+    struct DeviceCapabilityRecord
+    {
+        // The device is identified by its vendor, model and driver version.
+        // The pipeline cache UUID is the only device UUID available in Vulkan 1.0.
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        // Hashes of desired device extensions and depth format candidates
+        // the record has been made for.
+        uint32_t desiredExtensionsHash;
+        uint32_t depthFormatCandidatesHash;
+        // Result of TEST 1.
+        uint32_t allExtensionsAvailable;
+        // Amount of queue families and the index of the graphics one for TEST 2.
+        // If there is no graphics family, graphicsFamily is UINT32_MAX.
+        uint32_t queueFamilyCount;
+        uint32_t graphicsFamily;
+        // Valid timestamp bits of the graphics family.
+        uint32_t timestampValidBits;
+        // Result of TEST 4.
+        VkFormat depthFormat;
+        // Results of TEST 5 that need a query of extensions and features.
+        // The API version used with the device decides which features are queried.
+        uint32_t apiVersion;
+        uint32_t timelineSemaphore;
+        uint32_t descriptorIndexing;
+        uint32_t bufferDeviceAddress;
+        uint32_t synchronization2;
+        uint32_t dynamicRendering;
+        uint32_t graphicsPipelineLibrary;
+        uint32_t extendedDynamicState;
     };
 
-    // Calculate buffer size.
-    VkDeviceSize vertexBufferSize = sizeof(vertices[0]) * vertices.size();
+    // Add bytes to a FNV-1a hash.
+    auto hashBytes = [](uint32_t hash, const void* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ static_cast< const uint8_t* >(data)[i]) * 16777619u;
+        }
+        return hash;
+    };
 
-    // Describe a buffer.
-    VkBufferCreateInfo vkVertexBufferInfo{};
-    vkVertexBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    vkVertexBufferInfo.size = vertexBufferSize;
-    vkVertexBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    vkVertexBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    // Calculate hashes of the desired extension list and of the depth format
+    // candidates, so changing a list invalidates cached results of TEST 1 and TEST 4.
+    uint32_t desiredExtensionsHash = 2166136261u;
+    for (auto extension : desiredDeviceExtensions) {
+        // Hash the terminating zero as well to separate names.
+        desiredExtensionsHash = hashBytes(desiredExtensionsHash, extension, std::strlen(extension) + 1);
+    }
+    uint32_t depthFormatCandidatesHash = hashBytes(2166136261u, depthFormatCandidates.data(), sizeof(VkFormat) * depthFormatCandidates.size());
+
+    // Check if a record has been made for a device with the same driver by a build
+    // with the same desired extensions, depth format candidates and API version.
+    auto deviceCacheRecordMatches = [&](const DeviceCapabilityRecord& record, const VkPhysicalDeviceProperties& properties) {
+        return record.vendorID == properties.vendorID &&
+               record.deviceID == properties.deviceID &&
+               record.driverVersion == properties.driverVersion &&
+               record.desiredExtensionsHash == desiredExtensionsHash &&
+               record.depthFormatCandidatesHash == depthFormatCandidatesHash &&
+               record.apiVersion == std::min(vkAppInfo.apiVersion, properties.apiVersion) &&
+               std::memcmp(record.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    };
 
-    // Create a buffer.
-    VkBuffer vkVertexBuffer;
-    if (vkCreateBuffer(vkDevice, &vkVertexBufferInfo, nullptr, &vkVertexBuffer) != VK_SUCCESS) {
-        std::cerr << "Failed to create a vertex buffer!" << std::endl;
-        abort();
+    // Read the cache file.
+    // The file starts with a signature, a format version and an amount of records.
+    // If anything does not match, the cache is ignored and rebuilt from scratch.
+    std::vector< DeviceCapabilityRecord > deviceCapabilityCache;
+    bool deviceCapabilityCacheChanged = false;
+    std::ifstream deviceCacheInputFile(DEVICE_CACHE_FILE_NAME, std::ios::binary);
+    if (deviceCacheInputFile.is_open()) {
+        std::array< uint32_t, 3 > deviceCacheHeader{};
+        deviceCacheInputFile.read(reinterpret_cast< char* >(deviceCacheHeader.data()), sizeof(deviceCacheHeader));
+        if (deviceCacheInputFile &&
+                deviceCacheHeader[0] == DEVICE_CACHE_MAGIC &&
+                deviceCacheHeader[1] == DEVICE_CACHE_VERSION &&
+                deviceCacheHeader[2] <= DEVICE_CACHE_MAX_RECORDS) {
+            deviceCapabilityCache.resize(deviceCacheHeader[2]);
+            deviceCacheInputFile.read(reinterpret_cast< char* >(deviceCapabilityCache.data()), sizeof(DeviceCapabilityRecord) * deviceCapabilityCache.size());
+            if (!deviceCacheInputFile) {
+                deviceCapabilityCache.clear();
+            }
+        }
+        deviceCacheInputFile.close();
     }
 
-    // Retrieve memory requirements for the vertex buffer.
-    VkMemoryRequirements vkVertexBufferMemRequirements;
-    vkGetBufferMemoryRequirements(vkDevice, vkVertexBuffer, &vkVertexBufferMemRequirements);
+#endif
 
-    // Define memory allocate info.
-    VkMemoryAllocateInfo vkVertexBufferAllocInfo{};
-    vkVertexBufferAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    vkVertexBufferAllocInfo.allocationSize = vkVertexBufferMemRequirements.size;
-    // Find a suitable memory type.
-    uint32_t bufferMemTypeIndex = UINT32_MAX;
-    VkMemoryPropertyFlags vkBufferMemFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    VkPhysicalDeviceMemoryProperties vkBufferMemProperties;
-    vkGetPhysicalDeviceMemoryProperties(vkPhysicalDevice, &vkBufferMemProperties);
-    for (uint32_t i = 0; i < vkBufferMemProperties.memoryTypeCount; i++) {
-        if ((vkVertexBufferMemRequirements.memoryTypeBits & (1 << i)) &&
-                (vkBufferMemProperties.memoryTypes[i].propertyFlags & vkBufferMemFlags) == vkBufferMemFlags) {
-            bufferMemTypeIndex = i;
-            break;
+    // Fill capabilities of a physical device.
+    // All feature structures are queried by a single call with a pNext chain.
+    // A structure may be put into the chain only if its version is supported
+    // by both the instance and the device, or its extension is listed.
+    // Extensions are the ones TEST 1 has already enumerated.
+    auto queryDeviceCapabilities = [&](VkPhysicalDevice device, const VkPhysicalDeviceProperties& properties, const VkPhysicalDeviceFeatures& features,
+            const std::vector< VkExtensionProperties >& extensions) {
+        DeviceCapabilities capabilities;
+        capabilities.apiVersion = std::min(vkAppInfo.apiVersion, properties.apiVersion);
+        capabilities.multiDrawIndirect = (features.multiDrawIndirect == VK_TRUE);
+        capabilities.pipelineStatisticsQuery = (features.pipelineStatisticsQuery == VK_TRUE);
+        // vkGetPhysicalDeviceFeatures2() is not available in v1.0.
+        if (capabilities.apiVersion < VK_API_VERSION_1_1) {
+            return capabilities;
         }
-    }
-    vkVertexBufferAllocInfo.memoryTypeIndex = bufferMemTypeIndex;
-    // Allocate memory for the vertex buffer.
-    VkDeviceMemory vkVertexBufferMemory;
-    if (vkAllocateMemory(vkDevice, &vkVertexBufferAllocInfo, nullptr, &vkVertexBufferMemory) != VK_SUCCESS) {
-        std::cerr << "Failed to allocate memroy for the vertex buffer!" << std::endl;
-        abort();
-    }
 
-    // Bind the buffer to the allocated memory.
-    vkBindBufferMemory(vkDevice, vkVertexBuffer, vkVertexBufferMemory, 0);
+        auto hasExtension = [&](const char* name) {
+            for (const auto& extension : extensions) {
+                if (std::strcmp(extension.extensionName, name) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        };
 
-    // Copy our vertices to the allocated memory.
-    void* vertexBufferMemoryData;
-    vkMapMemory(vkDevice, vkVertexBufferMemory, 0, vertexBufferSize, 0, &vertexBufferMemoryData);
-    memcpy(vertexBufferMemoryData, vertices.data(), (size_t) vertexBufferSize);
-    vkUnmapMemory(vkDevice, vkVertexBufferMemory);
+        VkPhysicalDeviceFeatures2 vkFeatures2{};
+        vkFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        VkPhysicalDeviceVulkan12Features vk12Features{};
+        vk12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceVulkan13Features vk13Features{};
+        vk13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT vkLibraryFeatures{};
+        vkLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        VkPhysicalDeviceExtendedDynamicStateFeaturesEXT vkDynamicStateFeatures{};
+        vkDynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+
+        // Every structure is put in front of the chain.
+        if (capabilities.apiVersion >= VK_API_VERSION_1_2) {
+            vk12Features.pNext = vkFeatures2.pNext;
+            vkFeatures2.pNext = &vk12Features;
+        }
+        if (capabilities.apiVersion >= VK_API_VERSION_1_3) {
+            vk13Features.pNext = vkFeatures2.pNext;
+            vkFeatures2.pNext = &vk13Features;
+        }
+        if (hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+            vkLibraryFeatures.pNext = vkFeatures2.pNext;
+            vkFeatures2.pNext = &vkLibraryFeatures;
+        }
+        if (hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+            vkDynamicStateFeatures.pNext = vkFeatures2.pNext;
+            vkFeatures2.pNext = &vkDynamicStateFeatures;
+        }
+        vkGetPhysicalDeviceFeatures2(device, &vkFeatures2);
+
+        // Structures that were not in the chain stay zeroed.
+        capabilities.timelineSemaphore = (vk12Features.timelineSemaphore == VK_TRUE);
+        capabilities.descriptorIndexing = (vk12Features.descriptorIndexing == VK_TRUE);
+        capabilities.bufferDeviceAddress = (vk12Features.bufferDeviceAddress == VK_TRUE);
+        capabilities.synchronization2 = (vk13Features.synchronization2 == VK_TRUE);
+        capabilities.dynamicRendering = (vk13Features.dynamicRendering == VK_TRUE);
+        capabilities.graphicsPipelineLibrary = (vkLibraryFeatures.graphicsPipelineLibrary == VK_TRUE);
+        capabilities.extendedDynamicState = (vkDynamicStateFeatures.extendedDynamicState == VK_TRUE);
+        return capabilities;
+    };
 
-    // ==========================================================================
-    //               STEP 19: Create a pipeline assembly state
-    // ==========================================================================
-    // Pipeline assembly state describes a geometry of the input data.
-    // In our case the input is a list of triangles.
-    // ==========================================================================
+    // Go through the list of physical device and select the first suitable one.
+    // In advanced applications you may introduce a rating to choose
+    // the best video card or let the user select one manually.
+    for (auto device : vkDevices) {
+        // Get properties of the physical device.
+        VkPhysicalDeviceProperties vkDeviceProperties;
+        vkGetPhysicalDeviceProperties(device, &vkDeviceProperties);
 
-    VkPipelineInputAssemblyStateCreateInfo vkInputAssembly{};
-    vkInputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    vkInputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    vkInputAssembly.primitiveRestartEnable = VK_FALSE;
+        // Get features of the physical device.
+        VkPhysicalDeviceFeatures vkDeviceFeatures;
+        vkGetPhysicalDeviceFeatures(device, &vkDeviceFeatures);
+
+#ifdef DEVICE_CACHE
+
+        // Look for the device in the cache.
+        const DeviceCapabilityRecord* cachedCapabilities = nullptr;
+        for (const auto& record : deviceCapabilityCache) {
+            if (deviceCacheRecordMatches(record, vkDeviceProperties)) {
+                cachedCapabilities = &record;
+                break;
+            }
+        }
+
+#endif
+
+        // ---------------------------------------------------
+        // TEST 1: Check if all desired extensions are present
+        // ---------------------------------------------------
+
+        bool allExtensionsAvailable;
+        // Extensions available for the physical device, also used by TEST 5.
+        std::vector< VkExtensionProperties > vkAvailableExtensions;
+#ifdef DEVICE_CACHE
+        if (cachedCapabilities != nullptr) {
+            allExtensionsAvailable = (cachedCapabilities->allExtensionsAvailable != 0);
+        } else
+#endif
+        {
+            // Get extensions available for the physical device.
+            uint32_t vkExtensionCount;
+            vkEnumerateDeviceExtensionProperties(device, nullptr, &vkExtensionCount, nullptr);
+            vkAvailableExtensions.resize(vkExtensionCount);
+            vkEnumerateDeviceExtensionProperties(device, nullptr, &vkExtensionCount, vkAvailableExtensions.data());
+
+            // Get list of extensions and compare it to desired one.
+            std::set< std::string > requiredExtensions(desiredDeviceExtensions.begin(), desiredDeviceExtensions.end());
+            for (const auto& extension : vkAvailableExtensions) {
+                requiredExtensions.erase(extension.extensionName);
+            }
+            allExtensionsAvailable = requiredExtensions.empty();
+        }
+
+        // ----------------------------------------------------------
+        // TEST 2: Check if all required queue families are supported
+        // ----------------------------------------------------------
+
+        // Get list of available queue families.
+        uint32_t vkQueueFamilyCount = 0;
+        std::vector< VkQueueFamilyProperties > vkQueueFamilies;
+#ifdef DEVICE_CACHE
+        if (cachedCapabilities != nullptr) {
+            vkQueueFamilyCount = cachedCapabilities->queueFamilyCount;
+        } else
+#endif
+        {
+            vkGetPhysicalDeviceQueueFamilyProperties(device, &vkQueueFamilyCount, nullptr);
+            vkQueueFamilies.resize(vkQueueFamilyCount);
+            vkGetPhysicalDeviceQueueFamilyProperties(device, &vkQueueFamilyCount, vkQueueFamilies.data());
+        }
+
+        // Fill in QueueFamilyIndices structure to check that all required queue families are present.
+        QueueFamilyIndices currentDeviceQueueFamilyIndices;
+        // Timestamp support of the graphics family is kept for TEST 5.
+        uint32_t currentTimestampValidBits = 0;
+        for (uint32_t i = 0; i < vkQueueFamilyCount; i++) {
+#ifdef DEVICE_CACHE
+            // Take the graphics family from the cache.
+            if (cachedCapabilities != nullptr) {
+                if (cachedCapabilities->graphicsFamily == i) {
+                    currentDeviceQueueFamilyIndices.graphicsFamily = i;
+                    currentTimestampValidBits = cachedCapabilities->timestampValidBits;
+                }
+            } else
+#endif
+            {
+                // Take a queue family.
+                const auto& queueFamily = vkQueueFamilies[i];
+
+                // Check if this is a graphics family.
+                if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                    currentDeviceQueueFamilyIndices.graphicsFamily = i;
+                    currentTimestampValidBits = queueFamily.timestampValidBits;
+                }
+            }
+
+            // Check if it supports presentation.
+            // Note that graphicsFamily and presentFamily may refer to the same queue family
+            // for some video cards and we should be ready to this.
+            VkBool32 vkPresentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, vkSurface, &vkPresentSupport);
+            if (vkPresentSupport) {
+                currentDeviceQueueFamilyIndices.presentFamily = i;
+            }
+        }
+        bool queuesOk = currentDeviceQueueFamilyIndices.graphicsFamily.has_value() &&
+                        currentDeviceQueueFamilyIndices.presentFamily.has_value();
+
+        // ---------------------------------------------------------
+        // TEST 3: Check if the swap chain supports required formats
+        // ---------------------------------------------------------
+
+        // Fill swap chain information into a SwapChainSupportDetails structure.
+        SwapChainSupportDetails currenDeviceSwapChainDetails;
+        // We should do this only in case the device supports swap buffer.
+        // To avoid extra flags and more complex logic, just make sure that all
+        // desired extensions have been found.
+        if (allExtensionsAvailable) {
+            // Get surface capabilities.
+            vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, vkSurface, &currenDeviceSwapChainDetails.capabilities);
+            // Get supported formats.
+            uint32_t vkPhysicalDeviceFormatCount;
+            vkGetPhysicalDeviceSurfaceFormatsKHR(device, vkSurface, &vkPhysicalDeviceFormatCount, nullptr);
+            if (vkPhysicalDeviceFormatCount != 0) {
+                currenDeviceSwapChainDetails.formats.resize(vkPhysicalDeviceFormatCount);
+                vkGetPhysicalDeviceSurfaceFormatsKHR(device, vkSurface, &vkPhysicalDeviceFormatCount, currenDeviceSwapChainDetails.formats.data());
+            }
+            // Get supported present modes.
+            uint32_t vkPhysicalDevicePresentModeCount;
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device, vkSurface, &vkPhysicalDevicePresentModeCount, nullptr);
+            if (vkPhysicalDevicePresentModeCount != 0) {
+                currenDeviceSwapChainDetails.presentModes.resize(vkPhysicalDevicePresentModeCount);
+                vkGetPhysicalDeviceSurfacePresentModesKHR(device, vkSurface, &vkPhysicalDevicePresentModeCount, currenDeviceSwapChainDetails.presentModes.data());
+            }
+        }
+        bool swapChainOk = !currenDeviceSwapChainDetails.formats.empty() &&
+                           !currenDeviceSwapChainDetails.presentModes.empty();
+
+        // ----------------------------------------------
+        // TEST 4: Check if the depth buffer is avaialble
+        // ----------------------------------------------
+
+        // Select a format of depth buffer.
+        // We have a list of formats we need to test and pick one.
+        VkFormat currentDepthFormat = VK_FORMAT_UNDEFINED;
+#ifdef DEVICE_CACHE
+        if (cachedCapabilities != nullptr) {
+            currentDepthFormat = cachedCapabilities->depthFormat;
+        } else
+#endif
+        {
+            for (VkFormat format : depthFormatCandidates) {
+                VkFormatProperties vkProps;
+                vkGetPhysicalDeviceFormatProperties(device, format, &vkProps);
+                if (vkProps.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+                    currentDepthFormat = format;
+                    break;
+                }
+            }
+        }
+        bool depthFormatOk = (currentDepthFormat != VK_FORMAT_UNDEFINED);
+
+        // ----------------------------------------------------
+        // TEST 5: Check if all required features are supported
+        // ----------------------------------------------------
+
+        DeviceCapabilities currentDeviceCapabilities;
+#ifdef DEVICE_CACHE
+        if (cachedCapabilities != nullptr) {
+            currentDeviceCapabilities.apiVersion = cachedCapabilities->apiVersion;
+            currentDeviceCapabilities.multiDrawIndirect = (vkDeviceFeatures.multiDrawIndirect == VK_TRUE);
+            currentDeviceCapabilities.pipelineStatisticsQuery = (vkDeviceFeatures.pipelineStatisticsQuery == VK_TRUE);
+            currentDeviceCapabilities.timelineSemaphore = (cachedCapabilities->timelineSemaphore != 0);
+            currentDeviceCapabilities.descriptorIndexing = (cachedCapabilities->descriptorIndexing != 0);
+            currentDeviceCapabilities.bufferDeviceAddress = (cachedCapabilities->bufferDeviceAddress != 0);
+            currentDeviceCapabilities.synchronization2 = (cachedCapabilities->synchronization2 != 0);
+            currentDeviceCapabilities.dynamicRendering = (cachedCapabilities->dynamicRendering != 0);
+            currentDeviceCapabilities.graphicsPipelineLibrary = (cachedCapabilities->graphicsPipelineLibrary != 0);
+            currentDeviceCapabilities.extendedDynamicState = (cachedCapabilities->extendedDynamicState != 0);
+        } else
+#endif
+        {
+            currentDeviceCapabilities = queryDeviceCapabilities(device, vkDeviceProperties, vkDeviceFeatures, vkAvailableExtensions);
+        }
+        currentDeviceCapabilities.timestampValidBits = currentTimestampValidBits;
+        bool featuresOk = true;
+#ifdef PIPELINE_STATISTICS
+        // Pipeline statistics queries are an optional feature.
+        featuresOk = featuresOk && currentDeviceCapabilities.pipelineStatisticsQuery;
+#endif
+#ifdef DYNAMIC_RENDERING
+        // Both features are optional even in v1.3.
+        featuresOk = featuresOk && currentDeviceCapabilities.dynamicRendering && currentDeviceCapabilities.synchronization2;
+#endif
+#ifdef GRAPHICS_PIPELINE_LIBRARY
+        // The extension might be listed by a driver that does not support the feature.
+        featuresOk = featuresOk && currentDeviceCapabilities.graphicsPipelineLibrary;
+#endif
+#ifdef EXTENDED_DYNAMIC_STATE
+        featuresOk = featuresOk && currentDeviceCapabilities.extendedDynamicState;
+#endif
+
+#ifdef DEVICE_CACHE
+
+        // Remember results of the tests for the next start.
+        // A record of the same device with another driver is stale and is replaced,
+        // records of other builds of the application are kept.
+        if (cachedCapabilities == nullptr) {
+            DeviceCapabilityRecord record{};
+            record.vendorID = vkDeviceProperties.vendorID;
+            record.deviceID = vkDeviceProperties.deviceID;
+            record.driverVersion = vkDeviceProperties.driverVersion;
+            std::memcpy(record.pipelineCacheUUID, vkDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+            record.desiredExtensionsHash = desiredExtensionsHash;
+            record.depthFormatCandidatesHash = depthFormatCandidatesHash;
+            record.allExtensionsAvailable = allExtensionsAvailable ? 1 : 0;
+            record.queueFamilyCount = vkQueueFamilyCount;
+            record.graphicsFamily = currentDeviceQueueFamilyIndices.graphicsFamily.value_or(UINT32_MAX);
+            record.timestampValidBits = currentTimestampValidBits;
+            record.depthFormat = currentDepthFormat;
+            record.apiVersion = currentDeviceCapabilities.apiVersion;
+            record.timelineSemaphore = currentDeviceCapabilities.timelineSemaphore ? 1 : 0;
+            record.descriptorIndexing = currentDeviceCapabilities.descriptorIndexing ? 1 : 0;
+            record.bufferDeviceAddress = currentDeviceCapabilities.bufferDeviceAddress ? 1 : 0;
+            record.synchronization2 = currentDeviceCapabilities.synchronization2 ? 1 : 0;
+            record.dynamicRendering = currentDeviceCapabilities.dynamicRendering ? 1 : 0;
+            record.graphicsPipelineLibrary = currentDeviceCapabilities.graphicsPipelineLibrary ? 1 : 0;
+            record.extendedDynamicState = currentDeviceCapabilities.extendedDynamicState ? 1 : 0;
+            bool recordReplaced = false;
+            for (auto& oldRecord : deviceCapabilityCache) {
+                bool staleDriver = oldRecord.vendorID == record.vendorID && oldRecord.deviceID == record.deviceID &&
+                                   (oldRecord.driverVersion != record.driverVersion ||
+                                    std::memcmp(oldRecord.pipelineCacheUUID, record.pipelineCacheUUID, VK_UUID_SIZE) != 0);
+                if (staleDriver || deviceCacheRecordMatches(oldRecord, vkDeviceProperties)) {
+                    oldRecord = record;
+                    recordReplaced = true;
+                    break;
+                }
+            }
+            if (!recordReplaced) {
+                // Forget the oldest record if the cache is full.
+                if (deviceCapabilityCache.size() >= DEVICE_CACHE_MAX_RECORDS) {
+                    deviceCapabilityCache.erase(deviceCapabilityCache.begin());
+                }
+                deviceCapabilityCache.push_back(record);
+            }
+            deviceCapabilityCacheChanged = true;
+        }
+
+#endif
+
+        // Select the first suitable device.
+        if (allExtensionsAvailable && queuesOk && swapChainOk && depthFormatOk && featuresOk) {
+            vkPhysicalDevice = device;
+            queueFamilyIndices = currentDeviceQueueFamilyIndices;
+            swapChainSupportDetails = currenDeviceSwapChainDetails;
+            vkDepthFormat = currentDepthFormat;
+            vkPhysicalDeviceProperties = vkDeviceProperties;
+            deviceCapabilities = currentDeviceCapabilities;
+            break;
+        }
+    }
+
+#ifdef DEVICE_CACHE
+
+    // Save the cache if some devices have been tested for the first time.
+    // Failure to write the file is not critical - the cache is just rebuilt next time.
+    if (deviceCapabilityCacheChanged) {
+        std::ofstream deviceCacheOutputFile(DEVICE_CACHE_FILE_NAME, std::ios::binary | std::ios::trunc);
+        std::array< uint32_t, 3 > deviceCacheHeader {
+            DEVICE_CACHE_MAGIC,
+            DEVICE_CACHE_VERSION,
+            static_cast< uint32_t >(deviceCapabilityCache.size())
+        };
+        deviceCacheOutputFile.write(reinterpret_cast< const char* >(deviceCacheHeader.data()), sizeof(deviceCacheHeader));
+        deviceCacheOutputFile.write(reinterpret_cast< const char* >(deviceCapabilityCache.data()), sizeof(DeviceCapabilityRecord) * deviceCapabilityCache.size());
+        if (!deviceCacheOutputFile) {
+            std::cerr << "Failed to write the device cache!" << std::endl;
+        }
+    }
+
+#endif
+
+    // Check if we have found any suitable device.
+    if (vkPhysicalDevice == VK_NULL_HANDLE) {
+        std::cerr << "No suitable physical devices available!" << std::endl;
+        abort();
+    }
+
+    // Memory properties are needed by every allocation, so ask for them once.
+    vkGetPhysicalDeviceMemoryProperties(vkPhysicalDevice, &deviceCapabilities.memoryProperties);
+    for (uint32_t i = 0; i < deviceCapabilities.memoryProperties.memoryTypeCount; i++) {
+        if (deviceCapabilities.memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+            deviceCapabilities.lazilyAllocatedMemory = true;
+        }
+    }
+
+    // Show which fast paths the selected device allows.
+    std::ostringstream deviceCapabilitiesLine;
+    deviceCapabilitiesLine << "Vulkan " << VK_VERSION_MAJOR(deviceCapabilities.apiVersion) << "." << VK_VERSION_MINOR(deviceCapabilities.apiVersion)
+                           << " on " << vkPhysicalDeviceProperties.deviceName << ", features:"
+                           << (deviceCapabilities.multiDrawIndirect ? " multiDrawIndirect" : "")
+                           << (deviceCapabilities.pipelineStatisticsQuery ? " pipelineStatisticsQuery" : "")
+                           << (deviceCapabilities.timelineSemaphore ? " timelineSemaphore" : "")
+                           << (deviceCapabilities.descriptorIndexing ? " descriptorIndexing" : "")
+                           << (deviceCapabilities.bufferDeviceAddress ? " bufferDeviceAddress" : "")
+                           << (deviceCapabilities.synchronization2 ? " synchronization2" : "")
+                           << (deviceCapabilities.dynamicRendering ? " dynamicRendering" : "")
+                           << (deviceCapabilities.graphicsPipelineLibrary ? " graphicsPipelineLibrary" : "")
+                           << (deviceCapabilities.extendedDynamicState ? " extendedDynamicState" : "")
+                           << (deviceCapabilities.timestampValidBits != 0 ? " timestamps" : "")
+                           << (deviceCapabilities.lazilyAllocatedMemory ? " lazilyAllocatedMemory" : "");
+    logMessage(LOG_SEVERITY_INFO, 0, deviceCapabilitiesLine.str().c_str());
+
+    // ==========================================================================
+    //                   STEP 9: Create a logical device
+    // ==========================================================================
+    // Logical devices are instances of the physical device created for
+    // the particular application. We should create one in order to use it.
+    // ==========================================================================
+
+    // Logical device of a video card.
+    VkDevice vkDevice;
+
+    // As it was mentioned above, we might have two queue families referring
+    // to the same index which means there is only one family that is suitable
+    // for both needs.
+    // Use std::set to filter out duplicates as we should mention each queue
+    // only once during logical device creation.
+    std::set< uint32_t > uniqueQueueFamilies = {
+        queueFamilyIndices.graphicsFamily.value(),
+        queueFamilyIndices.presentFamily.value()
+    };
+
+    // Go through all remaining queues and make a creation info structure.
+    std::vector< VkDeviceQueueCreateInfo > queueCreateInfos;
+    float queuePriority = 1.0f;
+    for (uint32_t queueFamily : uniqueQueueFamilies) {
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = queueFamily;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &queuePriority;
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+
+    // Select physical device features we want to use.
+    // Everything found in STEP 8 is switched on, so any code path may
+    // rely on a feature as soon as deviceCapabilities reports it.
+    // If you specify something that is not supported - device
+    // creation will fail, so you should check beforehand.
+    VkPhysicalDeviceFeatures vkDeviceFeatures {};
+    vkDeviceFeatures.multiDrawIndirect = deviceCapabilities.multiDrawIndirect ? VK_TRUE : VK_FALSE;
+    vkDeviceFeatures.pipelineStatisticsQuery = deviceCapabilities.pipelineStatisticsQuery ? VK_TRUE : VK_FALSE;
+
+    // Features beyond v1.0 are switched on by structures in the pNext chain.
+    // Every structure is put in front of the chain.
+    void* vkDeviceFeaturesChain = nullptr;
+    VkPhysicalDeviceVulkan12Features vkDevice12Features{};
+    vkDevice12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vkDevice12Features.timelineSemaphore = deviceCapabilities.timelineSemaphore ? VK_TRUE : VK_FALSE;
+    vkDevice12Features.descriptorIndexing = deviceCapabilities.descriptorIndexing ? VK_TRUE : VK_FALSE;
+    vkDevice12Features.bufferDeviceAddress = deviceCapabilities.bufferDeviceAddress ? VK_TRUE : VK_FALSE;
+    if (deviceCapabilities.apiVersion >= VK_API_VERSION_1_2) {
+        vkDevice12Features.pNext = vkDeviceFeaturesChain;
+        vkDeviceFeaturesChain = &vkDevice12Features;
+    }
+    VkPhysicalDeviceVulkan13Features vkDevice13Features{};
+    vkDevice13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    vkDevice13Features.synchronization2 = deviceCapabilities.synchronization2 ? VK_TRUE : VK_FALSE;
+    vkDevice13Features.dynamicRendering = deviceCapabilities.dynamicRendering ? VK_TRUE : VK_FALSE;
+    if (deviceCapabilities.apiVersion >= VK_API_VERSION_1_3) {
+        vkDevice13Features.pNext = vkDeviceFeaturesChain;
+        vkDeviceFeaturesChain = &vkDevice13Features;
+    }
+#ifdef GRAPHICS_PIPELINE_LIBRARY
+    // Structures of extensions may be chained only if the extension is enabled.
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT vkLibraryFeatures{};
+    vkLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    vkLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+    vkLibraryFeatures.pNext = vkDeviceFeaturesChain;
+    vkDeviceFeaturesChain = &vkLibraryFeatures;
+#endif
+#ifdef EXTENDED_DYNAMIC_STATE
+    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT vkDynamicStateFeatures{};
+    vkDynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+    vkDynamicStateFeatures.extendedDynamicState = VK_TRUE;
+    vkDynamicStateFeatures.pNext = vkDeviceFeaturesChain;
+    vkDeviceFeaturesChain = &vkDynamicStateFeatures;
+#endif
+
+    // Logical device creation info.
+    VkDeviceCreateInfo vkDeviceCreateInfo {};
+    vkDeviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    vkDeviceCreateInfo.pNext = vkDeviceFeaturesChain;
+    vkDeviceCreateInfo.queueCreateInfoCount = queueCreateInfos.size();
+    vkDeviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
+    vkDeviceCreateInfo.pEnabledFeatures = &vkDeviceFeatures;
+    // Specify which extensions we want to enable.
+    vkDeviceCreateInfo.enabledExtensionCount = static_cast< uint32_t >(desiredDeviceExtensions.size());
+    vkDeviceCreateInfo.ppEnabledExtensionNames = desiredDeviceExtensions.data();
+
+#ifdef DEBUG_MODE
+
+    // Switch on all requested layers for debug mode.
+    vkDeviceCreateInfo.enabledLayerCount = static_cast< uint32_t >(desiredValidationLayers.size());
+    vkDeviceCreateInfo.ppEnabledLayerNames = desiredValidationLayers.data();
+
+#else
+
+    vkDeviceCreateInfo.enabledLayerCount = 0;
+
+#endif
+
+    // Create a logical device.
+    if (vkCreateDevice(vkPhysicalDevice, &vkDeviceCreateInfo, vkAllocator, &vkDevice) != VK_SUCCESS) {
+        std::cerr << "Failed to create a logical device!" << std::endl;
+        abort();
+    }
+
+    // --------------------------------------------------------------------------
+    // Prepare debug names and labels.
+    // --------------------------------------------------------------------------
+    // GPU captures and profilers show objects by names and group commands
+    // of command buffers by labels instead of anonymous handles. Both come
+    // from VK_EXT_debug_utils enabled in debug mode only. In release mode
+    // the functions below do nothing, so their calls are optimized out.
+    // --------------------------------------------------------------------------
+
+#ifdef DEBUG_MODE
+
+    // Functions of the extension are not exported by the loader library.
+    auto vkSetDebugUtilsObjectNameEXT = reinterpret_cast< PFN_vkSetDebugUtilsObjectNameEXT >(vkGetInstanceProcAddr(vkInstance, "vkSetDebugUtilsObjectNameEXT"));
+    auto vkCmdBeginDebugUtilsLabelEXT = reinterpret_cast< PFN_vkCmdBeginDebugUtilsLabelEXT >(vkGetInstanceProcAddr(vkInstance, "vkCmdBeginDebugUtilsLabelEXT"));
+    auto vkCmdEndDebugUtilsLabelEXT = reinterpret_cast< PFN_vkCmdEndDebugUtilsLabelEXT >(vkGetInstanceProcAddr(vkInstance, "vkCmdEndDebugUtilsLabelEXT"));
+    if (vkSetDebugUtilsObjectNameEXT == nullptr || vkCmdBeginDebugUtilsLabelEXT == nullptr || vkCmdEndDebugUtilsLabelEXT == nullptr) {
+        std::cerr << "Failed to load debug utils functions!" << std::endl;
+        abort();
+    }
+
+    // Give a name to an object. Objects of an array get their index after the name.
+    auto setDebugName = [&](VkObjectType objectType, auto handle, const char* name, size_t index = SIZE_MAX) {
+        std::string indexedName = name;
+        if (index != SIZE_MAX) {
+            indexedName += " " + std::to_string(index);
+        }
+        VkDebugUtilsObjectNameInfoEXT vkNameInfo{};
+        vkNameInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+        vkNameInfo.objectType = objectType;
+        vkNameInfo.objectHandle = reinterpret_cast< uint64_t >(handle);
+        vkNameInfo.pObjectName = indexedName.c_str();
+        vkSetDebugUtilsObjectNameEXT(vkDevice, &vkNameInfo);
+    };
+
+    // Open and close a labeled region of commands.
+    auto beginDebugLabel = [&](VkCommandBuffer commandBuffer, const char* name) {
+        VkDebugUtilsLabelEXT vkLabel{};
+        vkLabel.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+        vkLabel.pLabelName = name;
+        vkCmdBeginDebugUtilsLabelEXT(commandBuffer, &vkLabel);
+    };
+    auto endDebugLabel = [&](VkCommandBuffer commandBuffer) {
+        vkCmdEndDebugUtilsLabelEXT(commandBuffer);
+    };
+
+#else
+
+    auto setDebugName = [](VkObjectType, auto, const char*, size_t = SIZE_MAX) {};
+    auto beginDebugLabel = [](VkCommandBuffer, const char*) {};
+    auto endDebugLabel = [](VkCommandBuffer) {};
+
+#endif
+
+    setDebugName(VK_OBJECT_TYPE_DEVICE, vkDevice, "Logical device");
+
+    // ==========================================================================
+    //                   STEP 10: Select surface configuration
+    // ==========================================================================
+    // We should select surface format, present mode and extent (size) from
+    // the proposed values. They will be used in furhter calls.
+    // ==========================================================================
+
+    // Select a color format.
+    VkSurfaceFormatKHR vkSelectedFormat = swapChainSupportDetails.formats[0];
+    for (const auto& availableFormat : swapChainSupportDetails.formats) {
+        if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            vkSelectedFormat = availableFormat;
+            break;
+        }
+    }
+
+    // Select a present mode.
+    VkPresentModeKHR vkSelectedPresendMode = swapChainSupportDetails.presentModes[0];
+    for (const auto& availablePresentMode : swapChainSupportDetails.presentModes) {
+        // Preferrable mode. If we find it, break the cycle immediately.
+        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+            vkSelectedPresendMode = availablePresentMode;
+            break;
+        }
+        // Fallback mode. If we find it, store to vkSelectedPresendMode,
+        // but try to find something better.
+        if (availablePresentMode == VK_PRESENT_MODE_FIFO_KHR) {
+            vkSelectedPresendMode = availablePresentMode;
+        }
+    }
+
+    // Select a swap chain images resolution.
+    VkExtent2D vkSelectedExtent;
+    if (swapChainSupportDetails.capabilities.currentExtent.width != UINT32_MAX) {
+        vkSelectedExtent = swapChainSupportDetails.capabilities.currentExtent;
+    } else {
+        // Some window managers do not allow to use resolution different from
+        // the resolution of the window. In such cases Vulkan will report
+        // UINT32_MAX as currentExtent.width and currentExtent.height.
+        vkSelectedExtent = { WINDOW_WIDTH, WINDOW_HEIGHT };
+        // Make sure the value is between minImageExtent.width and maxImageExtent.width.
+        vkSelectedExtent.width = std::max(
+                    swapChainSupportDetails.capabilities.minImageExtent.width,
+                    std::min(
+                        swapChainSupportDetails.capabilities.maxImageExtent.width,
+                        vkSelectedExtent.width
+                        )
+                    );
+        // Make sure the value is between minImageExtent.height and maxImageExtent.height.
+        vkSelectedExtent.height = std::max(
+                    swapChainSupportDetails.capabilities.minImageExtent.height,
+                    std::min(
+                        swapChainSupportDetails.capabilities.maxImageExtent.height,
+                        vkSelectedExtent.height
+                        )
+                    );
+    }
+
+    // ==========================================================================
+    //                     STEP 11: Create a swap chain
+    // ==========================================================================
+    // Swap chain is a chain of rendered images that are going to be displayed
+    // on the screen. It is used to synchronize image rendering with refresh
+    // rate of the screen (VSync). If the application generates frames faster
+    // than they are displayed, it should wait.
+    // ==========================================================================
+
+    // First of all we should select a size of the swap chain.
+    // It is recommended to use minValue + 1 unless the amount is configured,
+    // but we also have to make sure it is within minValue and maxValue.
+    // If maxValue is zero, it means there is no upper bound.
+#if defined(SWAPCHAIN_IMAGES)
+    uint32_t imageCount = SWAPCHAIN_IMAGES;
+#elif defined(SWAPCHAIN_IMAGES_AUTO)
+    // Start with the smallest amount. The main loop adds images while
+    // acquisition waits for them (see STEP 36).
+    uint32_t imageCount = swapChainSupportDetails.capabilities.minImageCount;
+#else
+    uint32_t imageCount = swapChainSupportDetails.capabilities.minImageCount + 1;
+#endif
+    if (imageCount < swapChainSupportDetails.capabilities.minImageCount) {
+        imageCount = swapChainSupportDetails.capabilities.minImageCount;
+    }
+    if (swapChainSupportDetails.capabilities.maxImageCount > 0 && imageCount > swapChainSupportDetails.capabilities.maxImageCount) {
+        imageCount = swapChainSupportDetails.capabilities.maxImageCount;
+    }
+
+    // Fill in swap chain create info using selected surface configuration.
+    VkSwapchainCreateInfoKHR vkSwapChainCreateInfo{};
+    vkSwapChainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    vkSwapChainCreateInfo.surface = vkSurface;
+    vkSwapChainCreateInfo.minImageCount = imageCount;
+    vkSwapChainCreateInfo.imageFormat = vkSelectedFormat.format;
+    vkSwapChainCreateInfo.imageColorSpace = vkSelectedFormat.colorSpace;
+    vkSwapChainCreateInfo.imageExtent = vkSelectedExtent;
+    vkSwapChainCreateInfo.imageArrayLayers = 1;
+    vkSwapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+#if defined(TAA) || defined(POST_PROCESSING)
+    // The result of TAA or post-processing is blitted into swap chain images (see STEP 33).
+    VkFormatProperties vkSwapChainFormatProperties;
+    vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice, vkSelectedFormat.format, &vkSwapChainFormatProperties);
+    if (!(swapChainSupportDetails.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) ||
+            !(vkSwapChainFormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
+        std::cerr << "Swap chain images can not be written by a blit!" << std::endl;
+        abort();
+    }
+    vkSwapChainCreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+#endif
+    // We have two options for queue synchronization:
+    // - VK_SHARING_MODE_EXCLUSIVE - An image ownership should be explicitly transferred
+    //                               before using it in a differen queue. Best performance option.
+    // - VK_SHARING_MODE_CONCURRENT - Images can be used in different queues without
+    //                                explicit ownership transfer. Less performant, but simpler in implementation.
+    // If we have only one queue family - we should use VK_SHARING_MODE_EXCLUSIVE as we do not need
+    // to do any synchrnoization and can use the faster option for free.
+    // If we have two queue families - we will use VK_SHARING_MODE_CONCURRENT mode to avoid
+    // additional complexity of ownership transferring.
+    uint32_t familyIndices[] = {
+        queueFamilyIndices.graphicsFamily.value(),
+        queueFamilyIndices.presentFamily.value()
+    };
+    if (familyIndices[0] != familyIndices[1]) {
+        vkSwapChainCreateInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        vkSwapChainCreateInfo.queueFamilyIndexCount = 2;
+        vkSwapChainCreateInfo.pQueueFamilyIndices = familyIndices;
+    } else {
+        vkSwapChainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        vkSwapChainCreateInfo.queueFamilyIndexCount = 0;
+        vkSwapChainCreateInfo.pQueueFamilyIndices = nullptr;
+    }
+    vkSwapChainCreateInfo.preTransform = swapChainSupportDetails.capabilities.currentTransform;
+    vkSwapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    vkSwapChainCreateInfo.presentMode = vkSelectedPresendMode;
+    vkSwapChainCreateInfo.clipped = VK_TRUE;
+    // This option is only required if we recreate a swap chain (see SWAPCHAIN_IMAGES_AUTO in STEP 36).
+    vkSwapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+
+    // Create a swap chain.
+    VkSwapchainKHR vkSwapChain;
+    auto createSwapChain = [&]() {
+        if (vkCreateSwapchainKHR(vkDevice, &vkSwapChainCreateInfo, vkAllocator, &vkSwapChain) != VK_SUCCESS) {
+            std::cerr << "Failed to create a swap chain!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_SWAPCHAIN_KHR, vkSwapChain, "Swap chain");
+    };
+#ifndef PARALLEL_STARTUP
+    // With PARALLEL_STARTUP the swap chain is created in STEP 12.
+    createSwapChain();
+#endif
+
+    // ==========================================================================
+    //                 STEP 12: Create swap chain image views
+    // ==========================================================================
+    // After the swap chain is created, it contains Vulkan images that are
+    // used to transfer rendered picture. In order to work with images
+    // we should create image views.
+    // ==========================================================================
+
+    // Images of the swap chain and their views.
+    // They are created again when the swap chain is recreated.
+    std::vector< VkImage > vkSwapChainImages;
+    std::vector< VkImageView > vkSwapChainImageViews;
+    auto createSwapChainImageViews = [&]() {
+        // Fetch Vulkan images associated to the swap chain.
+        uint32_t vkSwapChainImageCount;
+        vkGetSwapchainImagesKHR(vkDevice, vkSwapChain, &vkSwapChainImageCount, nullptr);
+        vkSwapChainImages.resize(vkSwapChainImageCount);
+        vkGetSwapchainImagesKHR(vkDevice, vkSwapChain, &vkSwapChainImageCount, vkSwapChainImages.data());
+        for (size_t i = 0; i < vkSwapChainImages.size(); i++) {
+            setDebugName(VK_OBJECT_TYPE_IMAGE, vkSwapChainImages[i], "Swap chain image", i);
+        }
+
+        // Create image views for each image.
+        vkSwapChainImageViews.resize(vkSwapChainImageCount);
+        for (size_t i = 0; i < vkSwapChainImageCount; i++) {
+            // Image view create info.
+            VkImageViewCreateInfo createInfo{};
+            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            createInfo.image = vkSwapChainImages[i];
+            createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            createInfo.format = vkSelectedFormat.format;
+            createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            createInfo.subresourceRange.baseMipLevel = 0;
+            createInfo.subresourceRange.levelCount = 1;
+            createInfo.subresourceRange.baseArrayLayer = 0;
+            createInfo.subresourceRange.layerCount = 1;
+            // Create an image view.
+            if (vkCreateImageView(vkDevice, &createInfo, vkAllocator, &vkSwapChainImageViews[i]) != VK_SUCCESS) {
+                std::cerr << "Failed to create an image view #" << i << "!" << std::endl;
+                abort();
+            }
+            setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, vkSwapChainImageViews[i], "Swap chain image view", i);
+        }
+    };
+#ifdef PARALLEL_STARTUP
+    // Swap chain creation talks to the presentation engine, while nothing
+    // before framebuffers needs the swap chain. So create it and its image
+    // views on a worker thread while the main thread creates the descriptor
+    // set layout, buffers, shader modules, attachments, the render pass and
+    // pipelines. The result is taken in STEP 32.
+    auto swapChainTask = std::async(std::launch::async, [&]() {
+        createSwapChain();
+        createSwapChainImageViews();
+    });
+#else
+    createSwapChainImageViews();
+#endif
+
+    // ==========================================================================
+    //               STEP 13: Create a descriptor set layout
+    // ==========================================================================
+    // Descriptor set layout describes a layout for uniform variables.
+    // The pipeline is create taking into account the layout and after it is
+    // possible to attach particular values of the unifrom variables that
+    // correspond to the layout. In short, the layout descibe which uniforms
+    // are expected by the shaders.
+    // We bind a single uniform buffer object to the vertex shader, so
+    // we have only one binding.
+    // ==========================================================================
+
+    VkDescriptorSetLayoutBinding vkUboLayoutBinding{};
+    vkUboLayoutBinding.binding = 0;
+    vkUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    vkUboLayoutBinding.descriptorCount = 1;
+    vkUboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    vkUboLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayout vkDescriptorSetLayout;
+
+    VkDescriptorSetLayoutCreateInfo vkLayoutInfo{};
+    vkLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    vkLayoutInfo.bindingCount = 1;
+    vkLayoutInfo.pBindings = &vkUboLayoutBinding;
+
+    if (vkCreateDescriptorSetLayout(vkDevice, &vkLayoutInfo, vkAllocator, &vkDescriptorSetLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor set layout" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, vkDescriptorSetLayout, "Uniform descriptor set layout");
+
+    // ==========================================================================
+    //                      STEP 14: Create uniform buffers
+    // ==========================================================================
+    // Uniform buffer contains a structure that is provided to shaders
+    // as a uniform variable. In our case this is a couple of matrices.
+    // As we expect to have more than one frame rendered at the same time
+    // and we are going to update this buffer every frame, we should avoid
+    // situation when one frame reads the uniform buffer while it is
+    // being updated. So we should create one buffer per swap chain image.
+    // ==========================================================================
+
+    // Structure that we want to provide to the vertext shader.
+    struct UniformBufferObject {
+        glm::mat4 model;
+        glm::mat4 view;
+        glm::mat4 proj;
+#ifdef TAA
+        // Matrices of the previous frame to calculate motion vectors.
+        glm::mat4 previousModel;
+        glm::mat4 previousView;
+        glm::mat4 previousProj;
+        // Sub-pixel offsets in NDC added to the projection:
+        // xy - of the current frame, zw - of the previous one.
+        glm::vec4 jitter;
+#endif
+    };
+
+    // Get size of the uniform buffer.
+    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+
+    // Uniform buffers.
+    std::vector< VkBuffer > vkUniformBuffers;
+    vkUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    // Memory of uniform buffers.
+    std::vector< VkDeviceMemory > vkUniformBuffersMemory;
+    vkUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+
+    // Create one uniform buffer per frame in flight. A buffer is written
+    // only after the fence of its frame is signaled, so the GPU never reads
+    // a buffer the CPU is writing.
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        // Describe a buffer.
+        VkBufferCreateInfo vkBufferInfo{};
+        vkBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        vkBufferInfo.size = bufferSize;
+        vkBufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        vkBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        // Create a buffer.
+        if (vkCreateBuffer(vkDevice, &vkBufferInfo, vkAllocator, &vkUniformBuffers[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create a buffer!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_BUFFER, vkUniformBuffers[i], "Uniform buffer", i);
+
+        // Retrieve memory requirements for the vertex buffer.
+        VkMemoryRequirements vkMemRequirements;
+        vkGetBufferMemoryRequirements(vkDevice, vkUniformBuffers[i], &vkMemRequirements);
+
+        // Define memory allocate info.
+        VkMemoryAllocateInfo vkAllocInfo{};
+        vkAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        vkAllocInfo.allocationSize = vkMemRequirements.size;
+        // Select suitable memory type.
+        uint32_t memTypeIndex = UINT32_MAX;
+        VkMemoryPropertyFlags vkMemFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        const VkPhysicalDeviceMemoryProperties& vkMemProperties = deviceCapabilities.memoryProperties;
+        for (uint32_t i = 0; i < vkMemProperties.memoryTypeCount; i++) {
+            if ((vkMemRequirements.memoryTypeBits & (1 << i)) && (vkMemProperties.memoryTypes[i].propertyFlags & vkMemFlags) == vkMemFlags) {
+                memTypeIndex = i;
+                break;
+            }
+        }
+        vkAllocInfo.memoryTypeIndex = memTypeIndex;
+
+        // Allocate memory for the vertex buffer.
+        if (vkAllocateMemory(vkDevice, &vkAllocInfo, vkAllocator, &vkUniformBuffersMemory[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate buffer memory!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, vkUniformBuffersMemory[i], "Uniform buffer memory", i);
+
+        // Bind the buffer to the allocated memory.
+        vkBindBufferMemory(vkDevice, vkUniformBuffers[i], vkUniformBuffersMemory[i], 0);
+    }
+
+    // ==========================================================================
+    //                  STEP 15: Write descriptopr sets
+    // ==========================================================================
+    // For each unifrom buffer we have to create a descriptor set and submit
+    // the buffer data to it. Descriptor sets are created by the descriptor pool.
+    // ==========================================================================
+
+    // Define a descriptor pool size. We need one descriptor set per frame in flight.
+    VkDescriptorPoolSize vkPoolSize{};
+    vkPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    vkPoolSize.descriptorCount = static_cast< uint32_t >(MAX_FRAMES_IN_FLIGHT);
+
+    // Define descriptor pool.
+    VkDescriptorPoolCreateInfo vkDescriptorPoolInfo{};
+    vkDescriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    vkDescriptorPoolInfo.poolSizeCount = 1;
+    vkDescriptorPoolInfo.pPoolSizes = &vkPoolSize;
+    vkDescriptorPoolInfo.maxSets = static_cast< uint32_t >(MAX_FRAMES_IN_FLIGHT);
+
+    // Create descriptor pool.
+    VkDescriptorPool vkDescriptorPool;
+    if (vkCreateDescriptorPool(vkDevice, &vkDescriptorPoolInfo, vkAllocator, &vkDescriptorPool) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor pool!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, vkDescriptorPool, "Uniform descriptor pool");
+
+    // Take a descriptor set layout created above and use it for all descriptor sets.
+    std::vector< VkDescriptorSetLayout > layouts(MAX_FRAMES_IN_FLIGHT, vkDescriptorSetLayout);
+
+    // Describe allocate infor for descriptor set.
+    VkDescriptorSetAllocateInfo vkDescriptSetAllocInfo{};
+    vkDescriptSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    vkDescriptSetAllocInfo.descriptorPool = vkDescriptorPool;
+    vkDescriptSetAllocInfo.descriptorSetCount = static_cast< uint32_t >(MAX_FRAMES_IN_FLIGHT);
+    vkDescriptSetAllocInfo.pSetLayouts = layouts.data();
+
+    // Create a descriptor set.
+    std::vector< VkDescriptorSet > vkDescriptorSets;
+    vkDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateDescriptorSets(vkDevice, &vkDescriptSetAllocInfo, vkDescriptorSets.data()) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate descriptor set!" << std::endl;
+        abort();
+    }
+    for (size_t i = 0; i < vkDescriptorSets.size(); i++) {
+        setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET, vkDescriptorSets[i], "Uniform descriptor set", i);
+    }
+
+    // Write descriptors for each uniform buffer.
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        // Describe a uniform buffer info.
+        VkDescriptorBufferInfo vkBufferInfo{};
+        vkBufferInfo.buffer = vkUniformBuffers[i];
+        vkBufferInfo.offset = 0;
+        vkBufferInfo.range = sizeof(UniformBufferObject);
+
+        // Describe a descriptor set to write.
+        VkWriteDescriptorSet vkDescriptorWrite{};
+        vkDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        vkDescriptorWrite.dstSet = vkDescriptorSets[i];
+        vkDescriptorWrite.dstBinding = 0;
+        vkDescriptorWrite.dstArrayElement = 0;
+        vkDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        vkDescriptorWrite.descriptorCount = 1;
+        vkDescriptorWrite.pBufferInfo = &vkBufferInfo;
+        vkDescriptorWrite.pImageInfo = nullptr;
+        vkDescriptorWrite.pTexelBufferView = nullptr;
+
+        // Write the descriptor set.
+        vkUpdateDescriptorSets(vkDevice, 1, &vkDescriptorWrite, 0, nullptr);
+    }
+
+    // ==========================================================================
+    //                        STEP 16: Load shaders
+    // ==========================================================================
+    // Shaders are special code that is executed directly on GPU.
+    // For our simple example we use vertex and fragment shaders.
+    // Unlike OpenGL, Vulcan uses a binary format which is called SPIR-V and
+    // each shader should be compiled to this format using glslc compiler that
+    // could be found in Vulkan SDK.
+    // ==========================================================================
+
+    // Create a shader module from SPIR-V code.
+    auto createShaderModule = [&](const std::vector< char >& code, const char* fileName) {
+        // Shader module creation info.
+        VkShaderModuleCreateInfo vkShaderCreateInfo{};
+        vkShaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        vkShaderCreateInfo.codeSize = code.size();
+        vkShaderCreateInfo.pCode = reinterpret_cast< const uint32_t* >(code.data());
+        // Create a shader module.
+        VkShaderModule module;
+        if (vkCreateShaderModule(vkDevice, &vkShaderCreateInfo, vkAllocator, &module) != VK_SUCCESS) {
+            std::cerr << "Failed to create a shader!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_SHADER_MODULE, module, fileName);
+        return module;
+    };
+
+    // Read a SPIR-V file and create a shader module.
+    auto loadShaderModule = [&](const char* fileName) {
+        return createShaderModule(readShaderFile(fileName), fileName);
+    };
+    // Only shaders of optional passes are loaded this way.
+    (void) loadShaderModule;
+
+    // The code of the main shaders is kept, capture mode writes it out.
+#ifdef PARALLEL_STARTUP
+    // Take the code read in background (see STEP 1).
+    std::vector< char > vertexShaderBuffer = vertexShaderTask.get();
+    std::vector< char > fragmentShaderBuffer = fragmentShaderTask.get();
+#else
+    std::vector< char > vertexShaderBuffer = readShaderFile("main.vert.spv");
+    std::vector< char > fragmentShaderBuffer = readShaderFile("main.frag.spv");
+#endif
+    VkShaderModule vkVertexShaderModule = createShaderModule(vertexShaderBuffer, "main.vert.spv");
+    VkShaderModule vkFragmentShaderModule = createShaderModule(fragmentShaderBuffer, "main.frag.spv");
+
+    // --------------------------------------------------------------------------
+
+    // Create a pipeline stage for a vertex shader.
+    VkPipelineShaderStageCreateInfo vkVertShaderStageInfo{};
+    vkVertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vkVertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vkVertShaderStageInfo.module = vkVertexShaderModule;
+    // main function name
+    vkVertShaderStageInfo.pName = "main";
+
+    // Create a pipeline stage for a fragment shader.
+    VkPipelineShaderStageCreateInfo vkFragShaderStageInfo{};
+    vkFragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vkFragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    vkFragShaderStageInfo.module = vkFragmentShaderModule;
+    // main function name
+    vkFragShaderStageInfo.pName = "main";
+
+    // Put both shader modules into an array.
+    std::array< VkPipelineShaderStageCreateInfo, 2 > shaderStages {
+        vkVertShaderStageInfo,
+        vkFragShaderStageInfo
+    };
+
+    // ==========================================================================
+    //                    STEP 17: Describe a vertex buffer
+    // ==========================================================================
+    // Vertex buffers provide vertices to shaders. In our case this is a geometry
+    // of a cube. First of all we have to describe the buffer pointint out to
+    // how struct data is bound into shader variables.
+    // ==========================================================================
+
+    // Structure that represents a vertex of a cube.
+    struct Vertex
+    {
+        // 3D coordinates of the vertex.
+        glm::vec3 pos;
+        // Color of the vertex.
+        glm::vec3 color;
+    };
+
+    // Binding descriptor specifies how our array is splited into vertices.
+    // In particular, we say that each sizeof(Vertex) bytes correspond to one vertex.
+    VkVertexInputBindingDescription vkBindingDescription{};
+    vkBindingDescription.binding = 0;
+    vkBindingDescription.stride = sizeof(Vertex);
+    vkBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    // Attribute description specifies how one vertext is split into separate variables.
+    // In our case a vertext is a composition of two vec3 values: coordinates and color.
+    // Property location corresponds to a location value in shader code.
+    std::array< VkVertexInputAttributeDescription, 2 > vkAttributeDescriptions{};
+    // Description of the first attribute (coordinates).
+    vkAttributeDescriptions[0].binding = 0;
+    vkAttributeDescriptions[0].location = 0;
+    vkAttributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    vkAttributeDescriptions[0].offset = offsetof(Vertex, pos);
+    // Description of the second attribute (color).
+    vkAttributeDescriptions[1].binding = 0;
+    vkAttributeDescriptions[1].location = 1;
+    vkAttributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    vkAttributeDescriptions[1].offset = offsetof(Vertex, color);
+
+    // Create a vertex input state for pipeline creation.
+    VkPipelineVertexInputStateCreateInfo vkVertexInputInfo{};
+    vkVertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vkVertexInputInfo.vertexBindingDescriptionCount = 1;
+    vkVertexInputInfo.pVertexBindingDescriptions = &vkBindingDescription;
+    vkVertexInputInfo.vertexAttributeDescriptionCount = static_cast< uint32_t >(vkAttributeDescriptions.size());
+    vkVertexInputInfo.pVertexAttributeDescriptions = vkAttributeDescriptions.data();
+
+    // ==========================================================================
+    //                    STEP 18: Create a vertex buffer
+    // ==========================================================================
+    // Vertex buffer contains vertices of our model we want to pass
+    // to the vertex shader.
+    // ==========================================================================
+
+    // Create a cube specifying its vertices.
+    // Each triplet of vertices represent one triangle.
+    // We do not use index buffer, so some vertices are duplicated.
+    // Each plane has its own color.
+    std::vector< Vertex > vertices
+    {
+        { { -0.5f, -0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+        { {  0.5f, -0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+        { {  0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+        { {  0.5f, -0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+
+        { { -0.5f, -0.5f, -0.5f }, { 1.0f, 1.0f, 0.0f } },
+        { { -0.5f, -0.5f,  0.5f }, { 1.0f, 1.0f, 0.0f } },
+        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 1.0f, 0.0f } },
+        { { -0.5f,  0.5f,  0.5f }, { 1.0f, 1.0f, 0.0f } },
+        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 1.0f, 0.0f } },
+        { { -0.5f, -0.5f,  0.5f }, { 1.0f, 1.0f, 0.0f } },
+
+        { {  0.5f, -0.5f,  0.5f }, { 1.0f, 1.0f, 1.0f } },
+        { {  0.5f, -0.5f, -0.5f }, { 1.0f, 1.0f, 1.0f } },
+        { {  0.5f,  0.5f,  0.5f }, { 1.0f, 1.0f, 1.0f } },
+        { {  0.5f,  0.5f, -0.5f }, { 1.0f, 1.0f, 1.0f } },
+        { {  0.5f,  0.5f,  0.5f }, { 1.0f, 1.0f, 1.0f } },
+        { {  0.5f, -0.5f, -0.5f }, { 1.0f, 1.0f, 1.0f } },
+
+        { { -0.5f,  0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
+        { { -0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
+        { {  0.5f,  0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
+        { {  0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
+        { {  0.5f,  0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
+        { { -0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 0.0f } },
+
+        { {  0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 1.0f } },
+        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 1.0f } },
+        { {  0.5f,  0.5f,  0.5f }, { 1.0f, 0.0f, 1.0f } },
+        { { -0.5f,  0.5f,  0.5f }, { 1.0f, 0.0f, 1.0f } },
+        { {  0.5f,  0.5f,  0.5f }, { 1.0f, 0.0f, 1.0f } },
+        { { -0.5f,  0.5f, -0.5f }, { 1.0f, 0.0f, 1.0f } },
+
+        { { -0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 1.0f } },
+        { { -0.5f, -0.5f, -0.5f }, { 0.0f, 1.0f, 1.0f } },
+        { {  0.5f, -0.5f, -0.5f }, { 0.0f, 1.0f, 1.0f } },
+        { { -0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 1.0f } },
+        { {  0.5f, -0.5f, -0.5f }, { 0.0f, 1.0f, 1.0f } },
+        { {  0.5f, -0.5f,  0.5f }, { 0.0f, 1.0f, 1.0f } },
+    };
+
+    // Calculate buffer size.
+    VkDeviceSize vertexBufferSize = sizeof(vertices[0]) * vertices.size();
+
+    // Describe a buffer.
+    VkBufferCreateInfo vkVertexBufferInfo{};
+    vkVertexBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    vkVertexBufferInfo.size = vertexBufferSize;
+    vkVertexBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    vkVertexBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // Create a buffer.
+    VkBuffer vkVertexBuffer;
+    if (vkCreateBuffer(vkDevice, &vkVertexBufferInfo, vkAllocator, &vkVertexBuffer) != VK_SUCCESS) {
+        std::cerr << "Failed to create a vertex buffer!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_BUFFER, vkVertexBuffer, "Vertex buffer");
+
+    // Retrieve memory requirements for the vertex buffer.
+    VkMemoryRequirements vkVertexBufferMemRequirements;
+    vkGetBufferMemoryRequirements(vkDevice, vkVertexBuffer, &vkVertexBufferMemRequirements);
+
+    // Define memory allocate info.
+    VkMemoryAllocateInfo vkVertexBufferAllocInfo{};
+    vkVertexBufferAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    vkVertexBufferAllocInfo.allocationSize = vkVertexBufferMemRequirements.size;
+    // Find a suitable memory type.
+    uint32_t bufferMemTypeIndex = UINT32_MAX;
+    VkMemoryPropertyFlags vkBufferMemFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkPhysicalDeviceMemoryProperties& vkBufferMemProperties = deviceCapabilities.memoryProperties;
+    for (uint32_t i = 0; i < vkBufferMemProperties.memoryTypeCount; i++) {
+        if ((vkVertexBufferMemRequirements.memoryTypeBits & (1 << i)) &&
+                (vkBufferMemProperties.memoryTypes[i].propertyFlags & vkBufferMemFlags) == vkBufferMemFlags) {
+            bufferMemTypeIndex = i;
+            break;
+        }
+    }
+    vkVertexBufferAllocInfo.memoryTypeIndex = bufferMemTypeIndex;
+    // Allocate memory for the vertex buffer.
+    VkDeviceMemory vkVertexBufferMemory;
+    if (vkAllocateMemory(vkDevice, &vkVertexBufferAllocInfo, vkAllocator, &vkVertexBufferMemory) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate memroy for the vertex buffer!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, vkVertexBufferMemory, "Vertex buffer memory");
+
+    // Bind the buffer to the allocated memory.
+    vkBindBufferMemory(vkDevice, vkVertexBuffer, vkVertexBufferMemory, 0);
+
+    // Copy our vertices to the allocated memory.
+    void* vertexBufferMemoryData;
+    vkMapMemory(vkDevice, vkVertexBufferMemory, 0, vertexBufferSize, 0, &vertexBufferMemoryData);
+    memcpy(vertexBufferMemoryData, vertices.data(), (size_t) vertexBufferSize);
+    vkUnmapMemory(vkDevice, vkVertexBufferMemory);
+
+    // ==========================================================================
+    //               STEP 19: Create a pipeline assembly state
+    // ==========================================================================
+    // Pipeline assembly state describes a geometry of the input data.
+    // In our case the input is a list of triangles.
+    // With extended dynamic state the topology is set when command buffers
+    // are recorded (see STEP 33).
+    // ==========================================================================
+
+    VkPipelineInputAssemblyStateCreateInfo vkInputAssembly{};
+    vkInputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    vkInputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    vkInputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // ==========================================================================
+    //                 STEP 20: Create a viewport and scissors
+    // ==========================================================================
+    // Viewport is a region of a framebuffer that will be used for renderring.
+    // Scissors define if some part of rendered image should be cut.
+    // In our example we define both viewport and scissors equal to
+    // the framebuffer size.
+    // ==========================================================================
+
+    // Size of rendered images. It is equal to the size of the swap chain
+    // unless the scene is rendered in lower resolution and upscaled
+    // by post-processing (see STEP 31).
+    VkExtent2D vkRenderExtent = vkSelectedExtent;
+#ifdef POST_PROCESSING
+    vkRenderExtent.width = std::max(1u, static_cast< uint32_t >(vkSelectedExtent.width * RENDER_SCALE));
+    vkRenderExtent.height = std::max(1u, static_cast< uint32_t >(vkSelectedExtent.height * RENDER_SCALE));
+#endif
+
+    // Create a viewport.
+    VkViewport vkViewport{};
+    vkViewport.x = 0.0f;
+    vkViewport.y = 0.0f;
+    vkViewport.width = static_cast< float >(vkRenderExtent.width);
+    vkViewport.height = static_cast< float >(vkRenderExtent.height);
+    vkViewport.minDepth = 0.0f;
+    vkViewport.maxDepth = 1.0f;
+
+    // Create scissors.
+    VkRect2D vkScissor{};
+    vkScissor.offset = {0, 0};
+    vkScissor.extent = vkRenderExtent;
+
+    // Make a structure for framebuffer creation.
+    VkPipelineViewportStateCreateInfo vkViewportState{};
+    vkViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    vkViewportState.viewportCount = 1;
+    vkViewportState.pViewports = &vkViewport;
+    vkViewportState.scissorCount = 1;
+    vkViewportState.pScissors = &vkScissor;
+
+    // ==========================================================================
+    //                 STEP 21: Create a rasterization stage
+    // ==========================================================================
+    // Rasterization stage takes primitives and rasterizes them to fragments
+    // pased to the fragment shader.
+    // With extended dynamic state the cull mode and the front face are set
+    // when command buffers are recorded (see STEP 33).
+    // ==========================================================================
+
+    // Rasterizer create info
+    VkPipelineRasterizationStateCreateInfo vkRasterizer{};
+    vkRasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    vkRasterizer.depthClampEnable = VK_FALSE;
+    vkRasterizer.rasterizerDiscardEnable = VK_FALSE;
+    // Fill in triangles.
+    vkRasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    vkRasterizer.lineWidth = 1.0f;
+    // Enable face culling.
+    vkRasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    vkRasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    vkRasterizer.depthBiasEnable = VK_FALSE;
+    vkRasterizer.depthBiasConstantFactor = 0.0f;
+    vkRasterizer.depthBiasClamp = 0.0f;
+    vkRasterizer.depthBiasSlopeFactor = 0.0f;
+
+    // ==========================================================================
+    //                     STEP 22: Create an MSAA state
+    // ==========================================================================
+    // MultiSample Anti-Aliasing is used to make edges smoother by rendering
+    // them in higher resolution (having more then one fragment per pixel) and
+    // then smoothering the result into one pixel.
+    //
+    // See https://en.wikipedia.org/wiki/Multisample_anti-aliasing
+    // ==========================================================================
+
+    // Select the maximal amount of samples supported by the device.
+    // Properties of the device have already been fetched in STEP 8.
+    VkSampleCountFlagBits vkMsaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkSampleCountFlags vkSampleCounts = vkPhysicalDeviceProperties.limits.framebufferColorSampleCounts & vkPhysicalDeviceProperties.limits.framebufferDepthSampleCounts;
+    if (vkSampleCounts & VK_SAMPLE_COUNT_64_BIT) {
+        vkMsaaSamples = VK_SAMPLE_COUNT_64_BIT;
+    } else if (vkSampleCounts & VK_SAMPLE_COUNT_32_BIT) {
+        vkMsaaSamples = VK_SAMPLE_COUNT_32_BIT;
+    } else if (vkSampleCounts & VK_SAMPLE_COUNT_16_BIT) {
+        vkMsaaSamples = VK_SAMPLE_COUNT_16_BIT;
+    } else if (vkSampleCounts & VK_SAMPLE_COUNT_8_BIT) {
+        vkMsaaSamples = VK_SAMPLE_COUNT_8_BIT;
+    } else if (vkSampleCounts & VK_SAMPLE_COUNT_4_BIT) {
+        vkMsaaSamples = VK_SAMPLE_COUNT_4_BIT;
+    } else if (vkSampleCounts & VK_SAMPLE_COUNT_2_BIT) {
+        vkMsaaSamples = VK_SAMPLE_COUNT_2_BIT;
+    }
+#ifdef TAA
+    // Temporal anti-aliasing gathers sub-pixel samples over several frames
+    // instead, so the scene is rendered with a single sample per pixel.
+    vkMsaaSamples = VK_SAMPLE_COUNT_1_BIT;
+#endif
+
+    // Create a state for MSAA.
+    VkPipelineMultisampleStateCreateInfo vkMultisampling{};
+    vkMultisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    vkMultisampling.sampleShadingEnable = VK_FALSE;
+    vkMultisampling.rasterizationSamples = vkMsaaSamples;
+    vkMultisampling.minSampleShading = 1.0f;
+    vkMultisampling.pSampleMask = nullptr;
+    vkMultisampling.alphaToCoverageEnable = VK_FALSE;
+    vkMultisampling.alphaToOneEnable = VK_FALSE;
+
+    // ==========================================================================
+    //                  STEP 23: Create a resolve attachment
+    // ==========================================================================
+    // In order to implement MSAA we should introduce a so-called
+    // resolve attachment. The attachment has only 1 sample and while rendering
+    // a multi-sampled image will be resolved to this attachment.
+    // To make it work we should specify the resolve attachment
+    // during subpass creation.
+    // ==========================================================================
+
+    // Description of an image for resolve attachment.
+    VkImageCreateInfo vkColorImageInfo{};
+    vkColorImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    vkColorImageInfo.imageType = VK_IMAGE_TYPE_2D;
+    vkColorImageInfo.extent.width = vkRenderExtent.width;
+    vkColorImageInfo.extent.height = vkRenderExtent.height;
+    vkColorImageInfo.extent.depth = 1;
+    vkColorImageInfo.mipLevels = 1;
+    vkColorImageInfo.arrayLayers = 1;
+    vkColorImageInfo.format = vkSelectedFormat.format;
+    vkColorImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    vkColorImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    vkColorImageInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    vkColorImageInfo.samples = vkMsaaSamples;
+    vkColorImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+#ifdef TAA
+    // With TAA nothing is resolved: the image keeps the scene in a floating
+    // point format, so the resolve shader can blend it without banding,
+    // and it is sampled by the resolve shader afterwards.
+    VkFormat taaColorFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+    vkColorImageInfo.format = taaColorFormat;
+    vkColorImageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+#endif
+
+    // Create an image for resolve attachment.
+    VkImage colorImage;
+    if (vkCreateImage(vkDevice, &vkColorImageInfo, vkAllocator, &colorImage) != VK_SUCCESS) {
+        std::cerr << "Failed to create an image!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_IMAGE, colorImage, "Color attachment");
+
+    // Get memory requirements.
+    VkMemoryRequirements vkMemRequirements;
+    vkGetImageMemoryRequirements(vkDevice, colorImage, &vkMemRequirements);
+
+    // Description of memory allocation.
+    VkMemoryAllocateInfo vkColorImageAllocInfo{};
+    vkColorImageAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    vkColorImageAllocInfo.allocationSize = vkMemRequirements.size;
+    // Find memory type.
+    const VkPhysicalDeviceMemoryProperties& vkColorImageMemProperties = deviceCapabilities.memoryProperties;
+    // A transient attachment prefers lazily allocated memory if the device has it.
+    // The image lists such types in its requirements only if it may use them.
+    uint32_t colorImageMemoryTypeInex = UINT32_MAX;
+    if (deviceCapabilities.lazilyAllocatedMemory) {
+        for (uint32_t i = 0; i < vkColorImageMemProperties.memoryTypeCount; i++) {
+            if ((vkMemRequirements.memoryTypeBits & (1 << i)) && (vkColorImageMemProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+                colorImageMemoryTypeInex = i;
+                break;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < vkColorImageMemProperties.memoryTypeCount && colorImageMemoryTypeInex == UINT32_MAX; i++) {
+        if ((vkMemRequirements.memoryTypeBits & (1 << i)) && (vkColorImageMemProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+            colorImageMemoryTypeInex = i;
+        }
+    }
+    vkColorImageAllocInfo.memoryTypeIndex = colorImageMemoryTypeInex;
+
+    // Allocate memory for resolve attachment.
+    VkDeviceMemory colorImageMemory;
+    if (vkAllocateMemory(vkDevice, &vkColorImageAllocInfo, vkAllocator, &colorImageMemory) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate image memory!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, colorImageMemory, "Color attachment memory");
+
+    // Bind the image to the memory.
+    vkBindImageMemory(vkDevice, colorImage, colorImageMemory, 0);
+
+    // Describe an image view for resolve attachment.
+    VkImageViewCreateInfo vkColorImageViewInfo{};
+    vkColorImageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    vkColorImageViewInfo.image = colorImage;
+    vkColorImageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    vkColorImageViewInfo.format = vkColorImageInfo.format;
+    vkColorImageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    vkColorImageViewInfo.subresourceRange.baseMipLevel = 0;
+    vkColorImageViewInfo.subresourceRange.levelCount = 1;
+    vkColorImageViewInfo.subresourceRange.baseArrayLayer = 0;
+    vkColorImageViewInfo.subresourceRange.layerCount = 1;
+
+    // Create an image view for resolve attachment.
+    VkImageView colorImageView;
+    if (vkCreateImageView(vkDevice, &vkColorImageViewInfo, vkAllocator, &colorImageView) != VK_SUCCESS) {
+        std::cerr << "Failed to create texture image view!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, colorImageView, "Color attachment view");
+
+    // Describe a resolve attachment.
+    VkAttachmentDescription colorAttachmentResolve{};
+    colorAttachmentResolve.format = vkSelectedFormat.format;
+    colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    // Resolve attachment reference.
+    VkAttachmentReference colorAttachmentResolveRef{};
+    colorAttachmentResolveRef.attachment = 2;
+    colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+#ifdef TAA
+
+    // --------------------------------------------------------------------------
+    // Create a motion vector attachment.
+    // --------------------------------------------------------------------------
+    // With TAA the third attachment is not a resolve target anymore. The main
+    // subpass writes the screen space motion of each pixel into it, so the
+    // resolve shader knows where the pixel was in the previous frame.
+    // The swap chain image is written by the resolve pass (see STEP 33).
+    // --------------------------------------------------------------------------
+
+    VkFormat taaVelocityFormat = VK_FORMAT_R16G16_SFLOAT;
+
+    // Describe an image.
+    VkImageCreateInfo vkVelocityImageInfo = vkColorImageInfo;
+    vkVelocityImageInfo.format = taaVelocityFormat;
+
+    // Create an image.
+    VkImage velocityImage;
+    if (vkCreateImage(vkDevice, &vkVelocityImageInfo, vkAllocator, &velocityImage) != VK_SUCCESS) {
+        std::cerr << "Failed to create an image!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_IMAGE, velocityImage, "Velocity attachment");
+
+    // Allocate device local memory for the image.
+    VkMemoryRequirements vkVelocityMemRequirements;
+    vkGetImageMemoryRequirements(vkDevice, velocityImage, &vkVelocityMemRequirements);
+    VkMemoryAllocateInfo vkVelocityImageAllocInfo{};
+    vkVelocityImageAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    vkVelocityImageAllocInfo.allocationSize = vkVelocityMemRequirements.size;
+    vkVelocityImageAllocInfo.memoryTypeIndex = UINT32_MAX;
+    for (uint32_t i = 0; i < vkColorImageMemProperties.memoryTypeCount; i++) {
+        if ((vkVelocityMemRequirements.memoryTypeBits & (1 << i)) && (vkColorImageMemProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+            vkVelocityImageAllocInfo.memoryTypeIndex = i;
+            break;
+        }
+    }
+    VkDeviceMemory velocityImageMemory;
+    if (vkAllocateMemory(vkDevice, &vkVelocityImageAllocInfo, vkAllocator, &velocityImageMemory) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate image memory!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, velocityImageMemory, "Velocity attachment memory");
+    vkBindImageMemory(vkDevice, velocityImage, velocityImageMemory, 0);
+
+    // Create an image view.
+    VkImageViewCreateInfo vkVelocityImageViewInfo = vkColorImageViewInfo;
+    vkVelocityImageViewInfo.image = velocityImage;
+    vkVelocityImageViewInfo.format = taaVelocityFormat;
+    VkImageView velocityImageView;
+    if (vkCreateImageView(vkDevice, &vkVelocityImageViewInfo, vkAllocator, &velocityImageView) != VK_SUCCESS) {
+        std::cerr << "Failed to create texture image view!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, velocityImageView, "Velocity attachment view");
+
+    // Both color attachments are read by the resolve shader after the render pass.
+    // Pixels not covered by the cube do not move.
+    colorAttachmentResolve.format = taaVelocityFormat;
+    colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+#elif defined(POST_PROCESSING)
+
+    // --------------------------------------------------------------------------
+    // Create a post-processing input image.
+    // --------------------------------------------------------------------------
+    // The scene is resolved into an image of the render size instead of the
+    // swap chain image. It is sampled by the first post-processing pass, and
+    // the swap chain image is written by the last one (see STEP 33).
+    // --------------------------------------------------------------------------
+
+    // Describe an image.
+    VkImageCreateInfo vkResolveImageInfo = vkColorImageInfo;
+    vkResolveImageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    vkResolveImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+    // Create an image.
+    VkImage resolveImage;
+    if (vkCreateImage(vkDevice, &vkResolveImageInfo, vkAllocator, &resolveImage) != VK_SUCCESS) {
+        std::cerr << "Failed to create an image!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_IMAGE, resolveImage, "Resolve attachment");
+
+    // Allocate device local memory for the image.
+    VkMemoryRequirements vkResolveMemRequirements;
+    vkGetImageMemoryRequirements(vkDevice, resolveImage, &vkResolveMemRequirements);
+    VkMemoryAllocateInfo vkResolveImageAllocInfo{};
+    vkResolveImageAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    vkResolveImageAllocInfo.allocationSize = vkResolveMemRequirements.size;
+    vkResolveImageAllocInfo.memoryTypeIndex = UINT32_MAX;
+    for (uint32_t i = 0; i < vkColorImageMemProperties.memoryTypeCount; i++) {
+        if ((vkResolveMemRequirements.memoryTypeBits & (1 << i)) && (vkColorImageMemProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+            vkResolveImageAllocInfo.memoryTypeIndex = i;
+            break;
+        }
+    }
+    VkDeviceMemory resolveImageMemory;
+    if (vkAllocateMemory(vkDevice, &vkResolveImageAllocInfo, vkAllocator, &resolveImageMemory) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate image memory!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, resolveImageMemory, "Resolve attachment memory");
+    vkBindImageMemory(vkDevice, resolveImage, resolveImageMemory, 0);
+
+    // Create an image view.
+    VkImageViewCreateInfo vkResolveImageViewInfo = vkColorImageViewInfo;
+    vkResolveImageViewInfo.image = resolveImage;
+    VkImageView resolveImageView;
+    if (vkCreateImageView(vkDevice, &vkResolveImageViewInfo, vkAllocator, &resolveImageView) != VK_SUCCESS) {
+        std::cerr << "Failed to create texture image view!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, resolveImageView, "Resolve attachment view");
+
+    // The resolved image is sampled after the render pass.
+    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+#endif
+
+    // ==========================================================================
+    //                 STEP 24: Create a color blend state
+    // ==========================================================================
+    // Color blend state describes how fragments are applied to the result
+    // image. There might be options like mixing, but we switch off blending and
+    // simply put a new color instead of existing one.
+    // ==========================================================================
+
+    // Configuration per attached framebuffer.
+    VkPipelineColorBlendAttachmentState vkColorBlendAttachment{};
+    vkColorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    vkColorBlendAttachment.blendEnable = VK_FALSE;
+    // Other fields are optional.
+    vkColorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    vkColorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+    vkColorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    vkColorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    vkColorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    vkColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    // Global color blending settings.
+    VkPipelineColorBlendStateCreateInfo vkColorBlending{};
+    vkColorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    vkColorBlending.attachmentCount = 1;
+    vkColorBlending.pAttachments = &vkColorBlendAttachment;
+#ifdef TAA
+    // Motion vectors are written the same way as colors.
+    std::array< VkPipelineColorBlendAttachmentState, 2 > taaColorBlendAttachments {
+        vkColorBlendAttachment,
+        vkColorBlendAttachment
+    };
+    vkColorBlending.attachmentCount = static_cast< uint32_t >(taaColorBlendAttachments.size());
+    vkColorBlending.pAttachments = taaColorBlendAttachments.data();
+#endif
+#ifdef DEFERRED_SHADING
+    // The main subpass writes the albedo and the normal instead of a color,
+    // followed by motion vectors with TAA.
+    std::array< VkPipelineColorBlendAttachmentState, 3 > gBufferColorBlendAttachments {
+        vkColorBlendAttachment,
+        vkColorBlendAttachment,
+        vkColorBlendAttachment
+    };
+#ifdef TAA
+    vkColorBlending.attachmentCount = 3;
+#else
+    vkColorBlending.attachmentCount = 2;
+#endif
+    vkColorBlending.pAttachments = gBufferColorBlendAttachments.data();
+#endif
+    vkColorBlending.logicOpEnable = VK_FALSE;
+    // Other fields are optional.
+    vkColorBlending.logicOp = VK_LOGIC_OP_COPY;
+    vkColorBlending.blendConstants[0] = 0.0f;
+    vkColorBlending.blendConstants[1] = 0.0f;
+    vkColorBlending.blendConstants[2] = 0.0f;
+    vkColorBlending.blendConstants[3] = 0.0f;
+
+    // ==========================================================================
+    //                   STEP 25: Create a color attachment
+    // ==========================================================================
+    // Color attachment contains pixels of rendered image, so we should create
+    // one in order to display something.
+    // ==========================================================================
+
+    // Descriptor of a color attachment.
+    VkAttachmentDescription vkColorAttachment{};
+    vkColorAttachment.format = vkSelectedFormat.format;
+    vkColorAttachment.samples = vkMsaaSamples;
+    vkColorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    vkColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    vkColorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    vkColorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    vkColorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Since we use MSAA, we should specify VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL here.
+    // If we disable MSAA, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR will be enough.
+    vkColorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+#ifdef TAA
+    // The scene is sampled by the resolve shader after the render pass.
+    vkColorAttachment.format = taaColorFormat;
+    vkColorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+#endif
+
+    // Color attachment reference.
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+#ifdef DEFERRED_SHADING
+
+    // --------------------------------------------------------------------------
+    // Create G-buffer attachments.
+    // --------------------------------------------------------------------------
+    // In deferred mode the cube is drawn into a G-buffer: the albedo and the
+    // normal of each sample. The lighting subpass reads them as input
+    // attachments at the same pixel, so tiled GPUs keep them in tile memory.
+    // Their content is never stored, so the images are transient and backed
+    // by lazily allocated memory where possible, which might never be
+    // committed at all.
+    // --------------------------------------------------------------------------
+
+    // Formats of the albedo and the normal attachments.
+    std::array< VkFormat, 2 > gBufferFormats {
+        VK_FORMAT_R8G8B8A8_UNORM,
+        VK_FORMAT_A2B10G10R10_UNORM_PACK32
+    };
+    // Index of the first G-buffer attachment in the render pass.
+    uint32_t gBufferFirstAttachment = 3;
+
+    std::array< VkImage, 2 > gBufferImages;
+    std::array< VkDeviceMemory, 2 > gBufferImagesMemory;
+    std::array< VkImageView, 2 > gBufferImageViews;
+    std::array< VkAttachmentDescription, 2 > gBufferAttachments{};
+    // References to write the G-buffer and to read it in the lighting subpass.
+    std::array< VkAttachmentReference, 2 > gBufferAttachmentRefs{};
+    std::array< VkAttachmentReference, 2 > gBufferInputRefs{};
+    for (size_t i = 0; i < gBufferImages.size(); i++) {
+        // Describe an image.
+        VkImageCreateInfo vkGBufferImageInfo{};
+        vkGBufferImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        vkGBufferImageInfo.imageType = VK_IMAGE_TYPE_2D;
+        vkGBufferImageInfo.extent.width = vkRenderExtent.width;
+        vkGBufferImageInfo.extent.height = vkRenderExtent.height;
+        vkGBufferImageInfo.extent.depth = 1;
+        vkGBufferImageInfo.mipLevels = 1;
+        vkGBufferImageInfo.arrayLayers = 1;
+        vkGBufferImageInfo.format = gBufferFormats[i];
+        vkGBufferImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        vkGBufferImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        vkGBufferImageInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+        vkGBufferImageInfo.samples = vkMsaaSamples;
+        vkGBufferImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        // Create an image.
+        if (vkCreateImage(vkDevice, &vkGBufferImageInfo, vkAllocator, &gBufferImages[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create a G-buffer image!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_IMAGE, gBufferImages[i], "G-buffer attachment", i);
+
+        // Prefer lazily allocated memory if the device has it, fall back to device local one.
+        VkMemoryRequirements vkGBufferMemRequirements;
+        vkGetImageMemoryRequirements(vkDevice, gBufferImages[i], &vkGBufferMemRequirements);
+        VkMemoryAllocateInfo vkGBufferAllocInfo{};
+        vkGBufferAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        vkGBufferAllocInfo.allocationSize = vkGBufferMemRequirements.size;
+        vkGBufferAllocInfo.memoryTypeIndex = UINT32_MAX;
+        for (VkMemoryPropertyFlags vkGBufferMemFlags : { VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT }) {
+            if (vkGBufferMemFlags == VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT && !deviceCapabilities.lazilyAllocatedMemory) {
+                continue;
+            }
+            for (uint32_t j = 0; j < vkColorImageMemProperties.memoryTypeCount && vkGBufferAllocInfo.memoryTypeIndex == UINT32_MAX; j++) {
+                if ((vkGBufferMemRequirements.memoryTypeBits & (1 << j)) &&
+                        (vkColorImageMemProperties.memoryTypes[j].propertyFlags & vkGBufferMemFlags)) {
+                    vkGBufferAllocInfo.memoryTypeIndex = j;
+                }
+            }
+        }
+        if (vkAllocateMemory(vkDevice, &vkGBufferAllocInfo, vkAllocator, &gBufferImagesMemory[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate image memory!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, gBufferImagesMemory[i], "G-buffer attachment memory", i);
+        vkBindImageMemory(vkDevice, gBufferImages[i], gBufferImagesMemory[i], 0);
+
+        // Create an image view.
+        VkImageViewCreateInfo vkGBufferViewInfo{};
+        vkGBufferViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        vkGBufferViewInfo.image = gBufferImages[i];
+        vkGBufferViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        vkGBufferViewInfo.format = gBufferFormats[i];
+        vkGBufferViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        vkGBufferViewInfo.subresourceRange.baseMipLevel = 0;
+        vkGBufferViewInfo.subresourceRange.levelCount = 1;
+        vkGBufferViewInfo.subresourceRange.baseArrayLayer = 0;
+        vkGBufferViewInfo.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(vkDevice, &vkGBufferViewInfo, vkAllocator, &gBufferImageViews[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create a G-buffer image view!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, gBufferImageViews[i], "G-buffer attachment view", i);
+
+        // Cleared to zero, so the background is not lit. Nothing is stored.
+        gBufferAttachments[i].format = gBufferFormats[i];
+        gBufferAttachments[i].samples = vkMsaaSamples;
+        gBufferAttachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        gBufferAttachments[i].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        gBufferAttachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        gBufferAttachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        gBufferAttachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        gBufferAttachments[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        gBufferAttachmentRefs[i].attachment = gBufferFirstAttachment + static_cast< uint32_t >(i);
+        gBufferAttachmentRefs[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        gBufferInputRefs[i].attachment = gBufferFirstAttachment + static_cast< uint32_t >(i);
+        gBufferInputRefs[i].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+#endif
+
+    // ==========================================================================
+    //                  STEP 26: Create a depth buffer image
+    // ==========================================================================
+    // In order to use a depth buffer, we should create an image.
+    // Unlike swap buffer images, we need only one depth image and it should
+    // be created explicitly.
+    // ==========================================================================
+
+    // Describe a depth image.
+    VkImageCreateInfo vkImageInfo{};
+    vkImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    vkImageInfo.imageType = VK_IMAGE_TYPE_2D;
+    vkImageInfo.extent.width = vkRenderExtent.width;
+    vkImageInfo.extent.height = vkRenderExtent.height;
+    vkImageInfo.extent.depth = 1;
+    vkImageInfo.mipLevels = 1;
+    vkImageInfo.arrayLayers = 1;
+    vkImageInfo.format = vkDepthFormat;
+    vkImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    vkImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    vkImageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    vkImageInfo.samples = vkMsaaSamples;
+    vkImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // Create a depth image.
+    VkImage vkDepthImage;
+    if (vkCreateImage(vkDevice, &vkImageInfo, vkAllocator, &vkDepthImage) != VK_SUCCESS) {
+        std::cerr << "Failed to create a depth image!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_IMAGE, vkDepthImage, "Depth buffer");
+
+    // Retrieve memory requirements for the depth image.
+    VkMemoryRequirements vkmDepthMemRequirements;
+    vkGetImageMemoryRequirements(vkDevice, vkDepthImage, &vkmDepthMemRequirements);
+
+    // Define memory allocate info.
+    VkMemoryAllocateInfo memoryAllocInfo{};
+    memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryAllocInfo.allocationSize = vkmDepthMemRequirements.size;
+    // Find a suitable memory type.
+    uint32_t memTypeIndex = UINT32_MAX;
+    const VkPhysicalDeviceMemoryProperties& memProperties = deviceCapabilities.memoryProperties;
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if ((vkmDepthMemRequirements.memoryTypeBits & (1 << i)) &&
+                (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+            memTypeIndex = i;
+            break;
+        }
+    }
+    memoryAllocInfo.memoryTypeIndex = memTypeIndex;
+
+    // Allocate memory for the depth image.
+    VkDeviceMemory vkDepthImageMemory;
+    if (vkAllocateMemory(vkDevice, &memoryAllocInfo, vkAllocator, &vkDepthImageMemory) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate image memory!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, vkDepthImageMemory, "Depth buffer memory");
+
+    // Bind the image to the allocated memory.
+    vkBindImageMemory(vkDevice, vkDepthImage, vkDepthImageMemory, 0);
+
+    // ==========================================================================
+    //                STEP 27: Create a depth buffer image view
+    // ==========================================================================
+    // Similarly to swap buffer images, we need an image view to use it.
+    // ==========================================================================
+
+    // Destribe an image view.
+    VkImageViewCreateInfo vkViewInfo{};
+    vkViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    vkViewInfo.image = vkDepthImage;
+    vkViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    vkViewInfo.format = vkDepthFormat;
+    vkViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    vkViewInfo.subresourceRange.baseMipLevel = 0;
+    vkViewInfo.subresourceRange.levelCount = 1;
+    vkViewInfo.subresourceRange.baseArrayLayer = 0;
+    vkViewInfo.subresourceRange.layerCount = 1;
+
+    // Create an image view.
+    VkImageView vkDepthImageView;
+    if (vkCreateImageView(vkDevice, &vkViewInfo, vkAllocator, &vkDepthImageView) != VK_SUCCESS) {
+        std::cerr << "Failed to create a texture image view!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, vkDepthImageView, "Depth buffer view");
+
+    // ==========================================================================
+    //            STEP 28: Create a depth and stensil attachment
+    // ==========================================================================
+    // Depth and stensil attachment is used to support two tests:
+    // - depth test - Makes sure that only the nearest fragment is displayed.
+    // - stensil test - Allows to cut some fragments depending on values of
+    //                  the stensil buffer.
+    // Although in this example we only need a depth test, both of them use
+    // the same attachment.
+    // ==========================================================================
+
+    // Descriptor of a depth attachment.
+    // Even with the depth prepass the attachment is cleared only once
+    // and never stored: both subpasses live in the same render pass,
+    // so the depth values stay in the attachment between them.
+    VkAttachmentDescription vkDepthAttachment{};
+    vkDepthAttachment.format = vkDepthFormat;
+    vkDepthAttachment.samples = vkMsaaSamples;
+    vkDepthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    vkDepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    vkDepthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    vkDepthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    vkDepthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    vkDepthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    // Depth attachment reference.
+    VkAttachmentReference vkDepthAttachmentRef{};
+    vkDepthAttachmentRef.attachment = 1;
+    vkDepthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+#ifdef DEPTH_PREPASS
+
+    // The main subpass only reads depth values produced by the prepass,
+    // so it may use a read-only layout of the same attachment.
+    VkAttachmentReference vkReadOnlyDepthAttachmentRef{};
+    vkReadOnlyDepthAttachmentRef.attachment = 1;
+    vkReadOnlyDepthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+#endif
+
+    // ==========================================================================
+    //               STEP 29: Configure depth and stensil tests
+    // ==========================================================================
+    // This stage configures behavior of depth and stensil tests. In this example
+    // we use regular VK_COMPARE_OP_LESS depth operation and disable stensil test.
+    //
+    // In reversed depth mode the near plane is mapped to 1.0 and the infinitely
+    // far plane to 0.0. Combined with a floating point depth buffer, this
+    // distributes precision almost uniformly over the whole view distance,
+    // because the exponent of a float compensates the 1/z distribution.
+    // Therefore nearer fragments have greater depth and VK_COMPARE_OP_GREATER
+    // is used instead.
+    // With extended dynamic state the depth test, the depth write and the
+    // compare operation are set when command buffers are recorded (see STEP 33).
+    // ==========================================================================
+
+    VkPipelineDepthStencilStateCreateInfo vkDepthStencil{};
+    vkDepthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    vkDepthStencil.depthTestEnable = VK_TRUE;
+    vkDepthStencil.depthWriteEnable = VK_TRUE;
+#ifdef REVERSE_Z
+    vkDepthStencil.depthCompareOp = VK_COMPARE_OP_GREATER;
+#else
+    vkDepthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+#endif
+    vkDepthStencil.depthBoundsTestEnable = VK_FALSE;
+    vkDepthStencil.minDepthBounds = 0.0f;
+    vkDepthStencil.maxDepthBounds = 1.0f;
+    vkDepthStencil.stencilTestEnable = VK_FALSE;
+    vkDepthStencil.front = VkStencilOpState{};
+    vkDepthStencil.back = VkStencilOpState{};
+
+#ifdef DEPTH_PREPASS
+
+    // The depth prepass fills the depth buffer with the nearest depth of each
+    // fragment using the regular test above.
+    VkPipelineDepthStencilStateCreateInfo vkPrepassDepthStencil = vkDepthStencil;
+
+    // After that the main pass shades only fragments that exactly match
+    // the stored depth, so each pixel is shaded once regardless of overdraw.
+    // Both passes use the same vertex shader, which declares gl_Position as
+    // invariant, so depth values are bit-identical across the two pipelines.
+    vkDepthStencil.depthWriteEnable = VK_FALSE;
+    vkDepthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+
+#endif
+
+    // ==========================================================================
+    //                     STEP 30: Create a render pass
+    // ==========================================================================
+    // Render pass represents a collection of attachments, subpasses
+    // and dependencies between the subpasses.
+    // Subpasses allow to organize rendering process as a chain of operations.
+    // Each operation is applied to the result of the previous one.
+    // In the example we only need a single subpass.
+    // If the depth prepass is enabled, one more depth-only subpass is
+    // executed before the main one.
+    // In deferred shading mode the main subpass is followed by a lighting
+    // subpass, which reads the G-buffer as input attachments.
+    // In dynamic rendering mode no render pass is created at all.
+    // ==========================================================================
+
+    // Index of the subpass that draws the colored cube.
+    uint32_t mainSubpassIndex = 0;
+
+#ifdef DYNAMIC_RENDERING
+
+#ifdef DEFERRED_SHADING
+#error "Deferred shading reads the G-buffer as subpass input attachments, which dynamic rendering does not have"
+#endif
+
+    // --------------------------------------------------------------------------
+    // Describe attachment formats for dynamic rendering.
+    // --------------------------------------------------------------------------
+    // With dynamic rendering there are neither render pass nor framebuffer
+    // objects. Command buffers begin rendering directly with image views and
+    // change layouts of the images by explicit barriers (see STEP 33), so
+    // nothing has to be recreated when the attachments change.
+    // A pipeline only needs to know formats of the attachments it writes.
+    // The depth prepass is a separate rendering scope, so there are no
+    // subpasses and every pipeline is created for the subpass 0.
+    // --------------------------------------------------------------------------
+
+    // Formats of color attachments written by the main pipeline.
+#ifdef TAA
+    std::array< VkFormat, 2 > renderingColorFormats { vkColorAttachment.format, colorAttachmentResolve.format };
+#else
+    std::array< VkFormat, 1 > renderingColorFormats { vkColorAttachment.format };
+#endif
+
+    // Chained to the pipeline create info instead of a render pass.
+    VkPipelineRenderingCreateInfo vkPipelineRenderingInfo{};
+    vkPipelineRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    vkPipelineRenderingInfo.viewMask = 0;
+    vkPipelineRenderingInfo.colorAttachmentCount = static_cast< uint32_t >(renderingColorFormats.size());
+    vkPipelineRenderingInfo.pColorAttachmentFormats = renderingColorFormats.data();
+    vkPipelineRenderingInfo.depthAttachmentFormat = vkDepthFormat;
+    vkPipelineRenderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+
+#else
+
+    // Define a subpass and include both attachments (color and depth-stensil).
+    VkSubpassDescription vkSubpass{};
+    vkSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    vkSubpass.colorAttachmentCount = 1;
+    vkSubpass.pColorAttachments = &colorAttachmentRef;
+    vkSubpass.pDepthStencilAttachment = &vkDepthAttachmentRef;
+    vkSubpass.pResolveAttachments = &colorAttachmentResolveRef;
+
+    // Define a subpass dependency.
+    VkSubpassDependency vkDependency{};
+    vkDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    vkDependency.dstSubpass = 0;
+    vkDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    vkDependency.srcAccessMask = 0;
+    vkDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    vkDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    // Collect all subpasses and dependencies of the render pass.
+    std::vector< VkSubpassDescription > vkSubpasses;
+    std::vector< VkSubpassDependency > vkDependencies;
+
+#ifdef TAA
+
+    // The main subpass writes the scene and motion vectors, nothing is resolved.
+    std::array< VkAttachmentReference, 2 > taaColorAttachmentRefs {
+        colorAttachmentRef,
+        colorAttachmentResolveRef
+    };
+    vkSubpass.colorAttachmentCount = static_cast< uint32_t >(taaColorAttachmentRefs.size());
+    vkSubpass.pColorAttachments = taaColorAttachmentRefs.data();
+    vkSubpass.pResolveAttachments = nullptr;
+
+#endif
+
+#ifdef DEFERRED_SHADING
+
+    // The main subpass fills the G-buffer instead of the color attachment.
+    // Motion vectors still go to the third attachment with TAA.
+    std::array< VkAttachmentReference, 3 > gBufferSubpassRefs {
+        gBufferAttachmentRefs[0],
+        gBufferAttachmentRefs[1],
+        colorAttachmentResolveRef
+    };
+#ifdef TAA
+    vkSubpass.colorAttachmentCount = 3;
+#else
+    vkSubpass.colorAttachmentCount = 2;
+#endif
+    vkSubpass.pColorAttachments = gBufferSubpassRefs.data();
+    vkSubpass.pResolveAttachments = nullptr;
+
+    // The lighting subpass reads the G-buffer and writes the color attachment,
+    // which is resolved the same way as in forward mode.
+    VkSubpassDescription vkLightingSubpass{};
+    vkLightingSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    vkLightingSubpass.inputAttachmentCount = static_cast< uint32_t >(gBufferInputRefs.size());
+    vkLightingSubpass.pInputAttachments = gBufferInputRefs.data();
+    vkLightingSubpass.colorAttachmentCount = 1;
+    vkLightingSubpass.pColorAttachments = &colorAttachmentRef;
+    vkLightingSubpass.pDepthStencilAttachment = nullptr;
+#ifdef TAA
+    vkLightingSubpass.pResolveAttachments = nullptr;
+#else
+    vkLightingSubpass.pResolveAttachments = &colorAttachmentResolveRef;
+#endif
+
+    // The lighting subpass reads only the pixel it writes, so the dependency
+    // is local to a region and the G-buffer never leaves tile memory.
+    VkSubpassDependency vkLightingDependency{};
+    vkLightingDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    vkLightingDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    vkLightingDependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    vkLightingDependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    vkLightingDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+#endif
+
+#if defined(TAA) || defined(POST_PROCESSING)
+
+    // Images written by the render pass are still read by compute shaders of the previous frame.
+    vkDependency.srcStageMask |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    // Compute shaders should wait until the main subpass is finished.
+    VkSubpassDependency vkResolveDependency{};
+    vkResolveDependency.srcSubpass = 0;
+    vkResolveDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    vkResolveDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    vkResolveDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    vkResolveDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    vkResolveDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+#endif
+
+#ifdef DEPTH_PREPASS
+
+    // The depth-only subpass has no color attachments at all.
+    VkSubpassDescription vkPrepassSubpass{};
+    vkPrepassSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    vkPrepassSubpass.colorAttachmentCount = 0;
+    vkPrepassSubpass.pColorAttachments = nullptr;
+    vkPrepassSubpass.pDepthStencilAttachment = &vkDepthAttachmentRef;
+    vkPrepassSubpass.pResolveAttachments = nullptr;
+
+    // The main subpass goes second and does not write depth anymore.
+    mainSubpassIndex = 1;
+    vkSubpass.pDepthStencilAttachment = &vkReadOnlyDepthAttachmentRef;
+    vkDependency.dstSubpass = mainSubpassIndex;
+
+    // The prepass should not start writing depth until the previous frame
+    // has finished depth tests, because the depth image is shared.
+    VkSubpassDependency vkPrepassDependency{};
+    vkPrepassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    vkPrepassDependency.dstSubpass = 0;
+    vkPrepassDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    vkPrepassDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    vkPrepassDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    vkPrepassDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // The main subpass should see all depth values written by the prepass.
+    // Each pixel depends only on the same pixel of the prepass, so the dependency
+    // is local to a region which allows tiled GPUs to keep depth on chip.
+    VkSubpassDependency vkMainDependency{};
+    vkMainDependency.srcSubpass = 0;
+    vkMainDependency.dstSubpass = mainSubpassIndex;
+    vkMainDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    vkMainDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    vkMainDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    vkMainDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+    vkMainDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    vkSubpasses.push_back(vkPrepassSubpass);
+    vkDependencies.push_back(vkPrepassDependency);
+    vkDependencies.push_back(vkMainDependency);
+
+#endif
+
+    vkSubpasses.push_back(vkSubpass);
+    vkDependencies.push_back(vkDependency);
+#ifdef DEFERRED_SHADING
+    // Index of the subpass that lights the G-buffer.
+    uint32_t lightingSubpassIndex = mainSubpassIndex + 1;
+    vkLightingDependency.srcSubpass = mainSubpassIndex;
+    vkLightingDependency.dstSubpass = lightingSubpassIndex;
+    vkSubpasses.push_back(vkLightingSubpass);
+    vkDependencies.push_back(vkLightingDependency);
+#endif
+#if defined(TAA) || defined(POST_PROCESSING)
+    vkResolveDependency.srcSubpass = mainSubpassIndex;
+    vkDependencies.push_back(vkResolveDependency);
+#ifdef DEFERRED_SHADING
+    // The color attachment is written by the lighting subpass.
+    vkResolveDependency.srcSubpass = lightingSubpassIndex;
+    vkDependencies.push_back(vkResolveDependency);
+#endif
+#endif
+
+    // Define a render pass and attach the subpass.
+    VkRenderPassCreateInfo vkRenderPassInfo{};
+    vkRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+#ifdef DEFERRED_SHADING
+    std::array< VkAttachmentDescription, 5 > attachments = {
+        vkColorAttachment, vkDepthAttachment, colorAttachmentResolve, gBufferAttachments[0], gBufferAttachments[1]
+    };
+#else
+    std::array< VkAttachmentDescription, 3 > attachments = { vkColorAttachment, vkDepthAttachment, colorAttachmentResolve };
+#endif
+    vkRenderPassInfo.attachmentCount = static_cast< uint32_t >(attachments.size());
+    vkRenderPassInfo.pAttachments = attachments.data();
+    vkRenderPassInfo.subpassCount = static_cast< uint32_t >(vkSubpasses.size());
+    vkRenderPassInfo.pSubpasses = vkSubpasses.data();
+    vkRenderPassInfo.dependencyCount = static_cast< uint32_t >(vkDependencies.size());
+    vkRenderPassInfo.pDependencies = vkDependencies.data();
+
+    // Create a render pass.
+    VkRenderPass vkRenderPass;
+    if (vkCreateRenderPass(vkDevice, &vkRenderPassInfo, vkAllocator, &vkRenderPass) != VK_SUCCESS) {
+        std::cerr << "Failed to create a render pass!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_RENDER_PASS, vkRenderPass, "Main render pass");
+
+#endif
+
+    // ==========================================================================
+    //                   STEP 31: Create a graphics pipeline
+    // ==========================================================================
+    // All stages prepared above should be combined into a graphics pipeline.
+    // ==========================================================================
+
+    // Define a pipeline layout.
+    VkPipelineLayoutCreateInfo vkPipelineLayoutInfo{};
+    vkPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    vkPipelineLayoutInfo.setLayoutCount = 1;
+    vkPipelineLayoutInfo.pSetLayouts = &vkDescriptorSetLayout;
+    vkPipelineLayoutInfo.pushConstantRangeCount = 0;
+    vkPipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+    // Create a pipeline layout.
+    VkPipelineLayout vkPipelineLayout;
+    if (vkCreatePipelineLayout(vkDevice, &vkPipelineLayoutInfo, vkAllocator, &vkPipelineLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to creare a pipeline layout!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, vkPipelineLayout, "Main pipeline layout");
+
+    // Define a pipeline and provide all stages created above.
+    VkGraphicsPipelineCreateInfo vkPipelineInfo{};
+    vkPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    vkPipelineInfo.stageCount = shaderStages.size();
+    vkPipelineInfo.pStages = shaderStages.data();
+    vkPipelineInfo.pVertexInputState = &vkVertexInputInfo;
+    vkPipelineInfo.pInputAssemblyState = &vkInputAssembly;
+    vkPipelineInfo.pViewportState = &vkViewportState;
+    vkPipelineInfo.pRasterizationState = &vkRasterizer;
+    vkPipelineInfo.pMultisampleState = &vkMultisampling;
+    vkPipelineInfo.pDepthStencilState = &vkDepthStencil;
+    vkPipelineInfo.pColorBlendState = &vkColorBlending;
+    vkPipelineInfo.pDynamicState = nullptr;
+#ifdef EXTENDED_DYNAMIC_STATE
+    // Render states which are not baked into pipelines. All other pipelines
+    // are copies of this one, so a pipeline does not depend on them anymore
+    // and serves any combination of them.
+    std::array< VkDynamicState, 6 > vkDynamicStates {
+        VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY,
+        VK_DYNAMIC_STATE_CULL_MODE,
+        VK_DYNAMIC_STATE_FRONT_FACE,
+        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP
+    };
+    VkPipelineDynamicStateCreateInfo vkDynamicState{};
+    vkDynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    vkDynamicState.dynamicStateCount = static_cast< uint32_t >(vkDynamicStates.size());
+    vkDynamicState.pDynamicStates = vkDynamicStates.data();
+    vkPipelineInfo.pDynamicState = &vkDynamicState;
+#endif
+    vkPipelineInfo.layout = vkPipelineLayout;
+#ifdef DYNAMIC_RENDERING
+    vkPipelineInfo.pNext = &vkPipelineRenderingInfo;
+    vkPipelineInfo.renderPass = VK_NULL_HANDLE;
+#else
+    vkPipelineInfo.renderPass = vkRenderPass;
+#endif
+    vkPipelineInfo.subpass = mainSubpassIndex;
+    vkPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    vkPipelineInfo.basePipelineIndex = -1;
+
+    // Create a pipeline.
+    VkPipeline vkGraphicsPipeline;
+#if defined(GRAPHICS_PIPELINE_LIBRARY)
+
+    // --------------------------------------------------------------------------
+    // Link the pipeline from graphics pipeline libraries.
+    // --------------------------------------------------------------------------
+    // The pipeline is split into four parts which are compiled separately:
+    // vertex input, pre-rasterization shaders, fragment shader and fragment
+    // output. A variant that differs in one part only reuses the others.
+    // Linking the parts without optimization is cheap, so the first frame is
+    // drawn with a fast-linked pipeline, while a link time optimized one is
+    // built on a worker thread. When it is ready, it replaces the fast-linked
+    // pipeline in the main loop (see STEP 36).
+    // --------------------------------------------------------------------------
+
+    auto graphicsPipelineLinkStartTime = std::chrono::high_resolution_clock::now();
+
+    // Each part is described by a copy of the full create info of a pipeline.
+    // Only the states and shader stages which belong to the part are kept,
+    // the others are dropped. Parts keep link time optimization info for the
+    // optimized link.
+    auto createPipelineLibrary = [&](const VkGraphicsPipelineCreateInfo& vkBasePipelineInfo, VkGraphicsPipelineLibraryFlagsEXT flags, const char* name) {
+        VkGraphicsPipelineLibraryCreateInfoEXT vkLibraryInfo{};
+        vkLibraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+        vkLibraryInfo.pNext = vkBasePipelineInfo.pNext;
+        vkLibraryInfo.flags = flags;
+
+        // The fragment shader belongs to the fragment shader part, all other stages to pre-rasterization.
+        std::vector< VkPipelineShaderStageCreateInfo > libraryStages;
+        for (uint32_t i = 0; i < vkBasePipelineInfo.stageCount; i++) {
+            bool fragmentStage = vkBasePipelineInfo.pStages[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT;
+            if (flags & (fragmentStage ? VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT : VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT)) {
+                libraryStages.push_back(vkBasePipelineInfo.pStages[i]);
+            }
+        }
+
+        VkGraphicsPipelineCreateInfo vkLibraryPipelineInfo = vkBasePipelineInfo;
+        vkLibraryPipelineInfo.pNext = &vkLibraryInfo;
+        vkLibraryPipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+        vkLibraryPipelineInfo.stageCount = static_cast< uint32_t >(libraryStages.size());
+        vkLibraryPipelineInfo.pStages = libraryStages.empty() ? nullptr : libraryStages.data();
+        if (!(flags & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT)) {
+            vkLibraryPipelineInfo.pVertexInputState = nullptr;
+            vkLibraryPipelineInfo.pInputAssemblyState = nullptr;
+        }
+        if (!(flags & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT)) {
+            vkLibraryPipelineInfo.pViewportState = nullptr;
+            vkLibraryPipelineInfo.pRasterizationState = nullptr;
+        }
+        if (!(flags & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT)) {
+            vkLibraryPipelineInfo.pDepthStencilState = nullptr;
+        }
+        if (!(flags & (VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT))) {
+            vkLibraryPipelineInfo.pMultisampleState = nullptr;
+        }
+        if (!(flags & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT)) {
+            vkLibraryPipelineInfo.pColorBlendState = nullptr;
+        }
+        if (!(flags & (VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT))) {
+            vkLibraryPipelineInfo.layout = VK_NULL_HANDLE;
+        }
+
+        VkPipeline library;
+        if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkLibraryPipelineInfo, vkAllocator, &library) != VK_SUCCESS) {
+            std::cerr << "Failed to create a " << name << " pipeline library!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_PIPELINE, library, name);
+        return library;
+    };
+    std::array< VkPipeline, 4 > vkPipelineLibraries {
+        createPipelineLibrary(vkPipelineInfo, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, "vertex input"),
+        createPipelineLibrary(vkPipelineInfo, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, "pre-rasterization"),
+        createPipelineLibrary(vkPipelineInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, "fragment shader"),
+        createPipelineLibrary(vkPipelineInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, "fragment output")
+    };
+
+    // Link all parts into a complete pipeline. All states come from the libraries.
+    VkPipelineLibraryCreateInfoKHR vkPipelineLibraryInfo{};
+    vkPipelineLibraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    vkPipelineLibraryInfo.libraryCount = static_cast< uint32_t >(vkPipelineLibraries.size());
+    vkPipelineLibraryInfo.pLibraries = vkPipelineLibraries.data();
+    VkGraphicsPipelineCreateInfo vkLinkedPipelineInfo{};
+    vkLinkedPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    vkLinkedPipelineInfo.pNext = &vkPipelineLibraryInfo;
+    vkLinkedPipelineInfo.flags = 0;
+    vkLinkedPipelineInfo.layout = vkPipelineLayout;
+    vkLinkedPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    vkLinkedPipelineInfo.basePipelineIndex = -1;
+
+    // Fast link.
+    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkLinkedPipelineInfo, vkAllocator, &vkGraphicsPipeline) != VK_SUCCESS) {
+        std::cerr << "Failed to link a graphics pipeline!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE, vkGraphicsPipeline, "Graphics pipeline (fast-linked)");
+    float graphicsPipelineLinkTime = std::chrono::duration< float, std::chrono::milliseconds::period >(std::chrono::high_resolution_clock::now() - graphicsPipelineLinkStartTime).count();
+    std::cout << "Graphics pipeline libraries compiled and fast-linked in " << graphicsPipelineLinkTime << " ms" << std::endl;
+
+    // Optimized link on a worker thread. Its create info is a separate copy,
+    // as nothing else may change it while the thread runs.
+    VkGraphicsPipelineCreateInfo vkOptimizedPipelineInfo = vkLinkedPipelineInfo;
+    vkOptimizedPipelineInfo.flags = VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+    auto optimizedPipelineTask = std::async(std::launch::async, [&]() {
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkOptimizedPipelineInfo, vkAllocator, &pipeline) != VK_SUCCESS) {
+            std::cerr << "Failed to link an optimized graphics pipeline!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_PIPELINE, pipeline, "Graphics pipeline (optimized)");
+        return pipeline;
+    });
+
+#elif defined(PARALLEL_STARTUP)
+    // Shader compilation makes pipeline creation the slowest call of the startup.
+    // Nothing but command buffer recording needs the pipeline, so compile it on
+    // a worker thread while framebuffers and command buffers are being created.
+    // The result is taken in STEP 33. All structures referenced by the create
+    // info stay alive till the end of main().
+    auto graphicsPipelineTask = std::async(std::launch::async, [&]() {
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkPipelineInfo, vkAllocator, &pipeline) != VK_SUCCESS) {
+            std::cerr << "Failed to create a graphics pipeline!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_PIPELINE, pipeline, "Graphics pipeline");
+        return pipeline;
+    });
+#else
+    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkPipelineInfo, vkAllocator, &vkGraphicsPipeline) != VK_SUCCESS) {
+        std::cerr << "Failed to create a graphics pipeline!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE, vkGraphicsPipeline, "Graphics pipeline");
+#endif
+
+#ifdef DEPTH_PREPASS
+
+    // --------------------------------------------------------------------------
+    // Create a depth prepass pipeline.
+    // --------------------------------------------------------------------------
+
+    // The depth-only pipeline does not need a fragment shader at all:
+    // depth is produced by the fixed function part, so the fragment stage
+    // is left empty which is the cheapest possible fragment stage.
+    std::array< VkPipelineShaderStageCreateInfo, 1 > prepassShaderStages {
+        vkVertShaderStageInfo
+    };
+
+    // There are no color attachments in the prepass subpass.
+    VkPipelineColorBlendStateCreateInfo vkPrepassColorBlending = vkColorBlending;
+    vkPrepassColorBlending.attachmentCount = 0;
+    vkPrepassColorBlending.pAttachments = nullptr;
+
+    // Reuse all other states of the main pipeline.
+    VkGraphicsPipelineCreateInfo vkPrepassPipelineInfo = vkPipelineInfo;
+    vkPrepassPipelineInfo.stageCount = prepassShaderStages.size();
+    vkPrepassPipelineInfo.pStages = prepassShaderStages.data();
+    vkPrepassPipelineInfo.pDepthStencilState = &vkPrepassDepthStencil;
+    vkPrepassPipelineInfo.pColorBlendState = &vkPrepassColorBlending;
+    vkPrepassPipelineInfo.subpass = 0;
+#ifdef DYNAMIC_RENDERING
+    // The prepass renders depth only.
+    VkPipelineRenderingCreateInfo vkPrepassRenderingInfo = vkPipelineRenderingInfo;
+    vkPrepassRenderingInfo.colorAttachmentCount = 0;
+    vkPrepassRenderingInfo.pColorAttachmentFormats = nullptr;
+    vkPrepassPipelineInfo.pNext = &vkPrepassRenderingInfo;
+#endif
+
+    // Create a pipeline.
+    VkPipeline vkPrepassPipeline;
+#ifdef GRAPHICS_PIPELINE_LIBRARY
+    // The prepass differs from the main pipeline in the fragment shader and
+    // fragment output parts only, so it reuses the vertex input part and
+    // compiles just its own depth-only parts. With a render pass the
+    // pre-rasterization part is tied to a subpass, so the prepass needs
+    // its own one as well.
+    std::array< VkPipeline, 4 > vkPrepassPipelineLibraries {
+        vkPipelineLibraries[0],
+#ifdef DYNAMIC_RENDERING
+        vkPipelineLibraries[1],
+#else
+        createPipelineLibrary(vkPrepassPipelineInfo, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, "depth prepass pre-rasterization"),
+#endif
+        createPipelineLibrary(vkPrepassPipelineInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, "depth prepass fragment shader"),
+        createPipelineLibrary(vkPrepassPipelineInfo, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, "depth prepass fragment output")
+    };
+    VkPipelineLibraryCreateInfoKHR vkPrepassPipelineLibraryInfo = vkPipelineLibraryInfo;
+    vkPrepassPipelineLibraryInfo.libraryCount = static_cast< uint32_t >(vkPrepassPipelineLibraries.size());
+    vkPrepassPipelineLibraryInfo.pLibraries = vkPrepassPipelineLibraries.data();
+    VkGraphicsPipelineCreateInfo vkLinkedPrepassPipelineInfo = vkLinkedPipelineInfo;
+    vkLinkedPrepassPipelineInfo.pNext = &vkPrepassPipelineLibraryInfo;
+
+    // Fast link.
+    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkLinkedPrepassPipelineInfo, vkAllocator, &vkPrepassPipeline) != VK_SUCCESS) {
+        std::cerr << "Failed to link a depth prepass pipeline!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE, vkPrepassPipeline, "Depth prepass pipeline (fast-linked)");
+
+    // Optimized link on a worker thread, it replaces the fast-linked pipeline
+    // together with the main one.
+    VkGraphicsPipelineCreateInfo vkOptimizedPrepassPipelineInfo = vkLinkedPrepassPipelineInfo;
+    vkOptimizedPrepassPipelineInfo.flags = VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+    auto optimizedPrepassPipelineTask = std::async(std::launch::async, [&]() {
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkOptimizedPrepassPipelineInfo, vkAllocator, &pipeline) != VK_SUCCESS) {
+            std::cerr << "Failed to link an optimized depth prepass pipeline!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_PIPELINE, pipeline, "Depth prepass pipeline (optimized)");
+        return pipeline;
+    });
+#else
+    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkPrepassPipelineInfo, vkAllocator, &vkPrepassPipeline) != VK_SUCCESS) {
+        std::cerr << "Failed to create a depth prepass pipeline!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE, vkPrepassPipeline, "Depth prepass pipeline");
+#endif
+
+#endif
+
+#ifdef DEFERRED_SHADING
+
+    // --------------------------------------------------------------------------
+    // Create a lighting pipeline.
+    // --------------------------------------------------------------------------
+    // The lighting subpass draws a single triangle covering the whole screen.
+    // Its vertices are generated from indices in the vertex shader, so there is
+    // no vertex buffer. The fragment shader lights each sample of the G-buffer
+    // and writes the average, so MSAA keeps working: the color attachment is
+    // resolved at the end of the subpass as in forward mode.
+    // --------------------------------------------------------------------------
+
+    VkShaderModule vkFullscreenShaderModule = loadShaderModule("fullscreen.vert.spv");
+    VkShaderModule vkLightingShaderModule = loadShaderModule("lighting.frag.spv");
+
+    // The shader loops over samples of the G-buffer, the count is known
+    // only at runtime and is passed as a specialization constant.
+    uint32_t lightingSampleCount = static_cast< uint32_t >(vkMsaaSamples);
+    VkSpecializationMapEntry vkLightingSpecializationEntry{};
+    vkLightingSpecializationEntry.constantID = 0;
+    vkLightingSpecializationEntry.offset = 0;
+    vkLightingSpecializationEntry.size = sizeof(lightingSampleCount);
+    VkSpecializationInfo vkLightingSpecializationInfo{};
+    vkLightingSpecializationInfo.mapEntryCount = 1;
+    vkLightingSpecializationInfo.pMapEntries = &vkLightingSpecializationEntry;
+    vkLightingSpecializationInfo.dataSize = sizeof(lightingSampleCount);
+    vkLightingSpecializationInfo.pData = &lightingSampleCount;
+
+    // Create pipeline stages.
+    std::array< VkPipelineShaderStageCreateInfo, 2 > lightingShaderStages{};
+    lightingShaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    lightingShaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    lightingShaderStages[0].module = vkFullscreenShaderModule;
+    lightingShaderStages[0].pName = "main";
+    lightingShaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    lightingShaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    lightingShaderStages[1].module = vkLightingShaderModule;
+    lightingShaderStages[1].pName = "main";
+    lightingShaderStages[1].pSpecializationInfo = &vkLightingSpecializationInfo;
+
+    // Both G-buffer attachments are read as input attachments.
+    std::array< VkDescriptorSetLayoutBinding, 2 > vkLightingBindings{};
+    for (uint32_t i = 0; i < vkLightingBindings.size(); i++) {
+        vkLightingBindings[i].binding = i;
+        vkLightingBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        vkLightingBindings[i].descriptorCount = 1;
+        vkLightingBindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        vkLightingBindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo vkLightingLayoutInfo{};
+    vkLightingLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    vkLightingLayoutInfo.bindingCount = static_cast< uint32_t >(vkLightingBindings.size());
+    vkLightingLayoutInfo.pBindings = vkLightingBindings.data();
+    VkDescriptorSetLayout vkLightingDescriptorSetLayout;
+    if (vkCreateDescriptorSetLayout(vkDevice, &vkLightingLayoutInfo, vkAllocator, &vkLightingDescriptorSetLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor set layout" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, vkLightingDescriptorSetLayout, "Lighting descriptor set layout");
+
+    // The G-buffer is shared by all framebuffers, so a single descriptor set is enough.
+    VkDescriptorPoolSize vkLightingPoolSize{};
+    vkLightingPoolSize.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    vkLightingPoolSize.descriptorCount = static_cast< uint32_t >(vkLightingBindings.size());
+    VkDescriptorPoolCreateInfo vkLightingDescriptorPoolInfo{};
+    vkLightingDescriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    vkLightingDescriptorPoolInfo.poolSizeCount = 1;
+    vkLightingDescriptorPoolInfo.pPoolSizes = &vkLightingPoolSize;
+    vkLightingDescriptorPoolInfo.maxSets = 1;
+    VkDescriptorPool vkLightingDescriptorPool;
+    if (vkCreateDescriptorPool(vkDevice, &vkLightingDescriptorPoolInfo, vkAllocator, &vkLightingDescriptorPool) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor pool!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, vkLightingDescriptorPool, "Lighting descriptor pool");
+
+    VkDescriptorSetAllocateInfo vkLightingDescriptorSetAllocInfo{};
+    vkLightingDescriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    vkLightingDescriptorSetAllocInfo.descriptorPool = vkLightingDescriptorPool;
+    vkLightingDescriptorSetAllocInfo.descriptorSetCount = 1;
+    vkLightingDescriptorSetAllocInfo.pSetLayouts = &vkLightingDescriptorSetLayout;
+    VkDescriptorSet vkLightingDescriptorSet;
+    if (vkAllocateDescriptorSets(vkDevice, &vkLightingDescriptorSetAllocInfo, &vkLightingDescriptorSet) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate descriptor set!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET, vkLightingDescriptorSet, "Lighting descriptor set");
+
+    // Input attachments have no sampler, the layout is the one of the lighting subpass.
+    std::array< VkDescriptorImageInfo, 2 > vkLightingImageInfos{};
+    std::array< VkWriteDescriptorSet, 2 > vkLightingDescriptorWrites{};
+    for (uint32_t i = 0; i < vkLightingDescriptorWrites.size(); i++) {
+        vkLightingImageInfos[i] = { VK_NULL_HANDLE, gBufferImageViews[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        vkLightingDescriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        vkLightingDescriptorWrites[i].dstSet = vkLightingDescriptorSet;
+        vkLightingDescriptorWrites[i].dstBinding = i;
+        vkLightingDescriptorWrites[i].dstArrayElement = 0;
+        vkLightingDescriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        vkLightingDescriptorWrites[i].descriptorCount = 1;
+        vkLightingDescriptorWrites[i].pImageInfo = &vkLightingImageInfos[i];
+    }
+    vkUpdateDescriptorSets(vkDevice, static_cast< uint32_t >(vkLightingDescriptorWrites.size()), vkLightingDescriptorWrites.data(), 0, nullptr);
+
+    // Define a pipeline layout.
+    VkPipelineLayoutCreateInfo vkLightingPipelineLayoutInfo{};
+    vkLightingPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    vkLightingPipelineLayoutInfo.setLayoutCount = 1;
+    vkLightingPipelineLayoutInfo.pSetLayouts = &vkLightingDescriptorSetLayout;
+    VkPipelineLayout vkLightingPipelineLayout;
+    if (vkCreatePipelineLayout(vkDevice, &vkLightingPipelineLayoutInfo, vkAllocator, &vkLightingPipelineLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to creare a pipeline layout!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, vkLightingPipelineLayout, "Lighting pipeline layout");
+
+    // No vertex buffers.
+    VkPipelineVertexInputStateCreateInfo vkLightingVertexInputInfo{};
+    vkLightingVertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    // The triangle is not culled, whatever the winding order is.
+    VkPipelineRasterizationStateCreateInfo vkLightingRasterizer = vkRasterizer;
+    vkLightingRasterizer.cullMode = VK_CULL_MODE_NONE;
+
+    // The lighting subpass writes only the color attachment.
+    VkPipelineColorBlendStateCreateInfo vkLightingColorBlending = vkColorBlending;
+    vkLightingColorBlending.attachmentCount = 1;
+    vkLightingColorBlending.pAttachments = &vkColorBlendAttachment;
+
+    // Reuse all other states of the main pipeline. There is no depth attachment.
+    VkGraphicsPipelineCreateInfo vkLightingPipelineInfo = vkPipelineInfo;
+    vkLightingPipelineInfo.stageCount = lightingShaderStages.size();
+    vkLightingPipelineInfo.pStages = lightingShaderStages.data();
+    vkLightingPipelineInfo.pVertexInputState = &vkLightingVertexInputInfo;
+    vkLightingPipelineInfo.pRasterizationState = &vkLightingRasterizer;
+    vkLightingPipelineInfo.pDepthStencilState = nullptr;
+    vkLightingPipelineInfo.pColorBlendState = &vkLightingColorBlending;
+    vkLightingPipelineInfo.layout = vkLightingPipelineLayout;
+    vkLightingPipelineInfo.subpass = lightingSubpassIndex;
+
+    // Create a pipeline.
+    VkPipeline vkLightingPipeline;
+    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkLightingPipelineInfo, vkAllocator, &vkLightingPipeline) != VK_SUCCESS) {
+        std::cerr << "Failed to create a lighting pipeline!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE, vkLightingPipeline, "Lighting pipeline");
+
+#endif
+
+#ifdef OVERDRAW_MODE
+
+    // --------------------------------------------------------------------------
+    // Create an overdraw measurement pass.
+    // --------------------------------------------------------------------------
+    // The scene is drawn once more into a single channel float image without
+    // depth test. Each fragment adds 1.0 with additive blending, so after the
+    // pass each pixel keeps the amount of fragments shaded for it. The image
+    // is copied into a host visible buffer and analyzed on CPU a few frames
+    // later, when the fence of the command buffer is signaled.
+    // R32_UINT can not be blended, and blending is guaranteed for R16_SFLOAT
+    // which keeps integers exactly up to 2048 - enough for any sane overdraw.
+    // Sample shading is off, so with MSAA a fragment shader also runs once
+    // per pixel and primitive; the pass uses 1 sample and gives the same count.
+    // --------------------------------------------------------------------------
+
+    VkFormat overdrawFormat = VK_FORMAT_R16_SFLOAT;
+
+    VkShaderModule vkOverdrawShaderModule = loadShaderModule("overdraw.frag.spv");
+
+    // Create a pipeline stage for the overdraw fragment shader.
+    VkPipelineShaderStageCreateInfo vkOverdrawShaderStageInfo{};
+    vkOverdrawShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vkOverdrawShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    vkOverdrawShaderStageInfo.module = vkOverdrawShaderModule;
+    vkOverdrawShaderStageInfo.pName = "main";
+    std::array< VkPipelineShaderStageCreateInfo, 2 > overdrawShaderStages {
+        vkVertShaderStageInfo,
+        vkOverdrawShaderStageInfo
+    };
+
+    // Describe the only attachment of the overdraw pass.
+    // It ends up ready to be copied into a buffer.
+    VkAttachmentDescription vkOverdrawAttachment{};
+    vkOverdrawAttachment.format = overdrawFormat;
+    vkOverdrawAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    vkOverdrawAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    vkOverdrawAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    vkOverdrawAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    vkOverdrawAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    vkOverdrawAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    vkOverdrawAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    VkAttachmentReference vkOverdrawAttachmentRef{};
+    vkOverdrawAttachmentRef.attachment = 0;
+    vkOverdrawAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription vkOverdrawSubpass{};
+    vkOverdrawSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    vkOverdrawSubpass.colorAttachmentCount = 1;
+    vkOverdrawSubpass.pColorAttachments = &vkOverdrawAttachmentRef;
+
+    // The copy should wait until the counts are written.
+    VkSubpassDependency vkOverdrawDependency{};
+    vkOverdrawDependency.srcSubpass = 0;
+    vkOverdrawDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    vkOverdrawDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    vkOverdrawDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    vkOverdrawDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    vkOverdrawDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo vkOverdrawRenderPassInfo{};
+    vkOverdrawRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    vkOverdrawRenderPassInfo.attachmentCount = 1;
+    vkOverdrawRenderPassInfo.pAttachments = &vkOverdrawAttachment;
+    vkOverdrawRenderPassInfo.subpassCount = 1;
+    vkOverdrawRenderPassInfo.pSubpasses = &vkOverdrawSubpass;
+    vkOverdrawRenderPassInfo.dependencyCount = 1;
+    vkOverdrawRenderPassInfo.pDependencies = &vkOverdrawDependency;
+
+    VkRenderPass vkOverdrawRenderPass;
+    if (vkCreateRenderPass(vkDevice, &vkOverdrawRenderPassInfo, vkAllocator, &vkOverdrawRenderPass) != VK_SUCCESS) {
+        std::cerr << "Failed to create an overdraw render pass!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_RENDER_PASS, vkOverdrawRenderPass, "Overdraw render pass");
+
+    // No MSAA in the overdraw pass.
+    VkPipelineMultisampleStateCreateInfo vkOverdrawMultisampling = vkMultisampling;
+    vkOverdrawMultisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    // Every fragment adds 1.0 to the value of the pixel.
+    VkPipelineColorBlendAttachmentState vkOverdrawBlendAttachment{};
+    vkOverdrawBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT;
+    vkOverdrawBlendAttachment.blendEnable = VK_TRUE;
+    vkOverdrawBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    vkOverdrawBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    vkOverdrawBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    vkOverdrawBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    vkOverdrawBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    vkOverdrawBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo vkOverdrawColorBlending = vkColorBlending;
+    vkOverdrawColorBlending.attachmentCount = 1;
+    vkOverdrawColorBlending.pAttachments = &vkOverdrawBlendAttachment;
+
+    // Reuse all other states of the main pipeline.
+    // There is no depth attachment, so every fragment passes.
+    VkGraphicsPipelineCreateInfo vkOverdrawPipelineInfo = vkPipelineInfo;
+    vkOverdrawPipelineInfo.stageCount = overdrawShaderStages.size();
+    vkOverdrawPipelineInfo.pStages = overdrawShaderStages.data();
+    vkOverdrawPipelineInfo.pMultisampleState = &vkOverdrawMultisampling;
+    vkOverdrawPipelineInfo.pDepthStencilState = nullptr;
+    vkOverdrawPipelineInfo.pColorBlendState = &vkOverdrawColorBlending;
+    vkOverdrawPipelineInfo.pNext = nullptr;
+    vkOverdrawPipelineInfo.renderPass = vkOverdrawRenderPass;
+    vkOverdrawPipelineInfo.subpass = 0;
+
+    VkPipeline vkOverdrawPipeline;
+    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkOverdrawPipelineInfo, vkAllocator, &vkOverdrawPipeline) != VK_SUCCESS) {
+        std::cerr << "Failed to create an overdraw pipeline!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE, vkOverdrawPipeline, "Overdraw pipeline");
+
+    // Create an image, a framebuffer and a readback buffer per frame in flight,
+    // because each command buffer is resubmitted only after its fence is signaled.
+    size_t overdrawPixelCount = static_cast< size_t >(vkRenderExtent.width) * vkRenderExtent.height;
+    VkDeviceSize overdrawBufferSize = overdrawPixelCount * sizeof(uint16_t);
+    std::vector< VkImage > vkOverdrawImages(MAX_FRAMES_IN_FLIGHT);
+    std::vector< VkDeviceMemory > vkOverdrawImagesMemory(MAX_FRAMES_IN_FLIGHT);
+    std::vector< VkImageView > vkOverdrawImageViews(MAX_FRAMES_IN_FLIGHT);
+    std::vector< VkFramebuffer > vkOverdrawFramebuffers(MAX_FRAMES_IN_FLIGHT);
+    std::vector< VkBuffer > vkOverdrawBuffers(MAX_FRAMES_IN_FLIGHT);
+    std::vector< VkDeviceMemory > vkOverdrawBuffersMemory(MAX_FRAMES_IN_FLIGHT);
+    std::vector< const uint16_t* > overdrawBuffersData(MAX_FRAMES_IN_FLIGHT);
+    const VkPhysicalDeviceMemoryProperties& vkOverdrawMemProperties = deviceCapabilities.memoryProperties;
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        // Describe an image.
+        VkImageCreateInfo vkOverdrawImageInfo{};
+        vkOverdrawImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        vkOverdrawImageInfo.imageType = VK_IMAGE_TYPE_2D;
+        vkOverdrawImageInfo.extent.width = vkRenderExtent.width;
+        vkOverdrawImageInfo.extent.height = vkRenderExtent.height;
+        vkOverdrawImageInfo.extent.depth = 1;
+        vkOverdrawImageInfo.mipLevels = 1;
+        vkOverdrawImageInfo.arrayLayers = 1;
+        vkOverdrawImageInfo.format = overdrawFormat;
+        vkOverdrawImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        vkOverdrawImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        vkOverdrawImageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        vkOverdrawImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        vkOverdrawImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        // Create an image.
+        if (vkCreateImage(vkDevice, &vkOverdrawImageInfo, vkAllocator, &vkOverdrawImages[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create an overdraw image!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_IMAGE, vkOverdrawImages[i], "Overdraw image", i);
+
+        // Allocate device local memory for the image.
+        VkMemoryRequirements vkOverdrawImageMemRequirements;
+        vkGetImageMemoryRequirements(vkDevice, vkOverdrawImages[i], &vkOverdrawImageMemRequirements);
+        VkMemoryAllocateInfo vkOverdrawImageAllocInfo{};
+        vkOverdrawImageAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        vkOverdrawImageAllocInfo.allocationSize = vkOverdrawImageMemRequirements.size;
+        vkOverdrawImageAllocInfo.memoryTypeIndex = UINT32_MAX;
+        for (uint32_t j = 0; j < vkOverdrawMemProperties.memoryTypeCount; j++) {
+            if ((vkOverdrawImageMemRequirements.memoryTypeBits & (1 << j)) &&
+                    (vkOverdrawMemProperties.memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+                vkOverdrawImageAllocInfo.memoryTypeIndex = j;
+                break;
+            }
+        }
+        if (vkAllocateMemory(vkDevice, &vkOverdrawImageAllocInfo, vkAllocator, &vkOverdrawImagesMemory[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate image memory!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, vkOverdrawImagesMemory[i], "Overdraw image memory", i);
+        vkBindImageMemory(vkDevice, vkOverdrawImages[i], vkOverdrawImagesMemory[i], 0);
+
+        // Create an image view.
+        VkImageViewCreateInfo vkOverdrawViewInfo{};
+        vkOverdrawViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        vkOverdrawViewInfo.image = vkOverdrawImages[i];
+        vkOverdrawViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        vkOverdrawViewInfo.format = overdrawFormat;
+        vkOverdrawViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        vkOverdrawViewInfo.subresourceRange.baseMipLevel = 0;
+        vkOverdrawViewInfo.subresourceRange.levelCount = 1;
+        vkOverdrawViewInfo.subresourceRange.baseArrayLayer = 0;
+        vkOverdrawViewInfo.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(vkDevice, &vkOverdrawViewInfo, vkAllocator, &vkOverdrawImageViews[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create an overdraw image view!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, vkOverdrawImageViews[i], "Overdraw image view", i);
+
+        // Create a framebuffer.
+        VkFramebufferCreateInfo vkOverdrawFramebufferInfo{};
+        vkOverdrawFramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        vkOverdrawFramebufferInfo.renderPass = vkOverdrawRenderPass;
+        vkOverdrawFramebufferInfo.attachmentCount = 1;
+        vkOverdrawFramebufferInfo.pAttachments = &vkOverdrawImageViews[i];
+        vkOverdrawFramebufferInfo.width = vkRenderExtent.width;
+        vkOverdrawFramebufferInfo.height = vkRenderExtent.height;
+        vkOverdrawFramebufferInfo.layers = 1;
+        if (vkCreateFramebuffer(vkDevice, &vkOverdrawFramebufferInfo, vkAllocator, &vkOverdrawFramebuffers[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create a framebuffer!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_FRAMEBUFFER, vkOverdrawFramebuffers[i], "Overdraw framebuffer", i);
+
+        // Create a readback buffer.
+        VkBufferCreateInfo vkOverdrawBufferInfo{};
+        vkOverdrawBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        vkOverdrawBufferInfo.size = overdrawBufferSize;
+        vkOverdrawBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        vkOverdrawBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(vkDevice, &vkOverdrawBufferInfo, vkAllocator, &vkOverdrawBuffers[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create an overdraw buffer!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_BUFFER, vkOverdrawBuffers[i], "Overdraw readback buffer", i);
+
+        // Allocate host visible memory for the buffer.
+        VkMemoryRequirements vkOverdrawBufferMemRequirements;
+        vkGetBufferMemoryRequirements(vkDevice, vkOverdrawBuffers[i], &vkOverdrawBufferMemRequirements);
+        VkMemoryPropertyFlags vkOverdrawBufferMemFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        VkMemoryAllocateInfo vkOverdrawBufferAllocInfo{};
+        vkOverdrawBufferAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        vkOverdrawBufferAllocInfo.allocationSize = vkOverdrawBufferMemRequirements.size;
+        vkOverdrawBufferAllocInfo.memoryTypeIndex = UINT32_MAX;
+        for (uint32_t j = 0; j < vkOverdrawMemProperties.memoryTypeCount; j++) {
+            if ((vkOverdrawBufferMemRequirements.memoryTypeBits & (1 << j)) &&
+                    (vkOverdrawMemProperties.memoryTypes[j].propertyFlags & vkOverdrawBufferMemFlags) == vkOverdrawBufferMemFlags) {
+                vkOverdrawBufferAllocInfo.memoryTypeIndex = j;
+                break;
+            }
+        }
+        if (vkAllocateMemory(vkDevice, &vkOverdrawBufferAllocInfo, vkAllocator, &vkOverdrawBuffersMemory[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate memory for the overdraw buffer!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, vkOverdrawBuffersMemory[i], "Overdraw readback buffer memory", i);
+        vkBindBufferMemory(vkDevice, vkOverdrawBuffers[i], vkOverdrawBuffersMemory[i], 0);
+
+        // Keep the buffer mapped all the time.
+        void* overdrawBufferData;
+        vkMapMemory(vkDevice, vkOverdrawBuffersMemory[i], 0, overdrawBufferSize, 0, &overdrawBufferData);
+        overdrawBuffersData[i] = static_cast< const uint16_t* >(overdrawBufferData);
+    }
+
+    // Print average and maximal overdraw and a histogram of the image
+    // rendered by the given frame in flight.
+    auto reportOverdraw = [&](size_t frame) {
+        const uint16_t* counts = overdrawBuffersData[frame];
+        // The last bucket keeps all pixels drawn 8 times and more.
+        std::array< size_t, 9 > histogram{};
+        uint64_t fragmentCount = 0;
+        size_t coveredPixelCount = 0;
+        uint32_t maxOverdraw = 0;
+        for (size_t i = 0; i < overdrawPixelCount; i++) {
+            uint32_t count = static_cast< uint32_t >(glm::unpackHalf1x16(counts[i]));
+            fragmentCount += count;
+            coveredPixelCount += (count > 0) ? 1 : 0;
+            maxOverdraw = std::max(maxOverdraw, count);
+            histogram[std::min< size_t >(count, histogram.size() - 1)]++;
+        }
+        std::ostringstream line;
+        line << "Overdraw: average " << (coveredPixelCount > 0 ? static_cast< float >(fragmentCount) / coveredPixelCount : 0.0f)
+             << " per covered pixel, " << static_cast< float >(fragmentCount) / overdrawPixelCount
+             << " per pixel, max " << maxOverdraw << "; histogram:";
+        for (size_t i = 0; i < histogram.size(); i++) {
+            line << " " << i << (i + 1 == histogram.size() ? "+" : "") << ":"
+                 << 100.0f * histogram[i] / overdrawPixelCount << "%";
+        }
+        logMessage(LOG_SEVERITY_INFO, 0, line.str().c_str());
+    };
+
+#endif
+
+#if defined(TAA) || defined(POST_PROCESSING)
+
+    // Describe a layout transition of a whole color image.
+    auto colorImageBarrier = [](VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) {
+        VkImageMemoryBarrier vkBarrier{};
+        vkBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        vkBarrier.srcAccessMask = srcAccessMask;
+        vkBarrier.dstAccessMask = dstAccessMask;
+        vkBarrier.oldLayout = oldLayout;
+        vkBarrier.newLayout = newLayout;
+        vkBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        vkBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        vkBarrier.image = image;
+        vkBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        vkBarrier.subresourceRange.baseMipLevel = 0;
+        vkBarrier.subresourceRange.levelCount = 1;
+        vkBarrier.subresourceRange.baseArrayLayer = 0;
+        vkBarrier.subresourceRange.layerCount = 1;
+        return vkBarrier;
+    };
+
+#endif
+
+#ifdef TAA
+
+    // --------------------------------------------------------------------------
+    // Create a TAA resolve pass.
+    // --------------------------------------------------------------------------
+    // Each frame the projection is shifted by a different sub-pixel offset,
+    // so over several frames every pixel gathers samples from different
+    // points, like MSAA does within a single frame. A compute shader blends
+    // the current frame with the accumulated history reprojected by motion
+    // vectors. The history is limited by colors around the pixel, which
+    // removes ghosts of pixels that became hidden. The result is copied into
+    // the history for the next frame and blitted into the swap chain image.
+    // --------------------------------------------------------------------------
+
+    VkShaderModule vkTaaShaderModule = loadShaderModule("taa.comp.spv");
+
+    // Create a device local image of the scene size in the scene format with its view.
+    // The history and the resolve result are shared by all command buffers
+    // in the same way as the color and depth attachments are.
+    const VkPhysicalDeviceMemoryProperties& vkTaaMemProperties = deviceCapabilities.memoryProperties;
+    auto createTaaImage = [&](VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory, VkImageView& view) {
+        VkImageCreateInfo vkTaaImageInfo = vkColorImageInfo;
+        vkTaaImageInfo.usage = usage;
+        if (vkCreateImage(vkDevice, &vkTaaImageInfo, vkAllocator, &image) != VK_SUCCESS) {
+            std::cerr << "Failed to create a TAA image!" << std::endl;
+            abort();
+        }
+
+        VkMemoryRequirements vkTaaMemRequirements;
+        vkGetImageMemoryRequirements(vkDevice, image, &vkTaaMemRequirements);
+        VkMemoryAllocateInfo vkTaaAllocInfo{};
+        vkTaaAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        vkTaaAllocInfo.allocationSize = vkTaaMemRequirements.size;
+        vkTaaAllocInfo.memoryTypeIndex = UINT32_MAX;
+        for (uint32_t j = 0; j < vkTaaMemProperties.memoryTypeCount; j++) {
+            if ((vkTaaMemRequirements.memoryTypeBits & (1 << j)) &&
+                    (vkTaaMemProperties.memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+                vkTaaAllocInfo.memoryTypeIndex = j;
+                break;
+            }
+        }
+        if (vkAllocateMemory(vkDevice, &vkTaaAllocInfo, vkAllocator, &memory) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate image memory!" << std::endl;
+            abort();
+        }
+        vkBindImageMemory(vkDevice, image, memory, 0);
+
+        VkImageViewCreateInfo vkTaaViewInfo = vkColorImageViewInfo;
+        vkTaaViewInfo.image = image;
+        if (vkCreateImageView(vkDevice, &vkTaaViewInfo, vkAllocator, &view) != VK_SUCCESS) {
+            std::cerr << "Failed to create a TAA image view!" << std::endl;
+            abort();
+        }
+    };
+
+    // The history is sampled by the shader and overwritten by a copy.
+    VkImage taaHistoryImage;
+    VkDeviceMemory taaHistoryImageMemory;
+    VkImageView taaHistoryImageView;
+    createTaaImage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, taaHistoryImage, taaHistoryImageMemory, taaHistoryImageView);
+    setDebugName(VK_OBJECT_TYPE_IMAGE, taaHistoryImage, "TAA history");
+    setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, taaHistoryImageMemory, "TAA history memory");
+    setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, taaHistoryImageView, "TAA history view");
+
+    // The result is written by the shader and copied to the history and the swap chain.
+    VkImage taaOutputImage;
+    VkDeviceMemory taaOutputImageMemory;
+    VkImageView taaOutputImageView;
+#ifdef POST_PROCESSING
+    // It is also sampled by the first post-processing pass.
+    createTaaImage(VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, taaOutputImage, taaOutputImageMemory, taaOutputImageView);
+#else
+    createTaaImage(VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, taaOutputImage, taaOutputImageMemory, taaOutputImageView);
+#endif
+    setDebugName(VK_OBJECT_TYPE_IMAGE, taaOutputImage, "TAA output");
+    setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, taaOutputImageMemory, "TAA output memory");
+    setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, taaOutputImageView, "TAA output view");
+
+    // The history is reprojected to fractional positions, so it is filtered.
+    VkSamplerCreateInfo vkTaaSamplerInfo{};
+    vkTaaSamplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    vkTaaSamplerInfo.magFilter = VK_FILTER_LINEAR;
+    vkTaaSamplerInfo.minFilter = VK_FILTER_LINEAR;
+    vkTaaSamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    vkTaaSamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    vkTaaSamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    vkTaaSamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    vkTaaSamplerInfo.anisotropyEnable = VK_FALSE;
+    vkTaaSamplerInfo.maxAnisotropy = 1.0f;
+    vkTaaSamplerInfo.compareEnable = VK_FALSE;
+    vkTaaSamplerInfo.minLod = 0.0f;
+    vkTaaSamplerInfo.maxLod = 0.0f;
+    vkTaaSamplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    vkTaaSamplerInfo.unnormalizedCoordinates = VK_FALSE;
+    VkSampler vkTaaSampler;
+    if (vkCreateSampler(vkDevice, &vkTaaSamplerInfo, vkAllocator, &vkTaaSampler) != VK_SUCCESS) {
+        std::cerr << "Failed to create a TAA sampler!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_SAMPLER, vkTaaSampler, "TAA sampler");
+
+    // Bindings: the scene, motion vectors, the history and the result.
+    std::array< VkDescriptorSetLayoutBinding, 4 > vkTaaBindings{};
+    for (uint32_t i = 0; i < vkTaaBindings.size(); i++) {
+        vkTaaBindings[i].binding = i;
+        vkTaaBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        vkTaaBindings[i].descriptorCount = 1;
+        vkTaaBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        vkTaaBindings[i].pImmutableSamplers = nullptr;
+    }
+    vkTaaBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+    VkDescriptorSetLayoutCreateInfo vkTaaLayoutInfo{};
+    vkTaaLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    vkTaaLayoutInfo.bindingCount = static_cast< uint32_t >(vkTaaBindings.size());
+    vkTaaLayoutInfo.pBindings = vkTaaBindings.data();
+    VkDescriptorSetLayout vkTaaDescriptorSetLayout;
+    if (vkCreateDescriptorSetLayout(vkDevice, &vkTaaLayoutInfo, vkAllocator, &vkTaaDescriptorSetLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor set layout" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, vkTaaDescriptorSetLayout, "TAA descriptor set layout");
+
+    // All images are shared, so a single descriptor set is enough.
+    std::array< VkDescriptorPoolSize, 2 > vkTaaPoolSizes{};
+    vkTaaPoolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    vkTaaPoolSizes[0].descriptorCount = 3;
+    vkTaaPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    vkTaaPoolSizes[1].descriptorCount = 1;
+    VkDescriptorPoolCreateInfo vkTaaDescriptorPoolInfo{};
+    vkTaaDescriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    vkTaaDescriptorPoolInfo.poolSizeCount = static_cast< uint32_t >(vkTaaPoolSizes.size());
+    vkTaaDescriptorPoolInfo.pPoolSizes = vkTaaPoolSizes.data();
+    vkTaaDescriptorPoolInfo.maxSets = 1;
+    VkDescriptorPool vkTaaDescriptorPool;
+    if (vkCreateDescriptorPool(vkDevice, &vkTaaDescriptorPoolInfo, vkAllocator, &vkTaaDescriptorPool) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor pool!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, vkTaaDescriptorPool, "TAA descriptor pool");
+
+    VkDescriptorSetAllocateInfo vkTaaDescriptorSetAllocInfo{};
+    vkTaaDescriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    vkTaaDescriptorSetAllocInfo.descriptorPool = vkTaaDescriptorPool;
+    vkTaaDescriptorSetAllocInfo.descriptorSetCount = 1;
+    vkTaaDescriptorSetAllocInfo.pSetLayouts = &vkTaaDescriptorSetLayout;
+    VkDescriptorSet vkTaaDescriptorSet;
+    if (vkAllocateDescriptorSets(vkDevice, &vkTaaDescriptorSetAllocInfo, &vkTaaDescriptorSet) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate descriptor set!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET, vkTaaDescriptorSet, "TAA descriptor set");
+
+    // Layouts the images have while the resolve shader runs.
+    std::array< VkDescriptorImageInfo, 4 > vkTaaImageInfos{};
+    vkTaaImageInfos[0] = { vkTaaSampler, colorImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    vkTaaImageInfos[1] = { vkTaaSampler, velocityImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    vkTaaImageInfos[2] = { vkTaaSampler, taaHistoryImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    vkTaaImageInfos[3] = { VK_NULL_HANDLE, taaOutputImageView, VK_IMAGE_LAYOUT_GENERAL };
+    std::array< VkWriteDescriptorSet, 4 > vkTaaDescriptorWrites{};
+    for (uint32_t i = 0; i < vkTaaDescriptorWrites.size(); i++) {
+        vkTaaDescriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        vkTaaDescriptorWrites[i].dstSet = vkTaaDescriptorSet;
+        vkTaaDescriptorWrites[i].dstBinding = i;
+        vkTaaDescriptorWrites[i].dstArrayElement = 0;
+        vkTaaDescriptorWrites[i].descriptorType = vkTaaBindings[i].descriptorType;
+        vkTaaDescriptorWrites[i].descriptorCount = 1;
+        vkTaaDescriptorWrites[i].pImageInfo = &vkTaaImageInfos[i];
+    }
+    vkUpdateDescriptorSets(vkDevice, static_cast< uint32_t >(vkTaaDescriptorWrites.size()), vkTaaDescriptorWrites.data(), 0, nullptr);
+
+    // Define a pipeline layout.
+    VkPipelineLayoutCreateInfo vkTaaPipelineLayoutInfo{};
+    vkTaaPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    vkTaaPipelineLayoutInfo.setLayoutCount = 1;
+    vkTaaPipelineLayoutInfo.pSetLayouts = &vkTaaDescriptorSetLayout;
+    VkPipelineLayout vkTaaPipelineLayout;
+    if (vkCreatePipelineLayout(vkDevice, &vkTaaPipelineLayoutInfo, vkAllocator, &vkTaaPipelineLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to creare a pipeline layout!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, vkTaaPipelineLayout, "TAA pipeline layout");
+
+    // Create a compute pipeline.
+    VkComputePipelineCreateInfo vkTaaPipelineInfo{};
+    vkTaaPipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    vkTaaPipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vkTaaPipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    vkTaaPipelineInfo.stage.module = vkTaaShaderModule;
+    vkTaaPipelineInfo.stage.pName = "main";
+    vkTaaPipelineInfo.layout = vkTaaPipelineLayout;
+    vkTaaPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    vkTaaPipelineInfo.basePipelineIndex = -1;
+    VkPipeline vkTaaPipeline;
+    if (vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, &vkTaaPipelineInfo, vkAllocator, &vkTaaPipeline) != VK_SUCCESS) {
+        std::cerr << "Failed to create a TAA pipeline!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE, vkTaaPipeline, "TAA pipeline");
+
+#endif
+
+#ifdef POST_PROCESSING
+
+    // --------------------------------------------------------------------------
+    // Create a post-processing chain.
+    // --------------------------------------------------------------------------
+    // Post-processing is an ordered list of compute passes. Each pass samples
+    // the output of the previous one and writes its own storage image, the
+    // first pass takes the resolved scene. The last output is blitted into the
+    // swap chain image. Passes before upscaling run in the render size, so a
+    // lower RENDER_SCALE makes both the scene and these passes cheaper.
+    // --------------------------------------------------------------------------
+
+    // Description of a post-processing pass.
+    struct PostProcessingPass {
+        // Name printed with GPU time of the pass.
+        const char* name;
+        // File with SPIR-V code of the compute shader.
+        const char* shaderFileName;
+        // Size of the output image.
+        VkExtent2D extent;
+        // Objects created for the pass.
+        VkShaderModule shaderModule;
+        VkPipeline pipeline;
+        VkImage image;
+        VkDeviceMemory imageMemory;
+        VkImageView imageView;
+        VkDescriptorSet descriptorSet;
+    };
+
+    // Passes in the order of execution.
+    std::vector< PostProcessingPass > postProcessingPasses {
+        { "FXAA", "fxaa.comp.spv", vkRenderExtent },
+        { "upscale", "upscale.comp.spv", vkSelectedExtent },
+        { "sharpen", "sharpen.comp.spv", vkSelectedExtent },
+        { "color grading", "grade.comp.spv", vkSelectedExtent }
+    };
+
+    // The scene sampled by the first pass.
+#ifdef TAA
+    VkImageView postProcessingInputView = taaOutputImageView;
+#else
+    VkImageView postProcessingInputView = resolveImageView;
+#endif
+
+    // All passes sample with the same filter.
+    VkSamplerCreateInfo vkPostProcessingSamplerInfo{};
+    vkPostProcessingSamplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    vkPostProcessingSamplerInfo.magFilter = VK_FILTER_LINEAR;
+    vkPostProcessingSamplerInfo.minFilter = VK_FILTER_LINEAR;
+    vkPostProcessingSamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    vkPostProcessingSamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    vkPostProcessingSamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    vkPostProcessingSamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    vkPostProcessingSamplerInfo.anisotropyEnable = VK_FALSE;
+    vkPostProcessingSamplerInfo.maxAnisotropy = 1.0f;
+    vkPostProcessingSamplerInfo.compareEnable = VK_FALSE;
+    vkPostProcessingSamplerInfo.minLod = 0.0f;
+    vkPostProcessingSamplerInfo.maxLod = 0.0f;
+    vkPostProcessingSamplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    vkPostProcessingSamplerInfo.unnormalizedCoordinates = VK_FALSE;
+    VkSampler vkPostProcessingSampler;
+    if (vkCreateSampler(vkDevice, &vkPostProcessingSamplerInfo, vkAllocator, &vkPostProcessingSampler) != VK_SUCCESS) {
+        std::cerr << "Failed to create a post-processing sampler!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_SAMPLER, vkPostProcessingSampler, "Post-processing sampler");
+
+    // Each pass has the same bindings: an input and an output.
+    std::array< VkDescriptorSetLayoutBinding, 2 > vkPostProcessingBindings{};
+    vkPostProcessingBindings[0].binding = 0;
+    vkPostProcessingBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    vkPostProcessingBindings[0].descriptorCount = 1;
+    vkPostProcessingBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    vkPostProcessingBindings[1].binding = 1;
+    vkPostProcessingBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    vkPostProcessingBindings[1].descriptorCount = 1;
+    vkPostProcessingBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo vkPostProcessingLayoutInfo{};
+    vkPostProcessingLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    vkPostProcessingLayoutInfo.bindingCount = static_cast< uint32_t >(vkPostProcessingBindings.size());
+    vkPostProcessingLayoutInfo.pBindings = vkPostProcessingBindings.data();
+    VkDescriptorSetLayout vkPostProcessingDescriptorSetLayout;
+    if (vkCreateDescriptorSetLayout(vkDevice, &vkPostProcessingLayoutInfo, vkAllocator, &vkPostProcessingDescriptorSetLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor set layout" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, vkPostProcessingDescriptorSetLayout, "Post-processing descriptor set layout");
+
+    // One descriptor set per pass.
+    std::array< VkDescriptorPoolSize, 2 > vkPostProcessingPoolSizes{};
+    vkPostProcessingPoolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    vkPostProcessingPoolSizes[0].descriptorCount = static_cast< uint32_t >(postProcessingPasses.size());
+    vkPostProcessingPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    vkPostProcessingPoolSizes[1].descriptorCount = static_cast< uint32_t >(postProcessingPasses.size());
+    VkDescriptorPoolCreateInfo vkPostProcessingDescriptorPoolInfo{};
+    vkPostProcessingDescriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    vkPostProcessingDescriptorPoolInfo.poolSizeCount = static_cast< uint32_t >(vkPostProcessingPoolSizes.size());
+    vkPostProcessingDescriptorPoolInfo.pPoolSizes = vkPostProcessingPoolSizes.data();
+    vkPostProcessingDescriptorPoolInfo.maxSets = static_cast< uint32_t >(postProcessingPasses.size());
+    VkDescriptorPool vkPostProcessingDescriptorPool;
+    if (vkCreateDescriptorPool(vkDevice, &vkPostProcessingDescriptorPoolInfo, vkAllocator, &vkPostProcessingDescriptorPool) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor pool!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_POOL, vkPostProcessingDescriptorPool, "Post-processing descriptor pool");
+
+    // Define a pipeline layout shared by all passes.
+    VkPipelineLayoutCreateInfo vkPostProcessingPipelineLayoutInfo{};
+    vkPostProcessingPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    vkPostProcessingPipelineLayoutInfo.setLayoutCount = 1;
+    vkPostProcessingPipelineLayoutInfo.pSetLayouts = &vkPostProcessingDescriptorSetLayout;
+    VkPipelineLayout vkPostProcessingPipelineLayout;
+    if (vkCreatePipelineLayout(vkDevice, &vkPostProcessingPipelineLayoutInfo, vkAllocator, &vkPostProcessingPipelineLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to creare a pipeline layout!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_PIPELINE_LAYOUT, vkPostProcessingPipelineLayout, "Post-processing pipeline layout");
+
+    const VkPhysicalDeviceMemoryProperties& vkPostProcessingMemProperties = deviceCapabilities.memoryProperties;
+    for (size_t i = 0; i < postProcessingPasses.size(); i++) {
+        PostProcessingPass& pass = postProcessingPasses[i];
+
+        // Create a compute shader module.
+        pass.shaderModule = loadShaderModule(pass.shaderFileName);
+
+        // Create a compute pipeline.
+        VkComputePipelineCreateInfo vkPassPipelineInfo{};
+        vkPassPipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        vkPassPipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vkPassPipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        vkPassPipelineInfo.stage.module = pass.shaderModule;
+        vkPassPipelineInfo.stage.pName = "main";
+        vkPassPipelineInfo.layout = vkPostProcessingPipelineLayout;
+        vkPassPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        vkPassPipelineInfo.basePipelineIndex = -1;
+        if (vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, &vkPassPipelineInfo, vkAllocator, &pass.pipeline) != VK_SUCCESS) {
+            std::cerr << "Failed to create a post-processing pipeline!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_PIPELINE, pass.pipeline, pass.name);
+
+        // Create an output image. Intermediate results are kept in a floating
+        // point format, so passes do not lose precision one after another.
+        // The last output is blitted into the swap chain image.
+        VkImageCreateInfo vkPassImageInfo{};
+        vkPassImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        vkPassImageInfo.imageType = VK_IMAGE_TYPE_2D;
+        vkPassImageInfo.extent.width = pass.extent.width;
+        vkPassImageInfo.extent.height = pass.extent.height;
+        vkPassImageInfo.extent.depth = 1;
+        vkPassImageInfo.mipLevels = 1;
+        vkPassImageInfo.arrayLayers = 1;
+        vkPassImageInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+        vkPassImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        vkPassImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        vkPassImageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        vkPassImageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        vkPassImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateImage(vkDevice, &vkPassImageInfo, vkAllocator, &pass.image) != VK_SUCCESS) {
+            std::cerr << "Failed to create a post-processing image!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_IMAGE, pass.image, pass.name);
+
+        // Allocate device local memory for the image.
+        VkMemoryRequirements vkPassMemRequirements;
+        vkGetImageMemoryRequirements(vkDevice, pass.image, &vkPassMemRequirements);
+        VkMemoryAllocateInfo vkPassAllocInfo{};
+        vkPassAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        vkPassAllocInfo.allocationSize = vkPassMemRequirements.size;
+        vkPassAllocInfo.memoryTypeIndex = UINT32_MAX;
+        for (uint32_t j = 0; j < vkPostProcessingMemProperties.memoryTypeCount; j++) {
+            if ((vkPassMemRequirements.memoryTypeBits & (1 << j)) &&
+                    (vkPostProcessingMemProperties.memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+                vkPassAllocInfo.memoryTypeIndex = j;
+                break;
+            }
+        }
+        if (vkAllocateMemory(vkDevice, &vkPassAllocInfo, vkAllocator, &pass.imageMemory) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate image memory!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_DEVICE_MEMORY, pass.imageMemory, pass.name);
+        vkBindImageMemory(vkDevice, pass.image, pass.imageMemory, 0);
+
+        // Create an image view.
+        VkImageViewCreateInfo vkPassViewInfo{};
+        vkPassViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        vkPassViewInfo.image = pass.image;
+        vkPassViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        vkPassViewInfo.format = vkPassImageInfo.format;
+        vkPassViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        vkPassViewInfo.subresourceRange.baseMipLevel = 0;
+        vkPassViewInfo.subresourceRange.levelCount = 1;
+        vkPassViewInfo.subresourceRange.baseArrayLayer = 0;
+        vkPassViewInfo.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(vkDevice, &vkPassViewInfo, vkAllocator, &pass.imageView) != VK_SUCCESS) {
+            std::cerr << "Failed to create a post-processing image view!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_IMAGE_VIEW, pass.imageView, pass.name);
+
+        // Allocate a descriptor set.
+        VkDescriptorSetAllocateInfo vkPassDescriptorSetAllocInfo{};
+        vkPassDescriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        vkPassDescriptorSetAllocInfo.descriptorPool = vkPostProcessingDescriptorPool;
+        vkPassDescriptorSetAllocInfo.descriptorSetCount = 1;
+        vkPassDescriptorSetAllocInfo.pSetLayouts = &vkPostProcessingDescriptorSetLayout;
+        if (vkAllocateDescriptorSets(vkDevice, &vkPassDescriptorSetAllocInfo, &pass.descriptorSet) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate descriptor set!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_DESCRIPTOR_SET, pass.descriptorSet, pass.name);
+
+        // Bind the output of the previous pass and the own output.
+        std::array< VkDescriptorImageInfo, 2 > vkPassImageInfos{};
+        vkPassImageInfos[0] = {
+            vkPostProcessingSampler,
+            i == 0 ? postProcessingInputView : postProcessingPasses[i - 1].imageView,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        };
+        vkPassImageInfos[1] = { VK_NULL_HANDLE, pass.imageView, VK_IMAGE_LAYOUT_GENERAL };
+        std::array< VkWriteDescriptorSet, 2 > vkPassDescriptorWrites{};
+        for (uint32_t j = 0; j < vkPassDescriptorWrites.size(); j++) {
+            vkPassDescriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            vkPassDescriptorWrites[j].dstSet = pass.descriptorSet;
+            vkPassDescriptorWrites[j].dstBinding = j;
+            vkPassDescriptorWrites[j].dstArrayElement = 0;
+            vkPassDescriptorWrites[j].descriptorType = vkPostProcessingBindings[j].descriptorType;
+            vkPassDescriptorWrites[j].descriptorCount = 1;
+            vkPassDescriptorWrites[j].pImageInfo = &vkPassImageInfos[j];
+        }
+        vkUpdateDescriptorSets(vkDevice, static_cast< uint32_t >(vkPassDescriptorWrites.size()), vkPassDescriptorWrites.data(), 0, nullptr);
+    }
+
+#endif
 
     // ==========================================================================
-    //                 STEP 20: Create a viewport and scissors
-    // ==========================================================================
-    // Viewport is a region of a framebuffer that will be used for renderring.
-    // Scissors define if some part of rendered image should be cut.
-    // In our example we define both viewport and scissors equal to
-    // the framebuffer size.
+    //                     STEP 32: Create framebuffers
+    // ==========================================================================
+    // Framebuffer refers to all attachments that are output of the rendering
+    // process.
+    // Dynamic rendering refers to image views directly, so there is nothing
+    // to create in this mode.
+    // ==========================================================================
+
+#ifdef PARALLEL_STARTUP
+    // Wait for the swap chain created in background (see STEP 12).
+    swapChainTask.get();
+#endif
+
+#ifndef DYNAMIC_RENDERING
+
+    // Create framebuffers, one per swap chain image view.
+    std::vector< VkFramebuffer > vkSwapChainFramebuffers;
+    auto createSwapChainFramebuffers = [&]() {
+        vkSwapChainFramebuffers.resize(vkSwapChainImageViews.size());
+        for (size_t i = 0; i < vkSwapChainImageViews.size(); i++) {
+            // We have only two attachments: color and depth.
+            // Depth attachment is shared.
+#ifdef DEFERRED_SHADING
+            // The G-buffer is shared too.
+            std::array< VkImageView, 5 > attachments = {
+                colorImageView,
+                vkDepthImageView,
+                vkSwapChainImageViews[i],
+                gBufferImageViews[0],
+                gBufferImageViews[1]
+            };
+#else
+            std::array< VkImageView, 3 > attachments = {
+                colorImageView,
+                vkDepthImageView,
+                vkSwapChainImageViews[i]
+            };
+#endif
+#ifdef TAA
+            // Motion vectors are shared as well, swap chain images are written by a blit.
+            attachments[2] = velocityImageView;
+#elif defined(POST_PROCESSING)
+            // The scene is resolved into the post-processing input.
+            attachments[2] = resolveImageView;
+#endif
+
+            // Describe a framebuffer.
+            VkFramebufferCreateInfo vkFramebufferInfo{};
+            vkFramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            vkFramebufferInfo.renderPass = vkRenderPass;
+            vkFramebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());;
+            vkFramebufferInfo.pAttachments =  attachments.data();
+            vkFramebufferInfo.width = vkRenderExtent.width;
+            vkFramebufferInfo.height = vkRenderExtent.height;
+            vkFramebufferInfo.layers = 1;
+
+            // Create a framebuffer.
+            if (vkCreateFramebuffer(vkDevice, &vkFramebufferInfo, vkAllocator, &vkSwapChainFramebuffers[i]) != VK_SUCCESS) {
+                std::cerr << "Failed to create a framebuffer!" << std::endl;
+                abort();
+            }
+            setDebugName(VK_OBJECT_TYPE_FRAMEBUFFER, vkSwapChainFramebuffers[i], "Framebuffer", i);
+        }
+    };
+    createSwapChainFramebuffers();
+
+#endif
+
+    // ==========================================================================
+    //                    STEP 33: Create command buffers
+    // ==========================================================================
+    // Command buffers describe a set of rendering commands submitted to Vulkan.
+    // We need to have one buffer per each frame in flight.
+    // Command buffers are taken from the command pool, so we should
+    // create one.
     // ==========================================================================
 
-    // Create a viewport.
-    VkViewport vkViewport{};
-    vkViewport.x = 0.0f;
-    vkViewport.y = 0.0f;
-    vkViewport.width = static_cast< float >(vkSelectedExtent.width);
-    vkViewport.height = static_cast< float >(vkSelectedExtent.height);
-    vkViewport.minDepth = 0.0f;
-    vkViewport.maxDepth = 1.0f;
+    // Describe a command pool.
+    VkCommandPoolCreateInfo vkPoolInfo{};
+    vkPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    vkPoolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    // Command buffers are reset one by one when they are recorded again.
+    vkPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    // Create a command pool.
+    VkCommandPool vkCommandPool;
+    if (vkCreateCommandPool(vkDevice, &vkPoolInfo, vkAllocator, &vkCommandPool) != VK_SUCCESS) {
+        std::cerr << "Failed to create a command pool!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_COMMAND_POOL, vkCommandPool, "Command pool");
+
+    // Create a vector for all command buffers.
+    std::vector< VkCommandBuffer > vkCommandBuffers;
+    vkCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    // Describe a command buffer allocate info.
+    VkCommandBufferAllocateInfo vkAllocInfo{};
+    vkAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    vkAllocInfo.commandPool = vkCommandPool;
+    vkAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    vkAllocInfo.commandBufferCount = static_cast< uint32_t >(vkCommandBuffers.size());
+
+    // Allocate command buffers.
+    if (vkAllocateCommandBuffers(vkDevice, &vkAllocInfo, vkCommandBuffers.data()) != VK_SUCCESS) {
+        std::cerr << "Failed to create command buffers" << std::endl;
+        abort();
+    }
+    for (size_t i = 0; i < vkCommandBuffers.size(); i++) {
+        setDebugName(VK_OBJECT_TYPE_COMMAND_BUFFER, vkCommandBuffers[i], "Command buffer", i);
+    }
+
+#if defined(PARALLEL_STARTUP) && !defined(GRAPHICS_PIPELINE_LIBRARY)
+    // Wait for the pipeline compiled in background (see STEP 31).
+    vkGraphicsPipeline = graphicsPipelineTask.get();
+#endif
+
+#ifdef PIPELINE_STATISTICS
+
+    // --------------------------------------------------------------------------
+    // Create a pipeline statistics query pool.
+    // --------------------------------------------------------------------------
+    // GPU counts vertices, primitives and shader invocations while the render
+    // pass is executed. These numbers do not depend on timing, so they show
+    // whether culling or overdraw changes really reduce the work of the GPU.
+    // There is one query per command buffer, so a query is not reused
+    // before its results are read.
+    // --------------------------------------------------------------------------
+
+    // Statistics we are interested in.
+    // Results are written in the order of bits, not in the order of this list.
+    VkQueryPipelineStatisticFlags vkPipelineStatistics =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    // Names of statistics in the order of results.
+    const std::array< const char*, 4 > pipelineStatisticNames {
+        "input vertices",
+        "vertex shader invocations",
+        "clipping primitives",
+        "fragment shader invocations"
+    };
+
+    // Describe a query pool.
+    VkQueryPoolCreateInfo vkQueryPoolInfo{};
+    vkQueryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    vkQueryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    vkQueryPoolInfo.queryCount = static_cast< uint32_t >(vkCommandBuffers.size());
+    vkQueryPoolInfo.pipelineStatistics = vkPipelineStatistics;
+
+    // Create a query pool.
+    VkQueryPool vkStatisticsQueryPool;
+    if (vkCreateQueryPool(vkDevice, &vkQueryPoolInfo, vkAllocator, &vkStatisticsQueryPool) != VK_SUCCESS) {
+        std::cerr << "Failed to create a query pool!" << std::endl;
+        abort();
+    }
+    setDebugName(VK_OBJECT_TYPE_QUERY_POOL, vkStatisticsQueryPool, "Pipeline statistics query pool");
+
+#endif
+
+#ifdef POST_PROCESSING
+
+    // --------------------------------------------------------------------------
+    // Create a timestamp query pool for post-processing.
+    // --------------------------------------------------------------------------
+    // A timestamp is written before the first pass and after each pass, so
+    // the difference of neighboring timestamps is GPU time of a pass.
+    // Each command buffer has its own range of queries.
+    // --------------------------------------------------------------------------
+
+    // Timestamps are only meaningful if the queue supports them. Timing is
+    // just a diagnostic, so without them post-processing runs untimed and
+    // the query pool stays null.
+    uint32_t timestampValidBits = deviceCapabilities.timestampValidBits;
+    if (timestampValidBits == 0) {
+        logMessage(LOG_SEVERITY_WARNING, 0, "Timestamps are not supported by the graphics queue, post-processing is not timed");
+    }
+    // Only the lower timestampValidBits bits of a timestamp are meaningful.
+    uint64_t timestampMask = timestampValidBits >= 64 ? UINT64_MAX : (uint64_t(1) << timestampValidBits) - 1;
+
+    // Amount of timestamps written by each command buffer.
+    uint32_t postProcessingTimestampCount = static_cast< uint32_t >(postProcessingPasses.size()) + 1;
+
+    // Describe a query pool.
+    VkQueryPoolCreateInfo vkTimestampQueryPoolInfo{};
+    vkTimestampQueryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    vkTimestampQueryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    vkTimestampQueryPoolInfo.queryCount = postProcessingTimestampCount * static_cast< uint32_t >(vkCommandBuffers.size());
+
+    // Create a query pool.
+    VkQueryPool vkTimestampQueryPool = VK_NULL_HANDLE;
+    if (timestampValidBits != 0) {
+        if (vkCreateQueryPool(vkDevice, &vkTimestampQueryPoolInfo, vkAllocator, &vkTimestampQueryPool) != VK_SUCCESS) {
+            std::cerr << "Failed to create a query pool!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_QUERY_POOL, vkTimestampQueryPool, "Post-processing timestamp query pool");
+    }
+
+#endif
+
+#ifdef DYNAMIC_RENDERING
+
+    // --------------------------------------------------------------------------
+    // Prepare synchronization2 barriers for dynamic rendering.
+    // --------------------------------------------------------------------------
+    // Without a render pass nobody changes layouts of the attachments, so
+    // each command buffer moves them into attachment layouts before rendering
+    // and into the layouts expected by the next consumer after it. Barriers of
+    // synchronization2 keep stages and accesses of each image together.
+    // --------------------------------------------------------------------------
+
+    // Functions of v1.3 are not exported by the loader library of older SDKs,
+    // so pointers to them are obtained from the device.
+    auto vkCmdBeginRendering = reinterpret_cast< PFN_vkCmdBeginRendering >(vkGetDeviceProcAddr(vkDevice, "vkCmdBeginRendering"));
+    auto vkCmdEndRendering = reinterpret_cast< PFN_vkCmdEndRendering >(vkGetDeviceProcAddr(vkDevice, "vkCmdEndRendering"));
+    auto vkCmdPipelineBarrier2 = reinterpret_cast< PFN_vkCmdPipelineBarrier2 >(vkGetDeviceProcAddr(vkDevice, "vkCmdPipelineBarrier2"));
+    if (vkCmdBeginRendering == nullptr || vkCmdEndRendering == nullptr || vkCmdPipelineBarrier2 == nullptr) {
+        std::cerr << "Failed to load dynamic rendering functions!" << std::endl;
+        abort();
+    }
+
+    // Describe a layout transition of a whole single level image.
+    auto renderingImageBarrier = [](VkImage image, VkImageAspectFlags aspectMask, VkImageLayout oldLayout, VkImageLayout newLayout,
+                                    VkPipelineStageFlags2 srcStageMask, VkAccessFlags2 srcAccessMask,
+                                    VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask) {
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = srcStageMask;
+        barrier.srcAccessMask = srcAccessMask;
+        barrier.dstStageMask = dstStageMask;
+        barrier.dstAccessMask = dstAccessMask;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = aspectMask;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        return barrier;
+    };
+
+    // Record all barriers at once.
+    auto renderingPipelineBarrier = [&](VkCommandBuffer commandBuffer, const std::vector< VkImageMemoryBarrier2 >& barriers) {
+        VkDependencyInfo vkDependencyInfo{};
+        vkDependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        vkDependencyInfo.imageMemoryBarrierCount = static_cast< uint32_t >(barriers.size());
+        vkDependencyInfo.pImageMemoryBarriers = barriers.data();
+        vkCmdPipelineBarrier2(commandBuffer, &vkDependencyInfo);
+    };
+
+    // A layout transition of a combined depth and stencil format should include both aspects.
+    VkImageAspectFlags depthAspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (vkDepthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || vkDepthFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+        depthAspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    // Stages that accessed the attachments in the previous frame: the third
+    // attachment and the color attachment with TAA are read by compute shaders.
+    VkPipelineStageFlags2 colorAttachmentStages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+#if defined(TAA) || defined(POST_PROCESSING)
+    colorAttachmentStages |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+#endif
+    VkPipelineStageFlags2 depthAttachmentStages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+
+#endif
+
+#ifdef EXTENDED_DYNAMIC_STATE
+
+    // --------------------------------------------------------------------------
+    // Prepare dynamic render states.
+    // --------------------------------------------------------------------------
+    // Pipelines leave topology, culling and depth test states to command
+    // buffers. The values are taken from the same structures that would be
+    // baked into pipelines otherwise (STEPs 19, 21 and 29).
+    // --------------------------------------------------------------------------
+
+    // Functions of the extension are not exported by the loader library.
+    auto vkCmdSetPrimitiveTopology = reinterpret_cast< PFN_vkCmdSetPrimitiveTopology >(vkGetDeviceProcAddr(vkDevice, "vkCmdSetPrimitiveTopologyEXT"));
+    auto vkCmdSetCullMode = reinterpret_cast< PFN_vkCmdSetCullMode >(vkGetDeviceProcAddr(vkDevice, "vkCmdSetCullModeEXT"));
+    auto vkCmdSetFrontFace = reinterpret_cast< PFN_vkCmdSetFrontFace >(vkGetDeviceProcAddr(vkDevice, "vkCmdSetFrontFaceEXT"));
+    auto vkCmdSetDepthTestEnable = reinterpret_cast< PFN_vkCmdSetDepthTestEnable >(vkGetDeviceProcAddr(vkDevice, "vkCmdSetDepthTestEnableEXT"));
+    auto vkCmdSetDepthWriteEnable = reinterpret_cast< PFN_vkCmdSetDepthWriteEnable >(vkGetDeviceProcAddr(vkDevice, "vkCmdSetDepthWriteEnableEXT"));
+    auto vkCmdSetDepthCompareOp = reinterpret_cast< PFN_vkCmdSetDepthCompareOp >(vkGetDeviceProcAddr(vkDevice, "vkCmdSetDepthCompareOpEXT"));
+    if (vkCmdSetPrimitiveTopology == nullptr || vkCmdSetCullMode == nullptr || vkCmdSetFrontFace == nullptr ||
+            vkCmdSetDepthTestEnable == nullptr || vkCmdSetDepthWriteEnable == nullptr || vkCmdSetDepthCompareOp == nullptr) {
+        std::cerr << "Failed to load extended dynamic state functions!" << std::endl;
+        abort();
+    }
+
+    // Set all dynamic states for the next draws. Without depth stencil state
+    // the depth test is switched off.
+    auto setRenderState = [&](VkCommandBuffer commandBuffer, VkCullModeFlags cullMode, const VkPipelineDepthStencilStateCreateInfo* depthStencil) {
+        vkCmdSetPrimitiveTopology(commandBuffer, vkInputAssembly.topology);
+        vkCmdSetCullMode(commandBuffer, cullMode);
+        vkCmdSetFrontFace(commandBuffer, vkRasterizer.frontFace);
+        vkCmdSetDepthTestEnable(commandBuffer, depthStencil != nullptr ? depthStencil->depthTestEnable : VK_FALSE);
+        vkCmdSetDepthWriteEnable(commandBuffer, depthStencil != nullptr ? depthStencil->depthWriteEnable : VK_FALSE);
+        vkCmdSetDepthCompareOp(commandBuffer, depthStencil != nullptr ? depthStencil->depthCompareOp : VK_COMPARE_OP_ALWAYS);
+    };
 
-    // Create scissors.
-    VkRect2D vkScissor{};
-    vkScissor.offset = {0, 0};
-    vkScissor.extent = vkSelectedExtent;
+#endif
 
-    // Make a structure for framebuffer creation.
-    VkPipelineViewportStateCreateInfo vkViewportState{};
-    vkViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    vkViewportState.viewportCount = 1;
-    vkViewportState.pViewports = &vkViewport;
-    vkViewportState.scissorCount = 1;
-    vkViewportState.pScissors = &vkScissor;
+    // Describe a rendering sequence for a command buffer of a frame in flight.
+    // The command buffer is recorded again each frame for the acquired
+    // swap chain image, after the fence of the frame is signaled.
+    auto recordCommandBuffer = [&](size_t frame, uint32_t imageIndex) {
+        // Start adding commands into the buffer.
+        VkCommandBufferBeginInfo vkBeginInfo{};
+        vkBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        vkBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginInfo.pInheritanceInfo = nullptr;
+        if (vkBeginCommandBuffer(vkCommandBuffers[frame], &vkBeginInfo) != VK_SUCCESS) {
+            std::cerr << "Failed to start command buffer recording" << std::endl;
+            abort();
+        }
 
-    // ==========================================================================
-    //                 STEP 21: Create a rasterization stage
-    // ==========================================================================
-    // Rasterization stage takes primitives and rasterizes them to fragments
-    // pased to the fragment shader.
-    // ==========================================================================
+        // Define default values of color and depth buffer attachment elements.
+        // In our case this means a black color of the background and a maximal depth of each fragment.
+        // In reversed depth mode the farthest depth is 0.0.
+#ifdef DEFERRED_SHADING
+        // The G-buffer is cleared to zero albedo, which the lighting shader
+        // treats as the background. It has no motion with TAA either.
+        std::array< VkClearValue, 5 > vkClearValues{};
+        vkClearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+        vkClearValues[3].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+        vkClearValues[4].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+#elif defined(TAA)
+        // Pixels of the background have no motion.
+        std::array< VkClearValue, 3 > vkClearValues{};
+        vkClearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+#else
+        std::array< VkClearValue, 2 > vkClearValues{};
+#endif
+        vkClearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+#ifdef REVERSE_Z
+        vkClearValues[1].depthStencil = { 0.0f, 0 };
+#else
+        vkClearValues[1].depthStencil = { 1.0f, 0 };
+#endif
 
-    // Rasterizer create info
-    VkPipelineRasterizationStateCreateInfo vkRasterizer{};
-    vkRasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    vkRasterizer.depthClampEnable = VK_FALSE;
-    vkRasterizer.rasterizerDiscardEnable = VK_FALSE;
-    // Fill in triangles.
-    vkRasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    vkRasterizer.lineWidth = 1.0f;
-    // Enable face culling.
-    vkRasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    vkRasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    vkRasterizer.depthBiasEnable = VK_FALSE;
-    vkRasterizer.depthBiasConstantFactor = 0.0f;
-    vkRasterizer.depthBiasClamp = 0.0f;
-    vkRasterizer.depthBiasSlopeFactor = 0.0f;
+#ifdef DYNAMIC_RENDERING
+        // The third attachment: the resolve target, or motion vectors with TAA.
+#ifdef TAA
+        VkImage renderTargetImage = velocityImage;
+        VkImageView renderTargetImageView = velocityImageView;
+#elif defined(POST_PROCESSING)
+        VkImage renderTargetImage = resolveImage;
+        VkImageView renderTargetImageView = resolveImageView;
+#else
+        VkImage renderTargetImage = vkSwapChainImages[imageIndex];
+        VkImageView renderTargetImageView = vkSwapChainImageViews[imageIndex];
+#endif
 
-    // ==========================================================================
-    //                     STEP 22: Create an MSAA state
-    // ==========================================================================
-    // MultiSample Anti-Aliasing is used to make edges smoother by rendering
-    // them in higher resolution (having more then one fragment per pixel) and
-    // then smoothering the result into one pixel.
-    //
-    // See https://en.wikipedia.org/wiki/Multisample_anti-aliasing
-    // ==========================================================================
+        // Describe the color attachment. Load and store operations are the
+        // same as in the render pass. It is resolved at the end of rendering.
+        std::vector< VkRenderingAttachmentInfo > vkColorRenderingAttachments(1);
+        vkColorRenderingAttachments[0].sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        vkColorRenderingAttachments[0].imageView = colorImageView;
+        vkColorRenderingAttachments[0].imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        vkColorRenderingAttachments[0].loadOp = vkColorAttachment.loadOp;
+        vkColorRenderingAttachments[0].storeOp = vkColorAttachment.storeOp;
+        vkColorRenderingAttachments[0].clearValue = vkClearValues[0];
+#ifdef TAA
+        // Motion vectors are a second color attachment, nothing is resolved.
+        VkRenderingAttachmentInfo vkVelocityRenderingAttachment{};
+        vkVelocityRenderingAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        vkVelocityRenderingAttachment.imageView = renderTargetImageView;
+        vkVelocityRenderingAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        vkVelocityRenderingAttachment.loadOp = colorAttachmentResolve.loadOp;
+        vkVelocityRenderingAttachment.storeOp = colorAttachmentResolve.storeOp;
+        vkVelocityRenderingAttachment.clearValue = vkClearValues[2];
+        vkColorRenderingAttachments.push_back(vkVelocityRenderingAttachment);
+#else
+        vkColorRenderingAttachments[0].resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+        vkColorRenderingAttachments[0].resolveImageView = renderTargetImageView;
+        vkColorRenderingAttachments[0].resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+#endif
 
-    // Select the maximal amount of samples supported by the device.
-    VkSampleCountFlagBits vkMsaaSamples = VK_SAMPLE_COUNT_1_BIT;
-    VkPhysicalDeviceProperties vkPhysicalDeviceProperties;
-    vkGetPhysicalDeviceProperties(vkPhysicalDevice, &vkPhysicalDeviceProperties);
-    VkSampleCountFlags vkSampleCounts = vkPhysicalDeviceProperties.limits.framebufferColorSampleCounts & vkPhysicalDeviceProperties.limits.framebufferDepthSampleCounts;
-    if (vkSampleCounts & VK_SAMPLE_COUNT_64_BIT) {
-        vkMsaaSamples = VK_SAMPLE_COUNT_64_BIT;
-    } else if (vkSampleCounts & VK_SAMPLE_COUNT_32_BIT) {
-        vkMsaaSamples = VK_SAMPLE_COUNT_32_BIT;
-    } else if (vkSampleCounts & VK_SAMPLE_COUNT_16_BIT) {
-        vkMsaaSamples = VK_SAMPLE_COUNT_16_BIT;
-    } else if (vkSampleCounts & VK_SAMPLE_COUNT_8_BIT) {
-        vkMsaaSamples = VK_SAMPLE_COUNT_8_BIT;
-    } else if (vkSampleCounts & VK_SAMPLE_COUNT_4_BIT) {
-        vkMsaaSamples = VK_SAMPLE_COUNT_4_BIT;
-    } else if (vkSampleCounts & VK_SAMPLE_COUNT_2_BIT) {
-        vkMsaaSamples = VK_SAMPLE_COUNT_2_BIT;
-    }
+        // Describe the depth attachment.
+        VkRenderingAttachmentInfo vkDepthRenderingAttachment{};
+        vkDepthRenderingAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        vkDepthRenderingAttachment.imageView = vkDepthImageView;
+        vkDepthRenderingAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        vkDepthRenderingAttachment.loadOp = vkDepthAttachment.loadOp;
+        vkDepthRenderingAttachment.storeOp = vkDepthAttachment.storeOp;
+        vkDepthRenderingAttachment.clearValue = vkClearValues[1];
+
+        // Describe rendering.
+        VkRenderingInfo vkRenderingInfo{};
+        vkRenderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        vkRenderingInfo.renderArea.offset = { 0, 0 };
+        vkRenderingInfo.renderArea.extent = vkRenderExtent;
+        vkRenderingInfo.layerCount = 1;
+        vkRenderingInfo.viewMask = 0;
+        vkRenderingInfo.colorAttachmentCount = static_cast< uint32_t >(vkColorRenderingAttachments.size());
+        vkRenderingInfo.pColorAttachments = vkColorRenderingAttachments.data();
+        vkRenderingInfo.pDepthAttachment = &vkDepthRenderingAttachment;
+        vkRenderingInfo.pStencilAttachment = nullptr;
+
+#ifdef DEPTH_PREPASS
+        // The prepass is a separate rendering of depth only. Unlike subpasses
+        // of one render pass, the depth has to be stored between them.
+        VkRenderingAttachmentInfo vkPrepassDepthRenderingAttachment = vkDepthRenderingAttachment;
+        vkPrepassDepthRenderingAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        VkRenderingInfo vkPrepassRenderingInfo = vkRenderingInfo;
+        vkPrepassRenderingInfo.colorAttachmentCount = 0;
+        vkPrepassRenderingInfo.pColorAttachments = nullptr;
+        vkPrepassRenderingInfo.pDepthAttachment = &vkPrepassDepthRenderingAttachment;
+
+        // The main rendering only reads the depth.
+        vkDepthRenderingAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        vkDepthRenderingAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+#endif
+#else
+        // Describe a render pass.
+        VkRenderPassBeginInfo vkRenderPassBeginInfo{};
+        vkRenderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        vkRenderPassBeginInfo.renderPass = vkRenderPass;
+        vkRenderPassBeginInfo.framebuffer = vkSwapChainFramebuffers[imageIndex];
+        vkRenderPassBeginInfo.renderArea.offset = { 0, 0 };
+        vkRenderPassBeginInfo.renderArea.extent = vkRenderExtent;
+        vkRenderPassBeginInfo.clearValueCount = static_cast< uint32_t >(vkClearValues.size());
+        vkRenderPassBeginInfo.pClearValues = vkClearValues.data();
+#endif
 
-    // Create a state for MSAA.
-    VkPipelineMultisampleStateCreateInfo vkMultisampling{};
-    vkMultisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    vkMultisampling.sampleShadingEnable = VK_FALSE;
-    vkMultisampling.rasterizationSamples = vkMsaaSamples;
-    vkMultisampling.minSampleShading = 1.0f;
-    vkMultisampling.pSampleMask = nullptr;
-    vkMultisampling.alphaToCoverageEnable = VK_FALSE;
-    vkMultisampling.alphaToOneEnable = VK_FALSE;
+#ifdef PIPELINE_STATISTICS
+        // A query should be reset before each use.
+        // It covers the whole render pass, as a query started inside
+        // a render pass can not span several subpasses.
+        vkCmdResetQueryPool(vkCommandBuffers[frame], vkStatisticsQueryPool, static_cast< uint32_t >(frame), 1);
+        vkCmdBeginQuery(vkCommandBuffers[frame], vkStatisticsQueryPool, static_cast< uint32_t >(frame), 0);
+#endif
+
+#ifdef DYNAMIC_RENDERING
+        // Contents of the attachments from the previous frame are not needed.
+        renderingPipelineBarrier(vkCommandBuffers[frame], {
+            renderingImageBarrier(colorImage, VK_IMAGE_ASPECT_COLOR_BIT,
+                                  VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                                  colorAttachmentStages, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                                  VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT),
+            renderingImageBarrier(renderTargetImage, VK_IMAGE_ASPECT_COLOR_BIT,
+                                  VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                                  colorAttachmentStages, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                                  VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT),
+            renderingImageBarrier(vkDepthImage, depthAspectMask,
+                                  VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                                  depthAttachmentStages, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                  depthAttachmentStages, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+        });
+#else
+        // Start render pass.
+        vkCmdBeginRenderPass(vkCommandBuffers[frame], &vkRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+#endif
+        // Bind vertices.
+        VkBuffer vertexBuffers[] = { vkVertexBuffer };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(vkCommandBuffers[frame], 0, 1, vertexBuffers, offsets);
+        // Bind descriptor sets for uniforms.
+        // Both pipelines share the same layout, so the binding stays valid after switching pipelines.
+        vkCmdBindDescriptorSets(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 1, &vkDescriptorSets[frame], 0, nullptr);
+#ifdef DEPTH_PREPASS
+#ifdef DYNAMIC_RENDERING
+        vkCmdBeginRendering(vkCommandBuffers[frame], &vkPrepassRenderingInfo);
+#endif
+        // Fill in the depth buffer.
+        beginDebugLabel(vkCommandBuffers[frame], "Depth prepass");
+        vkCmdBindPipeline(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_GRAPHICS, vkPrepassPipeline);
+#ifdef EXTENDED_DYNAMIC_STATE
+        setRenderState(vkCommandBuffers[frame], vkRasterizer.cullMode, &vkPrepassDepthStencil);
+#endif
+        vkCmdDraw(vkCommandBuffers[frame], static_cast< uint32_t >(vertices.size()), 1, 0, 0);
+        endDebugLabel(vkCommandBuffers[frame]);
+#ifdef DYNAMIC_RENDERING
+        vkCmdEndRendering(vkCommandBuffers[frame]);
+        // The main rendering should see all depth values written by the prepass.
+        renderingPipelineBarrier(vkCommandBuffers[frame], {
+            renderingImageBarrier(vkDepthImage, depthAspectMask,
+                                  VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                                  depthAttachmentStages, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                  depthAttachmentStages, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT)
+        });
+#else
+        // Switch to the main subpass.
+        vkCmdNextSubpass(vkCommandBuffers[frame], VK_SUBPASS_CONTENTS_INLINE);
+#endif
+#endif
+#ifdef DYNAMIC_RENDERING
+        // Start rendering.
+        vkCmdBeginRendering(vkCommandBuffers[frame], &vkRenderingInfo);
+#endif
+        // Bind a pipeline we defined above.
+        beginDebugLabel(vkCommandBuffers[frame], "Scene");
+        vkCmdBindPipeline(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_GRAPHICS, vkGraphicsPipeline);
+#ifdef EXTENDED_DYNAMIC_STATE
+        setRenderState(vkCommandBuffers[frame], vkRasterizer.cullMode, &vkDepthStencil);
+#endif
+        // Draw command.
+        vkCmdDraw(vkCommandBuffers[frame], static_cast< uint32_t >(vertices.size()), 1, 0, 0);
+        endDebugLabel(vkCommandBuffers[frame]);
+#ifdef DEFERRED_SHADING
+        // Light the G-buffer with a fullscreen triangle.
+        vkCmdNextSubpass(vkCommandBuffers[frame], VK_SUBPASS_CONTENTS_INLINE);
+        beginDebugLabel(vkCommandBuffers[frame], "Lighting");
+        vkCmdBindPipeline(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_GRAPHICS, vkLightingPipeline);
+#ifdef EXTENDED_DYNAMIC_STATE
+        setRenderState(vkCommandBuffers[frame], vkLightingRasterizer.cullMode, nullptr);
+#endif
+        vkCmdBindDescriptorSets(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_GRAPHICS, vkLightingPipelineLayout, 0, 1, &vkLightingDescriptorSet, 0, nullptr);
+        vkCmdDraw(vkCommandBuffers[frame], 3, 1, 0, 0);
+        endDebugLabel(vkCommandBuffers[frame]);
+#endif
+#ifdef DYNAMIC_RENDERING
+        // Finish rendering.
+        vkCmdEndRendering(vkCommandBuffers[frame]);
+#if defined(TAA) || defined(POST_PROCESSING)
+        // Compute shaders should wait until the images are written.
+        std::vector< VkImageMemoryBarrier2 > vkRenderingFinalBarriers {
+            renderingImageBarrier(renderTargetImage, VK_IMAGE_ASPECT_COLOR_BIT,
+                                  VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                  VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                                  VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT)
+        };
+#ifdef TAA
+        // The scene itself is read by the TAA resolve shader too.
+        vkRenderingFinalBarriers.push_back(
+            renderingImageBarrier(colorImage, VK_IMAGE_ASPECT_COLOR_BIT,
+                                  VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                  VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                                  VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT));
+#endif
+        renderingPipelineBarrier(vkCommandBuffers[frame], vkRenderingFinalBarriers);
+#else
+        // The swap chain image is presented right after the command buffer.
+        renderingPipelineBarrier(vkCommandBuffers[frame], {
+            renderingImageBarrier(renderTargetImage, VK_IMAGE_ASPECT_COLOR_BIT,
+                                  VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                  VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                                  VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, VK_ACCESS_2_NONE)
+        });
+#endif
+#else
+        // Finish render pass.
+        vkCmdEndRenderPass(vkCommandBuffers[frame]);
+#endif
+
+#ifdef PIPELINE_STATISTICS
+        // Stop counting.
+        vkCmdEndQuery(vkCommandBuffers[frame], vkStatisticsQueryPool, static_cast< uint32_t >(frame));
+#endif
+
+#ifdef TAA
+        beginDebugLabel(vkCommandBuffers[frame], "TAA resolve");
+        // The previous result has already been copied, so its content is discarded.
+        // It might still be read by the post-processing chain of the previous frame.
+        VkImageMemoryBarrier vkTaaOutputBarrier = colorImageBarrier(taaOutputImage,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT);
+        vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &vkTaaOutputBarrier);
+
+        // Blend the scene with the history.
+        // The render pass dependency makes attachments visible to the shader.
+        vkCmdBindPipeline(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_COMPUTE, vkTaaPipeline);
+        vkCmdBindDescriptorSets(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_COMPUTE, vkTaaPipelineLayout, 0, 1, &vkTaaDescriptorSet, 0, nullptr);
+        vkCmdDispatch(vkCommandBuffers[frame],
+            (vkRenderExtent.width + TAA_WORKGROUP_SIZE - 1) / TAA_WORKGROUP_SIZE,
+            (vkRenderExtent.height + TAA_WORKGROUP_SIZE - 1) / TAA_WORKGROUP_SIZE,
+            1);
+
+        // Prepare images for copying.
+        std::array< VkImageMemoryBarrier, 2 > vkTaaCopyBarriers {
+            colorImageBarrier(taaOutputImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT),
+            colorImageBarrier(taaHistoryImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)
+        };
+        vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, static_cast< uint32_t >(vkTaaCopyBarriers.size()), vkTaaCopyBarriers.data());
+
+        // Keep the result as the history of the next frame.
+        VkImageCopy vkTaaCopyRegion{};
+        vkTaaCopyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        vkTaaCopyRegion.srcOffset = { 0, 0, 0 };
+        vkTaaCopyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        vkTaaCopyRegion.dstOffset = { 0, 0, 0 };
+        vkTaaCopyRegion.extent = { vkRenderExtent.width, vkRenderExtent.height, 1 };
+        vkCmdCopyImage(vkCommandBuffers[frame], taaOutputImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            taaHistoryImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &vkTaaCopyRegion);
+
+        // Return the history to the resolve shader.
+        VkImageMemoryBarrier vkTaaHistoryBarrier = colorImageBarrier(taaHistoryImage,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &vkTaaHistoryBarrier);
+
+#ifdef POST_PROCESSING
+        // The result is the input of the post-processing chain.
+        VkImageMemoryBarrier vkTaaResultBarrier = colorImageBarrier(taaOutputImage,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT);
+        vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &vkTaaResultBarrier);
+#else
+        // The swap chain image has been released by the presentation engine when
+        // the semaphore waited at the transfer stage is signaled, so the barrier
+        // starts at the transfer stage.
+        VkImageMemoryBarrier vkTaaSwapChainBarrier = colorImageBarrier(vkSwapChainImages[imageIndex],
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &vkTaaSwapChainBarrier);
+
+        // Show the result. Unlike a copy, a blit converts it to the swap chain format.
+        VkImageBlit vkTaaBlitRegion{};
+        vkTaaBlitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        vkTaaBlitRegion.srcOffsets[0] = { 0, 0, 0 };
+        vkTaaBlitRegion.srcOffsets[1] = { static_cast< int32_t >(vkRenderExtent.width), static_cast< int32_t >(vkRenderExtent.height), 1 };
+        vkTaaBlitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        vkTaaBlitRegion.dstOffsets[0] = { 0, 0, 0 };
+        vkTaaBlitRegion.dstOffsets[1] = { static_cast< int32_t >(vkSelectedExtent.width), static_cast< int32_t >(vkSelectedExtent.height), 1 };
+        vkCmdBlitImage(vkCommandBuffers[frame], taaOutputImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            vkSwapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &vkTaaBlitRegion, VK_FILTER_NEAREST);
+
+        // Give the image to the presentation engine.
+        VkImageMemoryBarrier vkTaaPresentBarrier = colorImageBarrier(vkSwapChainImages[imageIndex],
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+        vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &vkTaaPresentBarrier);
+#endif
+        endDebugLabel(vkCommandBuffers[frame]);
+#endif
+
+#ifdef POST_PROCESSING
+        beginDebugLabel(vkCommandBuffers[frame], "Post-processing");
+        // Start timing. A timestamp at the bottom of the pipe is written
+        // when all previous commands are finished.
+        uint32_t firstTimestamp = postProcessingTimestampCount * static_cast< uint32_t >(frame);
+        if (vkTimestampQueryPool != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(vkCommandBuffers[frame], vkTimestampQueryPool, firstTimestamp, postProcessingTimestampCount);
+            vkCmdWriteTimestamp(vkCommandBuffers[frame], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vkTimestampQueryPool, firstTimestamp);
+        }
+
+        // Run passes one after another.
+        // The render pass dependency makes the resolved scene visible to the first pass.
+        for (size_t j = 0; j < postProcessingPasses.size(); j++) {
+            const PostProcessingPass& pass = postProcessingPasses[j];
+            bool lastPass = (j + 1 == postProcessingPasses.size());
+
+            // The previous content is not needed, but it might still be read
+            // by the next pass or copied by the previous frame.
+            VkImageMemoryBarrier vkPassOutputBarrier = colorImageBarrier(pass.image,
+                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT);
+            vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &vkPassOutputBarrier);
+
+            beginDebugLabel(vkCommandBuffers[frame], pass.name);
+            vkCmdBindPipeline(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipeline);
+            vkCmdBindDescriptorSets(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_COMPUTE, vkPostProcessingPipelineLayout, 0, 1, &pass.descriptorSet, 0, nullptr);
+            vkCmdDispatch(vkCommandBuffers[frame],
+                (pass.extent.width + POST_PROCESSING_WORKGROUP_SIZE - 1) / POST_PROCESSING_WORKGROUP_SIZE,
+                (pass.extent.height + POST_PROCESSING_WORKGROUP_SIZE - 1) / POST_PROCESSING_WORKGROUP_SIZE,
+                1);
+            if (vkTimestampQueryPool != VK_NULL_HANDLE) {
+                vkCmdWriteTimestamp(vkCommandBuffers[frame], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vkTimestampQueryPool, firstTimestamp + static_cast< uint32_t >(j) + 1);
+            }
+            endDebugLabel(vkCommandBuffers[frame]);
+
+            // The output is sampled by the next pass or copied into the swap chain image.
+            VkImageMemoryBarrier vkPassResultBarrier = colorImageBarrier(pass.image,
+                VK_IMAGE_LAYOUT_GENERAL, lastPass ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_ACCESS_SHADER_WRITE_BIT, lastPass ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT);
+            vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                lastPass ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &vkPassResultBarrier);
+        }
+
+        // The swap chain image has been released by the presentation engine when
+        // the semaphore waited at the transfer stage is signaled, so the barrier
+        // starts at the transfer stage.
+        VkImageMemoryBarrier vkPostProcessingSwapChainBarrier = colorImageBarrier(vkSwapChainImages[imageIndex],
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &vkPostProcessingSwapChainBarrier);
+
+        // Show the result. Unlike a copy, a blit converts it to the swap chain format.
+        VkImageBlit vkPostProcessingBlitRegion{};
+        vkPostProcessingBlitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        vkPostProcessingBlitRegion.srcOffsets[0] = { 0, 0, 0 };
+        vkPostProcessingBlitRegion.srcOffsets[1] = { static_cast< int32_t >(vkSelectedExtent.width), static_cast< int32_t >(vkSelectedExtent.height), 1 };
+        vkPostProcessingBlitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        vkPostProcessingBlitRegion.dstOffsets[0] = vkPostProcessingBlitRegion.srcOffsets[0];
+        vkPostProcessingBlitRegion.dstOffsets[1] = vkPostProcessingBlitRegion.srcOffsets[1];
+        vkCmdBlitImage(vkCommandBuffers[frame], postProcessingPasses.back().image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            vkSwapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &vkPostProcessingBlitRegion, VK_FILTER_NEAREST);
+
+        // Give the image to the presentation engine.
+        VkImageMemoryBarrier vkPostProcessingPresentBarrier = colorImageBarrier(vkSwapChainImages[imageIndex],
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+        vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &vkPostProcessingPresentBarrier);
+        endDebugLabel(vkCommandBuffers[frame]);
+#endif
+
+#ifdef OVERDRAW_MODE
+        beginDebugLabel(vkCommandBuffers[frame], "Overdraw");
+        // Draw the scene once more counting fragments per pixel.
+        // Vertex buffer and descriptor set bindings are kept between render passes.
+        VkClearValue vkOverdrawClearValue{};
+        vkOverdrawClearValue.color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+        VkRenderPassBeginInfo vkOverdrawRenderPassBeginInfo{};
+        vkOverdrawRenderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        vkOverdrawRenderPassBeginInfo.renderPass = vkOverdrawRenderPass;
+        vkOverdrawRenderPassBeginInfo.framebuffer = vkOverdrawFramebuffers[frame];
+        vkOverdrawRenderPassBeginInfo.renderArea.offset = { 0, 0 };
+        vkOverdrawRenderPassBeginInfo.renderArea.extent = vkRenderExtent;
+        vkOverdrawRenderPassBeginInfo.clearValueCount = 1;
+        vkOverdrawRenderPassBeginInfo.pClearValues = &vkOverdrawClearValue;
+        vkCmdBeginRenderPass(vkCommandBuffers[frame], &vkOverdrawRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(vkCommandBuffers[frame], VK_PIPELINE_BIND_POINT_GRAPHICS, vkOverdrawPipeline);
+#ifdef EXTENDED_DYNAMIC_STATE
+        setRenderState(vkCommandBuffers[frame], vkRasterizer.cullMode, nullptr);
+#endif
+        vkCmdDraw(vkCommandBuffers[frame], static_cast< uint32_t >(vertices.size()), 1, 0, 0);
+        vkCmdEndRenderPass(vkCommandBuffers[frame]);
+
+        // Copy the counts into the readback buffer.
+        VkBufferImageCopy vkOverdrawCopyRegion{};
+        vkOverdrawCopyRegion.bufferOffset = 0;
+        vkOverdrawCopyRegion.bufferRowLength = 0;
+        vkOverdrawCopyRegion.bufferImageHeight = 0;
+        vkOverdrawCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        vkOverdrawCopyRegion.imageSubresource.mipLevel = 0;
+        vkOverdrawCopyRegion.imageSubresource.baseArrayLayer = 0;
+        vkOverdrawCopyRegion.imageSubresource.layerCount = 1;
+        vkOverdrawCopyRegion.imageOffset = { 0, 0, 0 };
+        vkOverdrawCopyRegion.imageExtent = { vkRenderExtent.width, vkRenderExtent.height, 1 };
+        vkCmdCopyImageToBuffer(vkCommandBuffers[frame], vkOverdrawImages[frame], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, vkOverdrawBuffers[frame], 1, &vkOverdrawCopyRegion);
+
+        // Make the copied data visible to the host.
+        VkBufferMemoryBarrier vkOverdrawBufferBarrier{};
+        vkOverdrawBufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        vkOverdrawBufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkOverdrawBufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkOverdrawBufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        vkOverdrawBufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        vkOverdrawBufferBarrier.buffer = vkOverdrawBuffers[frame];
+        vkOverdrawBufferBarrier.offset = 0;
+        vkOverdrawBufferBarrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(vkCommandBuffers[frame], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &vkOverdrawBufferBarrier, 0, nullptr);
+        endDebugLabel(vkCommandBuffers[frame]);
+#endif
+
+        // Fihish adding commands into the buffer.
+        if (vkEndCommandBuffer(vkCommandBuffers[frame]) != VK_SUCCESS) {
+            std::cerr << "Failed to finish command buffer recording" << std::endl;
+            abort();
+        }
+    };
 
     // ==========================================================================
-    //                  STEP 23: Create a resolve attachment
+    //                   STEP 34: Synchronization primitives
     // ==========================================================================
-    // In order to implement MSAA we should introduce a so-called
-    // resolve attachment. The attachment has only 1 sample and while rendering
-    // a multi-sampled image will be resolved to this attachment.
-    // To make it work we should specify the resolve attachment
-    // during subpass creation.
+    // Rendering and presentation are not synchronized. It means that if the
+    // application renders frames faster then they are displayed, it will lead
+    // to memory overflow. In order to avoid this, we should wait in case
+    // rendering goes too fast and the chain is overflown.
     // ==========================================================================
 
-    // Description of an image for resolve attachment.
-    VkImageCreateInfo vkColorImageInfo{};
-    vkColorImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    vkColorImageInfo.imageType = VK_IMAGE_TYPE_2D;
-    vkColorImageInfo.extent.width = vkSelectedExtent.width;
-    vkColorImageInfo.extent.height = vkSelectedExtent.height;
-    vkColorImageInfo.extent.depth = 1;
-    vkColorImageInfo.mipLevels = 1;
-    vkColorImageInfo.arrayLayers = 1;
-    vkColorImageInfo.format = vkSelectedFormat.format;
-    vkColorImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    vkColorImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    vkColorImageInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    vkColorImageInfo.samples = vkMsaaSamples;
-    vkColorImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    // Describe a semaphore.
+    VkSemaphoreCreateInfo vkSemaphoreInfo{};
+    vkSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    // Create an image for resolve attachment.
-    VkImage colorImage;
-    if (vkCreateImage(vkDevice, &vkColorImageInfo, nullptr, &colorImage) != VK_SUCCESS) {
-        std::cerr << "Failed to create an image!" << std::endl;
-        abort();
+    // The first semaphore group signals that an image is aquired and ready for rendering.
+    // Create semaphore per each image we expect to render in parallel.
+    // These semaphores perform GPU-GPU synchronization.
+    std::vector< VkSemaphore > vkImageAvailableSemaphores;
+    vkImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        // Create a semaphore.
+        if (vkCreateSemaphore(vkDevice, &vkSemaphoreInfo, vkAllocator, &vkImageAvailableSemaphores[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create a semaphore!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_SEMAPHORE, vkImageAvailableSemaphores[i], "Image available semaphore", i);
     }
 
-    // Get memory requirements.
-    VkMemoryRequirements vkMemRequirements;
-    vkGetImageMemoryRequirements(vkDevice, colorImage, &vkMemRequirements);
+    // The second semaphore group signals that an image is rendered and ready for presentation.
+    // Create semaphore per each image we expect to render in parallel.
+    // These semaphores perform GPU-GPU synchronization.
+    std::vector< VkSemaphore > vkRenderFinishedSemaphores;
+    vkRenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        // Create a semaphore.
+        if (vkCreateSemaphore(vkDevice, &vkSemaphoreInfo, vkAllocator, &vkRenderFinishedSemaphores[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create a semaphore!" << std::endl;
+            abort();
+        }
+        setDebugName(VK_OBJECT_TYPE_SEMAPHORE, vkRenderFinishedSemaphores[i], "Render finished semaphore", i);
+    }
 
-    // Description of memory allocation.
-    VkMemoryAllocateInfo vkColorImageAllocInfo{};
-    vkColorImageAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    vkColorImageAllocInfo.allocationSize = vkMemRequirements.size;
-    // Find memory type.
-    VkPhysicalDeviceMemoryProperties vkColorImageMemProperties;
-    vkGetPhysicalDeviceMemoryProperties(vkPhysicalDevice, &vkColorImageMemProperties);
-    uint32_t colorImageMemoryTypeInex = UINT32_MAX;
-    for (uint32_t i = 0; i < vkColorImageMemProperties.memoryTypeCount; i++) {
-        if ((vkMemRequirements.memoryTypeBits & (1 << i)) && (vkColorImageMemProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
-            colorImageMemoryTypeInex = i;
-            break;
+    // In order to not overflow the swap chain we need to wait on CPU side if there are too many images
+    // produced by GPU. This CPU-GPU synchronization is performed by fences.
+
+    // Free fences for images running in parallel.
+    std::vector< VkFence > vkInFlightFences;
+
+    // Describe a fence.
+    VkFenceCreateInfo vkFenceInfo{};
+    vkFenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    vkFenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    // Create fences.
+    vkInFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (vkCreateFence(vkDevice, &vkFenceInfo, vkAllocator, &vkInFlightFences[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create a fence!" << std::endl;
+            abort();
         }
+        setDebugName(VK_OBJECT_TYPE_FENCE, vkInFlightFences[i], "In flight fence", i);
     }
-    vkColorImageAllocInfo.memoryTypeIndex = colorImageMemoryTypeInex;
 
-    // Allocate memory for resolve attachment.
-    VkDeviceMemory colorImageMemory;
-    if (vkAllocateMemory(vkDevice, &vkColorImageAllocInfo, nullptr, &colorImageMemory) != VK_SUCCESS) {
-        std::cerr << "Failed to allocate image memory!" << std::endl;
-        abort();
+    // ==========================================================================
+    //                     STEP 35: Pick graphics queues
+    // ==========================================================================
+    // We have checked that the device supports all required queues, but now
+    // we need to pick their handles explicitly.
+    // ==========================================================================
+
+    // Pick a graphics queue.
+    VkQueue vkGraphicsQueue;
+    vkGetDeviceQueue(vkDevice, queueFamilyIndices.graphicsFamily.value(), 0, &vkGraphicsQueue);
+    setDebugName(VK_OBJECT_TYPE_QUEUE, vkGraphicsQueue, "Graphics queue");
+
+    // Pick a present queue.
+    // It might happen that both handles refer to the same queue.
+    VkQueue vkPresentQueue;
+    vkGetDeviceQueue(vkDevice, queueFamilyIndices.presentFamily.value(), 0, &vkPresentQueue);
+    // A queue shared by both roles keeps the name of the graphics queue.
+    if (vkPresentQueue != vkGraphicsQueue) {
+        setDebugName(VK_OBJECT_TYPE_QUEUE, vkPresentQueue, "Present queue");
     }
 
-    // Bind the image to the memory.
-    vkBindImageMemory(vkDevice, colorImage, colorImageMemory, 0);
+#ifdef TAA
 
-    // Describe an image view for resolve attachment.
-    VkImageViewCreateInfo vkColorImageViewInfo{};
-    vkColorImageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    vkColorImageViewInfo.image = colorImage;
-    vkColorImageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    vkColorImageViewInfo.format = vkSelectedFormat.format;
-    vkColorImageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    vkColorImageViewInfo.subresourceRange.baseMipLevel = 0;
-    vkColorImageViewInfo.subresourceRange.levelCount = 1;
-    vkColorImageViewInfo.subresourceRange.baseArrayLayer = 0;
-    vkColorImageViewInfo.subresourceRange.layerCount = 1;
+    // --------------------------------------------------------------------------
+    // Clear the TAA history.
+    // --------------------------------------------------------------------------
+    // Command buffers expect the history to be ready for sampling, so it is
+    // cleared and transitioned once before the first frame. The black history
+    // is clamped by colors of the first frame, so it does not show up.
+    // --------------------------------------------------------------------------
 
-    // Create an image view for resolve attachment.
-    VkImageView colorImageView;
-    if (vkCreateImageView(vkDevice, &vkColorImageViewInfo, nullptr, &colorImageView) != VK_SUCCESS) {
-        std::cerr << "Failed to create texture image view!" << std::endl;
+    VkCommandBufferAllocateInfo vkTaaClearAllocInfo{};
+    vkTaaClearAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    vkTaaClearAllocInfo.commandPool = vkCommandPool;
+    vkTaaClearAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    vkTaaClearAllocInfo.commandBufferCount = 1;
+    VkCommandBuffer vkTaaClearCommandBuffer;
+    if (vkAllocateCommandBuffers(vkDevice, &vkTaaClearAllocInfo, &vkTaaClearCommandBuffer) != VK_SUCCESS) {
+        std::cerr << "Failed to create command buffers" << std::endl;
         abort();
     }
+    setDebugName(VK_OBJECT_TYPE_COMMAND_BUFFER, vkTaaClearCommandBuffer, "TAA clear command buffer");
+
+    VkCommandBufferBeginInfo vkTaaClearBeginInfo{};
+    vkTaaClearBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    vkTaaClearBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(vkTaaClearCommandBuffer, &vkTaaClearBeginInfo);
+    VkImageMemoryBarrier vkTaaClearBarrier = colorImageBarrier(taaHistoryImage,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(vkTaaClearCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &vkTaaClearBarrier);
+    VkClearColorValue vkTaaClearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+    VkImageSubresourceRange vkTaaClearRange = vkTaaClearBarrier.subresourceRange;
+    vkCmdClearColorImage(vkTaaClearCommandBuffer, taaHistoryImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &vkTaaClearColor, 1, &vkTaaClearRange);
+    VkImageMemoryBarrier vkTaaReadyBarrier = colorImageBarrier(taaHistoryImage,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(vkTaaClearCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &vkTaaReadyBarrier);
+    vkEndCommandBuffer(vkTaaClearCommandBuffer);
+
+    // Submit and wait, it happens only once.
+    VkSubmitInfo vkTaaClearSubmitInfo{};
+    vkTaaClearSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    vkTaaClearSubmitInfo.commandBufferCount = 1;
+    vkTaaClearSubmitInfo.pCommandBuffers = &vkTaaClearCommandBuffer;
+    if (vkQueueSubmit(vkGraphicsQueue, 1, &vkTaaClearSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        std::cerr << "Failed to submit a command buffer!" << std::endl;
+        abort();
+    }
+    vkQueueWaitIdle(vkGraphicsQueue);
+    vkFreeCommandBuffers(vkDevice, vkCommandPool, 1, &vkTaaClearCommandBuffer);
 
-    // Describe a resolve attachment.
-    VkAttachmentDescription colorAttachmentResolve{};
-    colorAttachmentResolve.format = vkSelectedFormat.format;
-    colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    // Resolve attachment reference.
-    VkAttachmentReference colorAttachmentResolveRef{};
-    colorAttachmentResolveRef.attachment = 2;
-    colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+#endif
 
     // ==========================================================================
-    //                 STEP 24: Create a color blend state
+    //                         STEP 36: Main loop
     // ==========================================================================
-    // Color blend state describes how fragments are applied to the result
-    // image. There might be options like mixing, but we switch off blending and
-    // simply put a new color instead of existing one.
+    // Main loop executes rendering.
     // ==========================================================================
 
-    // Configuration per attached framebuffer.
-    VkPipelineColorBlendAttachmentState vkColorBlendAttachment{};
-    vkColorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    vkColorBlendAttachment.blendEnable = VK_FALSE;
-    // Other fields are optional.
-    vkColorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-    vkColorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-    vkColorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    vkColorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    vkColorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    vkColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    // Index of a framce processed in the current loop.
+    // We go through MAX_FRAMES_IN_FLIGHT indices.
+    size_t currentFrame = 0;
+    // Amount of frames sent for rendering.
+    uint64_t renderedFrameCount = 0;
 
-    // Global color blending settings.
-    VkPipelineColorBlendStateCreateInfo vkColorBlending{};
-    vkColorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    vkColorBlending.attachmentCount = 1;
-    vkColorBlending.pAttachments = &vkColorBlendAttachment;
-    vkColorBlending.logicOpEnable = VK_FALSE;
-    // Other fields are optional.
-    vkColorBlending.logicOp = VK_LOGIC_OP_COPY;
-    vkColorBlending.blendConstants[0] = 0.0f;
-    vkColorBlending.blendConstants[1] = 0.0f;
-    vkColorBlending.blendConstants[2] = 0.0f;
-    vkColorBlending.blendConstants[3] = 0.0f;
+    // Initial value of the system timer we use for rotation animation.
+    auto startTime = std::chrono::high_resolution_clock::now();
 
-    // ==========================================================================
-    //                   STEP 25: Create a color attachment
-    // ==========================================================================
-    // Color attachment contains pixels of rendered image, so we should create
-    // one in order to display something.
-    // ==========================================================================
+    // Input is sent from the window to rendering without locking, so
+    // rendering may run on another thread (see RENDER_THREAD below).
+    // GLFW calls callbacks from glfwPollEvents() or glfwWaitEvents().
+    struct WindowInput {
+        // Key events.
+        SpscQueue< InputEvent, INPUT_QUEUE_SIZE > inputQueue;
+#ifdef LATE_LATCH
+        // Latest cursor positions.
+        TripleBuffer< CursorSample > cursorSamples;
+        // The last cursor position sent. Used by the window only.
+        CursorSample lastCursorSample{};
+#endif
+#ifdef ON_DEMAND_RENDERING
+        // Set by the window when a frame should be rendered.
+        std::atomic< bool > redrawRequested{ true };
+        // Wake up the render thread waiting for a redraw.
+        std::mutex redrawMutex;
+        std::condition_variable redrawCondition;
+
+        // Ask rendering to produce a frame.
+        void requestRedraw()
+        {
+            redrawRequested.store(true, std::memory_order_release);
+#ifdef RENDER_THREAD
+            // The lock makes sure the render thread either sees the flag
+            // before it starts waiting or gets the notification.
+            { std::lock_guard< std::mutex > lock(redrawMutex); }
+            redrawCondition.notify_one();
+#endif
+        }
+#endif
+    };
+    WindowInput windowInput;
+    glfwSetWindowUserPointer(glfwWindow, &windowInput);
+    glfwSetKeyCallback(glfwWindow, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
+        (void) scancode;
+        (void) mods;
+        auto input = static_cast< WindowInput* >(glfwGetWindowUserPointer(window));
+        // Events are dropped if rendering is stuck anyway.
+        input->inputQueue.push(InputEvent{ key, action });
+#ifdef ON_DEMAND_RENDERING
+        input->requestRedraw();
+#endif
+    });
+#ifdef LATE_LATCH
+    glfwSetCursorPosCallback(glfwWindow, [](GLFWwindow* window, double x, double y) {
+        auto input = static_cast< WindowInput* >(glfwGetWindowUserPointer(window));
+        CursorSample& sample = input->cursorSamples.writeItem();
+        sample.x = x;
+        sample.y = y;
+        sample.time = std::chrono::steady_clock::now();
+        sample.speedX = 0.0;
+        sample.speedY = 0.0;
+        double interval = std::chrono::duration< double >(sample.time - input->lastCursorSample.time).count();
+        if (interval > 0.0 && interval < 1.0) {
+            sample.speedX = (x - input->lastCursorSample.x) / interval;
+            sample.speedY = (y - input->lastCursorSample.y) / interval;
+        }
+        input->lastCursorSample = sample;
+        input->cursorSamples.publish();
+#ifdef ON_DEMAND_RENDERING
+        // The camera follows the cursor.
+        input->requestRedraw();
+#endif
+    });
+#endif
+#ifdef ON_DEMAND_RENDERING
+    // The window content should be drawn again, e.g. after it was covered or minimized.
+    glfwSetWindowRefreshCallback(glfwWindow, [](GLFWwindow* window) {
+        static_cast< WindowInput* >(glfwGetWindowUserPointer(window))->requestRedraw();
+    });
+#endif
 
-    // Descriptor of a color attachment.
-    VkAttachmentDescription vkColorAttachment{};
-    vkColorAttachment.format = vkSelectedFormat.format;
-    vkColorAttachment.samples = vkMsaaSamples;
-    vkColorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    vkColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    vkColorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    vkColorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    vkColorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    // Since we use MSAA, we should specify VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL here.
-    // If we disable MSAA, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR will be enough.
-    vkColorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // --------------------------------------------------------------------------
+    // Simulate the scene.
+    // --------------------------------------------------------------------------
+    // The simulation applies input and advances the animation. Each step ends
+    // with a snapshot of the scene published through a triple buffer, and
+    // a frame renders the latest published snapshot. With SIMULATION_THREAD
+    // steps run on a separate thread at a fixed rate independent of the frame
+    // rate, otherwise one step is made before each frame.
+    // --------------------------------------------------------------------------
 
-    // Color attachment reference.
-    VkAttachmentReference colorAttachmentRef{};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // State of the scene needed to render a frame.
+    struct SceneSnapshot {
+        // Transformation of the cube.
+        glm::mat4 model;
+        // Amount of simulation steps that have changed the scene.
+        uint64_t version;
+    };
+    TripleBuffer< SceneSnapshot > sceneSnapshots;
+
+    // Time of the animation in seconds. Space pauses and resumes it.
+    float animationTime = 0.0f;
+    bool animationPaused = false;
+    uint64_t sceneVersion = 0;
+
+    // Advance the scene by the given time and publish its snapshot.
+    auto simulate = [&](float deltaTime) {
+        // The time has passed in the state before the input.
+        if (!animationPaused && deltaTime > 0.0f) {
+            animationTime += deltaTime;
+            sceneVersion++;
+        }
 
-    // ==========================================================================
-    //                  STEP 26: Create a depth buffer image
-    // ==========================================================================
-    // In order to use a depth buffer, we should create an image.
-    // Unlike swap buffer images, we need only one depth image and it should
-    // be created explicitly.
-    // ==========================================================================
+        // Apply input received from the window.
+        InputEvent inputEvent;
+        while (windowInput.inputQueue.pop(inputEvent)) {
+            if (inputEvent.key == GLFW_KEY_SPACE && inputEvent.action == GLFW_PRESS) {
+                animationPaused = !animationPaused;
+                sceneVersion++;
+            }
+        }
 
-    // Describe a depth image.
-    VkImageCreateInfo vkImageInfo{};
-    vkImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    vkImageInfo.imageType = VK_IMAGE_TYPE_2D;
-    vkImageInfo.extent.width = vkSelectedExtent.width;
-    vkImageInfo.extent.height = vkSelectedExtent.height;
-    vkImageInfo.extent.depth = 1;
-    vkImageInfo.mipLevels = 1;
-    vkImageInfo.arrayLayers = 1;
-    vkImageInfo.format = vkDepthFormat;
-    vkImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    vkImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    vkImageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-    vkImageInfo.samples = vkMsaaSamples;
-    vkImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        SceneSnapshot& snapshot = sceneSnapshots.writeItem();
+        snapshot.model = glm::rotate(glm::mat4(1.0f), animationTime * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        snapshot.version = sceneVersion;
+        sceneSnapshots.publish();
+    };
 
-    // Create a depth image.
-    VkImage vkDepthImage;
-    if (vkCreateImage(vkDevice, &vkImageInfo, nullptr, &vkDepthImage) != VK_SUCCESS) {
-        std::cerr << "Failed to create a depth image!" << std::endl;
-        abort();
-    }
+    // The first frame needs a snapshot too.
+    simulate(0.0f);
+
+#ifdef SIMULATION_THREAD
+    std::atomic< bool > simulationThreadStopRequested{ false };
+    std::thread simulationThread([&]() {
+        // Steps are scheduled on a fixed grid. A late step is followed by the
+        // next one immediately, so the simulation catches up.
+        const std::chrono::steady_clock::duration tickDuration = std::chrono::nanoseconds(1000000000 / SIMULATION_TICK_RATE);
+        auto nextTickTime = std::chrono::steady_clock::now();
+        while (!simulationThreadStopRequested.load(std::memory_order_acquire)) {
+            simulate(1.0f / SIMULATION_TICK_RATE);
+            nextTickTime += tickDuration;
+            std::this_thread::sleep_until(nextTickTime);
+        }
+    });
+#else
+    // Time of the previous simulation step.
+    auto previousSimulationTime = startTime;
+#endif
 
-    // Retrieve memory requirements for the depth image.
-    VkMemoryRequirements vkmDepthMemRequirements;
-    vkGetImageMemoryRequirements(vkDevice, vkDepthImage, &vkmDepthMemRequirements);
+#ifdef LATE_LATCH
 
-    // Define memory allocate info.
-    VkMemoryAllocateInfo memoryAllocInfo{};
-    memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocInfo.allocationSize = vkmDepthMemRequirements.size;
-    // Find a suitable memory type.
-    uint32_t memTypeIndex = UINT32_MAX;
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(vkPhysicalDevice, &memProperties);
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((vkmDepthMemRequirements.memoryTypeBits & (1 << i)) &&
-                (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
-            memTypeIndex = i;
-            break;
-        }
-    }
-    memoryAllocInfo.memoryTypeIndex = memTypeIndex;
+#ifdef TAA
+#error "TAA reprojects with the view known when a frame is recorded, so the view can not be latched later"
+#endif
+#ifdef CAPTURE_MODE
+#error "The capture stores the view known when a frame is recorded, so the view can not be latched later"
+#endif
 
-    // Allocate memory for the depth image.
-    VkDeviceMemory vkDepthImageMemory;
-    if (vkAllocateMemory(vkDevice, &memoryAllocInfo, nullptr, &vkDepthImageMemory) != VK_SUCCESS) {
-        std::cerr << "Failed to allocate image memory!" << std::endl;
-        abort();
-    }
+    // --------------------------------------------------------------------------
+    // Late latch the camera.
+    // --------------------------------------------------------------------------
+    // The camera orbits the cube following the mouse cursor. The view matrix
+    // is written into the uniform buffer right before the submission, after
+    // the image is acquired and commands are recorded, from the latest cursor
+    // position. With LATE_LATCH_PREDICTION a moving cursor is extrapolated
+    // from the time of its sample to the predicted present time, which is one
+    // measured presentation interval after the latch.
+    // The uniform buffer memory is coherent, so the write needs no flush.
+    // --------------------------------------------------------------------------
 
-    // Bind the image to the allocated memory.
-    vkBindImageMemory(vkDevice, vkDepthImage, vkDepthImageMemory, 0);
+    // View matrix for the camera rotated around the cube.
+    auto cameraView = [](float rotation) {
+        glm::vec3 eye(glm::rotate(glm::mat4(1.0f), rotation, glm::vec3(0.0f, 0.0f, 1.0f)) * glm::vec4(2.0f, 2.0f, -2.0f, 1.0f));
+        return glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    };
 
-    // ==========================================================================
-    //                STEP 27: Create a depth buffer image view
-    // ==========================================================================
-    // Similarly to swap buffer images, we need an image view to use it.
-    // ==========================================================================
+    // Time of the last cursor sample latched.
+    std::chrono::steady_clock::time_point lateLatchSampleTime{};
+    // Sum and maximum of times from a cursor sample to its submission
+    // in milliseconds over the last second.
+    double lateLatchLatencySum = 0.0;
+    double lateLatchLatencyMax = 0.0;
+    uint64_t lateLatchSampleCount = 0;
+    // Time when the latency was printed last time.
+    auto lateLatchPrintTime = std::chrono::steady_clock::now();
+
+#ifdef LATE_LATCH_PREDICTION
+    // Average interval between presentations in seconds and the time of the last one.
+    // Both are updated by presentFrame() which runs on the same thread as latchView().
+    double presentInterval = std::chrono::duration< double >(LATE_LATCH_DEFAULT_PRESENT_INTERVAL).count();
+    std::chrono::steady_clock::time_point lastPresentTime{};
+#endif
 
-    // Destribe an image view.
-    VkImageViewCreateInfo vkViewInfo{};
-    vkViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    vkViewInfo.image = vkDepthImage;
-    vkViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    vkViewInfo.format = vkDepthFormat;
-    vkViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    vkViewInfo.subresourceRange.baseMipLevel = 0;
-    vkViewInfo.subresourceRange.levelCount = 1;
-    vkViewInfo.subresourceRange.baseArrayLayer = 0;
-    vkViewInfo.subresourceRange.layerCount = 1;
+    // Write the view matrix of a frame from the latest cursor position.
+    auto latchView = [&](size_t frame) {
+        const CursorSample& cursorSample = windowInput.cursorSamples.read();
+        double cursorX = cursorSample.x;
+#ifdef LATE_LATCH_PREDICTION
+        auto latchTime = std::chrono::steady_clock::now();
+        if (latchTime - cursorSample.time < LATE_LATCH_STOPPED_CURSOR_TIME) {
+            // The sample is already old, so extrapolate over its age as well.
+            double predictionTime = std::chrono::duration< double >(latchTime - cursorSample.time).count() + presentInterval;
+            cursorX += cursorSample.speedX * predictionTime;
+        }
+#endif
+        glm::mat4 view = cameraView(static_cast< float >(cursorX) * CAMERA_ROTATION_SPEED);
 
-    // Create an image view.
-    VkImageView vkDepthImageView;
-    if (vkCreateImageView(vkDevice, &vkViewInfo, nullptr, &vkDepthImageView) != VK_SUCCESS) {
-        std::cerr << "Failed to create a texture image view!" << std::endl;
-        abort();
-    }
+        void* data;
+        vkMapMemory(vkDevice, vkUniformBuffersMemory[frame], offsetof(UniformBufferObject, view), sizeof(view), 0, &data);
+        memcpy(data, &view, sizeof(view));
+        vkUnmapMemory(vkDevice, vkUniformBuffersMemory[frame]);
+        return cursorSample.time;
+    };
 
-    // ==========================================================================
-    //            STEP 28: Create a depth and stensil attachment
-    // ==========================================================================
-    // Depth and stensil attachment is used to support two tests:
-    // - depth test - Makes sure that only the nearest fragment is displayed.
-    // - stensil test - Allows to cut some fragments depending on values of
-    //                  the stensil buffer.
-    // Although in this example we only need a depth test, both of them use
-    // the same attachment.
-    // ==========================================================================
+    // Count the latency of a cursor sample once it is submitted for the first time.
+    auto reportLateLatchLatency = [&](std::chrono::steady_clock::time_point sampleTime) {
+        auto submitTime = std::chrono::steady_clock::now();
+        if (sampleTime != lateLatchSampleTime && sampleTime != std::chrono::steady_clock::time_point{}) {
+            lateLatchSampleTime = sampleTime;
+            double latency = std::chrono::duration< double, std::chrono::milliseconds::period >(submitTime - sampleTime).count();
+            lateLatchLatencySum += latency;
+            lateLatchLatencyMax = std::max(lateLatchLatencyMax, latency);
+            lateLatchSampleCount++;
+        }
 
-    // Descriptor of a depth attachment.
-    VkAttachmentDescription vkDepthAttachment{};
-    vkDepthAttachment.format = vkDepthFormat;
-    vkDepthAttachment.samples = vkMsaaSamples;
-    vkDepthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    vkDepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    vkDepthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    vkDepthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    vkDepthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    vkDepthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        // Print the average and maximal latency once per second.
+        if (submitTime - lateLatchPrintTime >= std::chrono::seconds(1) && lateLatchSampleCount > 0) {
+            std::ostringstream line;
+            line << "Cursor sample to submit latency, ms: average " << lateLatchLatencySum / lateLatchSampleCount
+                 << "; maximum " << lateLatchLatencyMax << "; samples " << lateLatchSampleCount;
+            logMessage(LOG_SEVERITY_INFO, 0, line.str().c_str());
+            lateLatchLatencySum = 0.0;
+            lateLatchLatencyMax = 0.0;
+            lateLatchSampleCount = 0;
+            lateLatchPrintTime = submitTime;
+        }
+    };
 
-    // Depth attachment reference.
-    VkAttachmentReference vkDepthAttachmentRef{};
-    vkDepthAttachmentRef.attachment = 1;
-    vkDepthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+#endif
 
-    // ==========================================================================
-    //               STEP 29: Configure depth and stensil tests
-    // ==========================================================================
-    // This stage configures behavior of depth and stensil tests. In this example
-    // we use regular VK_COMPARE_OP_LESS depth operation and disable stensil test.
-    // ==========================================================================
+    // --------------------------------------------------------------------------
+    // Recreate the swap chain.
+    // --------------------------------------------------------------------------
+    // The swap chain becomes out of date when the surface changes, e.g. some
+    // drivers report it while the window is minimized. It is recreated with
+    // the same settings then: the window is not resizable, so images keep
+    // their size and only image views and framebuffers depend on them.
+    // The swap chain is recreated by the thread which owns the queues, at a
+    // point where none of its images is acquired.
+    // --------------------------------------------------------------------------
 
-    VkPipelineDepthStencilStateCreateInfo vkDepthStencil{};
-    vkDepthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    vkDepthStencil.depthTestEnable = VK_TRUE;
-    vkDepthStencil.depthWriteEnable = VK_TRUE;
-    vkDepthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    vkDepthStencil.depthBoundsTestEnable = VK_FALSE;
-    vkDepthStencil.minDepthBounds = 0.0f;
-    vkDepthStencil.maxDepthBounds = 1.0f;
-    vkDepthStencil.stencilTestEnable = VK_FALSE;
-    vkDepthStencil.front = VkStencilOpState{};
-    vkDepthStencil.back = VkStencilOpState{};
+    // Set when the swap chain has been reported out of date.
+    bool swapChainOutOfDate = false;
+
+    // Recreate the swap chain with vkSwapChainCreateInfo.minImageCount images.
+    // Returns false and closes the window if it cannot be recreated.
+    auto recreateSwapChain = [&]() {
+        auto fail = [&](const char* reason) {
+            logMessage(LOG_SEVERITY_ERROR, 0, reason);
+            glfwSetWindowShouldClose(glfwWindow, GLFW_TRUE);
+            glfwPostEmptyEvent();
+            return false;
+        };
+
+        // A minimized window has no area, so wait until it is restored.
+        VkSurfaceCapabilitiesKHR vkSurfaceCapabilities;
+        while (true) {
+            if (glfwWindowShouldClose(glfwWindow)) {
+                return false;
+            }
+            vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vkPhysicalDevice, vkSurface, &vkSurfaceCapabilities);
+            if (vkSurfaceCapabilities.currentExtent.width != 0 && vkSurfaceCapabilities.currentExtent.height != 0) {
+                break;
+            }
+#if defined(RENDER_THREAD) || defined(PRESENT_THREAD)
+            // Only the main thread may wait for window events.
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+#else
+            glfwWaitEventsTimeout(0.1);
+#endif
+        }
+        const VkExtent2D& extent = vkSwapChainCreateInfo.imageExtent;
+        if (extent.width < vkSurfaceCapabilities.minImageExtent.width || extent.width > vkSurfaceCapabilities.maxImageExtent.width ||
+                extent.height < vkSurfaceCapabilities.minImageExtent.height || extent.height > vkSurfaceCapabilities.maxImageExtent.height) {
+            return fail("The surface does not allow swap chain images of the window size any more");
+        }
+
+        // Nothing may use the swap chain images any more.
+        vkDeviceWaitIdle(vkDevice);
+
+        // The old swap chain is retired by the new one.
+        vkSwapChainCreateInfo.oldSwapchain = vkSwapChain;
+        VkSwapchainKHR vkNewSwapChain;
+        VkResult vkCreateResult = vkCreateSwapchainKHR(vkDevice, &vkSwapChainCreateInfo, vkAllocator, &vkNewSwapChain);
+        vkSwapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+        if (vkCreateResult != VK_SUCCESS) {
+            return fail("Failed to recreate the swap chain");
+        }
 
+#ifndef DYNAMIC_RENDERING
+        for (auto framebuffer : vkSwapChainFramebuffers) {
+            vkDestroyFramebuffer(vkDevice, framebuffer, vkAllocator);
+        }
+#endif
+        for (auto imageView : vkSwapChainImageViews) {
+            vkDestroyImageView(vkDevice, imageView, vkAllocator);
+        }
+        vkDestroySwapchainKHR(vkDevice, vkSwapChain, vkAllocator);
+        vkSwapChain = vkNewSwapChain;
+        setDebugName(VK_OBJECT_TYPE_SWAPCHAIN_KHR, vkSwapChain, "Swap chain");
 
-    // ==========================================================================
-    //                     STEP 30: Create a render pass
-    // ==========================================================================
-    // Render pass represents a collection of attachments, subpasses
-    // and dependencies between the subpasses.
-    // Subpasses allow to organize rendering process as a chain of operations.
-    // Each operation is applied to the result of the previous one.
-    // In the example we only need a single subpass.
-    // ==========================================================================
+        createSwapChainImageViews();
+#ifndef DYNAMIC_RENDERING
+        createSwapChainFramebuffers();
+#endif
+        swapChainOutOfDate = false;
+        return true;
+    };
 
-    // Define a subpass and include both attachments (color and depth-stensil).
-    VkSubpassDescription vkSubpass{};
-    vkSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    vkSubpass.colorAttachmentCount = 1;
-    vkSubpass.pColorAttachments = &colorAttachmentRef;
-    vkSubpass.pDepthStencilAttachment = &vkDepthAttachmentRef;
-    vkSubpass.pResolveAttachments = &colorAttachmentResolveRef;
+#ifdef SWAPCHAIN_IMAGES_AUTO
 
-    // Define a subpass dependency.
-    VkSubpassDependency vkDependency{};
-    vkDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    vkDependency.dstSubpass = 0;
-    vkDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    vkDependency.srcAccessMask = 0;
-    vkDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    vkDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+#ifdef PRESENT_THREAD
+#error "The present thread owns the swap chain, so it can not be recreated by the main loop"
+#endif
 
-    // Define a render pass and attach the subpass.
-    VkRenderPassCreateInfo vkRenderPassInfo{};
-    vkRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    std::array< VkAttachmentDescription, 3 > attachments = { vkColorAttachment, vkDepthAttachment, colorAttachmentResolve };
-    vkRenderPassInfo.attachmentCount = static_cast< uint32_t >(attachments.size());
-    vkRenderPassInfo.pAttachments = attachments.data();
-    vkRenderPassInfo.subpassCount = 1;
-    vkRenderPassInfo.pSubpasses = &vkSubpass;
-    vkRenderPassInfo.dependencyCount = 1;
-    vkRenderPassInfo.pDependencies = &vkDependency;
+    // --------------------------------------------------------------------------
+    // Tune the swap chain size.
+    // --------------------------------------------------------------------------
+    // Too few swap chain images make vkAcquireNextImageKHR wait for the
+    // presentation engine to release one, too many cost memory and add
+    // latency. The swap chain starts with the minimal amount of images. After
+    // a warm-up the average acquisition wait is measured, and while it is
+    // noticeable the swap chain is recreated with one more image. If every
+    // tried amount waits, e.g. the frame rate is bound by VSync, the smallest
+    // amount waiting as little as the best one is kept.
+    // --------------------------------------------------------------------------
 
-    // Create a render pass.
-    VkRenderPass vkRenderPass;
-    if (vkCreateRenderPass(vkDevice, &vkRenderPassInfo, nullptr, &vkRenderPass) != VK_SUCCESS) {
-        std::cerr << "Failed to create a render pass!" << std::endl;
-        abort();
+    // Set until the image count is selected.
+    bool swapChainTuningPending = true;
+    // Frames rendered with the current image count.
+    uint32_t swapChainTuningFrameCount = 0;
+    // Total acquisition wait of the measured frames in milliseconds.
+    double swapChainAcquireWaitSum = 0.0;
+    // Average acquisition wait in milliseconds for each tried image count.
+    std::vector< std::pair< uint32_t, double > > swapChainAcquireWaits;
+    // The largest image count to try.
+    uint32_t swapChainMaxTunedImageCount = swapChainSupportDetails.capabilities.minImageCount + SWAPCHAIN_MAX_EXTRA_IMAGES;
+    if (swapChainSupportDetails.capabilities.maxImageCount > 0 && swapChainMaxTunedImageCount > swapChainSupportDetails.capabilities.maxImageCount) {
+        swapChainMaxTunedImageCount = swapChainSupportDetails.capabilities.maxImageCount;
     }
 
-    // ==========================================================================
-    //                   STEP 31: Create a graphics pipeline
-    // ==========================================================================
-    // All stages prepared above should be combined into a graphics pipeline.
-    // ==========================================================================
+    // Measure one acquisition.
+    auto addSwapChainAcquireWait = [&](std::chrono::high_resolution_clock::duration wait) {
+        if (swapChainTuningFrameCount++ >= SWAPCHAIN_WARMUP_SKIP_FRAMES) {
+            swapChainAcquireWaitSum += std::chrono::duration< double, std::milli >(wait).count();
+        }
+    };
 
-    // Define a pipeline layout.
-    VkPipelineLayoutCreateInfo vkPipelineLayoutInfo{};
-    vkPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    vkPipelineLayoutInfo.setLayoutCount = 1;
-    vkPipelineLayoutInfo.pSetLayouts = &vkDescriptorSetLayout;
-    vkPipelineLayoutInfo.pushConstantRangeCount = 0;
-    vkPipelineLayoutInfo.pPushConstantRanges = nullptr;
+    // Select the next image count once the current one is measured.
+    // Image counts are the requested minimal ones: the driver may create
+    // more images, so its count does not tell which requests were tried.
+    // Returns false if the swap chain cannot be used any more.
+    auto tuneSwapChain = [&]() {
+        if (!swapChainTuningPending || swapChainTuningFrameCount < SWAPCHAIN_WARMUP_SKIP_FRAMES + SWAPCHAIN_WARMUP_FRAMES) {
+            return true;
+        }
+        uint32_t currentImageCount = vkSwapChainCreateInfo.minImageCount;
+        double averageWait = swapChainAcquireWaitSum / SWAPCHAIN_WARMUP_FRAMES;
+        swapChainAcquireWaits.emplace_back(currentImageCount, averageWait);
+        swapChainTuningFrameCount = 0;
+        swapChainAcquireWaitSum = 0.0;
+        {
+            std::ostringstream line;
+            line << "Swap chain with " << currentImageCount << " requested images (" << vkSwapChainImages.size() << " created) waits "
+                 << averageWait << " ms per acquisition";
+            logMessage(LOG_SEVERITY_INFO, 0, line.str().c_str());
+        }
 
-    // Create a pipeline layout.
-    VkPipelineLayout vkPipelineLayout;
-    if (vkCreatePipelineLayout(vkDevice, &vkPipelineLayoutInfo, nullptr, &vkPipelineLayout) != VK_SUCCESS) {
-        std::cerr << "Failed to creare a pipeline layout!" << std::endl;
-        abort();
-    }
+        double threshold = std::chrono::duration< double, std::milli >(SWAPCHAIN_ACQUIRE_WAIT_THRESHOLD).count();
+        uint32_t selectedImageCount = currentImageCount;
+        if (averageWait > threshold) {
+            if (currentImageCount < swapChainMaxTunedImageCount) {
+                // Try one more image.
+                vkSwapChainCreateInfo.minImageCount = currentImageCount + 1;
+                return recreateSwapChain();
+            }
+            // More images do not help, so take the smallest amount close to the best one.
+            double bestWait = averageWait;
+            for (const auto& [imageCount, wait] : swapChainAcquireWaits) {
+                bestWait = std::min(bestWait, wait);
+            }
+            for (const auto& [imageCount, wait] : swapChainAcquireWaits) {
+                if (wait <= bestWait + threshold) {
+                    selectedImageCount = imageCount;
+                    break;
+                }
+            }
+        }
 
-    // Define a pipeline and provide all stages created above.
-    VkGraphicsPipelineCreateInfo vkPipelineInfo{};
-    vkPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    vkPipelineInfo.stageCount = shaderStages.size();
-    vkPipelineInfo.pStages = shaderStages.data();
-    vkPipelineInfo.pVertexInputState = &vkVertexInputInfo;
-    vkPipelineInfo.pInputAssemblyState = &vkInputAssembly;
-    vkPipelineInfo.pViewportState = &vkViewportState;
-    vkPipelineInfo.pRasterizationState = &vkRasterizer;
-    vkPipelineInfo.pMultisampleState = &vkMultisampling;
-    vkPipelineInfo.pDepthStencilState = &vkDepthStencil;
-    vkPipelineInfo.pColorBlendState = &vkColorBlending;
-    vkPipelineInfo.pDynamicState = nullptr;
-    vkPipelineInfo.layout = vkPipelineLayout;
-    vkPipelineInfo.renderPass = vkRenderPass;
-    vkPipelineInfo.subpass = 0;
-    vkPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    vkPipelineInfo.basePipelineIndex = -1;
+        swapChainTuningPending = false;
+        if (selectedImageCount != currentImageCount) {
+            vkSwapChainCreateInfo.minImageCount = selectedImageCount;
+            if (!recreateSwapChain()) {
+                return false;
+            }
+        }
+        std::ostringstream line;
+        line << "Swap chain image count selected: " << selectedImageCount << " requested, " << vkSwapChainImages.size() << " created";
+        logMessage(LOG_SEVERITY_INFO, 0, line.str().c_str());
+        return true;
+    };
 
-    // Create a pipeline.
-    VkPipeline vkGraphicsPipeline;
-    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkPipelineInfo, nullptr, &vkGraphicsPipeline) != VK_SUCCESS) {
-        std::cerr << "Failed to create a graphics pipeline!" << std::endl;
+#endif
+
+#ifdef TARGET_FPS
+
+    // --------------------------------------------------------------------------
+    // Limit the frame rate.
+    // --------------------------------------------------------------------------
+    // Frames are presented every TARGET_FRAME_TIME, so the deadline is kept
+    // for presentation rather than for the start of rendering, which takes
+    // a different time each frame. A sleeping thread wakes up late by the
+    // timer granularity, which is about 15.6 ms with default timers on
+    // Windows. So the limiter sleeps on a high-resolution timer until
+    // FRAME_LIMITER_SPIN_TIME before the deadline and spins through the rest.
+    // --------------------------------------------------------------------------
+
+#ifdef _WIN32
+    // High-resolution waitable timers are not available before Windows 10 1803.
+    // A regular timer follows the system timer resolution, which is raised
+    // to 1 ms then until the application exits.
+    bool frameLimiterTimerPeriodRaised = false;
+    HANDLE frameLimiterTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (frameLimiterTimer == nullptr) {
+        frameLimiterTimerPeriodRaised = (timeBeginPeriod(1) == TIMERR_NOERROR);
+        frameLimiterTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    }
+    if (frameLimiterTimer == nullptr) {
+        std::cerr << "Failed to create a frame rate limiter timer!" << std::endl;
         abort();
     }
+#endif
 
-    // ==========================================================================
-    //                     STEP 32: Create framebuffers
-    // ==========================================================================
-    // Framebuffer refers to all attachments that are output of the rendering
-    // process.
-    // ==========================================================================
+    // Sleep until the given time or a little longer.
+    auto sleepUntil = [&](std::chrono::steady_clock::time_point wakeUpTime) {
+#ifdef _WIN32
+        // A negative due time is relative, in 100 ns intervals.
+        LARGE_INTEGER dueTime;
+        dueTime.QuadPart = -std::chrono::duration_cast< std::chrono::duration< LONGLONG, std::ratio< 1, 10000000 > > >(wakeUpTime - std::chrono::steady_clock::now()).count();
+        if (dueTime.QuadPart < 0 && SetWaitableTimer(frameLimiterTimer, &dueTime, 0, nullptr, nullptr, FALSE)) {
+            WaitForSingleObject(frameLimiterTimer, INFINITE);
+        }
+#else
+        // steady_clock is not guaranteed to be CLOCK_MONOTONIC,
+        // so only the remaining time is taken from it.
+        auto sleepTime = std::chrono::duration_cast< std::chrono::nanoseconds >(wakeUpTime - std::chrono::steady_clock::now());
+        if (sleepTime.count() <= 0) {
+            return;
+        }
+        timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += static_cast< time_t >(sleepTime.count() / 1000000000);
+        deadline.tv_nsec += static_cast< long >(sleepTime.count() % 1000000000);
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        // The absolute deadline stays the same if a signal interrupts the sleep.
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+        }
+#endif
+    };
 
-    // Create framebuffers.
-    std::vector< VkFramebuffer > vkSwapChainFramebuffers;
-    vkSwapChainFramebuffers.resize(vkSwapChainImageViews.size());
-    for (size_t i = 0; i < vkSwapChainImageViews.size(); i++) {
-        // We have only two attachments: color and depth.
-        // Depth attachment is shared.
-        std::array< VkImageView, 3 > attachments = {
-            colorImageView,
-            vkDepthImageView,
-            vkSwapChainImageViews[i]
-        };
+    // Wait until the given time.
+    auto waitUntil = [&](std::chrono::steady_clock::time_point deadline) {
+        sleepUntil(deadline - FRAME_LIMITER_SPIN_TIME);
+        while (std::chrono::steady_clock::now() < deadline) {
+            // Spin.
+        }
+    };
 
-        // Describe a framebuffer.
-        VkFramebufferCreateInfo vkFramebufferInfo{};
-        vkFramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        vkFramebufferInfo.renderPass = vkRenderPass;
-        vkFramebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());;
-        vkFramebufferInfo.pAttachments =  attachments.data();
-        vkFramebufferInfo.width = vkSelectedExtent.width;
-        vkFramebufferInfo.height = vkSelectedExtent.height;
-        vkFramebufferInfo.layers = 1;
+    // Intervals between presentations in milliseconds.
+    struct FramePacingStatistics {
+        double intervalSum = 0.0;
+        double intervalSquareSum = 0.0;
+        // Largest difference from the target interval.
+        double maxDeviation = 0.0;
+        uint64_t intervalCount = 0;
+
+        void add(double interval)
+        {
+            intervalSum += interval;
+            intervalSquareSum += interval * interval;
+            maxDeviation = std::max(maxDeviation, std::abs(interval - std::chrono::duration< double, std::milli >(TARGET_FRAME_TIME).count()));
+            intervalCount++;
+        }
 
-        // Create a framebuffer.
-        if (vkCreateFramebuffer(vkDevice, &vkFramebufferInfo, nullptr, &vkSwapChainFramebuffers[i]) != VK_SUCCESS) {
-            std::cerr << "Failed to create a framebuffer!" << std::endl;
-            abort();
+        // Describe the average interval and the jitter, which is the standard deviation of intervals.
+        std::string describe() const
+        {
+            double average = intervalSum / intervalCount;
+            double jitter = std::sqrt(std::max(0.0, intervalSquareSum / intervalCount - average * average));
+            std::ostringstream line;
+            line << "Frame pacing over " << intervalCount << " frames, ms: target " << std::chrono::duration< double, std::milli >(TARGET_FRAME_TIME).count()
+                 << "; average " << average << "; jitter " << jitter << "; largest deviation " << maxDeviation;
+            return line.str();
         }
-    }
+    };
+    FramePacingStatistics framePacingTotal;
+    FramePacingStatistics framePacingSecond;
+    // Scheduled presentation of the next frame.
+    auto nextPresentTime = std::chrono::steady_clock::now();
+    // Previous presentation, if the interval to it shows pacing.
+    std::optional< std::chrono::steady_clock::time_point > previousPresentTime;
+    // Time when pacing was printed last time.
+    auto framePacingPrintTime = nextPresentTime;
+    // Set by rendering when it has waited for a change of the scene,
+    // which is not a pacing error.
+    std::atomic< bool > framePacingInterrupted{ false };
+
+    // Wait for the scheduled presentation of a frame. A frame late for more
+    // than a whole interval moves the schedule, so the following frames are
+    // not presented in a burst to catch up. Only the thread that presents
+    // frames calls it.
+    auto paceFrame = [&]() {
+        if (framePacingInterrupted.exchange(false, std::memory_order_acq_rel)) {
+            previousPresentTime.reset();
+        }
+        waitUntil(nextPresentTime);
+        auto presentTime = std::chrono::steady_clock::now();
+        if (presentTime - nextPresentTime > TARGET_FRAME_TIME) {
+            nextPresentTime = presentTime + TARGET_FRAME_TIME;
+        } else {
+            nextPresentTime += TARGET_FRAME_TIME;
+        }
+        if (previousPresentTime.has_value()) {
+            double frameInterval = std::chrono::duration< double, std::milli >(presentTime - previousPresentTime.value()).count();
+            framePacingTotal.add(frameInterval);
+            framePacingSecond.add(frameInterval);
+        }
+        previousPresentTime = presentTime;
 
-    // ==========================================================================
-    //                    STEP 33: Create command buffers
-    // ==========================================================================
-    // Command buffers describe a set of rendering commands submitted to Vulkan.
-    // We need to have one buffer per each image in the swap chain.
-    // Command buffers are taken from the command pool, so we should
-    // create one.
-    // ==========================================================================
+        // Print pacing once per second.
+        if (presentTime - framePacingPrintTime >= std::chrono::seconds(1) && framePacingSecond.intervalCount > 0) {
+            logMessage(LOG_SEVERITY_INFO, 0, framePacingSecond.describe().c_str());
+            framePacingSecond = FramePacingStatistics{};
+            framePacingPrintTime = presentTime;
+        }
+    };
 
-    // Describe a command pool.
-    VkCommandPoolCreateInfo vkPoolInfo{};
-    vkPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    vkPoolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-    vkPoolInfo.flags = 0;
+#endif
 
-    // Create a command pool.
-    VkCommandPool vkCommandPool;
-    if (vkCreateCommandPool(vkDevice, &vkPoolInfo, nullptr, &vkCommandPool) != VK_SUCCESS) {
-        std::cerr << "Failed to create a command pool!" << std::endl;
-        abort();
-    }
+    // --------------------------------------------------------------------------
+    // Present frames.
+    // --------------------------------------------------------------------------
+    // vkQueuePresentKHR may block for a long time on some drivers. With
+    // PRESENT_THREAD a separate thread owns the swap chain and the queues:
+    // it acquires images, passes their indices to rendering, and submits and
+    // presents frames rendering sends back, so rendering moves on to the next
+    // frame at once. Both the queues and the swap chain need external
+    // synchronization, so nothing else uses them while the thread runs.
+    // An out of date swap chain is recreated before the next acquisition
+    // which is made when no other image is acquired.
+    // --------------------------------------------------------------------------
 
-    // Create a vector for all command buffers.
-    std::vector< VkCommandBuffer > vkCommandBuffers;
-    vkCommandBuffers.resize(vkSwapChainFramebuffers.size());
+    // Set once the first frame has been sent for presentation.
+    bool firstFramePresented = false;
+    // Set once a suboptimal swap chain has been reported.
+    bool swapChainSuboptimalReported = false;
+
+    // Check a result of an operation with the swap chain. Returns false if
+    // the operation has failed. An out of date swap chain is marked to be
+    // recreated, on other errors the window is closed as the swap chain
+    // cannot be used any more.
+    auto checkSwapChainResult = [&](VkResult result, const char* operation) {
+        if (result == VK_SUBOPTIMAL_KHR) {
+            // Images are still presented, only less efficiently.
+            if (!swapChainSuboptimalReported) {
+                swapChainSuboptimalReported = true;
+                std::ostringstream line;
+                line << operation << ": the swap chain does not match the surface exactly";
+                logMessage(LOG_SEVERITY_WARNING, 0, line.str().c_str());
+            }
+            return true;
+        }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            if (!swapChainOutOfDate) {
+                swapChainOutOfDate = true;
+                std::ostringstream line;
+                line << operation << ": the swap chain is out of date and is recreated";
+                logMessage(LOG_SEVERITY_WARNING, 0, line.str().c_str());
+            }
+            return false;
+        }
+        if (result != VK_SUCCESS) {
+            std::ostringstream line;
+            line << operation << " failed with " << result;
+            logMessage(LOG_SEVERITY_ERROR, 0, line.str().c_str());
+            // GLFW allows to close the window and to wake up the main thread from any thread.
+            glfwSetWindowShouldClose(glfwWindow, GLFW_TRUE);
+            glfwPostEmptyEvent();
+            return false;
+        }
+        return true;
+    };
 
-    // Describe a command buffer allocate info.
-    VkCommandBufferAllocateInfo vkAllocInfo{};
-    vkAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    vkAllocInfo.commandPool = vkCommandPool;
-    vkAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    vkAllocInfo.commandBufferCount = static_cast< uint32_t >(vkCommandBuffers.size());
+    // Acquire a next swap chain image for a frame in flight.
+    // Returns false if the swap chain cannot be used any more.
+    auto acquireImage = [&](size_t frame, uint32_t& imageIndex) {
+#ifdef SWAPCHAIN_IMAGES_AUTO
+        auto acquireStartTime = std::chrono::high_resolution_clock::now();
+#endif
+        VkResult vkAcquireResult = vkAcquireNextImageKHR(vkDevice, vkSwapChain, UINT64_MAX, vkImageAvailableSemaphores[frame], VK_NULL_HANDLE, &imageIndex);
+#ifdef SWAPCHAIN_IMAGES_AUTO
+        if (swapChainTuningPending) {
+            addSwapChainAcquireWait(std::chrono::high_resolution_clock::now() - acquireStartTime);
+        }
+#endif
+        return checkSwapChainResult(vkAcquireResult, "Image acquisition");
+    };
 
-    // Allocate command buffers.
-    if (vkAllocateCommandBuffers(vkDevice, &vkAllocInfo, vkCommandBuffers.data()) != VK_SUCCESS) {
-        std::cerr << "Failed to create command buffers" << std::endl;
-        abort();
-    }
+    // Acquire a next swap chain image, recreating the swap chain while it is
+    // out of date. No other image may be acquired at the moment.
+    // Returns false if the swap chain cannot be used any more.
+    auto acquireUpToDateImage = [&](size_t frame, uint32_t& imageIndex) {
+        while (true) {
+            if (swapChainOutOfDate && !recreateSwapChain()) {
+                return false;
+            }
+            if (acquireImage(frame, imageIndex)) {
+                return true;
+            }
+            if (!swapChainOutOfDate) {
+                return false;
+            }
+        }
+    };
 
-    // Describe a rendering sequence for each command buffer.
-    for (size_t i = 0; i < vkCommandBuffers.size(); i++) {
-        // Start adding commands into the buffer.
-        VkCommandBufferBeginInfo vkBeginInfo{};
-        vkBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        vkBeginInfo.flags = 0;
-        vkBeginInfo.pInheritanceInfo = nullptr;
-        if (vkBeginCommandBuffer(vkCommandBuffers[i], &vkBeginInfo) != VK_SUCCESS) {
-            std::cerr << "Failed to start command buffer recording" << std::endl;
+    // Submit the command buffer of a frame in flight.
+    auto submitFrame = [&](size_t frame) {
+        // Describe a submit to the graphics queue.
+        VkSubmitInfo vkSubmitInfo{};
+        vkSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        // Specify semaphores the GPU should wait before executing the submit.
+        std::array< VkSemaphore, 1 > vkWaitSemaphores{ vkImageAvailableSemaphores[frame] };
+        // Pipeline stages corresponding to each semaphore.
+#if defined(TAA) || defined(POST_PROCESSING)
+        // The swap chain image is first written by a blit.
+        std::array< VkPipelineStageFlags, 1 > vkWaitStages{ VK_PIPELINE_STAGE_TRANSFER_BIT };
+#else
+        std::array< VkPipelineStageFlags, 1 > vkWaitStages{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+#endif
+        vkSubmitInfo.waitSemaphoreCount = vkWaitSemaphores.size();
+        vkSubmitInfo.pWaitSemaphores = vkWaitSemaphores.data();
+        vkSubmitInfo.pWaitDstStageMask = vkWaitStages.data();
+        vkSubmitInfo.commandBufferCount = 1;
+        vkSubmitInfo.pCommandBuffers = &vkCommandBuffers[frame];
+        // Specify semaphores the GPU should unlock after executing the submit.
+        std::array< VkSemaphore, 1 > vkSignalSemaphores{ vkRenderFinishedSemaphores[frame] };
+        vkSubmitInfo.signalSemaphoreCount = vkSignalSemaphores.size();
+        vkSubmitInfo.pSignalSemaphores = vkSignalSemaphores.data();
+
+#ifdef LATE_LATCH
+        auto cursorSampleTime = latchView(frame);
+#endif
+
+        // Submit to the queue.
+        if (vkQueueSubmit(vkGraphicsQueue, 1, &vkSubmitInfo, vkInFlightFences[frame]) != VK_SUCCESS) {
+            std::cerr << "Failed to submit" << std::endl;
             abort();
         }
 
-        // Define default values of color and depth buffer attachment elements.
-        // In our case this means a black color of the background and a maximal depth of each fragment.
-        std::array< VkClearValue, 2 > vkClearValues{};
-        vkClearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-        vkClearValues[1].depthStencil = { 1.0f, 0 };
-
-        // Describe a render pass.
-        VkRenderPassBeginInfo vkRenderPassBeginInfo{};
-        vkRenderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        vkRenderPassBeginInfo.renderPass = vkRenderPass;
-        vkRenderPassBeginInfo.framebuffer = vkSwapChainFramebuffers[i];
-        vkRenderPassBeginInfo.renderArea.offset = { 0, 0 };
-        vkRenderPassBeginInfo.renderArea.extent = vkSelectedExtent;
-        vkRenderPassBeginInfo.clearValueCount = static_cast< uint32_t >(vkClearValues.size());
-        vkRenderPassBeginInfo.pClearValues = vkClearValues.data();
+#ifdef LATE_LATCH
+        reportLateLatchLatency(cursorSampleTime);
+#endif
+    };
 
-        // Start render pass.
-        vkCmdBeginRenderPass(vkCommandBuffers[i], &vkRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        // Bind a pipeline we defined above.
-        vkCmdBindPipeline(vkCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, vkGraphicsPipeline);
-        // Bind vertices.
-        VkBuffer vertexBuffers[] = { vkVertexBuffer };
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(vkCommandBuffers[i], 0, 1, vertexBuffers, offsets);
-        // Bind descriptor sets for uniforms.
-        vkCmdBindDescriptorSets(vkCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 1, &vkDescriptorSets[i], 0, nullptr);
-        // Draw command.
-        vkCmdDraw(vkCommandBuffers[i], static_cast< uint32_t >(vertices.size()), 1, 0, 0);
-        // Finish render pass.
-        vkCmdEndRenderPass(vkCommandBuffers[i]);
+    // Present a swap chain image once its frame is rendered.
+    // Returns false if the swap chain cannot be used any more. The image is
+    // given back to the swap chain even if the swap chain is out of date.
+    auto presentFrame = [&](uint32_t imageIndex, size_t frame) {
+        // Prepare an image for presentation.
+        VkPresentInfoKHR vkPresentInfo{};
+        vkPresentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        // Specify semaphores we need to wait before presenting the image.
+        std::array< VkSemaphore, 1 > vkWaitSemaphores{ vkRenderFinishedSemaphores[frame] };
+        vkPresentInfo.waitSemaphoreCount = vkWaitSemaphores.size();
+        vkPresentInfo.pWaitSemaphores = vkWaitSemaphores.data();
+        std::array< VkSwapchainKHR, 1 > swapChains{ vkSwapChain };
+        vkPresentInfo.swapchainCount = swapChains.size();
+        vkPresentInfo.pSwapchains = swapChains.data();
+        vkPresentInfo.pImageIndices = &imageIndex;
+        vkPresentInfo.pResults = nullptr;
 
-        // Fihish adding commands into the buffer.
-        if (vkEndCommandBuffer(vkCommandBuffers[i]) != VK_SUCCESS) {
-            std::cerr << "Failed to finish command buffer recording" << std::endl;
-            abort();
+#ifdef TARGET_FPS
+        paceFrame();
+#endif
+        // Submit and image for presentaion.
+        VkResult vkPresentResult = vkQueuePresentKHR(vkPresentQueue, &vkPresentInfo);
+
+#if defined(LATE_LATCH) && defined(LATE_LATCH_PREDICTION)
+        // Follow the interval between presentations with a moving average.
+        auto presentTime = std::chrono::steady_clock::now();
+        if (lastPresentTime != std::chrono::steady_clock::time_point{} && presentTime - lastPresentTime < LATE_LATCH_MAX_PRESENT_INTERVAL) {
+            double interval = std::chrono::duration< double >(presentTime - lastPresentTime).count();
+            presentInterval += (interval - presentInterval) * 0.1;
+        }
+        lastPresentTime = presentTime;
+#endif
+        if (!checkSwapChainResult(vkPresentResult, "Presentation")) {
+            return swapChainOutOfDate;
         }
-    }
 
-    // ==========================================================================
-    //                   STEP 34: Synchronization primitives
-    // ==========================================================================
-    // Rendering and presentation are not synchronized. It means that if the
-    // application renders frames faster then they are displayed, it will lead
-    // to memory overflow. In order to avoid this, we should wait in case
-    // rendering goes too fast and the chain is overflown.
-    // ==========================================================================
+        // Report how long it took from the launch to the first presented frame.
+        if (!firstFramePresented) {
+            firstFramePresented = true;
+            auto firstFrameTime = std::chrono::high_resolution_clock::now();
+            float timeToFirstFrame = std::chrono::duration< float, std::chrono::milliseconds::period >(firstFrameTime - launchTime).count();
+            std::ostringstream line;
+            line << "Time to first frame: " << timeToFirstFrame << " ms";
+            logMessage(LOG_SEVERITY_INFO, 0, line.str().c_str());
+        }
+        return true;
+    };
 
-    // Describe a semaphore.
-    VkSemaphoreCreateInfo vkSemaphoreInfo{};
-    vkSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+#ifdef PRESENT_THREAD
+    // Frame rendered to a swap chain image and waiting for presentation.
+    struct PresentRequest {
+        uint32_t imageIndex;
+        // Index of the frame in flight.
+        size_t frame;
+    };
+    SpscQueue< uint32_t, MAX_FRAMES_IN_FLIGHT > acquiredImages;
+    SpscQueue< PresentRequest, MAX_FRAMES_IN_FLIGHT > presentRequests;
+    // Amount of frames sent to the present thread and handled by it.
+    uint64_t presentRequestCount = 0;
+    std::atomic< uint64_t > handledPresentRequestCount{ 0 };
+    std::atomic< bool > presentThreadStopRequested{ false };
+    // Set when the swap chain cannot be used any more and rendering should stop.
+    std::atomic< bool > presentThreadFailed{ false };
+
+    // The next image is acquired before the current one is presented, so its
+    // rendering overlaps presentation. That needs two images acquired at once,
+    // which is not allowed if the swap chain has no images above the minimum.
+    bool acquireAhead = vkSwapChainImages.size() > swapChainSupportDetails.capabilities.minImageCount;
+
+    std::thread presentThread([&]() {
+        // Acquire an image for a frame and pass it to rendering.
+        auto acquireForRendering = [&](size_t frame) {
+            uint32_t imageIndex;
+            if (!acquireUpToDateImage(frame, imageIndex)) {
+                return false;
+            }
+            acquiredImages.push(imageIndex);
+            return true;
+        };
 
-    // The first semaphore group signals that an image is aquired and ready for rendering.
-    // Create semaphore per each image we expect to render in parallel.
-    // These semaphores perform GPU-GPU synchronization.
-    std::vector< VkSemaphore > vkImageAvailableSemaphores;
-    vkImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        // Create a semaphore.
-        if (vkCreateSemaphore(vkDevice, &vkSemaphoreInfo, nullptr, &vkImageAvailableSemaphores[i]) != VK_SUCCESS) {
-            std::cerr << "Failed to create a semaphore!" << std::endl;
-            abort();
+        bool swapChainUsable = acquireForRendering(0);
+        if (!swapChainUsable) {
+            presentThreadFailed.store(true, std::memory_order_release);
         }
-    }
+        PresentRequest request;
+        while (true) {
+            while (!presentRequests.pop(request)) {
+                if (presentThreadStopRequested.load(std::memory_order_acquire)) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
 
-    // The second semaphore group signals that an image is rendered and ready for presentation.
-    // Create semaphore per each image we expect to render in parallel.
-    // These semaphores perform GPU-GPU synchronization.
-    std::vector< VkSemaphore > vkRenderFinishedSemaphores;
-    vkRenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        // Create a semaphore.
-        if (vkCreateSemaphore(vkDevice, &vkSemaphoreInfo, nullptr, &vkRenderFinishedSemaphores[i]) != VK_SUCCESS) {
-            std::cerr << "Failed to create a semaphore!" << std::endl;
-            abort();
+            // Frames are submitted even if the swap chain cannot be used,
+            // otherwise rendering would wait for their fences forever.
+            submitFrame(request.frame);
+            if (swapChainUsable) {
+                // The previous submission of the next frame may still wait for
+                // its image available semaphore, which must not be the case when
+                // the semaphore is given to the next acquisition.
+                size_t nextFrame = (request.frame + 1) % MAX_FRAMES_IN_FLIGHT;
+                vkWaitForFences(vkDevice, 1, &vkInFlightFences[nextFrame], VK_TRUE, UINT64_MAX);
+                if (acquireAhead && !swapChainOutOfDate) {
+                    uint32_t nextImageIndex;
+                    bool nextImageAcquired = acquireImage(nextFrame, nextImageIndex);
+                    swapChainUsable = presentFrame(request.imageIndex, request.frame);
+                    if (nextImageAcquired) {
+                        // If the presentation found the swap chain out of date,
+                        // it is recreated once this image is presented too.
+                        acquiredImages.push(nextImageIndex);
+                    } else if (swapChainOutOfDate) {
+                        // No image is acquired after the presentation.
+                        swapChainUsable = swapChainUsable && acquireForRendering(nextFrame);
+                    } else {
+                        swapChainUsable = false;
+                    }
+                } else {
+                    swapChainUsable = presentFrame(request.imageIndex, request.frame) && acquireForRendering(nextFrame);
+                }
+                if (!swapChainUsable) {
+                    presentThreadFailed.store(true, std::memory_order_release);
+                }
+            }
+            handledPresentRequestCount.fetch_add(1, std::memory_order_release);
         }
+    });
+#endif
+
+#ifdef PIPELINE_STATISTICS
+    // Sums of pipeline statistics over the whole run and over the last second.
+    std::array< uint64_t, 4 > pipelineStatisticsTotal{};
+    std::array< uint64_t, 4 > pipelineStatisticsSecond{};
+    // Amount of frames statistics are collected for.
+    uint64_t pipelineStatisticsFrameCount = 0;
+    uint64_t pipelineStatisticsSecondFrameCount = 0;
+    // Time when statistics were printed last time.
+    auto pipelineStatisticsPrintTime = startTime;
+#endif
+
+#ifdef CAPTURE_MODE
+
+#if defined(TAA) || defined(DEFERRED_SHADING) || defined(POST_PROCESSING)
+#error "The capture holds the forward pass only, so passes of TAA, deferred shading or post-processing would be missing from the replay"
+#endif
+
+    // --------------------------------------------------------------------------
+    // Start a command stream capture.
+    // --------------------------------------------------------------------------
+    // Resources are written once, then each frame adds its uniform buffer
+    // content and a draw. The replay tool executes the stream offscreen
+    // without any application logic (see replay.cpp and capture.h).
+    // --------------------------------------------------------------------------
+
+    std::ofstream captureFile(CAPTURE_FILE_NAME, std::ios::binary | std::ios::trunc);
+    if (!captureFile.is_open()) {
+        std::cerr << "Failed to create a capture file!" << std::endl;
+        abort();
+    }
+    CaptureFileHeader captureFileHeader{ CAPTURE_MAGIC, CAPTURE_VERSION };
+    captureFile.write(reinterpret_cast< const char* >(&captureFileHeader), sizeof(captureFileHeader));
+
+    // Write render targets.
+    // In prepass mode the main pipeline only tests for equal depth,
+    // so take the depth test of the prepass that is equal to the normal one.
+    CaptureTargets captureTargets{};
+    captureTargets.width = vkRenderExtent.width;
+    captureTargets.height = vkRenderExtent.height;
+    captureTargets.colorFormat = vkSelectedFormat.format;
+    captureTargets.depthFormat = vkDepthFormat;
+    captureTargets.samples = vkMsaaSamples;
+#ifdef DEPTH_PREPASS
+    captureTargets.depthCompareOp = vkPrepassDepthStencil.depthCompareOp;
+#else
+    captureTargets.depthCompareOp = vkDepthStencil.depthCompareOp;
+#endif
+#ifdef REVERSE_Z
+    captureTargets.clearDepth = 0.0f;
+#else
+    captureTargets.clearDepth = 1.0f;
+#endif
+    CaptureRecordHeader captureTargetsHeader{ CAPTURE_RECORD_TARGETS, sizeof(captureTargets) };
+    captureFile.write(reinterpret_cast< const char* >(&captureTargetsHeader), sizeof(captureTargetsHeader));
+    captureFile.write(reinterpret_cast< const char* >(&captureTargets), sizeof(captureTargets));
+
+    // Write shaders.
+    CaptureShader captureVertexShader{ VK_SHADER_STAGE_VERTEX_BIT };
+    CaptureRecordHeader captureVertexShaderHeader{ CAPTURE_RECORD_SHADER, static_cast< uint32_t >(sizeof(captureVertexShader) + vertexShaderBuffer.size()) };
+    captureFile.write(reinterpret_cast< const char* >(&captureVertexShaderHeader), sizeof(captureVertexShaderHeader));
+    captureFile.write(reinterpret_cast< const char* >(&captureVertexShader), sizeof(captureVertexShader));
+    captureFile.write(vertexShaderBuffer.data(), vertexShaderBuffer.size());
+    CaptureShader captureFragmentShader{ VK_SHADER_STAGE_FRAGMENT_BIT };
+    CaptureRecordHeader captureFragmentShaderHeader{ CAPTURE_RECORD_SHADER, static_cast< uint32_t >(sizeof(captureFragmentShader) + fragmentShaderBuffer.size()) };
+    captureFile.write(reinterpret_cast< const char* >(&captureFragmentShaderHeader), sizeof(captureFragmentShaderHeader));
+    captureFile.write(reinterpret_cast< const char* >(&captureFragmentShader), sizeof(captureFragmentShader));
+    captureFile.write(fragmentShaderBuffer.data(), fragmentShaderBuffer.size());
+
+    // Write the vertex buffer with its layout.
+    CaptureVertexLayout captureVertexLayout{ vkBindingDescription.stride, static_cast< uint32_t >(vkAttributeDescriptions.size()) };
+    CaptureRecordHeader captureVertexBufferHeader{
+        CAPTURE_RECORD_VERTEX_BUFFER,
+        static_cast< uint32_t >(sizeof(captureVertexLayout) + sizeof(CaptureVertexAttribute) * vkAttributeDescriptions.size() + vertexBufferSize)
+    };
+    captureFile.write(reinterpret_cast< const char* >(&captureVertexBufferHeader), sizeof(captureVertexBufferHeader));
+    captureFile.write(reinterpret_cast< const char* >(&captureVertexLayout), sizeof(captureVertexLayout));
+    for (const auto& attribute : vkAttributeDescriptions) {
+        CaptureVertexAttribute captureAttribute{ attribute.location, static_cast< uint32_t >(attribute.format), attribute.offset };
+        captureFile.write(reinterpret_cast< const char* >(&captureAttribute), sizeof(captureAttribute));
     }
+    captureFile.write(reinterpret_cast< const char* >(vertices.data()), vertexBufferSize);
 
-    // In order to not overflow the swap chain we need to wait on CPU side if there are too many images
-    // produced by GPU. This CPU-GPU synchronization is performed by fences.
+    // Amount of frames written to the file.
+    uint32_t capturedFrameCount = 0;
 
-    // Free fences for images running in parallel.
-    std::vector< VkFence > vkInFlightFences;
-    // Buffer of feces, locked by the images running in parallel.
-    std::vector< VkFence > vkImagesInFlight;
+#endif
 
-    // Describe a fence.
-    VkFenceCreateInfo vkFenceInfo{};
-    vkFenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    vkFenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+#ifdef OVERDRAW_MODE
+    // Time when overdraw was reported last time.
+    auto overdrawPrintTime = startTime;
+    // Index of the last frame in flight sent for rendering, if any.
+    std::optional< size_t > lastFrame;
+#endif
 
-    // Create fences.
-    vkInFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    vkImagesInFlight.resize(vkSwapChainImages.size(), VK_NULL_HANDLE);
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (vkCreateFence(vkDevice, &vkFenceInfo, nullptr, &vkInFlightFences[i]) != VK_SUCCESS) {
-            std::cerr << "Failed to create a fence!" << std::endl;
-            abort();
+#ifdef POST_PROCESSING
+    // Sums of GPU time of post-processing passes in nanoseconds
+    // over the whole run and over the last second.
+    std::vector< double > postProcessingTimeTotal(postProcessingPasses.size());
+    std::vector< double > postProcessingTimeSecond(postProcessingPasses.size());
+    // Amount of frames GPU time is collected for.
+    uint64_t postProcessingFrameCount = 0;
+    uint64_t postProcessingSecondFrameCount = 0;
+    // Time when GPU time was printed last time.
+    auto postProcessingPrintTime = startTime;
+#endif
+
+#ifdef TAA
+    // Amount of frames rendered with jitter.
+    uint32_t taaFrameIndex = 0;
+    // Uniform buffer object of the previous frame.
+    UniformBufferObject taaPreviousUbo{};
+    // Returns an element of the Halton low discrepancy sequence in [0; 1).
+    auto halton = [](uint32_t index, uint32_t base) {
+        float result = 0.0f;
+        float fraction = 1.0f;
+        while (index > 0) {
+            fraction /= base;
+            result += fraction * (index % base);
+            index /= base;
         }
-    }
+        return result;
+    };
+#endif
 
-    // ==========================================================================
-    //                     STEP 35: Pick graphics queues
-    // ==========================================================================
-    // We have checked that the device supports all required queues, but now
-    // we need to pick their handles explicitly.
-    // ==========================================================================
+#ifdef GRAPHICS_PIPELINE_LIBRARY
+    // The fast-linked pipeline is used until the optimized one is ready.
+    bool optimizedPipelinePending = true;
+#endif
 
-    // Pick a graphics queue.
-    VkQueue vkGraphicsQueue;
-    vkGetDeviceQueue(vkDevice, queueFamilyIndices.graphicsFamily.value(), 0, &vkGraphicsQueue);
+#ifdef ON_DEMAND_RENDERING
+    // Version of the scene rendered last time.
+    uint64_t renderedSceneVersion = 0;
+#ifdef TAA
+    // Amount of frames rendered after the last change so TAA converges.
+    uint32_t taaConvergenceFramesLeft = 0;
+#endif
+#endif
 
-    // Pick a present queue.
-    // It might happen that both handles refer to the same queue.
-    VkQueue vkPresentQueue;
-    vkGetDeviceQueue(vkDevice, queueFamilyIndices.presentFamily.value(), 0, &vkPresentQueue);
+#ifdef RENDER_THREAD
 
-    // ==========================================================================
-    //                         STEP 36: Main loop
-    // ==========================================================================
-    // Main loop executes rendering.
-    // ==========================================================================
+    // --------------------------------------------------------------------------
+    // Render on a separate thread.
+    // --------------------------------------------------------------------------
+    // Waiting for fences and swap chain images blocks the thread that renders.
+    // GLFW events must be processed on the main thread, so the main thread only
+    // waits for window events and rendering moves to its own thread. It gets
+    // input through inputQueue and stops when the window is closed.
+    // Vulkan objects are used by the render thread only until it is joined.
+    // --------------------------------------------------------------------------
 
-    // Index of a framce processed in the current loop.
-    // We go through MAX_FRAMES_IN_FLIGHT indices.
-    size_t currentFrame = 0;
+    std::atomic< bool > renderThreadStopRequested{ false };
 
-    // Initial value of the system timer we use for rotation animation.
-    auto startTime = std::chrono::high_resolution_clock::now();
+#endif
 
-    // Main loop.
-    while(!glfwWindowShouldClose(glfwWindow)) {
-        // Poll GLFW events.
-        glfwPollEvents();
+    // Render a single frame. Returns false if rendering should stop.
+    auto renderFrame = [&]() {
+#ifndef SIMULATION_THREAD
+        // Advance the scene by the time passed since the previous frame.
+        auto simulationTime = std::chrono::high_resolution_clock::now();
+        simulate(std::chrono::duration< float, std::chrono::seconds::period >(simulationTime - previousSimulationTime).count());
+        previousSimulationTime = simulationTime;
+#endif
+
+#ifdef ON_DEMAND_RENDERING
+        // Render a frame only if the scene or the window has changed.
+        // Otherwise sleep until something happens.
+        uint64_t latestSceneVersion = sceneSnapshots.read().version;
+        if (windowInput.redrawRequested.exchange(false, std::memory_order_acq_rel) || latestSceneVersion != renderedSceneVersion) {
+            renderedSceneVersion = latestSceneVersion;
+#ifdef TAA
+            taaConvergenceFramesLeft = TAA_JITTER_SAMPLE_COUNT;
+        } else if (taaConvergenceFramesLeft > 0) {
+            // Keep rendering the same scene until the history covers all jitter offsets.
+            taaConvergenceFramesLeft--;
+#endif
+        } else {
+#ifdef RENDER_THREAD
+            std::unique_lock< std::mutex > lock(windowInput.redrawMutex);
+            windowInput.redrawCondition.wait_for(lock, ON_DEMAND_IDLE_TIMEOUT, [&]() {
+                return windowInput.redrawRequested.load(std::memory_order_acquire) || renderThreadStopRequested.load(std::memory_order_acquire);
+            });
+#else
+            glfwWaitEventsTimeout(std::chrono::duration< double >(ON_DEMAND_IDLE_TIMEOUT).count());
+#endif
+#ifdef TARGET_FPS
+            // Waiting for a change is not a pacing error.
+            framePacingInterrupted.store(true, std::memory_order_release);
+#endif
+            return true;
+        }
+#endif
+
+#ifdef GRAPHICS_PIPELINE_LIBRARY
+        // Replace the fast-linked pipeline once the optimized link is finished.
+        // It is destroyed when none of the frames is executed. Command buffers
+        // are recorded each frame, so the next one uses the optimized pipeline.
+        // The depth prepass pipeline is replaced at the same time.
+        bool optimizedPipelineReady = optimizedPipelinePending && optimizedPipelineTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+#ifdef DEPTH_PREPASS
+        optimizedPipelineReady = optimizedPipelineReady && optimizedPrepassPipelineTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+#endif
+        if (optimizedPipelineReady) {
+            optimizedPipelinePending = false;
+#ifdef PRESENT_THREAD
+            // The present thread uses the queues, so let it handle all frames first.
+            while (handledPresentRequestCount.load(std::memory_order_acquire) != presentRequestCount) {
+                std::this_thread::yield();
+            }
+#endif
+            vkDeviceWaitIdle(vkDevice);
+            vkDestroyPipeline(vkDevice, vkGraphicsPipeline, vkAllocator);
+            vkGraphicsPipeline = optimizedPipelineTask.get();
+#ifdef DEPTH_PREPASS
+            vkDestroyPipeline(vkDevice, vkPrepassPipeline, vkAllocator);
+            vkPrepassPipeline = optimizedPrepassPipelineTask.get();
+#endif
+            float optimizedPipelineTime = std::chrono::duration< float, std::chrono::milliseconds::period >(std::chrono::high_resolution_clock::now() - graphicsPipelineLinkStartTime).count();
+            std::ostringstream line;
+            line << "Optimized graphics pipeline is used since " << optimizedPipelineTime << " ms after the libraries compilation started";
+            logMessage(LOG_SEVERITY_INFO, 0, line.str().c_str());
+        }
+#endif
+
+#ifdef SWAPCHAIN_IMAGES_AUTO
+        // Try another swap chain size once the current one is measured.
+        if (!tuneSwapChain()) {
+            return false;
+        }
+#endif
 
         // Wait for the current frame.
         vkWaitForFences(vkDevice, 1, &vkInFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
 
         // Aquire a next image from a swap chain to process.
         uint32_t imageIndex;
-        vkAcquireNextImageKHR(vkDevice, vkSwapChain, UINT64_MAX, vkImageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+#ifdef PRESENT_THREAD
+        // The present thread acquires images, rendering only takes them.
+        bool imageAcquired = false;
+        while (!presentThreadFailed.load(std::memory_order_acquire) && !(imageAcquired = acquiredImages.pop(imageIndex))) {
+#ifndef RENDER_THREAD
+            // Keep the window responsive, e.g. while the present thread waits
+            // for a minimized window to recreate the swap chain.
+            glfwPollEvents();
+#endif
+            std::this_thread::yield();
+        }
+        if (!imageAcquired) {
+            return false;
+        }
+#else
+        if (!acquireUpToDateImage(currentFrame, imageIndex)) {
+            return false;
+        }
+#endif
 
-        // Calculate time difference and rotation angle.
+        // Take the latest snapshot of the scene. It is not changed
+        // by the simulation until the next snapshot is taken.
         auto currentTime = std::chrono::high_resolution_clock::now();
-        float time = std::chrono::duration< float, std::chrono::seconds::period >(currentTime - startTime).count();
-        float angle = time * glm::radians(90.0f);
+        const SceneSnapshot& sceneSnapshot = sceneSnapshots.read();
 
         // Update uniform buffer object.
         UniformBufferObject ubo{};
-        ubo.model = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 0.0f, 1.0f));
+        ubo.model = sceneSnapshot.model;
+        // In LATE_LATCH mode the view is written again right before the submission.
         ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, -2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
         float aspectRatio = static_cast< float >(vkSelectedExtent.width) / vkSelectedExtent.height;
+#ifdef REVERSE_Z
+        // Reversed projection with an infinite far plane: z = near / -z_view,
+        // so the near plane goes to 1.0 and the depth tends to 0.0 at infinity.
+        // GLM does not provide such a matrix, so build it manually.
+        float focalLength = 1.0f / std::tan(glm::radians(45.0f) / 2.0f);
+        ubo.proj = glm::mat4(0.0f);
+        ubo.proj[0][0] = focalLength / aspectRatio;
+        ubo.proj[1][1] = focalLength;
+        ubo.proj[2][3] = -1.0f;
+        ubo.proj[3][2] = 0.1f;
+#else
         ubo.proj = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 10.0f);
+#endif
+#ifdef TAA
+        // Shift the image by a sub-pixel offset from the Halton (2, 3) sequence
+        // which covers a pixel evenly with a few samples. A translation applied
+        // after the projection moves all vertices by the same offset in NDC.
+        uint32_t jitterIndex = taaFrameIndex % TAA_JITTER_SAMPLE_COUNT + 1;
+        glm::vec2 jitter(
+            (halton(jitterIndex, 2) - 0.5f) * 2.0f / vkRenderExtent.width,
+            (halton(jitterIndex, 3) - 0.5f) * 2.0f / vkRenderExtent.height);
+        ubo.proj = glm::translate(glm::mat4(1.0f), glm::vec3(jitter, 0.0f)) * ubo.proj;
+        // The first frame has no previous one, so nothing moves.
+        ubo.previousModel = ubo.model;
+        ubo.previousView = ubo.view;
+        ubo.previousProj = ubo.proj;
+        ubo.jitter = glm::vec4(jitter, jitter);
+        if (taaFrameIndex > 0) {
+            ubo.previousModel = taaPreviousUbo.model;
+            ubo.previousView = taaPreviousUbo.view;
+            ubo.previousProj = taaPreviousUbo.proj;
+            ubo.jitter.z = taaPreviousUbo.jitter.x;
+            ubo.jitter.w = taaPreviousUbo.jitter.y;
+        }
+        taaPreviousUbo = ubo;
+        taaFrameIndex++;
+#endif
 
         // Write the uniform buffer object.
         void* data;
-        vkMapMemory(vkDevice, vkUniformBuffersMemory[imageIndex], 0, sizeof(ubo), 0, &data);
+        vkMapMemory(vkDevice, vkUniformBuffersMemory[currentFrame], 0, sizeof(ubo), 0, &data);
         memcpy(data, &ubo, sizeof(ubo));
-        vkUnmapMemory(vkDevice, vkUniformBuffersMemory[imageIndex]);
+        vkUnmapMemory(vkDevice, vkUniformBuffersMemory[currentFrame]);
+
+#ifdef CAPTURE_MODE
+        // Write the frame to the capture file.
+        if (capturedFrameCount < CAPTURE_MAX_FRAMES) {
+            CaptureRecordHeader captureUniformHeader{ CAPTURE_RECORD_UNIFORM_UPDATE, sizeof(ubo) };
+            captureFile.write(reinterpret_cast< const char* >(&captureUniformHeader), sizeof(captureUniformHeader));
+            captureFile.write(reinterpret_cast< const char* >(&ubo), sizeof(ubo));
+            CaptureDraw captureDraw{ static_cast< uint32_t >(vertices.size()) };
+            CaptureRecordHeader captureDrawHeader{ CAPTURE_RECORD_DRAW, sizeof(captureDraw) };
+            captureFile.write(reinterpret_cast< const char* >(&captureDrawHeader), sizeof(captureDrawHeader));
+            captureFile.write(reinterpret_cast< const char* >(&captureDraw), sizeof(captureDraw));
+            capturedFrameCount++;
+        }
+#endif
+
+        // The previous frame rendered with these resources has been waited for above.
+        if (renderedFrameCount >= MAX_FRAMES_IN_FLIGHT) {
+#ifdef PIPELINE_STATISTICS
+            // The previous frame rendered with this command buffer is finished,
+            // so its statistics are available and the query may be reused.
+            std::array< uint64_t, 4 > pipelineStatisticsFrame{};
+            if (vkGetQueryPoolResults(vkDevice, vkStatisticsQueryPool, static_cast< uint32_t >(currentFrame), 1,
+                    sizeof(pipelineStatisticsFrame), pipelineStatisticsFrame.data(), sizeof(pipelineStatisticsFrame),
+                    VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+                for (size_t i = 0; i < pipelineStatisticsFrame.size(); i++) {
+                    pipelineStatisticsTotal[i] += pipelineStatisticsFrame[i];
+                    pipelineStatisticsSecond[i] += pipelineStatisticsFrame[i];
+                }
+                pipelineStatisticsFrameCount++;
+                pipelineStatisticsSecondFrameCount++;
+            }
+
+            // Print average numbers per frame once per second.
+            if (currentTime - pipelineStatisticsPrintTime >= std::chrono::seconds(1) && pipelineStatisticsSecondFrameCount > 0) {
+                std::ostringstream line;
+                line << "Per frame:";
+                for (size_t i = 0; i < pipelineStatisticsSecond.size(); i++) {
+                    line << " " << pipelineStatisticNames[i] << " " << pipelineStatisticsSecond[i] / pipelineStatisticsSecondFrameCount << ";";
+                }
+                logMessage(LOG_SEVERITY_INFO, 0, line.str().c_str());
+                pipelineStatisticsSecond.fill(0);
+                pipelineStatisticsSecondFrameCount = 0;
+                pipelineStatisticsPrintTime = currentTime;
+            }
+#endif
+
+#ifdef POST_PROCESSING
+            // Timestamps of the previous frame rendered with this command buffer are available.
+            std::vector< uint64_t > timestamps(postProcessingTimestampCount);
+            if (vkTimestampQueryPool != VK_NULL_HANDLE && vkGetQueryPoolResults(vkDevice, vkTimestampQueryPool, postProcessingTimestampCount * static_cast< uint32_t >(currentFrame), postProcessingTimestampCount,
+                    timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t),
+                    VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+                for (size_t i = 0; i < postProcessingPasses.size(); i++) {
+                    // Timestamps are counted in ticks of timestampPeriod nanoseconds.
+                    double passTime = ((timestamps[i + 1] - timestamps[i]) & timestampMask) * vkPhysicalDeviceProperties.limits.timestampPeriod;
+                    postProcessingTimeTotal[i] += passTime;
+                    postProcessingTimeSecond[i] += passTime;
+                }
+                postProcessingFrameCount++;
+                postProcessingSecondFrameCount++;
+            }
 
-        // If the image is locked - wait for it.
-        if (vkImagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-            vkWaitForFences(vkDevice, 1, &vkImagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+            // Print average GPU time per frame once per second.
+            if (currentTime - postProcessingPrintTime >= std::chrono::seconds(1) && postProcessingSecondFrameCount > 0) {
+                double totalTime = 0.0;
+                std::ostringstream line;
+                line << "Post-processing GPU time, ms:";
+                for (size_t i = 0; i < postProcessingPasses.size(); i++) {
+                    double passTime = postProcessingTimeSecond[i] / postProcessingSecondFrameCount / 1000000.0;
+                    totalTime += passTime;
+                    line << " " << postProcessingPasses[i].name << " " << passTime << ";";
+                }
+                line << " total " << totalTime;
+                logMessage(LOG_SEVERITY_INFO, 0, line.str().c_str());
+                std::fill(postProcessingTimeSecond.begin(), postProcessingTimeSecond.end(), 0.0);
+                postProcessingSecondFrameCount = 0;
+                postProcessingPrintTime = currentTime;
+            }
+#endif
+
+#ifdef OVERDRAW_MODE
+            // The previous frame rendered with these resources is finished,
+            // so its readback buffer is ready. Analyze it once per second.
+            if (currentTime - overdrawPrintTime >= std::chrono::seconds(1)) {
+                reportOverdraw(currentFrame);
+                overdrawPrintTime = currentTime;
+            }
+#endif
         }
 
-        // Put a free fence to imagesInFlight array.
-        vkImagesInFlight[imageIndex] = vkInFlightFences[currentFrame];
+        // Record commands of the frame for the acquired image.
+        recordCommandBuffer(currentFrame, imageIndex);
 
-        // Describe a submit to the graphics queue.
-        VkSubmitInfo vkSubmitInfo{};
-        vkSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        // Specify semaphores the GPU should wait before executing the submit.
-        std::array< VkSemaphore, 1 > vkWaitSemaphores{ vkImageAvailableSemaphores[currentFrame] };
-        // Pipeline stages corresponding to each semaphore.
-        std::array< VkPipelineStageFlags, 1 > vkWaitStages{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-        vkSubmitInfo.waitSemaphoreCount = vkWaitSemaphores.size();
-        vkSubmitInfo.pWaitSemaphores = vkWaitSemaphores.data();
-        vkSubmitInfo.pWaitDstStageMask = vkWaitStages.data();
-        vkSubmitInfo.commandBufferCount = 1;
-        vkSubmitInfo.pCommandBuffers = &vkCommandBuffers[imageIndex];
-        // Specify semaphores the GPU should unlock after executing the submit.
-        std::array< VkSemaphore, 1 > vkSignalSemaphores{ vkRenderFinishedSemaphores[currentFrame] };
-        vkSubmitInfo.signalSemaphoreCount = vkSignalSemaphores.size();
-        vkSubmitInfo.pSignalSemaphores = vkSignalSemaphores.data();
+#if defined(LATE_LATCH) && !defined(RENDER_THREAD)
+        // Receive the latest cursor position before the view is latched.
+        glfwPollEvents();
+#endif
 
         // Reset the fence.
         vkResetFences(vkDevice, 1, &vkInFlightFences[currentFrame]);
 
-        // Submit to the queue.
-        if (vkQueueSubmit(vkGraphicsQueue, 1, &vkSubmitInfo, vkInFlightFences[currentFrame]) != VK_SUCCESS) {
-            std::cerr << "Failed to submit" << std::endl;
-            abort();
+#ifdef PRESENT_THREAD
+        // Hand the frame over to the present thread. The queue is never full,
+        // as rendering does not get more images than the swap chain gives out.
+        presentRequests.push(PresentRequest{ imageIndex, currentFrame });
+        presentRequestCount++;
+#else
+        submitFrame(currentFrame);
+#endif
+#ifdef OVERDRAW_MODE
+        // The frame is submitted, so its readback buffer is written once it is finished.
+        lastFrame = currentFrame;
+#endif
+#ifndef PRESENT_THREAD
+        if (!presentFrame(imageIndex, currentFrame)) {
+            return false;
         }
-
-        // Prepare an image for presentation.
-        VkPresentInfoKHR vkPresentInfo{};
-        vkPresentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        // Specify semaphores we need to wait before presenting the image.
-        vkPresentInfo.waitSemaphoreCount = vkSignalSemaphores.size();
-        vkPresentInfo.pWaitSemaphores = vkSignalSemaphores.data();
-        std::array< VkSwapchainKHR, 1 > swapChains{ vkSwapChain };
-        vkPresentInfo.swapchainCount = swapChains.size();
-        vkPresentInfo.pSwapchains = swapChains.data();
-        vkPresentInfo.pImageIndices = &imageIndex;
-        vkPresentInfo.pResults = nullptr;
-
-        // Submit and image for presentaion.
-        vkQueuePresentKHR(vkPresentQueue, &vkPresentInfo);
+#endif
 
         // Switch to the next frame in the loop.
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        renderedFrameCount++;
+        return true;
+    };
+
+#ifdef RENDER_THREAD
+    std::thread renderThread([&]() {
+        while (!renderThreadStopRequested.load(std::memory_order_acquire)) {
+            if (!renderFrame()) {
+                break;
+            }
+        }
+    });
+
+    // The main thread sleeps until something happens to the window.
+    while (!glfwWindowShouldClose(glfwWindow)) {
+        glfwWaitEvents();
+    }
+    renderThreadStopRequested.store(true, std::memory_order_release);
+#ifdef ON_DEMAND_RENDERING
+    // Wake up the render thread if it waits for a redraw.
+    windowInput.requestRedraw();
+#endif
+    renderThread.join();
+#else
+    // Main loop.
+    while (!glfwWindowShouldClose(glfwWindow)) {
+        // Poll GLFW events.
+        glfwPollEvents();
+        if (!renderFrame()) {
+            break;
+        }
     }
+#endif
+
+#ifdef PRESENT_THREAD
+    presentThreadStopRequested.store(true, std::memory_order_release);
+    presentThread.join();
+#endif
+
+#ifdef SIMULATION_THREAD
+    simulationThreadStopRequested.store(true, std::memory_order_release);
+    simulationThread.join();
+#endif
 
     // ==========================================================================
     //                     STEP 37: Deinitialization
@@ -1949,71 +6987,236 @@ int main()
     // Wait until all pending render operations are finished.
     vkDeviceWaitIdle(vkDevice);
 
+#ifdef CAPTURE_MODE
+
+    // Finish the capture.
+    captureFile.close();
+    if (!captureFile) {
+        std::cerr << "Failed to write the capture file!" << std::endl;
+    } else {
+        std::cout << "Captured " << capturedFrameCount << " frames into " << CAPTURE_FILE_NAME << std::endl;
+    }
+
+#endif
+
+#ifdef TARGET_FPS
+
+    // Report frame pacing over the whole run.
+    if (framePacingTotal.intervalCount > 0) {
+        std::cout << framePacingTotal.describe() << std::endl;
+    }
+
+#ifdef _WIN32
+    CloseHandle(frameLimiterTimer);
+    if (frameLimiterTimerPeriodRaised) {
+        timeEndPeriod(1);
+    }
+#endif
+
+#endif
+
+#ifdef PIPELINE_STATISTICS
+
+    // Report average pipeline statistics over the whole run.
+    if (pipelineStatisticsFrameCount > 0) {
+        std::cout << "Pipeline statistics over " << pipelineStatisticsFrameCount << " frames, average per frame:" << std::endl;
+        for (size_t i = 0; i < pipelineStatisticsTotal.size(); i++) {
+            std::cout << "  " << pipelineStatisticNames[i] << ": " << pipelineStatisticsTotal[i] / pipelineStatisticsFrameCount << std::endl;
+        }
+    }
+
+    // Destroy the query pool.
+    vkDestroyQueryPool(vkDevice, vkStatisticsQueryPool, vkAllocator);
+
+#endif
+
+#ifdef OVERDRAW_MODE
+
+    // Report overdraw of the last frame unless nothing has been rendered.
+    if (lastFrame.has_value()) {
+        reportOverdraw(lastFrame.value());
+    }
+
+    // Destroy overdraw pass resources.
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkUnmapMemory(vkDevice, vkOverdrawBuffersMemory[i]);
+        vkDestroyBuffer(vkDevice, vkOverdrawBuffers[i], vkAllocator);
+        vkFreeMemory(vkDevice, vkOverdrawBuffersMemory[i], vkAllocator);
+        vkDestroyFramebuffer(vkDevice, vkOverdrawFramebuffers[i], vkAllocator);
+        vkDestroyImageView(vkDevice, vkOverdrawImageViews[i], vkAllocator);
+        vkDestroyImage(vkDevice, vkOverdrawImages[i], vkAllocator);
+        vkFreeMemory(vkDevice, vkOverdrawImagesMemory[i], vkAllocator);
+    }
+    vkDestroyPipeline(vkDevice, vkOverdrawPipeline, vkAllocator);
+    vkDestroyRenderPass(vkDevice, vkOverdrawRenderPass, vkAllocator);
+    vkDestroyShaderModule(vkDevice, vkOverdrawShaderModule, vkAllocator);
+
+#endif
+
+#ifdef POST_PROCESSING
+
+    // Report average GPU time of post-processing over the whole run.
+    if (postProcessingFrameCount > 0) {
+        std::cout << "Post-processing GPU time over " << postProcessingFrameCount << " frames, average per frame:" << std::endl;
+        for (size_t i = 0; i < postProcessingPasses.size(); i++) {
+            std::cout << "  " << postProcessingPasses[i].name << ": " << postProcessingTimeTotal[i] / postProcessingFrameCount / 1000000.0 << " ms" << std::endl;
+        }
+    }
+
+    // Destroy post-processing resources.
+    // Descriptor sets are freed together with the pool.
+    vkDestroyQueryPool(vkDevice, vkTimestampQueryPool, vkAllocator);
+    for (auto& pass : postProcessingPasses) {
+        vkDestroyPipeline(vkDevice, pass.pipeline, vkAllocator);
+        vkDestroyShaderModule(vkDevice, pass.shaderModule, vkAllocator);
+        vkDestroyImageView(vkDevice, pass.imageView, vkAllocator);
+        vkDestroyImage(vkDevice, pass.image, vkAllocator);
+        vkFreeMemory(vkDevice, pass.imageMemory, vkAllocator);
+    }
+    vkDestroyPipelineLayout(vkDevice, vkPostProcessingPipelineLayout, vkAllocator);
+    vkDestroyDescriptorPool(vkDevice, vkPostProcessingDescriptorPool, vkAllocator);
+    vkDestroyDescriptorSetLayout(vkDevice, vkPostProcessingDescriptorSetLayout, vkAllocator);
+    vkDestroySampler(vkDevice, vkPostProcessingSampler, vkAllocator);
+#ifndef TAA
+    vkDestroyImageView(vkDevice, resolveImageView, vkAllocator);
+    vkDestroyImage(vkDevice, resolveImage, vkAllocator);
+    vkFreeMemory(vkDevice, resolveImageMemory, vkAllocator);
+#endif
+
+#endif
+
+#ifdef TAA
+
+    // Destroy TAA resolve pass resources.
+    vkDestroyPipeline(vkDevice, vkTaaPipeline, vkAllocator);
+    vkDestroyPipelineLayout(vkDevice, vkTaaPipelineLayout, vkAllocator);
+    vkDestroyDescriptorPool(vkDevice, vkTaaDescriptorPool, vkAllocator);
+    vkDestroyDescriptorSetLayout(vkDevice, vkTaaDescriptorSetLayout, vkAllocator);
+    vkDestroySampler(vkDevice, vkTaaSampler, vkAllocator);
+    vkDestroyImageView(vkDevice, taaOutputImageView, vkAllocator);
+    vkDestroyImage(vkDevice, taaOutputImage, vkAllocator);
+    vkFreeMemory(vkDevice, taaOutputImageMemory, vkAllocator);
+    vkDestroyImageView(vkDevice, taaHistoryImageView, vkAllocator);
+    vkDestroyImage(vkDevice, taaHistoryImage, vkAllocator);
+    vkFreeMemory(vkDevice, taaHistoryImageMemory, vkAllocator);
+    vkDestroyShaderModule(vkDevice, vkTaaShaderModule, vkAllocator);
+    vkDestroyImageView(vkDevice, velocityImageView, vkAllocator);
+    vkDestroyImage(vkDevice, velocityImage, vkAllocator);
+    vkFreeMemory(vkDevice, velocityImageMemory, vkAllocator);
+
+#endif
+
+#ifdef DEFERRED_SHADING
+
+    // Destroy lighting pass resources and the G-buffer.
+    vkDestroyPipeline(vkDevice, vkLightingPipeline, vkAllocator);
+    vkDestroyPipelineLayout(vkDevice, vkLightingPipelineLayout, vkAllocator);
+    vkDestroyDescriptorPool(vkDevice, vkLightingDescriptorPool, vkAllocator);
+    vkDestroyDescriptorSetLayout(vkDevice, vkLightingDescriptorSetLayout, vkAllocator);
+    vkDestroyShaderModule(vkDevice, vkLightingShaderModule, vkAllocator);
+    vkDestroyShaderModule(vkDevice, vkFullscreenShaderModule, vkAllocator);
+    for (size_t i = 0; i < gBufferImages.size(); i++) {
+        vkDestroyImageView(vkDevice, gBufferImageViews[i], vkAllocator);
+        vkDestroyImage(vkDevice, gBufferImages[i], vkAllocator);
+        vkFreeMemory(vkDevice, gBufferImagesMemory[i], vkAllocator);
+    }
+
+#endif
+
     // Destroy fences.
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyFence(vkDevice, vkInFlightFences[i], nullptr);
+        vkDestroyFence(vkDevice, vkInFlightFences[i], vkAllocator);
     }
 
     // Destroy semaphores.
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(vkDevice, vkRenderFinishedSemaphores[i], nullptr);
+        vkDestroySemaphore(vkDevice, vkRenderFinishedSemaphores[i], vkAllocator);
     }
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(vkDevice, vkImageAvailableSemaphores[i], nullptr);
+        vkDestroySemaphore(vkDevice, vkImageAvailableSemaphores[i], vkAllocator);
     }
 
     // Destroy swap uniform buffers.
-    for (size_t i = 0; i < vkSwapChainImages.size(); i++) {
-        vkDestroyBuffer(vkDevice, vkUniformBuffers[i], nullptr);
-        vkFreeMemory(vkDevice, vkUniformBuffersMemory[i], nullptr);
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkDestroyBuffer(vkDevice, vkUniformBuffers[i], vkAllocator);
+        vkFreeMemory(vkDevice, vkUniformBuffersMemory[i], vkAllocator);
     }
 
     // Destory descriptor pool for uniforms.
-    vkDestroyDescriptorPool(vkDevice, vkDescriptorPool, nullptr);
+    vkDestroyDescriptorPool(vkDevice, vkDescriptorPool, vkAllocator);
 
     // Destroy vertex buffer.
-    vkDestroyBuffer(vkDevice, vkVertexBuffer, nullptr);
-    vkFreeMemory(vkDevice, vkVertexBufferMemory, nullptr);
+    vkDestroyBuffer(vkDevice, vkVertexBuffer, vkAllocator);
+    vkFreeMemory(vkDevice, vkVertexBufferMemory, vkAllocator);
 
     // Destory command pool
-    vkDestroyCommandPool(vkDevice, vkCommandPool, nullptr);
+    vkDestroyCommandPool(vkDevice, vkCommandPool, vkAllocator);
 
     // Destory framebuffers.
+#ifndef DYNAMIC_RENDERING
     for (auto framebuffer : vkSwapChainFramebuffers) {
-        vkDestroyFramebuffer(vkDevice, framebuffer, nullptr);
+        vkDestroyFramebuffer(vkDevice, framebuffer, vkAllocator);
     }
+#endif
 
-    vkDestroyImageView(vkDevice, colorImageView, nullptr);
-    vkDestroyImage(vkDevice, colorImage, nullptr);
-    vkFreeMemory(vkDevice, colorImageMemory, nullptr);
+    vkDestroyImageView(vkDevice, colorImageView, vkAllocator);
+    vkDestroyImage(vkDevice, colorImage, vkAllocator);
+    vkFreeMemory(vkDevice, colorImageMemory, vkAllocator);
 
     // Destroy depth-stensil image and image view.
-    vkDestroyImageView(vkDevice, vkDepthImageView, nullptr);
-    vkDestroyImage(vkDevice, vkDepthImage, nullptr);
-    vkFreeMemory(vkDevice, vkDepthImageMemory, nullptr);
+    vkDestroyImageView(vkDevice, vkDepthImageView, vkAllocator);
+    vkDestroyImage(vkDevice, vkDepthImage, vkAllocator);
+    vkFreeMemory(vkDevice, vkDepthImageMemory, vkAllocator);
 
     // Destory pipeline.
-    vkDestroyPipeline(vkDevice, vkGraphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(vkDevice, vkPipelineLayout, nullptr);
-    vkDestroyRenderPass(vkDevice, vkRenderPass, nullptr);
+#ifdef DEPTH_PREPASS
+    vkDestroyPipeline(vkDevice, vkPrepassPipeline, vkAllocator);
+#endif
+    vkDestroyPipeline(vkDevice, vkGraphicsPipeline, vkAllocator);
+#ifdef GRAPHICS_PIPELINE_LIBRARY
+    // The optimized link might still be running if the window has been closed quickly.
+    if (optimizedPipelinePending) {
+        vkDestroyPipeline(vkDevice, optimizedPipelineTask.get(), vkAllocator);
+#ifdef DEPTH_PREPASS
+        vkDestroyPipeline(vkDevice, optimizedPrepassPipelineTask.get(), vkAllocator);
+#endif
+    }
+#ifdef DEPTH_PREPASS
+    // The first libraries are shared with the main pipeline.
+#ifdef DYNAMIC_RENDERING
+    for (size_t i = 2; i < vkPrepassPipelineLibraries.size(); i++) {
+#else
+    for (size_t i = 1; i < vkPrepassPipelineLibraries.size(); i++) {
+#endif
+        vkDestroyPipeline(vkDevice, vkPrepassPipelineLibraries[i], vkAllocator);
+    }
+#endif
+    for (auto library : vkPipelineLibraries) {
+        vkDestroyPipeline(vkDevice, library, vkAllocator);
+    }
+#endif
+    vkDestroyPipelineLayout(vkDevice, vkPipelineLayout, vkAllocator);
+#ifndef DYNAMIC_RENDERING
+    vkDestroyRenderPass(vkDevice, vkRenderPass, vkAllocator);
+#endif
 
     // Destroy shader modules.
-    vkDestroyShaderModule(vkDevice, vkFragmentShaderModule, nullptr);
-    vkDestroyShaderModule(vkDevice, vkVertexShaderModule, nullptr);
+    vkDestroyShaderModule(vkDevice, vkFragmentShaderModule, vkAllocator);
+    vkDestroyShaderModule(vkDevice, vkVertexShaderModule, vkAllocator);
 
     // Destory swap chain image views.
     for (auto imageView : vkSwapChainImageViews) {
-        vkDestroyImageView(vkDevice, imageView, nullptr);
+        vkDestroyImageView(vkDevice, imageView, vkAllocator);
     }
 
     // Destroy swap chain.
-    vkDestroySwapchainKHR(vkDevice, vkSwapChain, nullptr);
+    vkDestroySwapchainKHR(vkDevice, vkSwapChain, vkAllocator);
 
     // Destory descriptor set layout for uniforms.
-    vkDestroyDescriptorSetLayout(vkDevice, vkDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(vkDevice, vkDescriptorSetLayout, vkAllocator);
 
     // Destory logical device.
-    vkDestroyDevice(vkDevice, nullptr);
+    vkDestroyDevice(vkDevice, vkAllocator);
 
 #ifdef DEBUG_MODE
 
@@ -2025,15 +7228,47 @@ int main()
     }
 
     // Destory debug messenger.
-    vkDestroyDebugUtilsMessengerEXT(vkInstance, vkDebugMessenger, nullptr);
+    vkDestroyDebugUtilsMessengerEXT(vkInstance, vkDebugMessenger, vkAllocator);
 
 #endif
 
     // Destory surface.
-    vkDestroySurfaceKHR(vkInstance, vkSurface, nullptr);
+    vkDestroySurfaceKHR(vkInstance, vkSurface, vkAllocator);
 
     // Destroy Vulkan instance.
-    vkDestroyInstance(vkInstance, nullptr);
+    vkDestroyInstance(vkInstance, vkAllocator);
+
+#ifdef ASYNC_LOG
+    // No more messages come from Vulkan.
+    stopLogWriter();
+#endif
+
+#ifdef HOST_ALLOCATOR
+
+    // Report host memory used by Vulkan.
+    // All objects are destroyed, so nothing should remain allocated.
+    const std::array< const char*, HOST_ALLOCATION_SCOPE_COUNT > scopeNames {
+        "command", "object", "cache", "device", "instance"
+    };
+    std::cout << "Host allocations by Vulkan:" << std::endl;
+    for (size_t i = 0; i < HOST_ALLOCATION_SCOPE_COUNT; i++) {
+        std::cout << "  " << scopeNames[i] << ": "
+                  << hostAllocationStatistics.count[i] << " allocations, "
+                  << hostAllocationStatistics.peakBytes[i] << " bytes at peak, "
+                  << hostAllocationStatistics.bytes[i] << " bytes not freed" << std::endl;
+    }
+    std::cout << "  pooled: " << hostAllocationStatistics.pooledCount << " allocations" << std::endl;
+    std::cout << "  total: " << hostAllocationStatistics.peakTotalBytes << " bytes at peak" << std::endl;
+    std::cout << "  internal: " << hostAllocationStatistics.internalBytes << " bytes not freed" << std::endl;
+
+    // Release pool arenas. No more Vulkan calls follow.
+    hostPoolFreeLists.fill(nullptr);
+    for (auto arena : hostPoolArenas) {
+        std::free(arena);
+    }
+    hostPoolArenas.clear();
+
+#endif
 
     // Destroy window.
     glfwDestroyWindow(glfwWindow);
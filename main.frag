@@ -3,8 +3,41 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(location = 0) in vec3 fragColor;
+#ifdef TAA
+layout(location = 1) in vec4 currentPosition;
+layout(location = 2) in vec4 previousPosition;
+#endif
+#ifdef DEFERRED_SHADING
+layout(location = 3) in vec3 worldPosition;
+#endif
+
+#ifdef DEFERRED_SHADING
+// The G-buffer goes first, motion vectors follow it.
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+#define VELOCITY_LOCATION 2
+#else
 layout(location = 0) out vec4 outColor;
+#define VELOCITY_LOCATION 1
+#endif
+#ifdef TAA
+layout(location = VELOCITY_LOCATION) out vec2 outVelocity;
+#endif
 
 void main() {
+#ifdef DEFERRED_SHADING
+    // Alpha marks pixels covered by the cube, the background stays zero.
+    outAlbedo = vec4(fragColor, 1.0);
+    // The cube has no normals in its vertices, so the face normal is taken
+    // from derivatives of the position. Its sign is not reliable, the lighting
+    // shader lights both sides.
+    vec3 normal = normalize(cross(dFdy(worldPosition), dFdx(worldPosition)));
+    outNormal = vec4(normal * 0.5 + 0.5, 1.0);
+#else
     outColor = vec4(fragColor, 1.0);
+#endif
+#ifdef TAA
+    // Motion of the pixel since the previous frame in texture coordinates.
+    outVelocity = (currentPosition.xy / currentPosition.w - previousPosition.xy / previousPosition.w) * 0.5;
+#endif
 }
@@ -5,15 +5,42 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
 
+// The depth prepass and the main pass compare depth for equality, so the
+// position must be computed identically by both pipelines.
+invariant gl_Position;
+
 layout(location = 0) out vec3 fragColor;
+#ifdef TAA
+layout(location = 1) out vec4 currentPosition;
+layout(location = 2) out vec4 previousPosition;
+#endif
+#ifdef DEFERRED_SHADING
+layout(location = 3) out vec3 worldPosition;
+#endif
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
+#ifdef TAA
+    mat4 previousModel;
+    mat4 previousView;
+    mat4 previousProj;
+    vec4 jitter;
+#endif
 } ubo;
 
 void main() {
     gl_Position = ubo.proj * ubo.view * ubo.model * vec4(position, 1.0);
     fragColor = color;
+#ifdef DEFERRED_SHADING
+    worldPosition = (ubo.model * vec4(position, 1.0)).xyz;
+#endif
+#ifdef TAA
+    // Positions without jitter, so a still object has no motion.
+    currentPosition = gl_Position;
+    currentPosition.xy -= ubo.jitter.xy * gl_Position.w;
+    previousPosition = ubo.previousProj * ubo.previousView * ubo.previousModel * vec4(position, 1.0);
+    previousPosition.xy -= ubo.jitter.zw * previousPosition.w;
+#endif
 }
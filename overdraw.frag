@@ -0,0 +1,10 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) out float outCount;
+
+void main() {
+    // Each fragment adds one to the pixel with additive blending.
+    outCount = 1.0;
+}
@@ -0,0 +1,935 @@
+/****************************************************************************
+ *                                                                          *
+ *  Example of a simple 3D application using Vulkan API                     *
+ *  Copyright (C) 2020 Artem Hlumov <artyom.altair@gmail.com>               *
+ *                                                                          *
+ *  This program is free software: you can redistribute it and/or modify    *
+ *  it under the terms of the GNU General Public License as published by    *
+ *  the Free Software Foundation, either version 3 of the License, or       *
+ *  (at your option) any later version.                                     *
+ *                                                                          *
+ *  This program is distributed in the hope that it will be useful,         *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU General Public License for more details.                            *
+ *                                                                          *
+ *  You should have received a copy of the GNU General Public License       *
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.   *
+ *                                                                          *
+ ****************************************************************************
+ *                                                                          *
+ *     Replay tool for command stream captures written by the main          *
+ *   application built with CAPTURE_MODE. The stream is executed into       *
+ *   offscreen images as fast as possible, without a window and without     *
+ *   any application logic, so the time reflects driver and GPU only.       *
+ *                                                                          *
+ *   Usage: VKReplay [capture file] [amount of loops]                       *
+ *                                                                          *
+ ****************************************************************************/
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <algorithm>
+
+// Format of the capture file.
+#include "capture.h"
+
+/**
+ * Application name.
+ */
+constexpr const char* APPLICATION_NAME = "VKReplay";
+/**
+ * Maximal amount of frames processed at the same time.
+ */
+constexpr int MAX_FRAMES_IN_FLIGHT = 5;
+
+/**
+ * Main function.
+ * @param argc Amount of command line arguments.
+ * @param argv Command line arguments.
+ * @return Return code of the application.
+ */
+int main(int argc, char** argv)
+{
+    // ==========================================================================
+    //                     STEP 1: Read the capture file
+    // ==========================================================================
+    // The whole stream is loaded into memory before replay, so reading
+    // the file does not affect the measurement.
+    // ==========================================================================
+
+    // Take parameters from the command line.
+    const char* captureFileName = (argc > 1) ? argv[1] : CAPTURE_FILE_NAME;
+    int loopCount = (argc > 2) ? std::atoi(argv[2]) : 1;
+    if (loopCount < 1) {
+        loopCount = 1;
+    }
+
+    // Open file.
+    std::ifstream captureFile(captureFileName, std::ios::binary);
+    if (!captureFile.is_open()) {
+        std::cerr << "Capture file not found!" << std::endl;
+        abort();
+    }
+
+    // Check the header.
+    CaptureFileHeader captureFileHeader{};
+    captureFile.read(reinterpret_cast< char* >(&captureFileHeader), sizeof(captureFileHeader));
+    if (!captureFile || captureFileHeader.magic != CAPTURE_MAGIC || captureFileHeader.version != CAPTURE_VERSION) {
+        std::cerr << "Unsupported capture file!" << std::endl;
+        abort();
+    }
+
+    // One frame of the stream.
+    struct CapturedFrame
+    {
+        // Content of the uniform buffer.
+        std::vector< char > uniformData;
+        // Amount of vertices to draw.
+        uint32_t vertexCount;
+    };
+
+    // Content of the stream.
+    std::optional< CaptureTargets > captureTargets;
+    std::vector< char > vertexShaderCode;
+    std::vector< char > fragmentShaderCode;
+    CaptureVertexLayout captureVertexLayout{};
+    std::vector< CaptureVertexAttribute > captureVertexAttributes;
+    std::vector< char > vertexData;
+    std::vector< CapturedFrame > capturedFrames;
+    std::vector< char > pendingUniformData;
+    size_t uniformBufferSize = 0;
+
+    // Read records one by one.
+    CaptureRecordHeader recordHeader{};
+    while (captureFile.read(reinterpret_cast< char* >(&recordHeader), sizeof(recordHeader))) {
+        std::vector< char > payload(recordHeader.size);
+        if (!captureFile.read(payload.data(), payload.size())) {
+            std::cerr << "Capture file is truncated!" << std::endl;
+            abort();
+        }
+
+        if (recordHeader.type == CAPTURE_RECORD_TARGETS && payload.size() >= sizeof(CaptureTargets)) {
+            CaptureTargets targets;
+            std::memcpy(&targets, payload.data(), sizeof(targets));
+            captureTargets = targets;
+        } else if (recordHeader.type == CAPTURE_RECORD_SHADER && payload.size() >= sizeof(CaptureShader)) {
+            CaptureShader shader;
+            std::memcpy(&shader, payload.data(), sizeof(shader));
+            std::vector< char > code(payload.begin() + sizeof(shader), payload.end());
+            if (shader.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+                vertexShaderCode = code;
+            } else if (shader.stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+                fragmentShaderCode = code;
+            }
+        } else if (recordHeader.type == CAPTURE_RECORD_VERTEX_BUFFER && payload.size() >= sizeof(CaptureVertexLayout)) {
+            std::memcpy(&captureVertexLayout, payload.data(), sizeof(captureVertexLayout));
+            size_t attributesSize = sizeof(CaptureVertexAttribute) * captureVertexLayout.attributeCount;
+            if (payload.size() < sizeof(captureVertexLayout) + attributesSize) {
+                std::cerr << "Invalid vertex buffer record!" << std::endl;
+                abort();
+            }
+            captureVertexAttributes.resize(captureVertexLayout.attributeCount);
+            std::memcpy(captureVertexAttributes.data(), payload.data() + sizeof(captureVertexLayout), attributesSize);
+            vertexData.assign(payload.begin() + sizeof(captureVertexLayout) + attributesSize, payload.end());
+        } else if (recordHeader.type == CAPTURE_RECORD_UNIFORM_UPDATE) {
+            pendingUniformData = payload;
+            uniformBufferSize = std::max(uniformBufferSize, payload.size());
+        } else if (recordHeader.type == CAPTURE_RECORD_DRAW && payload.size() >= sizeof(CaptureDraw)) {
+            CaptureDraw draw;
+            std::memcpy(&draw, payload.data(), sizeof(draw));
+            capturedFrames.push_back({ pendingUniformData, draw.vertexCount });
+        }
+        // Unknown records are skipped.
+    }
+    captureFile.close();
+
+    // Check that the stream is complete.
+    if (!captureTargets.has_value() || vertexShaderCode.empty() || fragmentShaderCode.empty() ||
+            vertexData.empty() || capturedFrames.empty() || uniformBufferSize == 0) {
+        std::cerr << "Capture file is incomplete!" << std::endl;
+        abort();
+    }
+    VkExtent2D vkExtent = { captureTargets->width, captureTargets->height };
+    VkFormat vkColorFormat = static_cast< VkFormat >(captureTargets->colorFormat);
+    VkFormat vkDepthFormat = static_cast< VkFormat >(captureTargets->depthFormat);
+    VkSampleCountFlagBits vkSamples = static_cast< VkSampleCountFlagBits >(captureTargets->samples);
+
+    // ==========================================================================
+    //                    STEP 2: Create a Vulkan instance
+    // ==========================================================================
+    // Rendering is done offscreen, so no extensions are needed.
+    // ==========================================================================
+
+    // Specify application info and required Vulkan version.
+    VkApplicationInfo vkAppInfo {};
+    vkAppInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    vkAppInfo.pApplicationName = APPLICATION_NAME;
+    vkAppInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    vkAppInfo.pEngineName = APPLICATION_NAME;
+    vkAppInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    vkAppInfo.apiVersion = VK_API_VERSION_1_0;
+
+    // Fill in an instance create structure.
+    VkInstanceCreateInfo vkCreateInfo {};
+    vkCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    vkCreateInfo.pApplicationInfo = &vkAppInfo;
+    vkCreateInfo.enabledExtensionCount = 0;
+
+#ifdef DEBUG_MODE
+
+    // Switch on validation layers in debug mode.
+    std::vector< const char* > desiredValidationLayers = {
+        "VK_LAYER_KHRONOS_validation"
+    };
+    vkCreateInfo.enabledLayerCount = static_cast< uint32_t >(desiredValidationLayers.size());
+    vkCreateInfo.ppEnabledLayerNames = desiredValidationLayers.data();
+
+#else
+
+    // Do not use layers in release mode.
+    vkCreateInfo.enabledLayerCount = 0;
+
+#endif
+
+    // Create a Vulkan instance and check its validity.
+    VkInstance vkInstance;
+    if (vkCreateInstance(&vkCreateInfo, nullptr, &vkInstance) != VK_SUCCESS) {
+        std::cerr << "Failed to creae a Vulkan instance!" << std::endl;
+        abort();
+    }
+
+    // ==========================================================================
+    //                      STEP 3: Pick a physical device
+    // ==========================================================================
+    // The device should have a graphics queue and support formats and
+    // the amount of samples the stream has been captured with.
+    // ==========================================================================
+
+    // Get list of physical devices.
+    uint32_t vkDeviceCount = 0;
+    vkEnumeratePhysicalDevices(vkInstance, &vkDeviceCount, nullptr);
+    std::vector< VkPhysicalDevice > vkDevices(vkDeviceCount);
+    vkEnumeratePhysicalDevices(vkInstance, &vkDeviceCount, vkDevices.data());
+
+    VkPhysicalDevice vkPhysicalDevice = VK_NULL_HANDLE;
+    uint32_t graphicsFamily = UINT32_MAX;
+    for (auto device : vkDevices) {
+        // Check supported amount of samples.
+        VkPhysicalDeviceProperties vkDeviceProperties;
+        vkGetPhysicalDeviceProperties(device, &vkDeviceProperties);
+        VkSampleCountFlags vkSampleCounts = vkDeviceProperties.limits.framebufferColorSampleCounts & vkDeviceProperties.limits.framebufferDepthSampleCounts;
+        bool samplesOk = (vkSampleCounts & vkSamples) != 0;
+
+        // Check formats.
+        VkFormatProperties vkColorProps;
+        vkGetPhysicalDeviceFormatProperties(device, vkColorFormat, &vkColorProps);
+        VkFormatProperties vkDepthProps;
+        vkGetPhysicalDeviceFormatProperties(device, vkDepthFormat, &vkDepthProps);
+        bool formatsOk = (vkColorProps.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) &&
+                         (vkDepthProps.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
+        // Look for a graphics queue family.
+        uint32_t vkQueueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &vkQueueFamilyCount, nullptr);
+        std::vector< VkQueueFamilyProperties > vkQueueFamilies(vkQueueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &vkQueueFamilyCount, vkQueueFamilies.data());
+        uint32_t currentGraphicsFamily = UINT32_MAX;
+        for (uint32_t i = 0; i < vkQueueFamilyCount; i++) {
+            if (vkQueueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                currentGraphicsFamily = i;
+                break;
+            }
+        }
+
+        // Select the first suitable device.
+        if (samplesOk && formatsOk && currentGraphicsFamily != UINT32_MAX) {
+            vkPhysicalDevice = device;
+            graphicsFamily = currentGraphicsFamily;
+            break;
+        }
+    }
+
+    // Check if we have found any suitable device.
+    if (vkPhysicalDevice == VK_NULL_HANDLE) {
+        std::cerr << "No device can replay the capture!" << std::endl;
+        abort();
+    }
+
+    // Memory types of the device.
+    VkPhysicalDeviceMemoryProperties vkMemProperties;
+    vkGetPhysicalDeviceMemoryProperties(vkPhysicalDevice, &vkMemProperties);
+
+    // ==========================================================================
+    //                   STEP 4: Create a logical device
+    // ==========================================================================
+
+    // Describe the graphics queue.
+    float queuePriority = 1.0f;
+    VkDeviceQueueCreateInfo vkQueueCreateInfo{};
+    vkQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    vkQueueCreateInfo.queueFamilyIndex = graphicsFamily;
+    vkQueueCreateInfo.queueCount = 1;
+    vkQueueCreateInfo.pQueuePriorities = &queuePriority;
+
+    // No special features are needed.
+    VkPhysicalDeviceFeatures vkDeviceFeatures {};
+
+    // Logical device creation info.
+    VkDeviceCreateInfo vkDeviceCreateInfo {};
+    vkDeviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    vkDeviceCreateInfo.queueCreateInfoCount = 1;
+    vkDeviceCreateInfo.pQueueCreateInfos = &vkQueueCreateInfo;
+    vkDeviceCreateInfo.pEnabledFeatures = &vkDeviceFeatures;
+    vkDeviceCreateInfo.enabledExtensionCount = 0;
+    vkDeviceCreateInfo.enabledLayerCount = 0;
+
+    // Create a logical device.
+    VkDevice vkDevice;
+    if (vkCreateDevice(vkPhysicalDevice, &vkDeviceCreateInfo, nullptr, &vkDevice) != VK_SUCCESS) {
+        std::cerr << "Failed to create a logical device!" << std::endl;
+        abort();
+    }
+
+    // Pick the graphics queue.
+    VkQueue vkGraphicsQueue;
+    vkGetDeviceQueue(vkDevice, graphicsFamily, 0, &vkGraphicsQueue);
+
+    // ==========================================================================
+    //                   STEP 5: Create offscreen attachments
+    // ==========================================================================
+    // The same attachments as in the application: a multi-sampled color
+    // image, a depth image and a resolve image replacing the swap chain one.
+    // Without MSAA the color image is rendered directly and nothing is resolved.
+    // ==========================================================================
+
+    bool resolveNeeded = (vkSamples != VK_SAMPLE_COUNT_1_BIT);
+
+    // Describe images.
+    struct OffscreenImage
+    {
+        VkFormat format;
+        VkSampleCountFlagBits samples;
+        VkImageUsageFlags usage;
+        VkImageAspectFlags aspect;
+        VkImage image;
+        VkDeviceMemory memory;
+        VkImageView view;
+    };
+    std::vector< OffscreenImage > offscreenImages {
+        { vkColorFormat, vkSamples, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (resolveNeeded ? static_cast< VkImageUsageFlags >(VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) : 0), VK_IMAGE_ASPECT_COLOR_BIT, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE },
+        { vkDepthFormat, vkSamples, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE }
+    };
+    if (resolveNeeded) {
+        offscreenImages.push_back({ vkColorFormat, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE });
+    }
+
+    // Create images, memory and views.
+    for (auto& offscreenImage : offscreenImages) {
+        // Describe an image.
+        VkImageCreateInfo vkImageInfo{};
+        vkImageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        vkImageInfo.imageType = VK_IMAGE_TYPE_2D;
+        vkImageInfo.extent.width = vkExtent.width;
+        vkImageInfo.extent.height = vkExtent.height;
+        vkImageInfo.extent.depth = 1;
+        vkImageInfo.mipLevels = 1;
+        vkImageInfo.arrayLayers = 1;
+        vkImageInfo.format = offscreenImage.format;
+        vkImageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        vkImageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        vkImageInfo.usage = offscreenImage.usage;
+        vkImageInfo.samples = offscreenImage.samples;
+        vkImageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        // Create an image.
+        if (vkCreateImage(vkDevice, &vkImageInfo, nullptr, &offscreenImage.image) != VK_SUCCESS) {
+            std::cerr << "Failed to create an image!" << std::endl;
+            abort();
+        }
+
+        // Allocate device local memory.
+        VkMemoryRequirements vkMemRequirements;
+        vkGetImageMemoryRequirements(vkDevice, offscreenImage.image, &vkMemRequirements);
+        VkMemoryAllocateInfo vkAllocInfo{};
+        vkAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        vkAllocInfo.allocationSize = vkMemRequirements.size;
+        vkAllocInfo.memoryTypeIndex = UINT32_MAX;
+        for (uint32_t i = 0; i < vkMemProperties.memoryTypeCount; i++) {
+            if ((vkMemRequirements.memoryTypeBits & (1 << i)) &&
+                    (vkMemProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+                vkAllocInfo.memoryTypeIndex = i;
+                break;
+            }
+        }
+        if (vkAllocateMemory(vkDevice, &vkAllocInfo, nullptr, &offscreenImage.memory) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate image memory!" << std::endl;
+            abort();
+        }
+        vkBindImageMemory(vkDevice, offscreenImage.image, offscreenImage.memory, 0);
+
+        // Create an image view.
+        VkImageViewCreateInfo vkViewInfo{};
+        vkViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        vkViewInfo.image = offscreenImage.image;
+        vkViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        vkViewInfo.format = offscreenImage.format;
+        vkViewInfo.subresourceRange.aspectMask = offscreenImage.aspect;
+        vkViewInfo.subresourceRange.baseMipLevel = 0;
+        vkViewInfo.subresourceRange.levelCount = 1;
+        vkViewInfo.subresourceRange.baseArrayLayer = 0;
+        vkViewInfo.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(vkDevice, &vkViewInfo, nullptr, &offscreenImage.view) != VK_SUCCESS) {
+            std::cerr << "Failed to create an image view!" << std::endl;
+            abort();
+        }
+    }
+
+    // ==========================================================================
+    //                STEP 6: Create a render pass and a framebuffer
+    // ==========================================================================
+
+    // Color attachment. It is stored only if there is nothing to resolve.
+    VkAttachmentDescription vkColorAttachment{};
+    vkColorAttachment.format = vkColorFormat;
+    vkColorAttachment.samples = vkSamples;
+    vkColorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    vkColorAttachment.storeOp = resolveNeeded ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+    vkColorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    vkColorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    vkColorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    vkColorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    // Depth attachment.
+    VkAttachmentDescription vkDepthAttachment{};
+    vkDepthAttachment.format = vkDepthFormat;
+    vkDepthAttachment.samples = vkSamples;
+    vkDepthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    vkDepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    vkDepthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    vkDepthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    vkDepthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    vkDepthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    // Resolve attachment stands for the swap chain image.
+    VkAttachmentDescription vkResolveAttachment = vkColorAttachment;
+    vkResolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    vkResolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    vkResolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    std::vector< VkAttachmentDescription > vkAttachments { vkColorAttachment, vkDepthAttachment };
+    if (resolveNeeded) {
+        vkAttachments.push_back(vkResolveAttachment);
+    }
+
+    // Attachment references.
+    VkAttachmentReference colorAttachmentRef{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkAttachmentReference depthAttachmentRef{ 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+    VkAttachmentReference resolveAttachmentRef{ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+    // The only subpass.
+    VkSubpassDescription vkSubpass{};
+    vkSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    vkSubpass.colorAttachmentCount = 1;
+    vkSubpass.pColorAttachments = &colorAttachmentRef;
+    vkSubpass.pDepthStencilAttachment = &depthAttachmentRef;
+    vkSubpass.pResolveAttachments = resolveNeeded ? &resolveAttachmentRef : nullptr;
+
+    // Frames write the same attachments, so each frame waits for the previous one.
+    VkSubpassDependency vkDependency{};
+    vkDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    vkDependency.dstSubpass = 0;
+    vkDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    vkDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    vkDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    vkDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // Create a render pass.
+    VkRenderPassCreateInfo vkRenderPassInfo{};
+    vkRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    vkRenderPassInfo.attachmentCount = static_cast< uint32_t >(vkAttachments.size());
+    vkRenderPassInfo.pAttachments = vkAttachments.data();
+    vkRenderPassInfo.subpassCount = 1;
+    vkRenderPassInfo.pSubpasses = &vkSubpass;
+    vkRenderPassInfo.dependencyCount = 1;
+    vkRenderPassInfo.pDependencies = &vkDependency;
+    VkRenderPass vkRenderPass;
+    if (vkCreateRenderPass(vkDevice, &vkRenderPassInfo, nullptr, &vkRenderPass) != VK_SUCCESS) {
+        std::cerr << "Failed to create a render pass!" << std::endl;
+        abort();
+    }
+
+    // Create a framebuffer.
+    std::vector< VkImageView > framebufferAttachments;
+    for (const auto& offscreenImage : offscreenImages) {
+        framebufferAttachments.push_back(offscreenImage.view);
+    }
+    VkFramebufferCreateInfo vkFramebufferInfo{};
+    vkFramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    vkFramebufferInfo.renderPass = vkRenderPass;
+    vkFramebufferInfo.attachmentCount = static_cast< uint32_t >(framebufferAttachments.size());
+    vkFramebufferInfo.pAttachments = framebufferAttachments.data();
+    vkFramebufferInfo.width = vkExtent.width;
+    vkFramebufferInfo.height = vkExtent.height;
+    vkFramebufferInfo.layers = 1;
+    VkFramebuffer vkFramebuffer;
+    if (vkCreateFramebuffer(vkDevice, &vkFramebufferInfo, nullptr, &vkFramebuffer) != VK_SUCCESS) {
+        std::cerr << "Failed to create a framebuffer!" << std::endl;
+        abort();
+    }
+
+    // ==========================================================================
+    //              STEP 7: Create uniform buffers and descriptor sets
+    // ==========================================================================
+    // Each frame in flight has its own uniform buffer, so a buffer
+    // is never updated while the GPU reads it.
+    // ==========================================================================
+
+    VkDescriptorSetLayoutBinding vkUboLayoutBinding{};
+    vkUboLayoutBinding.binding = 0;
+    vkUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    vkUboLayoutBinding.descriptorCount = 1;
+    vkUboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    vkUboLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo vkLayoutInfo{};
+    vkLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    vkLayoutInfo.bindingCount = 1;
+    vkLayoutInfo.pBindings = &vkUboLayoutBinding;
+    VkDescriptorSetLayout vkDescriptorSetLayout;
+    if (vkCreateDescriptorSetLayout(vkDevice, &vkLayoutInfo, nullptr, &vkDescriptorSetLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor set layout" << std::endl;
+        abort();
+    }
+
+    // Create a descriptor pool.
+    VkDescriptorPoolSize vkPoolSize{};
+    vkPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    vkPoolSize.descriptorCount = MAX_FRAMES_IN_FLIGHT;
+    VkDescriptorPoolCreateInfo vkDescriptorPoolInfo{};
+    vkDescriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    vkDescriptorPoolInfo.poolSizeCount = 1;
+    vkDescriptorPoolInfo.pPoolSizes = &vkPoolSize;
+    vkDescriptorPoolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+    VkDescriptorPool vkDescriptorPool;
+    if (vkCreateDescriptorPool(vkDevice, &vkDescriptorPoolInfo, nullptr, &vkDescriptorPool) != VK_SUCCESS) {
+        std::cerr << "Failed to create a descriptor pool!" << std::endl;
+        abort();
+    }
+
+    // Allocate descriptor sets.
+    std::vector< VkDescriptorSetLayout > layouts(MAX_FRAMES_IN_FLIGHT, vkDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo vkDescriptSetAllocInfo{};
+    vkDescriptSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    vkDescriptSetAllocInfo.descriptorPool = vkDescriptorPool;
+    vkDescriptSetAllocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+    vkDescriptSetAllocInfo.pSetLayouts = layouts.data();
+    std::vector< VkDescriptorSet > vkDescriptorSets(MAX_FRAMES_IN_FLIGHT);
+    if (vkAllocateDescriptorSets(vkDevice, &vkDescriptSetAllocInfo, vkDescriptorSets.data()) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate descriptor set!" << std::endl;
+        abort();
+    }
+
+    // Create uniform buffers, keep them mapped and write descriptors.
+    std::vector< VkBuffer > vkUniformBuffers(MAX_FRAMES_IN_FLIGHT);
+    std::vector< VkDeviceMemory > vkUniformBuffersMemory(MAX_FRAMES_IN_FLIGHT);
+    std::vector< void* > uniformBuffersData(MAX_FRAMES_IN_FLIGHT);
+    VkMemoryPropertyFlags vkHostMemFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        // Create a buffer.
+        VkBufferCreateInfo vkBufferInfo{};
+        vkBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        vkBufferInfo.size = uniformBufferSize;
+        vkBufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        vkBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(vkDevice, &vkBufferInfo, nullptr, &vkUniformBuffers[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create a buffer!" << std::endl;
+            abort();
+        }
+
+        // Allocate host visible memory.
+        VkMemoryRequirements vkMemRequirements;
+        vkGetBufferMemoryRequirements(vkDevice, vkUniformBuffers[i], &vkMemRequirements);
+        VkMemoryAllocateInfo vkAllocInfo{};
+        vkAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        vkAllocInfo.allocationSize = vkMemRequirements.size;
+        vkAllocInfo.memoryTypeIndex = UINT32_MAX;
+        for (uint32_t j = 0; j < vkMemProperties.memoryTypeCount; j++) {
+            if ((vkMemRequirements.memoryTypeBits & (1 << j)) && (vkMemProperties.memoryTypes[j].propertyFlags & vkHostMemFlags) == vkHostMemFlags) {
+                vkAllocInfo.memoryTypeIndex = j;
+                break;
+            }
+        }
+        if (vkAllocateMemory(vkDevice, &vkAllocInfo, nullptr, &vkUniformBuffersMemory[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate buffer memory!" << std::endl;
+            abort();
+        }
+        vkBindBufferMemory(vkDevice, vkUniformBuffers[i], vkUniformBuffersMemory[i], 0);
+        vkMapMemory(vkDevice, vkUniformBuffersMemory[i], 0, uniformBufferSize, 0, &uniformBuffersData[i]);
+
+        // Write the descriptor set.
+        VkDescriptorBufferInfo vkDescriptorBufferInfo{};
+        vkDescriptorBufferInfo.buffer = vkUniformBuffers[i];
+        vkDescriptorBufferInfo.offset = 0;
+        vkDescriptorBufferInfo.range = uniformBufferSize;
+        VkWriteDescriptorSet vkDescriptorWrite{};
+        vkDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        vkDescriptorWrite.dstSet = vkDescriptorSets[i];
+        vkDescriptorWrite.dstBinding = 0;
+        vkDescriptorWrite.dstArrayElement = 0;
+        vkDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        vkDescriptorWrite.descriptorCount = 1;
+        vkDescriptorWrite.pBufferInfo = &vkDescriptorBufferInfo;
+        vkUpdateDescriptorSets(vkDevice, 1, &vkDescriptorWrite, 0, nullptr);
+    }
+
+    // ==========================================================================
+    //                    STEP 8: Create a vertex buffer
+    // ==========================================================================
+
+    // Describe a buffer.
+    VkBufferCreateInfo vkVertexBufferInfo{};
+    vkVertexBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    vkVertexBufferInfo.size = vertexData.size();
+    vkVertexBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    vkVertexBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // Create a buffer.
+    VkBuffer vkVertexBuffer;
+    if (vkCreateBuffer(vkDevice, &vkVertexBufferInfo, nullptr, &vkVertexBuffer) != VK_SUCCESS) {
+        std::cerr << "Failed to create a vertex buffer!" << std::endl;
+        abort();
+    }
+
+    // Allocate host visible memory as the application does.
+    VkMemoryRequirements vkVertexBufferMemRequirements;
+    vkGetBufferMemoryRequirements(vkDevice, vkVertexBuffer, &vkVertexBufferMemRequirements);
+    VkMemoryAllocateInfo vkVertexBufferAllocInfo{};
+    vkVertexBufferAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    vkVertexBufferAllocInfo.allocationSize = vkVertexBufferMemRequirements.size;
+    vkVertexBufferAllocInfo.memoryTypeIndex = UINT32_MAX;
+    for (uint32_t i = 0; i < vkMemProperties.memoryTypeCount; i++) {
+        if ((vkVertexBufferMemRequirements.memoryTypeBits & (1 << i)) &&
+                (vkMemProperties.memoryTypes[i].propertyFlags & vkHostMemFlags) == vkHostMemFlags) {
+            vkVertexBufferAllocInfo.memoryTypeIndex = i;
+            break;
+        }
+    }
+    VkDeviceMemory vkVertexBufferMemory;
+    if (vkAllocateMemory(vkDevice, &vkVertexBufferAllocInfo, nullptr, &vkVertexBufferMemory) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate memroy for the vertex buffer!" << std::endl;
+        abort();
+    }
+    vkBindBufferMemory(vkDevice, vkVertexBuffer, vkVertexBufferMemory, 0);
+
+    // Copy vertices to the allocated memory.
+    void* vertexBufferMemoryData;
+    vkMapMemory(vkDevice, vkVertexBufferMemory, 0, vertexData.size(), 0, &vertexBufferMemoryData);
+    memcpy(vertexBufferMemoryData, vertexData.data(), vertexData.size());
+    vkUnmapMemory(vkDevice, vkVertexBufferMemory);
+
+    // ==========================================================================
+    //                   STEP 9: Create a graphics pipeline
+    // ==========================================================================
+    // Shaders and vertex layout come from the capture, fixed function states
+    // are the same as in the application.
+    // ==========================================================================
+
+    // Create shader modules.
+    VkShaderModuleCreateInfo vkVertexShaderCreateInfo{};
+    vkVertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    vkVertexShaderCreateInfo.codeSize = vertexShaderCode.size();
+    vkVertexShaderCreateInfo.pCode = reinterpret_cast< const uint32_t* >(vertexShaderCode.data());
+    VkShaderModule vkVertexShaderModule;
+    if (vkCreateShaderModule(vkDevice, &vkVertexShaderCreateInfo, nullptr, &vkVertexShaderModule) != VK_SUCCESS) {
+        std::cerr << "Failed to create a shader!" << std::endl;
+        abort();
+    }
+    VkShaderModuleCreateInfo vkFragmentShaderCreateInfo{};
+    vkFragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    vkFragmentShaderCreateInfo.codeSize = fragmentShaderCode.size();
+    vkFragmentShaderCreateInfo.pCode = reinterpret_cast< const uint32_t* >(fragmentShaderCode.data());
+    VkShaderModule vkFragmentShaderModule;
+    if (vkCreateShaderModule(vkDevice, &vkFragmentShaderCreateInfo, nullptr, &vkFragmentShaderModule) != VK_SUCCESS) {
+        std::cerr << "Failed to create a shader!" << std::endl;
+        abort();
+    }
+    std::array< VkPipelineShaderStageCreateInfo, 2 > shaderStages{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vkVertexShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = vkFragmentShaderModule;
+    shaderStages[1].pName = "main";
+
+    // Describe vertex input.
+    VkVertexInputBindingDescription vkBindingDescription{};
+    vkBindingDescription.binding = 0;
+    vkBindingDescription.stride = captureVertexLayout.stride;
+    vkBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    std::vector< VkVertexInputAttributeDescription > vkAttributeDescriptions;
+    for (const auto& attribute : captureVertexAttributes) {
+        vkAttributeDescriptions.push_back({ attribute.location, 0, static_cast< VkFormat >(attribute.format), attribute.offset });
+    }
+    VkPipelineVertexInputStateCreateInfo vkVertexInputInfo{};
+    vkVertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vkVertexInputInfo.vertexBindingDescriptionCount = 1;
+    vkVertexInputInfo.pVertexBindingDescriptions = &vkBindingDescription;
+    vkVertexInputInfo.vertexAttributeDescriptionCount = static_cast< uint32_t >(vkAttributeDescriptions.size());
+    vkVertexInputInfo.pVertexAttributeDescriptions = vkAttributeDescriptions.data();
+
+    // Input assembly.
+    VkPipelineInputAssemblyStateCreateInfo vkInputAssembly{};
+    vkInputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    vkInputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    vkInputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport and scissors cover the whole target.
+    VkViewport vkViewport{};
+    vkViewport.x = 0.0f;
+    vkViewport.y = 0.0f;
+    vkViewport.width = static_cast< float >(vkExtent.width);
+    vkViewport.height = static_cast< float >(vkExtent.height);
+    vkViewport.minDepth = 0.0f;
+    vkViewport.maxDepth = 1.0f;
+    VkRect2D vkScissor{};
+    vkScissor.offset = {0, 0};
+    vkScissor.extent = vkExtent;
+    VkPipelineViewportStateCreateInfo vkViewportState{};
+    vkViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    vkViewportState.viewportCount = 1;
+    vkViewportState.pViewports = &vkViewport;
+    vkViewportState.scissorCount = 1;
+    vkViewportState.pScissors = &vkScissor;
+
+    // Rasterizer.
+    VkPipelineRasterizationStateCreateInfo vkRasterizer{};
+    vkRasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    vkRasterizer.depthClampEnable = VK_FALSE;
+    vkRasterizer.rasterizerDiscardEnable = VK_FALSE;
+    vkRasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    vkRasterizer.lineWidth = 1.0f;
+    vkRasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    vkRasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    vkRasterizer.depthBiasEnable = VK_FALSE;
+
+    // MSAA.
+    VkPipelineMultisampleStateCreateInfo vkMultisampling{};
+    vkMultisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    vkMultisampling.sampleShadingEnable = VK_FALSE;
+    vkMultisampling.rasterizationSamples = vkSamples;
+    vkMultisampling.minSampleShading = 1.0f;
+
+    // Depth test.
+    VkPipelineDepthStencilStateCreateInfo vkDepthStencil{};
+    vkDepthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    vkDepthStencil.depthTestEnable = VK_TRUE;
+    vkDepthStencil.depthWriteEnable = VK_TRUE;
+    vkDepthStencil.depthCompareOp = static_cast< VkCompareOp >(captureTargets->depthCompareOp);
+    vkDepthStencil.depthBoundsTestEnable = VK_FALSE;
+    vkDepthStencil.stencilTestEnable = VK_FALSE;
+
+    // No blending.
+    VkPipelineColorBlendAttachmentState vkColorBlendAttachment{};
+    vkColorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    vkColorBlendAttachment.blendEnable = VK_FALSE;
+    VkPipelineColorBlendStateCreateInfo vkColorBlending{};
+    vkColorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    vkColorBlending.logicOpEnable = VK_FALSE;
+    vkColorBlending.attachmentCount = 1;
+    vkColorBlending.pAttachments = &vkColorBlendAttachment;
+
+    // Create a pipeline layout.
+    VkPipelineLayoutCreateInfo vkPipelineLayoutInfo{};
+    vkPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    vkPipelineLayoutInfo.setLayoutCount = 1;
+    vkPipelineLayoutInfo.pSetLayouts = &vkDescriptorSetLayout;
+    VkPipelineLayout vkPipelineLayout;
+    if (vkCreatePipelineLayout(vkDevice, &vkPipelineLayoutInfo, nullptr, &vkPipelineLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to creare a pipeline layout!" << std::endl;
+        abort();
+    }
+
+    // Create a pipeline.
+    VkGraphicsPipelineCreateInfo vkPipelineInfo{};
+    vkPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    vkPipelineInfo.stageCount = shaderStages.size();
+    vkPipelineInfo.pStages = shaderStages.data();
+    vkPipelineInfo.pVertexInputState = &vkVertexInputInfo;
+    vkPipelineInfo.pInputAssemblyState = &vkInputAssembly;
+    vkPipelineInfo.pViewportState = &vkViewportState;
+    vkPipelineInfo.pRasterizationState = &vkRasterizer;
+    vkPipelineInfo.pMultisampleState = &vkMultisampling;
+    vkPipelineInfo.pDepthStencilState = &vkDepthStencil;
+    vkPipelineInfo.pColorBlendState = &vkColorBlending;
+    vkPipelineInfo.layout = vkPipelineLayout;
+    vkPipelineInfo.renderPass = vkRenderPass;
+    vkPipelineInfo.subpass = 0;
+    vkPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    vkPipelineInfo.basePipelineIndex = -1;
+    VkPipeline vkGraphicsPipeline;
+    if (vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &vkPipelineInfo, nullptr, &vkGraphicsPipeline) != VK_SUCCESS) {
+        std::cerr << "Failed to create a graphics pipeline!" << std::endl;
+        abort();
+    }
+
+    // ==========================================================================
+    //              STEP 10: Create command buffers and fences
+    // ==========================================================================
+    // Each frame in flight has its own command buffer which is re-recorded
+    // every time, as the application does when it draws dynamic content.
+    // ==========================================================================
+
+    // Create a command pool which allows resetting separate buffers.
+    VkCommandPoolCreateInfo vkPoolInfo{};
+    vkPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    vkPoolInfo.queueFamilyIndex = graphicsFamily;
+    vkPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    VkCommandPool vkCommandPool;
+    if (vkCreateCommandPool(vkDevice, &vkPoolInfo, nullptr, &vkCommandPool) != VK_SUCCESS) {
+        std::cerr << "Failed to create a command pool!" << std::endl;
+        abort();
+    }
+
+    // Allocate command buffers.
+    std::vector< VkCommandBuffer > vkCommandBuffers(MAX_FRAMES_IN_FLIGHT);
+    VkCommandBufferAllocateInfo vkAllocInfo{};
+    vkAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    vkAllocInfo.commandPool = vkCommandPool;
+    vkAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    vkAllocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+    if (vkAllocateCommandBuffers(vkDevice, &vkAllocInfo, vkCommandBuffers.data()) != VK_SUCCESS) {
+        std::cerr << "Failed to create command buffers" << std::endl;
+        abort();
+    }
+
+    // Create fences in signaled state.
+    VkFenceCreateInfo vkFenceInfo{};
+    vkFenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    vkFenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    std::vector< VkFence > vkInFlightFences(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (vkCreateFence(vkDevice, &vkFenceInfo, nullptr, &vkInFlightFences[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create a fence!" << std::endl;
+            abort();
+        }
+    }
+
+    // Clear values.
+    std::array< VkClearValue, 2 > vkClearValues{};
+    vkClearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+    vkClearValues[1].depthStencil = { captureTargets->clearDepth, 0 };
+
+    // ==========================================================================
+    //                         STEP 11: Replay
+    // ==========================================================================
+    // Frames are submitted one after another without any pacing.
+    // ==========================================================================
+
+    size_t currentFrame = 0;
+    auto replayStartTime = std::chrono::high_resolution_clock::now();
+    for (int loop = 0; loop < loopCount; loop++) {
+        for (const auto& frame : capturedFrames) {
+            // Wait until the command buffer and the uniform buffer of the slot are free.
+            vkWaitForFences(vkDevice, 1, &vkInFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+            vkResetFences(vkDevice, 1, &vkInFlightFences[currentFrame]);
+
+            // Update the uniform buffer.
+            memcpy(uniformBuffersData[currentFrame], frame.uniformData.data(), frame.uniformData.size());
+
+            // Record the frame.
+            VkCommandBuffer vkCommandBuffer = vkCommandBuffers[currentFrame];
+            vkResetCommandBuffer(vkCommandBuffer, 0);
+            VkCommandBufferBeginInfo vkBeginInfo{};
+            vkBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            vkBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            if (vkBeginCommandBuffer(vkCommandBuffer, &vkBeginInfo) != VK_SUCCESS) {
+                std::cerr << "Failed to start command buffer recording" << std::endl;
+                abort();
+            }
+            VkRenderPassBeginInfo vkRenderPassBeginInfo{};
+            vkRenderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            vkRenderPassBeginInfo.renderPass = vkRenderPass;
+            vkRenderPassBeginInfo.framebuffer = vkFramebuffer;
+            vkRenderPassBeginInfo.renderArea.offset = { 0, 0 };
+            vkRenderPassBeginInfo.renderArea.extent = vkExtent;
+            vkRenderPassBeginInfo.clearValueCount = static_cast< uint32_t >(vkClearValues.size());
+            vkRenderPassBeginInfo.pClearValues = vkClearValues.data();
+            vkCmdBeginRenderPass(vkCommandBuffer, &vkRenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(vkCommandBuffer, 0, 1, &vkVertexBuffer, &offset);
+            vkCmdBindDescriptorSets(vkCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkPipelineLayout, 0, 1, &vkDescriptorSets[currentFrame], 0, nullptr);
+            vkCmdBindPipeline(vkCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkGraphicsPipeline);
+            vkCmdDraw(vkCommandBuffer, frame.vertexCount, 1, 0, 0);
+            vkCmdEndRenderPass(vkCommandBuffer);
+            if (vkEndCommandBuffer(vkCommandBuffer) != VK_SUCCESS) {
+                std::cerr << "Failed to finish command buffer recording" << std::endl;
+                abort();
+            }
+
+            // Submit the frame.
+            VkSubmitInfo vkSubmitInfo{};
+            vkSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            vkSubmitInfo.commandBufferCount = 1;
+            vkSubmitInfo.pCommandBuffers = &vkCommandBuffer;
+            if (vkQueueSubmit(vkGraphicsQueue, 1, &vkSubmitInfo, vkInFlightFences[currentFrame]) != VK_SUCCESS) {
+                std::cerr << "Failed to submit" << std::endl;
+                abort();
+            }
+
+            currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        }
+    }
+
+    // Wait for the last frame and report results.
+    vkQueueWaitIdle(vkGraphicsQueue);
+    auto replayEndTime = std::chrono::high_resolution_clock::now();
+    float replayTime = std::chrono::duration< float, std::chrono::milliseconds::period >(replayEndTime - replayStartTime).count();
+    size_t replayedFrameCount = capturedFrames.size() * loopCount;
+    std::cout << "Replayed " << replayedFrameCount << " frames in " << replayTime << " ms: "
+              << replayTime / replayedFrameCount << " ms per frame, "
+              << 1000.0f * replayedFrameCount / replayTime << " frames per second" << std::endl;
+
+    // ==========================================================================
+    //                     STEP 12: Deinitialization
+    // ==========================================================================
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkDestroyFence(vkDevice, vkInFlightFences[i], nullptr);
+    }
+    vkDestroyCommandPool(vkDevice, vkCommandPool, nullptr);
+    vkDestroyPipeline(vkDevice, vkGraphicsPipeline, nullptr);
+    vkDestroyPipelineLayout(vkDevice, vkPipelineLayout, nullptr);
+    vkDestroyShaderModule(vkDevice, vkFragmentShaderModule, nullptr);
+    vkDestroyShaderModule(vkDevice, vkVertexShaderModule, nullptr);
+    vkDestroyBuffer(vkDevice, vkVertexBuffer, nullptr);
+    vkFreeMemory(vkDevice, vkVertexBufferMemory, nullptr);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkUnmapMemory(vkDevice, vkUniformBuffersMemory[i]);
+        vkDestroyBuffer(vkDevice, vkUniformBuffers[i], nullptr);
+        vkFreeMemory(vkDevice, vkUniformBuffersMemory[i], nullptr);
+    }
+    vkDestroyDescriptorPool(vkDevice, vkDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(vkDevice, vkDescriptorSetLayout, nullptr);
+    vkDestroyFramebuffer(vkDevice, vkFramebuffer, nullptr);
+    vkDestroyRenderPass(vkDevice, vkRenderPass, nullptr);
+    for (auto& offscreenImage : offscreenImages) {
+        vkDestroyImageView(vkDevice, offscreenImage.view, nullptr);
+        vkDestroyImage(vkDevice, offscreenImage.image, nullptr);
+        vkFreeMemory(vkDevice, offscreenImage.memory, nullptr);
+    }
+    vkDestroyDevice(vkDevice, nullptr);
+    vkDestroyInstance(vkInstance, nullptr);
+
+    return 0;
+}